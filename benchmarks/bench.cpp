@@ -0,0 +1,112 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "bench.hh"
+
+#ifndef PROTORPC_VERSION
+#define PROTORPC_VERSION "unknown"
+#endif
+
+namespace bench
+{
+
+void Suite::run(const std::string& name, const Body& body, std::size_t bytes_per_op)
+{
+    if (!enabled(name))
+        return;
+
+    using clock = std::chrono::steady_clock;
+
+    std::uint64_t iterations = 1;
+    clock::duration elapsed;
+
+    for (;;)
+    {
+        auto start = clock::now();
+        body(iterations);
+        elapsed = clock::now() - start;
+
+        if (elapsed >= min_time_ || iterations >= (1ull << 40))
+            break;
+
+        iterations *= 2;
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_op = ns / iterations;
+    result.ops_per_sec = iterations * 1e9 / ns;
+    result.bytes_per_sec = result.ops_per_sec * bytes_per_op;
+
+    std::cerr << name << ": " << result.ns_per_op << " ns/op" << std::endl;
+
+    results_.push_back(std::move(result));
+}
+
+void Suite::write_json(std::ostream& out) const
+{
+    out << "{\n  \"version\": \"" << PROTORPC_VERSION << "\",\n  \"benchmarks\": [";
+
+    for (std::size_t i = 0; i < results_.size(); i++)
+    {
+        const Result& r = results_[i];
+
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_sec\": " << r.ops_per_sec
+            << ", \"bytes_per_sec\": " << r.bytes_per_sec << "}";
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+}
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--output FILE] [--filter SUBSTRING] [--min-time MS]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string output;
+    std::string filter;
+    long min_time_ms = 200;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            min_time_ms = std::strtol(argv[++i], nullptr, 10);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    bench::Suite suite(std::chrono::milliseconds(min_time_ms), filter);
+
+    bench::port_benchmarks(suite);
+    bench::router_benchmarks(suite);
+    bench::channel_benchmarks(suite);
+    bench::serializer_benchmarks(suite);
+
+    if (output.empty())
+    {
+        suite.write_json(std::cout);
+    }
+    else
+    {
+        std::ofstream out(output);
+        suite.write_json(out);
+    }
+
+    return 0;
+}
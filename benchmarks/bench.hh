@@ -0,0 +1,82 @@
+#ifndef BENCH_BENCH_HH
+#define BENCH_BENCH_HH
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include <functional>
+
+namespace bench
+{
+    struct Result
+    {
+        std::string name;
+        std::uint64_t iterations = 0;
+        double ns_per_op = 0;
+        double ops_per_sec = 0;
+
+        // Zero when the benchmark does not move a payload.
+        double bytes_per_sec = 0;
+    };
+
+    /**
+     * Runs benchmarks and collects their results.
+     *
+     * A benchmark body receives an iteration count and must perform that many
+     * operations. The count is doubled until a run lasts at least the minimum
+     * time, so that timer and setup costs are amortized.
+     */
+    class Suite
+    {
+    public:
+        using Body = std::function<void(std::uint64_t iterations)>;
+
+        Suite(std::chrono::milliseconds min_time, std::string filter)
+            : min_time_(min_time), filter_(std::move(filter))
+        {}
+
+        /**
+         * Returns false if the benchmark is excluded by the filter, setup code
+         * can then be skipped.
+         */
+        bool enabled(const std::string& name) const
+        {
+            return filter_.empty() || name.find(filter_) != std::string::npos;
+        }
+
+        /**
+         * Measures a benchmark. bytes_per_op is used to report a throughput.
+         */
+        void run(const std::string& name, const Body& body, std::size_t bytes_per_op = 0);
+
+        void write_json(std::ostream& out) const;
+
+        const std::vector<Result>& results() const
+        {
+            return results_;
+        }
+
+    private:
+        std::chrono::milliseconds min_time_;
+        std::string filter_;
+        std::vector<Result> results_;
+    };
+
+    /**
+     * Prevents the compiler from optimizing a computed value away.
+     */
+    template <typename T>
+    inline void do_not_optimize(const T& value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    void port_benchmarks(Suite& suite);
+    void router_benchmarks(Suite& suite);
+    void channel_benchmarks(Suite& suite);
+    void serializer_benchmarks(Suite& suite);
+}
+
+#endif
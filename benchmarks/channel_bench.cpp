@@ -0,0 +1,195 @@
+#include <atomic>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "protoipc/router.hh"
+#include "protorpc/channel.hh"
+#include "bench.hh"
+
+namespace bench
+{
+
+namespace
+{
+    constexpr std::uint64_t ECHO_COMMAND = 1;
+    constexpr std::uint64_t POST_COMMAND = 2;
+
+    const std::size_t PAYLOAD_SIZES[] = { 16, 1024, 16 * 1024 };
+
+    class BenchReceiver : public rpc::RpcReceiver
+    {
+    public:
+        void on_message(rpc::Channel& chan, rpc::ObjectId object, rpc::PortId source_port, rpc::Message& message) override
+        {
+            if (message.opcode == ECHO_COMMAND)
+                chan.send_message(source_port, message);
+        }
+    };
+
+    class BenchProxy : public rpc::RpcProxy
+    {
+    public:
+        BenchProxy(rpc::Channel* chan, rpc::ObjectId object_id, rpc::PortId remote_port, rpc::ObjectId remote_id)
+            : rpc::RpcProxy(chan, object_id, remote_port, remote_id)
+        {}
+
+        bool echo(std::vector<std::uint8_t> payload)
+        {
+            rpc::Message message = make_message_(ECHO_COMMAND, std::move(payload));
+            rpc::Message result;
+
+            return channel_->send_request(remote_port(), message, result);
+        }
+
+        bool post(std::vector<std::uint8_t> payload)
+        {
+            rpc::Message message = make_message_(POST_COMMAND, std::move(payload));
+            return channel_->send_message(remote_port(), message);
+        }
+
+    private:
+        rpc::Message make_message_(std::uint64_t opcode, std::vector<std::uint8_t> payload)
+        {
+            rpc::Message message;
+            message.source = id();
+            message.destination = remote_id();
+            message.opcode = opcode;
+            message.payload = std::move(payload);
+
+            return message;
+        }
+    };
+
+    /**
+     * Two channels connected through a router. The receiving channel is
+     * driven by an external poll loop so that it can be stopped.
+     */
+    class Fixture
+    {
+    public:
+        Fixture()
+        {
+            auto add_client = [&]() {
+                int pair[2];
+
+                if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) == -1)
+                    throw std::runtime_error("socketpair");
+
+                fds_.push_back(pair[0]);
+                fds_.push_back(pair[1]);
+
+                return std::make_pair(router_.add_port(ipc::Port(pair[0])), ipc::Port(pair[1]));
+            };
+
+            auto [client_id, client_port] = add_client();
+            auto [server_id, server_port] = add_client();
+
+            client_.emplace(client_id, client_port);
+            server_.emplace(server_id, server_port);
+
+            auto receiver_id = server_->bind<BenchReceiver>();
+            proxy = client_->connect<BenchProxy>(server_id, receiver_id);
+
+            router_thread_ = std::thread([this]() {
+                router_.loop();
+            });
+
+            server_thread_ = std::thread([this]() {
+                pollfd fd = { server_->handle(), POLLIN, 0 };
+
+                while (!stop_.load(std::memory_order_relaxed))
+                {
+                    if (::poll(&fd, 1, 10) > 0)
+                        server_->poll_once();
+                }
+            });
+        }
+
+        ~Fixture()
+        {
+            stop_.store(true, std::memory_order_relaxed);
+            server_thread_.join();
+
+            // The router stops on messages to unknown ports.
+            ipc::Message stop;
+            stop.destination = UINT64_MAX;
+            ipc::Port(fds_[1]).send(stop);
+            router_thread_.join();
+
+            proxy.reset();
+            client_.reset();
+            server_.reset();
+
+            for (int fd : fds_)
+                close(fd);
+        }
+
+        rpc::Channel& client()
+        {
+            return *client_;
+        }
+
+        rpc::Proxy<BenchProxy> proxy;
+
+    private:
+        ipc::Router router_;
+        std::vector<int> fds_;
+        std::optional<rpc::Channel> client_;
+        std::optional<rpc::Channel> server_;
+        std::thread router_thread_;
+        std::thread server_thread_;
+        std::atomic<bool> stop_{false};
+    };
+
+    void roundtrip(Suite& suite, std::size_t size)
+    {
+        std::string name = "channel/roundtrip/" + std::to_string(size);
+
+        if (!suite.enabled(name))
+            return;
+
+        Fixture fixture;
+        std::vector<std::uint8_t> payload(size);
+
+        suite.run(name, [&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; i++)
+                fixture.proxy->echo(payload);
+        }, size * 2);
+    }
+
+    void one_way(Suite& suite, std::size_t size, bool batching)
+    {
+        std::string name = "channel/one_way/" + std::string(batching ? "batched/" : "unbatched/") + std::to_string(size);
+
+        if (!suite.enabled(name))
+            return;
+
+        Fixture fixture;
+        std::vector<std::uint8_t> payload(size);
+
+        if (batching)
+            fixture.client().enable_batching();
+
+        suite.run(name, [&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; i++)
+                fixture.proxy->post(payload);
+
+            // Messages are handled in order, the reply means all of them were
+            // received.
+            fixture.proxy->echo({});
+        }, size);
+    }
+}
+
+void channel_benchmarks(Suite& suite)
+{
+    for (std::size_t size : PAYLOAD_SIZES)
+    {
+        roundtrip(suite, size);
+        one_way(suite, size, false);
+        one_way(suite, size, true);
+    }
+}
+
+}
@@ -0,0 +1,137 @@
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "protoipc/port.hh"
+#include "bench.hh"
+
+namespace bench
+{
+
+namespace
+{
+    struct SocketType
+    {
+        const char* name;
+        int type;
+    };
+
+    const SocketType SOCKET_TYPES[] = {
+        { "dgram", SOCK_DGRAM },
+        { "seqpacket", SOCK_SEQPACKET },
+        { "stream", SOCK_STREAM },
+    };
+
+    const std::size_t PAYLOAD_SIZES[] = { 64, 1024, 16 * 1024, 64 * 1024 };
+
+    // Destination used to stop the helper threads.
+    constexpr std::uint64_t STOP = UINT64_MAX;
+
+    struct PortPair
+    {
+        PortPair(int type)
+        {
+            int fds[2];
+
+            if (socketpair(AF_UNIX, type, 0, fds) == -1)
+                throw std::runtime_error("socketpair");
+
+            // Large payloads must fit in a single datagram.
+            int size = 4 * 1024 * 1024;
+
+            for (int fd : fds)
+            {
+                setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+            }
+
+            a = ipc::Port(fds[0]);
+            b = ipc::Port(fds[1]);
+        }
+
+        ~PortPair()
+        {
+            a.close();
+            b.close();
+        }
+
+        ipc::Port a;
+        ipc::Port b;
+    };
+
+    void roundtrip(Suite& suite, const SocketType& socket_type, std::size_t size)
+    {
+        std::string name = "port/roundtrip/" + std::string(socket_type.name) + "/" + std::to_string(size);
+
+        if (!suite.enabled(name))
+            return;
+
+        PortPair ports(socket_type.type);
+
+        // Echoes every message back until told to stop.
+        std::thread echo([&]() {
+            ipc::Message msg;
+
+            while (ports.b.receive(msg) == ipc::PortError::Ok && msg.destination != STOP)
+                ports.b.send(msg);
+        });
+
+        ipc::Message msg;
+        msg.payload.resize(size);
+
+        suite.run(name, [&](std::uint64_t iterations) {
+            ipc::Message reply;
+
+            for (std::uint64_t i = 0; i < iterations; i++)
+            {
+                ports.a.send(msg);
+                ports.a.receive(reply);
+            }
+        }, size * 2);
+
+        ipc::Message stop;
+        stop.destination = STOP;
+        ports.a.send(stop);
+        echo.join();
+    }
+
+    void one_way(Suite& suite, const SocketType& socket_type, std::size_t size)
+    {
+        std::string name = "port/one_way/" + std::string(socket_type.name) + "/" + std::to_string(size);
+
+        if (!suite.enabled(name))
+            return;
+
+        PortPair ports(socket_type.type);
+
+        ipc::Message msg;
+        msg.payload.resize(size);
+
+        suite.run(name, [&](std::uint64_t iterations) {
+            std::thread sink([&]() {
+                ipc::Message received;
+
+                for (std::uint64_t i = 0; i < iterations; i++)
+                    ports.b.receive(received);
+            });
+
+            for (std::uint64_t i = 0; i < iterations; i++)
+                ports.a.send(msg);
+
+            sink.join();
+        }, size);
+    }
+}
+
+void port_benchmarks(Suite& suite)
+{
+    for (const SocketType& socket_type : SOCKET_TYPES)
+    {
+        for (std::size_t size : PAYLOAD_SIZES)
+        {
+            roundtrip(suite, socket_type, size);
+            one_way(suite, socket_type, size);
+        }
+    }
+}
+
+}
@@ -0,0 +1,246 @@
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "protoipc/router.hh"
+#include "protoipc/capture.hh"
+
+/**
+ * Replays a capture written by ipc::Router::set_capture(). Every port of the
+ * capture gets a local port. Messages are sent from the port of their source
+ * through a router, or straight to the port of their destination with
+ * --direct, then drained. Truncated payloads are padded with zeroes and
+ * handles are replaced by descriptors of /dev/null.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+struct ReplayPort
+{
+    ipc::Port local;
+    ipc::Port remote;
+    ipc::PortId router_id = 0;
+};
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--speed FACTOR | --fast] [--direct] CAPTURE" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string path;
+    double speed = 1;
+    bool direct = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+            speed = std::strtod(argv[++i], nullptr);
+        else if (std::strcmp(argv[i], "--fast") == 0)
+            speed = 0;
+        else if (std::strcmp(argv[i], "--direct") == 0)
+            direct = true;
+        else if (path.empty() && argv[i][0] != '-')
+            path = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (path.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ipc::CaptureReader reader;
+    std::vector<ipc::CapturedMessage> messages;
+
+    if (!reader.open(path))
+    {
+        std::cerr << "Could not open capture " << path << std::endl;
+        return 1;
+    }
+
+    for (ipc::CapturedMessage message; reader.next(&message);)
+        messages.push_back(std::move(message));
+
+    if (!reader.at_end())
+        std::cerr << "Capture is truncated, replaying the first " << messages.size() << " messages" << std::endl;
+
+    if (messages.empty())
+        return 0;
+
+    ipc::Router router;
+    std::map<std::uint64_t, ReplayPort> ports;
+
+    for (const ipc::CapturedMessage& message : messages)
+    {
+        for (std::uint64_t id : { message.source, message.destination })
+        {
+            if (ports.count(id))
+                continue;
+
+            ReplayPort& port = ports[id];
+
+            if (!ipc::Port::create_pair(port.local, port.remote))
+            {
+                std::cerr << "Could not create ports" << std::endl;
+                return 1;
+            }
+
+            if (!direct)
+                port.router_id = router.add_port(port.remote);
+        }
+    }
+
+    ipc::Port control_local;
+    ipc::Port control_remote;
+
+    if (!direct)
+    {
+        if (!ipc::Port::create_pair(control_local, control_remote))
+            return 1;
+
+        router.add_port(control_remote);
+    }
+
+    std::thread router_thread;
+
+    if (!direct)
+    {
+        router_thread = std::thread([&]() {
+            router.loop();
+        });
+    }
+
+    // Drains every port. Forwarded messages arrive on the local end of their
+    // destination, direct ones on the local end too since they are sent to
+    // the remote end.
+    std::atomic<std::uint64_t> received{0};
+    std::uint64_t expected = messages.size();
+
+    std::thread sink([&]() {
+        std::vector<pollfd> fds;
+        std::vector<ipc::Port*> sinks;
+
+        for (auto& [id, port] : ports)
+        {
+            fds.push_back(pollfd{ port.local.handle(), POLLIN, 0 });
+            sinks.push_back(&port.local);
+        }
+
+        while (received.load(std::memory_order_relaxed) < expected)
+        {
+            if (::poll(fds.data(), fds.size(), 100) <= 0)
+                continue;
+
+            for (std::size_t i = 0; i < fds.size(); i++)
+            {
+                if (!(fds[i].revents & POLLIN))
+                    continue;
+
+                ipc::Message message;
+
+                if (sinks[i]->receive(message) != ipc::PortError::Ok)
+                    continue;
+
+                for (int handle : message.handles)
+                    close(handle);
+
+                received.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    int placeholder = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    std::vector<std::uint64_t> lags;
+    std::uint64_t bytes = 0;
+
+    Clock::time_point start = Clock::now();
+    std::uint64_t first_timestamp = messages.front().timestamp;
+
+    for (const ipc::CapturedMessage& captured : messages)
+    {
+        if (speed > 0)
+        {
+            auto offset = std::chrono::nanoseconds(static_cast<std::uint64_t>((captured.timestamp - first_timestamp) / speed));
+            Clock::time_point scheduled = start + offset;
+
+            std::this_thread::sleep_until(scheduled);
+            lags.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - scheduled).count());
+        }
+
+        ipc::Message message;
+        message.payload = captured.payload;
+        message.payload.resize(captured.size);
+        message.handles.assign(std::min<std::uint64_t>(captured.handle_count, ipc::IPC_MAX_HANDLES), placeholder);
+
+        ipc::PortError err;
+
+        if (direct)
+        {
+            message.destination = captured.source;
+            err = ports[captured.destination].remote.send(message);
+        }
+        else
+        {
+            message.destination = ports[captured.destination].router_id;
+            err = ports[captured.source].local.send(message);
+        }
+
+        if (err != ipc::PortError::Ok)
+        {
+            std::cerr << "Could not send message" << std::endl;
+            std::exit(1);
+        }
+
+        bytes += captured.size;
+    }
+
+    sink.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (!direct)
+    {
+        // The router stops on messages to unknown ports.
+        ipc::Message stop;
+        stop.destination = UINT64_MAX;
+        control_local.send(stop);
+        router_thread.join();
+    }
+
+    double capture_seconds = (messages.back().timestamp - first_timestamp) / 1e9;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << messages.size() << " messages, " << ports.size() << " ports, "
+              << capture_seconds << " s captured\n"
+              << "replayed in " << seconds << " s: "
+              << messages.size() / seconds << " messages/s, "
+              << bytes / seconds / (1024 * 1024) << " MiB/s\n";
+
+    if (!lags.empty())
+    {
+        std::sort(lags.begin(), lags.end());
+
+        std::cout << "send lag behind the capture: p50 " << lags[lags.size() / 2] / 1000.0
+                  << " us, p99 " << lags[std::min(lags.size() - 1, lags.size() * 99 / 100)] / 1000.0
+                  << " us, max " << lags.back() / 1000.0 << " us\n";
+    }
+
+    close(placeholder);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "protoipc/router.hh"
+#include "bench.hh"
+
+namespace bench
+{
+
+namespace
+{
+    const std::size_t CLIENT_COUNTS[] = { 1, 4, 16 };
+
+    constexpr std::size_t PAYLOAD_SIZE = 256;
+
+    void forwarding(Suite& suite, std::size_t client_count)
+    {
+        std::string name = "router/forward/" + std::to_string(client_count) + "_clients";
+
+        if (!suite.enabled(name))
+            return;
+
+        ipc::Router router;
+        std::vector<int> fds;
+
+        auto add_client = [&]() {
+            int pair[2];
+
+            if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) == -1)
+                throw std::runtime_error("socketpair");
+
+            fds.push_back(pair[0]);
+            fds.push_back(pair[1]);
+
+            return std::make_pair(router.add_port(ipc::Port(pair[0])), ipc::Port(pair[1]));
+        };
+
+        auto [sink_id, sink] = add_client();
+        std::vector<ipc::Port> clients;
+
+        for (std::size_t i = 0; i < client_count; i++)
+            clients.push_back(add_client().second);
+
+        std::thread router_thread([&]() {
+            router.loop();
+        });
+
+        ipc::Message msg;
+        msg.destination = sink_id;
+        msg.payload.resize(PAYLOAD_SIZE);
+
+        // Every client sends its share of the messages to a single sink.
+        suite.run(name, [&](std::uint64_t iterations) {
+            std::uint64_t per_client = (iterations + client_count - 1) / client_count;
+            std::vector<std::thread> senders;
+
+            for (auto& client : clients)
+            {
+                senders.emplace_back([&]() {
+                    for (std::uint64_t i = 0; i < per_client; i++)
+                        client.send(msg);
+                });
+            }
+
+            ipc::Message received;
+
+            for (std::uint64_t i = 0; i < per_client * client_count; i++)
+                sink.receive(received);
+
+            for (auto& sender : senders)
+                sender.join();
+        }, PAYLOAD_SIZE);
+
+        // The router stops on messages to unknown ports.
+        ipc::Message stop;
+        stop.destination = UINT64_MAX;
+        clients[0].send(stop);
+        router_thread.join();
+
+        for (int fd : fds)
+            close(fd);
+    }
+}
+
+void router_benchmarks(Suite& suite)
+{
+    for (std::size_t count : CLIENT_COUNTS)
+        forwarding(suite, count);
+}
+
+}
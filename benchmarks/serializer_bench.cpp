@@ -0,0 +1,395 @@
+#include <string>
+#include <vector>
+#include <optional>
+#include "protorpc/serializer.hh"
+#include "protorpc/unserializer.hh"
+#include "cprotorpc/serializer.h"
+#include "cprotorpc/unserializer.h"
+#include "bench.hh"
+
+namespace bench
+{
+    // Timing record as generated by sidlcc, field by field and packed.
+    struct Sample
+    {
+        std::uint64_t stamp;
+        std::int32_t value;
+        std::uint16_t flags;
+        std::uint8_t kind;
+        std::uint8_t unit;
+    };
+
+    struct PackedSample : Sample
+    {};
+}
+
+namespace rpc
+{
+    template <>
+    struct serializable<bench::Sample>
+    {
+        static void serialize(const bench::Sample& obj, Serializer& s)
+        {
+            s.serialize(obj.stamp);
+            s.serialize(obj.value);
+            s.serialize(obj.flags);
+            s.serialize(obj.kind);
+            s.serialize(obj.unit);
+        }
+
+        static std::size_t size(const bench::Sample&)
+        {
+            return 16;
+        }
+    };
+
+    template <>
+    struct unserializable<bench::Sample>
+    {
+        static bool unserialize(bench::Sample* obj, Unserializer& u)
+        {
+            return u.unserialize(&obj->stamp) && u.unserialize(&obj->value) && u.unserialize(&obj->flags)
+                && u.unserialize(&obj->kind) && u.unserialize(&obj->unit);
+        }
+    };
+
+    template <>
+    struct serializable<bench::PackedSample>
+    {
+        static constexpr bool packed = true;
+
+        static void serialize(const bench::PackedSample& obj, Serializer& s)
+        {
+            s.serialize(&obj, sizeof(obj));
+        }
+
+        static std::size_t size(const bench::PackedSample&)
+        {
+            return sizeof(bench::PackedSample);
+        }
+    };
+
+    template <>
+    struct unserializable<bench::PackedSample>
+    {
+        static constexpr bool packed = true;
+
+        static bool unserialize(bench::PackedSample* obj, Unserializer& u)
+        {
+            return u.unserialize(obj, sizeof(*obj));
+        }
+    };
+}
+
+namespace bench
+{
+
+namespace
+{
+    const std::size_t STRING_SIZES[] = { 16, 1024 };
+    const std::size_t VECTOR_SIZES[] = { 16, 4096 };
+
+    /**
+     * Measures the encoding and the decoding of a single value with the C++
+     * serializer. A fresh serializer is used for each operation, as the
+     * generated code does.
+     */
+    template <typename T>
+    void cpp_type(Suite& suite, const std::string& type, const T& value)
+    {
+        std::string encode_name = "serializer/cpp/encode/" + type;
+        std::string decode_name = "serializer/cpp/decode/" + type;
+
+        rpc::Serializer reference;
+        reference.serialize(value);
+        std::vector<std::uint8_t> payload = reference.get_payload();
+
+        if (suite.enabled(encode_name))
+        {
+            suite.run(encode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    rpc::Serializer s;
+                    s.serialize(value);
+
+                    auto encoded = s.get_payload();
+                    do_not_optimize(encoded.data());
+                }
+            }, payload.size());
+        }
+
+        if (suite.enabled(decode_name))
+        {
+            suite.run(decode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    rpc::Unserializer u(payload);
+                    T decoded;
+
+                    if (!u.unserialize(&decoded))
+                        throw std::runtime_error("Could not decode " + type);
+
+                    do_not_optimize(decoded);
+                }
+            }, payload.size());
+        }
+    }
+
+    /**
+     * Same as cpp_type() for an integer vector with one of the opt-in
+     * encodings.
+     */
+    template <typename T>
+    void cpp_encoded(Suite& suite, const std::string& type, const std::vector<T>& value, rpc::Encoding encoding)
+    {
+        std::string encode_name = "serializer/cpp/encode/" + type;
+        std::string decode_name = "serializer/cpp/decode/" + type;
+
+        rpc::Serializer reference;
+        reference.serialize(value, encoding);
+        std::vector<std::uint8_t> payload = reference.get_payload();
+
+        if (suite.enabled(encode_name))
+        {
+            suite.run(encode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    rpc::Serializer s;
+                    s.serialize(value, encoding);
+
+                    auto encoded = s.get_payload();
+                    do_not_optimize(encoded.data());
+                }
+            }, payload.size());
+        }
+
+        if (suite.enabled(decode_name))
+        {
+            suite.run(decode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    rpc::Unserializer u(payload);
+                    std::vector<T> decoded;
+
+                    if (!u.unserialize(&decoded, encoding))
+                        throw std::runtime_error("Could not decode " + type);
+
+                    do_not_optimize(decoded);
+                }
+            }, payload.size());
+        }
+    }
+
+    /**
+     * Same as cpp_type() with the C serializer, the functions being given
+     * explicitly since C has no overloads.
+     */
+    template <typename T, typename Write, typename Read>
+    void c_type(Suite& suite, const std::string& type, const T& value, Write write, Read read)
+    {
+        std::string encode_name = "serializer/c/encode/" + type;
+        std::string decode_name = "serializer/c/decode/" + type;
+
+        sidl_serializer_t reference;
+        sidl_serializer_init(&reference);
+        write(&reference, value);
+
+        std::vector<std::uint8_t> payload(static_cast<std::uint8_t*>(reference.data),
+                static_cast<std::uint8_t*>(reference.data) + reference.data_size);
+
+        sidl_serializer_destroy(&reference);
+
+        if (suite.enabled(encode_name))
+        {
+            suite.run(encode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    sidl_serializer_t s;
+                    sidl_serializer_init(&s);
+                    write(&s, value);
+
+                    do_not_optimize(s.data);
+                    sidl_serializer_destroy(&s);
+                }
+            }, payload.size());
+        }
+
+        if (suite.enabled(decode_name))
+        {
+            suite.run(decode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    sidl_unserializer_t u;
+                    sidl_unserializer_init(&u, payload.data(), payload.size(), nullptr, 0);
+
+                    T decoded;
+
+                    if (read(&u, &decoded) != 0)
+                        throw std::runtime_error("Could not decode " + type);
+
+                    do_not_optimize(decoded);
+                }
+            }, payload.size());
+        }
+    }
+
+    /**
+     * Bulk vector functions of the C serializer against the element by
+     * element loop they replace, encoding and decoding a vector of size
+     * copies of value.
+     */
+    template <typename T, typename Vector>
+    void c_vector(Suite& suite, const std::string& type, std::size_t size, T value,
+            int (*write_vector)(sidl_serializer_t*, const Vector*), int (*read_vector)(sidl_unserializer_t*, Vector*),
+            int (*write)(sidl_serializer_t*, T), int (*read)(sidl_unserializer_t*, T*),
+            int (*append)(Vector*, T), void (*destroy)(Vector*))
+    {
+        std::string name = type + "/" + std::to_string(size);
+        std::vector<T> elements(size, value);
+        Vector vector = { size, size, elements.data() };
+
+        sidl_serializer_t reference;
+        sidl_serializer_init(&reference);
+        write_vector(&reference, &vector);
+
+        std::vector<std::uint8_t> payload(static_cast<std::uint8_t*>(reference.data),
+                static_cast<std::uint8_t*>(reference.data) + reference.data_size);
+
+        sidl_serializer_destroy(&reference);
+
+        auto encode = [&](const std::string& encode_name, auto body) {
+            if (!suite.enabled(encode_name))
+                return;
+
+            suite.run(encode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    sidl_serializer_t s;
+                    sidl_serializer_init(&s);
+                    body(&s);
+
+                    do_not_optimize(s.data);
+                    sidl_serializer_destroy(&s);
+                }
+            }, payload.size());
+        };
+
+        auto decode = [&](const std::string& decode_name, auto body) {
+            if (!suite.enabled(decode_name))
+                return;
+
+            suite.run(decode_name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; i++)
+                {
+                    sidl_unserializer_t u;
+                    sidl_unserializer_init(&u, payload.data(), payload.size(), nullptr, 0);
+
+                    Vector decoded;
+
+                    if (body(&u, &decoded) != 0)
+                        throw std::runtime_error("Could not decode " + type);
+
+                    do_not_optimize(decoded.elements);
+                    destroy(&decoded);
+                }
+            }, payload.size());
+        };
+
+        encode("serializer/c/encode/" + name, [&](sidl_serializer_t* s) {
+            write_vector(s, &vector);
+        });
+
+        encode("serializer/c/encode/" + name + "/per_element", [&](sidl_serializer_t* s) {
+            sidl_serializer_write_usize(s, vector.size);
+
+            for (std::size_t i = 0; i < vector.size; i++)
+                write(s, vector.elements[i]);
+        });
+
+        decode("serializer/c/decode/" + name, read_vector);
+
+        decode("serializer/c/decode/" + name + "/per_element", [&](sidl_unserializer_t* u, Vector* decoded) {
+            std::size_t count = 0;
+            sidl_unserializer_read_usize(u, &count);
+
+            decoded->size = 0;
+            decoded->capacity = 0;
+            decoded->elements = nullptr;
+
+            for (std::size_t i = 0; i < count; i++)
+            {
+                T element;
+
+                if (read(u, &element) != 0 || append(decoded, element) != 0)
+                    return -1;
+            }
+
+            return 0;
+        });
+    }
+}
+
+void serializer_benchmarks(Suite& suite)
+{
+    cpp_type<std::uint8_t>(suite, "u8", 0x12);
+    cpp_type<std::uint32_t>(suite, "u32", 0x12345678);
+    cpp_type<std::uint64_t>(suite, "u64", 0x123456789abcdef0);
+    cpp_type<std::int64_t>(suite, "i64", -0x123456789abcdef0);
+    cpp_type<std::size_t>(suite, "usize", 4096);
+    cpp_type<std::optional<std::uint64_t>>(suite, "optional<u64>", 42);
+
+    for (std::size_t size : STRING_SIZES)
+        cpp_type<std::string>(suite, "string/" + std::to_string(size), std::string(size, 'x'));
+
+    for (std::size_t size : VECTOR_SIZES)
+    {
+        cpp_type<std::vector<std::uint8_t>>(suite, "vec<u8>/" + std::to_string(size),
+                std::vector<std::uint8_t>(size, 0x5a));
+        cpp_type<std::vector<std::uint64_t>>(suite, "vec<u64>/" + std::to_string(size),
+                std::vector<std::uint64_t>(size, 0x123456789abcdef0));
+        cpp_type<std::vector<std::string>>(suite, "vec<string>/" + std::to_string(size),
+                std::vector<std::string>(size, std::string(16, 'x')));
+        cpp_type<std::vector<Sample>>(suite, "vec<struct>/" + std::to_string(size),
+                std::vector<Sample>(size, Sample{ 1700000000000000, -42, 3, 1, 2 }));
+        cpp_type<std::vector<PackedSample>>(suite, "vec<packed struct>/" + std::to_string(size),
+                std::vector<PackedSample>(size, PackedSample{ { 1700000000000000, -42, 3, 1, 2 } }));
+    }
+
+    // Timestamps a microsecond apart with some jitter, as sent by telemetry
+    std::vector<std::uint64_t> stamps;
+
+    for (std::uint64_t i = 0; i < 4096; i++)
+        stamps.push_back(1700000000000000 + i * 1000 + i * 7919 % 100);
+
+    cpp_type(suite, "vec<u64>/stamps", stamps);
+    cpp_encoded(suite, "vec<u64>/stamps/delta", stamps, rpc::Encoding::Delta);
+    cpp_encoded(suite, "vec<u64>/stamps/bitpack", stamps, rpc::Encoding::BitPack);
+
+        c_type<std::uint8_t>(suite, "u8", 0x12, sidl_serializer_write_u8, sidl_unserializer_read_u8);
+    c_type<std::uint32_t>(suite, "u32", 0x12345678, sidl_serializer_write_u32, sidl_unserializer_read_u32);
+    c_type<std::uint64_t>(suite, "u64", 0x123456789abcdef0, sidl_serializer_write_u64, sidl_unserializer_read_u64);
+    c_type<std::int64_t>(suite, "i64", -0x123456789abcdef0, sidl_serializer_write_i64, sidl_unserializer_read_i64);
+    c_type<std::size_t>(suite, "usize", 4096, sidl_serializer_write_usize, sidl_unserializer_read_usize);
+
+    for (std::size_t size : STRING_SIZES)
+    {
+        std::string value(size, 'x');
+
+        c_type<const char*>(suite, "string/" + std::to_string(size), value.c_str(),
+                sidl_serializer_write_string, sidl_unserializer_read_string);
+    }
+
+    for (std::size_t size : VECTOR_SIZES)
+    {
+        c_vector<std::uint8_t, sidl_u8_vector>(suite, "vec<u8>", size, 0x5a,
+                sidl_serializer_write_u8_vector, sidl_unserializer_read_u8_vector,
+                sidl_serializer_write_u8, sidl_unserializer_read_u8,
+                sidl_u8_vector_append, sidl_u8_vector_destroy);
+        c_vector<std::uint64_t, sidl_u64_vector>(suite, "vec<u64>", size, 0x123456789abcdef0,
+                sidl_serializer_write_u64_vector, sidl_unserializer_read_u64_vector,
+                sidl_serializer_write_u64, sidl_unserializer_read_u64,
+                sidl_u64_vector_append, sidl_u64_vector_destroy);
+    }
+}
+
+}
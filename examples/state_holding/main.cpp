@@ -22,7 +22,8 @@ namespace db
             return true;
         }
 
-        bool get(std::string key, std::optional<std::string>* result) override
+        // The key points into the request, it is looked up without a copy.
+        bool get(std::string_view key, std::optional<std::string>* result) override
         {
             auto it = data_.find(key);
 
@@ -35,7 +36,7 @@ namespace db
         }
 
     private:
-        std::map<std::string, std::string> data_;
+        std::map<std::string, std::string, std::less<>> data_;
     };
 }
 
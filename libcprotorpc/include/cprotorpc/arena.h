@@ -0,0 +1,62 @@
+#ifndef CPROTORPC_ARENA
+#define CPROTORPC_ARENA
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Alignment of every allocation, enough for all the sidl types
+#define SIDL_ARENA_ALIGNMENT (16)
+
+#define SIDL_ARENA_BLOCK_SIZE (4096)
+
+typedef struct sidl_arena_block_t
+{
+    struct sidl_arena_block_t* previous;
+    size_t size;
+} sidl_arena_block_t;
+
+/*
+ * Bump allocator for decoded strings and vectors. Allocations are carved
+ * out of large blocks and are never freed one by one: the whole arena is
+ * released at once with sidl_arena_reset(), or back to a mark with
+ * sidl_arena_rewind().
+ *
+ * Released blocks are kept for the next allocations, an arena decoding
+ * messages of similar sizes stops allocating once it has warmed up.
+ */
+typedef struct sidl_arena_t
+{
+    // Block being allocated from and bytes used in it
+    sidl_arena_block_t* block;
+    size_t used;
+
+    // Released blocks, reused before allocating new ones
+    sidl_arena_block_t* spare;
+} sidl_arena_t;
+
+// Position of an arena, allocations made after it are released by a rewind
+typedef struct sidl_arena_mark_t
+{
+    sidl_arena_block_t* block;
+    size_t used;
+} sidl_arena_mark_t;
+
+// Does not allocate, the first block is allocated on the first use.
+void sidl_arena_init(sidl_arena_t* a);
+void sidl_arena_destroy(sidl_arena_t* a);
+
+// Uninitialized memory aligned on SIDL_ARENA_ALIGNMENT, null on failure
+void* sidl_arena_alloc(sidl_arena_t* a, size_t size);
+
+sidl_arena_mark_t sidl_arena_mark(const sidl_arena_t* a);
+void sidl_arena_rewind(sidl_arena_t* a, sidl_arena_mark_t mark);
+void sidl_arena_reset(sidl_arena_t* a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
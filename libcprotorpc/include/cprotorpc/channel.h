@@ -0,0 +1,168 @@
+#ifndef CPROTORPC_CHANNEL
+#define CPROTORPC_CHANNEL
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cprotorpc/serializer.h"
+#include "cprotorpc/unserializer.h"
+#include "cprotorpc/arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same limit as ipc::IPC_MAX_HANDLES in libprotoipc
+#define SIDL_MAX_HANDLES (128)
+
+// Destination of the messages handled by the channel itself, see
+// rpc::CONTROL_OBJECT in libprotorpc.
+#define SIDL_CONTROL_OBJECT (UINT64_MAX)
+
+// Several rpc messages packed in a single ipc frame
+#define SIDL_CONTROL_BATCH (0)
+
+/*
+ * rpc message, same fields as rpc::Message. A received message points into
+ * the receive buffer of its channel and is valid until the next frame is
+ * received.
+ */
+typedef struct sidl_message_t
+{
+    uint64_t source;
+    uint64_t destination;
+    uint64_t opcode;
+
+    // Echoed by the reply, zero for unidirectional messages
+    uint64_t request_id;
+
+    // CLOCK_MONOTONIC time in nanoseconds, zero when there is none
+    uint64_t deadline;
+
+    const void* payload;
+    size_t payload_size;
+
+    int* handles;
+    size_t handle_count;
+} sidl_message_t;
+
+struct sidl_channel_t;
+struct sidl_receiver_t;
+struct sidl_waiting_call_t;
+struct sidl_pending_reply_t;
+
+typedef void (*sidl_dispatch_t)(struct sidl_channel_t* c, const struct sidl_receiver_t* receiver,
+        uint64_t source_port, sidl_message_t* message);
+
+/*
+ * Object bound to a channel. The generated <interface>_dispatch functions
+ * decode the message and call the matching entry of the vtable.
+ */
+typedef struct sidl_receiver_t
+{
+    uint64_t id;
+    sidl_dispatch_t dispatch;
+    const void* vtable;
+    void* object;
+} sidl_receiver_t;
+
+/*
+ * rpc channel speaking the wire format of rpc::Channel over a libprotoipc
+ * port, which is a connected unix socket. Buffers are reused from a message
+ * to the next one, a call does not allocate once they have grown to the
+ * size of the messages.
+ *
+ * The channel is synchronous: while waiting for a reply, other messages are
+ * dispatched to the bound receivers. Control messages other than batches
+ * (cancellations, streams, cache invalidations, reference counting) are
+ * ignored.
+ */
+typedef struct sidl_channel_t
+{
+    int fd;
+    uint64_t port_id;
+    uint64_t next_request_id;
+
+    // Payload of the message being built
+    sidl_serializer_t payload;
+
+    // Arguments decoded by the generated dispatch functions, rewound once
+    // the receiver returns.
+    sidl_arena_t arena;
+
+    // Last received frame, grown to the largest one
+    size_t frame_capacity;
+    void* frame;
+    uint64_t frame_source_port;
+    size_t frame_handle_count;
+    int frame_handles[SIDL_MAX_HANDLES];
+
+    // Messages of a received batch not returned yet, in [batch_offset, batch_end)
+    size_t batch_offset;
+    size_t batch_end;
+    size_t batch_handle_index;
+
+    size_t receiver_count;
+    size_t receiver_capacity;
+    sidl_receiver_t* receivers;
+
+    // Innermost call waiting for its reply, receivers can make calls while
+    // the outer ones wait.
+    struct sidl_waiting_call_t* waiting;
+
+    // Replies to outer calls received by nested ones, and the reply returned
+    // by the last call which took one of them.
+    struct sidl_pending_reply_t* pending_replies;
+    struct sidl_pending_reply_t* returned_reply;
+} sidl_channel_t;
+
+int sidl_channel_init(sidl_channel_t* c, uint64_t port_id, int fd);
+void sidl_channel_destroy(sidl_channel_t* c);
+
+int sidl_channel_bind(sidl_channel_t* c, uint64_t id, sidl_dispatch_t dispatch, const void* vtable, void* object);
+void sidl_channel_unbind(sidl_channel_t* c, uint64_t id);
+
+// Cleared serializer for the payload of the next message
+sidl_serializer_t* sidl_channel_payload(sidl_channel_t* c);
+
+// Sends a message whose payload and handles are those of sidl_channel_payload()
+int sidl_channel_send(sidl_channel_t* c, uint64_t remote_port, uint64_t source, uint64_t destination,
+        uint64_t opcode, uint64_t request_id);
+
+/*
+ * Sends a request and waits for its reply, `reply` is initialized with its
+ * payload and handles. The reply is valid until the next message is received.
+ *
+ * Calls made by the receivers dispatched meanwhile keep the replies of the
+ * outer calls for them.
+ */
+int sidl_channel_call(sidl_channel_t* c, uint64_t remote_port, uint64_t source, uint64_t destination,
+        uint64_t opcode, sidl_unserializer_t* reply);
+
+// Replies to a received request with the payload of sidl_channel_payload()
+int sidl_channel_reply(sidl_channel_t* c, uint64_t source_port, const sidl_message_t* request);
+
+/*
+ * Receives the next message and dispatches it to its receiver. Returns -1
+ * on errors and for messages to unknown objects.
+ */
+int sidl_channel_dispatch(sidl_channel_t* c);
+
+/*
+ * Remote object reached through a channel, used by the generated proxies.
+ */
+typedef struct sidl_proxy_t
+{
+    sidl_channel_t* channel;
+
+    // Local id of the proxy, replies are addressed to it
+    uint64_t id;
+
+    uint64_t remote_port;
+    uint64_t remote_id;
+} sidl_proxy_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef CPROTORPC_ENCODING
+#define CPROTORPC_ENCODING
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cprotorpc/sidl_types.h"
+#include "cprotorpc/serializer.h"
+#include "cprotorpc/unserializer.h"
+#include "cprotorpc/structures.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Opt-in encodings of integer vectors, same formats as rpc::Encoding in
+ * libprotorpc. The length of an encoded vector is a varint.
+ */
+typedef enum sidl_encoding_t
+{
+    // LEB128 of each value
+    SIDL_ENCODING_VARINT,
+
+    // LEB128 of the zigzag of each value
+    SIDL_ENCODING_ZIGZAG,
+
+    // Zigzag LEB128 of the difference with the previous value
+    SIDL_ENCODING_DELTA,
+
+    // Minimum value, then the offsets from it packed on as few bits as needed
+    SIDL_ENCODING_BITPACK,
+} sidl_encoding_t;
+
+int sidl_serializer_write_varint(sidl_serializer_t* s, uint64_t value);
+int sidl_unserializer_read_varint(sidl_unserializer_t* u, uint64_t* value);
+
+/*
+ * sidl_serializer_write_encoded_<type> encodes count values.
+ * sidl_unserializer_read_encoded_<type> initializes the vector with the
+ * decoded values, it must be destroyed by the caller on success.
+ */
+#define SIDL_ENCODED_FUNCTIONS(SIDL_TYPE, C_TYPE) \
+    int sidl_serializer_write_encoded_##SIDL_TYPE(sidl_serializer_t* s, const C_TYPE* values, size_t count, sidl_encoding_t encoding); \
+    int sidl_unserializer_read_encoded_##SIDL_TYPE(sidl_unserializer_t* u, SIDL_VSNAME(SIDL_TYPE)* v, sidl_encoding_t encoding);
+
+XM_SIDL_TYPES(SIDL_ENCODED_FUNCTIONS)
+
+#undef SIDL_ENCODED_FUNCTIONS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "cprotorpc/sidl_types.h"
+#include "cprotorpc/structures.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,6 +28,9 @@ typedef struct sidl_serializer_t
 
 int sidl_serializer_init(sidl_serializer_t* s);
 void sidl_serializer_destroy(sidl_serializer_t* s);
+
+// Makes room for size more bytes
+int sidl_serializer_reserve(sidl_serializer_t* s, size_t size);
 int sidl_serializer_write_raw(sidl_serializer_t* s, const void* data, size_t size);
 int sidl_serializer_write_fd(sidl_serializer_t* s, int fd);
 
@@ -38,9 +42,21 @@ XM_SIDL_TYPES(SIDL_SERIALIZE_FUNCTION)
 
 #undef SIDL_SERIALIZE_FUNCTION
 
-int sidl_serializer_write_string(sidl_serializer_t* s, const char* str);
+/*
+ * Bulk writers copying the values with a single memcpy.
+ * sidl_serializer_write_<type>_array writes count values without a length,
+ * as fixed arrays are encoded. sidl_serializer_write_<type>_vector writes
+ * the size of the vector first, as rpc::Serializer does for std::vector.
+ */
+#define SIDL_SERIALIZE_BULK_FUNCTIONS(SIDL_TYPE, C_TYPE) \
+    int sidl_serializer_write_##SIDL_TYPE##_array(sidl_serializer_t* s, const C_TYPE* values, size_t count); \
+    int sidl_serializer_write_##SIDL_TYPE##_vector(sidl_serializer_t* s, const SIDL_VSNAME(SIDL_TYPE)* v);
+
+XM_SIDL_TYPES(SIDL_SERIALIZE_BULK_FUNCTIONS)
 
+#undef SIDL_SERIALIZE_BULK_FUNCTIONS
 
+int sidl_serializer_write_string(sidl_serializer_t* s, const char* str);
 
 #ifdef __cplusplus
 }
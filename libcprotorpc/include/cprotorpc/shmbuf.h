@@ -0,0 +1,63 @@
+#ifndef CPROTORPC_SHMBUF
+#define CPROTORPC_SHMBUF
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cprotorpc/serializer.h"
+#include "cprotorpc/unserializer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Buffer living in a shared memory region (memfd). Only the file descriptor
+ * and the size are serialized, the region is mapped on the first call to
+ * sidl_shmbuf_data().
+ */
+typedef struct sidl_shmbuf_t
+{
+    int fd;
+
+    // Meaningful bytes and size of the region
+    size_t size;
+    size_t capacity;
+
+    // Null until mapped
+    void* mapping;
+} sidl_shmbuf_t;
+
+int sidl_shmbuf_create(sidl_shmbuf_t* b, size_t capacity);
+void sidl_shmbuf_destroy(sidl_shmbuf_t* b);
+int sidl_shmbuf_resize(sidl_shmbuf_t* b, size_t size);
+void* sidl_shmbuf_data(sidl_shmbuf_t* b);
+
+// The descriptor stays owned by the buffer, it must outlive the send.
+int sidl_serializer_write_shmbuf(sidl_serializer_t* s, const sidl_shmbuf_t* b);
+
+// The buffer takes ownership of the received descriptor.
+int sidl_unserializer_read_shmbuf(sidl_unserializer_t* u, sidl_shmbuf_t* b);
+
+/*
+ * Fixed set of regions recycled by a sender. Buffers are handed back with
+ * sidl_shmbuf_pool_release() once the peer is done with them.
+ */
+#define SIDL_SHMBUF_POOL_SIZE (8)
+
+typedef struct sidl_shmbuf_pool_t
+{
+    sidl_shmbuf_t buffers[SIDL_SHMBUF_POOL_SIZE];
+    uint8_t in_use[SIDL_SHMBUF_POOL_SIZE];
+    size_t count;
+} sidl_shmbuf_pool_t;
+
+void sidl_shmbuf_pool_init(sidl_shmbuf_pool_t* pool);
+void sidl_shmbuf_pool_destroy(sidl_shmbuf_pool_t* pool);
+sidl_shmbuf_t* sidl_shmbuf_pool_acquire(sidl_shmbuf_pool_t* pool, size_t size);
+void sidl_shmbuf_pool_release(sidl_shmbuf_pool_t* pool, sidl_shmbuf_t* b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,17 +41,15 @@ XM_SIDL_TYPES(SIDL_DECLARE_VECTOR_PROTO)
 // Special case for the string type
 SIDL_DECLARE_VECTOR_PROTO(string, char*)
 
-// Vector implementation
+// Vector implementation, init does not allocate and the first append
+// reserves SIDL_VECTOR_CAPACITY elements.
 #define SIDL_VECTOR_CAPACITY (10)
 
 #define SIDL_VEC_INIT_IMPL(SIDL_TYPE, C_TYPE) \
 int sidl_##SIDL_TYPE##_vector_init(SIDL_VSNAME(SIDL_TYPE)* v) { \
     v->size = 0; \
-    v->capacity = SIDL_VECTOR_CAPACITY; \
-    v->elements = malloc(sizeof(C_TYPE) * v->capacity); \
-    \
-    if (!v->elements) \
-        return -1; \
+    v->capacity = 0; \
+    v->elements = NULL; \
     \
     return 0; \
 }
@@ -74,7 +72,7 @@ int sidl_##SIDL_TYPE##_vector_from(SIDL_VSNAME(SIDL_TYPE)* v, C_TYPE* data, size
 int sidl_##SIDL_TYPE##_vector_append(SIDL_VSNAME(SIDL_TYPE)* v, C_TYPE value) { \
     if (v->size >= v->capacity) \
     { \
-        size_t new_capacity = v->capacity * 2; \
+        size_t new_capacity = v->capacity ? v->capacity * 2 : SIDL_VECTOR_CAPACITY; \
         C_TYPE* new_array = realloc(v->elements, new_capacity * sizeof(C_TYPE)); \
         \
         if (!new_array) \
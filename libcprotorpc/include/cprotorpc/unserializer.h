@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "cprotorpc/arena.h"
+#include "cprotorpc/sidl_types.h"
+#include "cprotorpc/structures.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,9 +22,24 @@ typedef struct sidl_unserializer_t
     size_t fd_count;
     size_t fd_index;
     int* fds;
+
+    // Decoded strings and vectors are allocated from it when set
+    sidl_arena_t* arena;
 } sidl_unserializer_t;
 
 void sidl_unserializer_init(sidl_unserializer_t* u, void* data, size_t data_size, int* fds, size_t fd_count);
+
+/*
+ * Strings and vectors read after this call come from the arena instead of
+ * the heap. They are released with the arena and must not be freed or
+ * destroyed, shared memory buffers still have to be destroyed.
+ */
+void sidl_unserializer_set_arena(sidl_unserializer_t* u, sidl_arena_t* arena);
+
+// Memory for decoded values, from the arena if any and the heap otherwise
+void* sidl_unserializer_alloc(sidl_unserializer_t* u, size_t size);
+void sidl_unserializer_free(sidl_unserializer_t* u, void* p);
+
 int sidl_unserializer_read_raw(sidl_unserializer_t* u, void* data, size_t size);
 int sidl_unserializer_read_fd(sidl_unserializer_t* u, int* fd);
 
@@ -37,6 +55,20 @@ int sidl_unserializer_read_i64(sidl_unserializer_t* u, int64_t* value);
 int sidl_unserializer_read_usize(sidl_unserializer_t* u, size_t* value);
 int sidl_unserializer_read_string(sidl_unserializer_t* u, const char** str);
 
+/*
+ * Bulk readers, counterparts of the sidl_serializer_write_<type>_array and
+ * sidl_serializer_write_<type>_vector functions. The vector is initialized
+ * with memory from sidl_unserializer_alloc(), it must be destroyed by the
+ * caller on success unless it comes from an arena.
+ */
+#define SIDL_UNSERIALIZE_BULK_FUNCTIONS(SIDL_TYPE, C_TYPE) \
+    int sidl_unserializer_read_##SIDL_TYPE##_array(sidl_unserializer_t* u, C_TYPE* values, size_t count); \
+    int sidl_unserializer_read_##SIDL_TYPE##_vector(sidl_unserializer_t* u, SIDL_VSNAME(SIDL_TYPE)* v);
+
+XM_SIDL_TYPES(SIDL_UNSERIALIZE_BULK_FUNCTIONS)
+
+#undef SIDL_UNSERIALIZE_BULK_FUNCTIONS
+
 #ifdef __cplusplus
 }
 #endif
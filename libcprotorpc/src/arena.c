@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "cprotorpc/arena.h"
+
+static size_t align(size_t size)
+{
+    return (size + SIDL_ARENA_ALIGNMENT - 1) & ~(size_t)(SIDL_ARENA_ALIGNMENT - 1);
+}
+
+// The data of a block follows its header, which is padded to keep it aligned
+#define SIDL_ARENA_HEADER_SIZE (align(sizeof(sidl_arena_block_t)))
+
+static void free_blocks(sidl_arena_block_t* block)
+{
+    while (block)
+    {
+        sidl_arena_block_t* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+}
+
+void sidl_arena_init(sidl_arena_t* a)
+{
+    a->block = NULL;
+    a->used = 0;
+    a->spare = NULL;
+}
+
+void sidl_arena_destroy(sidl_arena_t* a)
+{
+    free_blocks(a->block);
+    free_blocks(a->spare);
+    sidl_arena_init(a);
+}
+
+static sidl_arena_block_t* acquire_block(sidl_arena_t* a, size_t size)
+{
+    for (sidl_arena_block_t** spare = &a->spare; *spare; spare = &(*spare)->previous)
+    {
+        sidl_arena_block_t* block = *spare;
+
+        if (block->size >= size)
+        {
+            *spare = block->previous;
+            return block;
+        }
+    }
+
+    // Blocks double so that their count stays logarithmic in the total size
+    size_t block_size = a->block ? a->block->size * 2 : SIDL_ARENA_BLOCK_SIZE;
+
+    if (block_size < size)
+        block_size = size;
+
+    sidl_arena_block_t* block = malloc(SIDL_ARENA_HEADER_SIZE + block_size);
+
+    if (!block)
+        return NULL;
+
+    block->size = block_size;
+
+    return block;
+}
+
+void* sidl_arena_alloc(sidl_arena_t* a, size_t size)
+{
+    if (size > SIZE_MAX / 2)
+        return NULL;
+
+    size = align(size);
+
+    if (!a->block || a->block->size - a->used < size)
+    {
+        sidl_arena_block_t* block = acquire_block(a, size);
+
+        if (!block)
+            return NULL;
+
+        block->previous = a->block;
+        a->block = block;
+        a->used = 0;
+    }
+
+    void* p = (char*)a->block + SIDL_ARENA_HEADER_SIZE + a->used;
+    a->used += size;
+
+    return p;
+}
+
+sidl_arena_mark_t sidl_arena_mark(const sidl_arena_t* a)
+{
+    sidl_arena_mark_t mark;
+    mark.block = a->block;
+    mark.used = a->used;
+
+    return mark;
+}
+
+void sidl_arena_rewind(sidl_arena_t* a, sidl_arena_mark_t mark)
+{
+    while (a->block != mark.block)
+    {
+        sidl_arena_block_t* block = a->block;
+        a->block = block->previous;
+
+        block->previous = a->spare;
+        a->spare = block;
+    }
+
+    a->used = mark.used;
+}
+
+void sidl_arena_reset(sidl_arena_t* a)
+{
+    sidl_arena_mark_t empty = { NULL, 0 };
+    sidl_arena_rewind(a, empty);
+}
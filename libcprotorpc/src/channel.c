@@ -0,0 +1,602 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "cprotorpc/channel.h"
+
+// ipc header of a frame: payload size, handle count and destination port
+#define SIDL_IPC_HEADER_SIZE (3 * sizeof(uint64_t))
+
+// rpc header: source, destination, opcode, request id, deadline, then the
+// size of the payload which follows.
+#define SIDL_RPC_HEADER_SIZE (6 * sizeof(uint64_t))
+
+#define SIDL_CHANNEL_FRAME_CAPACITY (4096)
+#define SIDL_CHANNEL_RECEIVER_CAPACITY (4)
+
+typedef struct sidl_waiting_call_t
+{
+    struct sidl_waiting_call_t* outer;
+
+    // The reply is addressed to the proxy which sent the request
+    uint64_t source;
+    uint64_t request_id;
+} sidl_waiting_call_t;
+
+/*
+ * Copy of a reply which arrived while a nested call was waiting. The handles
+ * follow the structure, then the payload.
+ */
+typedef struct sidl_pending_reply_t
+{
+    struct sidl_pending_reply_t* next;
+    uint64_t destination;
+    uint64_t request_id;
+    size_t payload_size;
+    size_t handle_count;
+} sidl_pending_reply_t;
+
+static int* pending_reply_handles(sidl_pending_reply_t* r)
+{
+    return (int*)(r + 1);
+}
+
+static void* pending_reply_payload(sidl_pending_reply_t* r)
+{
+    return pending_reply_handles(r) + r->handle_count;
+}
+
+static void close_handles(const int* handles, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        close(handles[i]);
+}
+
+int sidl_channel_init(sidl_channel_t* c, uint64_t port_id, int fd)
+{
+    memset(c, 0, sizeof(*c));
+
+    c->fd = fd;
+    c->port_id = port_id;
+    c->next_request_id = 1;
+    sidl_arena_init(&c->arena);
+
+    if (sidl_serializer_init(&c->payload) < 0)
+        return -1;
+
+    c->frame_capacity = SIDL_CHANNEL_FRAME_CAPACITY;
+    c->frame = malloc(c->frame_capacity);
+
+    if (!c->frame)
+    {
+        sidl_serializer_destroy(&c->payload);
+        return -1;
+    }
+
+    return 0;
+}
+
+void sidl_channel_destroy(sidl_channel_t* c)
+{
+    // Nobody took the handles of the replies still pending
+    while (c->pending_replies)
+    {
+        sidl_pending_reply_t* r = c->pending_replies;
+        c->pending_replies = r->next;
+
+        close_handles(pending_reply_handles(r), r->handle_count);
+        free(r);
+    }
+
+    free(c->returned_reply);
+    sidl_serializer_destroy(&c->payload);
+    sidl_arena_destroy(&c->arena);
+    free(c->frame);
+    free(c->receivers);
+}
+
+int sidl_channel_bind(sidl_channel_t* c, uint64_t id, sidl_dispatch_t dispatch, const void* vtable, void* object)
+{
+    for (size_t i = 0; i < c->receiver_count; i++)
+    {
+        if (c->receivers[i].id == id)
+            return -1;
+    }
+
+    if (c->receiver_count == c->receiver_capacity)
+    {
+        size_t new_capacity = c->receiver_capacity ? c->receiver_capacity * 2 : SIDL_CHANNEL_RECEIVER_CAPACITY;
+        sidl_receiver_t* new_receivers = realloc(c->receivers, sizeof(sidl_receiver_t) * new_capacity);
+
+        if (!new_receivers)
+            return -1;
+
+        c->receiver_capacity = new_capacity;
+        c->receivers = new_receivers;
+    }
+
+    sidl_receiver_t* receiver = &c->receivers[c->receiver_count++];
+    receiver->id = id;
+    receiver->dispatch = dispatch;
+    receiver->vtable = vtable;
+    receiver->object = object;
+
+    return 0;
+}
+
+void sidl_channel_unbind(sidl_channel_t* c, uint64_t id)
+{
+    for (size_t i = 0; i < c->receiver_count; i++)
+    {
+        if (c->receivers[i].id == id)
+        {
+            c->receivers[i] = c->receivers[--c->receiver_count];
+            return;
+        }
+    }
+}
+
+sidl_serializer_t* sidl_channel_payload(sidl_channel_t* c)
+{
+    c->payload.data_size = 0;
+    c->payload.fd_count = 0;
+
+    return &c->payload;
+}
+
+/*
+ * Same framing as ipc::Port::send(): the ipc header, then the rpc header and
+ * the payload, sent from where they are without copying them in a frame.
+ */
+int sidl_channel_send(sidl_channel_t* c, uint64_t remote_port, uint64_t source, uint64_t destination,
+        uint64_t opcode, uint64_t request_id)
+{
+    const sidl_serializer_t* s = &c->payload;
+
+    if (s->fd_count > SIDL_MAX_HANDLES)
+        return -1;
+
+    uint64_t ipc_header[3] = { SIDL_RPC_HEADER_SIZE + s->data_size, s->fd_count, remote_port };
+    uint64_t rpc_header[6] = { source, destination, opcode, request_id, 0, s->data_size };
+
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int) * SIDL_MAX_HANDLES)];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov[3];
+    iov[0].iov_base = ipc_header;
+    iov[0].iov_len = sizeof(ipc_header);
+    iov[1].iov_base = rpc_header;
+    iov[1].iov_len = sizeof(rpc_header);
+    iov[2].iov_base = s->data;
+    iov[2].iov_len = s->data_size;
+
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = iov;
+    header.msg_iovlen = 3;
+
+    if (s->fd_count > 0)
+    {
+        memset(&control, 0, sizeof(control));
+        header.msg_control = control.buffer;
+        header.msg_controllen = CMSG_SPACE(sizeof(int) * s->fd_count);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * s->fd_count);
+
+        memcpy(CMSG_DATA(cmsg), s->fds, sizeof(int) * s->fd_count);
+    }
+
+    size_t remaining = sizeof(ipc_header) + sizeof(rpc_header) + s->data_size;
+
+    while (remaining > 0)
+    {
+        ssize_t sent = sendmsg(c->fd, &header, MSG_NOSIGNAL);
+
+        if (sent == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        remaining -= sent;
+
+        // Large frames can be sent in several parts, the handles go with
+        // the first one.
+        header.msg_control = NULL;
+        header.msg_controllen = 0;
+
+        while (sent > 0 && header.msg_iovlen > 0)
+        {
+            if ((size_t)sent < header.msg_iov->iov_len)
+            {
+                header.msg_iov->iov_base = (char*)header.msg_iov->iov_base + sent;
+                header.msg_iov->iov_len -= sent;
+                break;
+            }
+
+            sent -= header.msg_iov->iov_len;
+            header.msg_iov++;
+            header.msg_iovlen--;
+        }
+    }
+
+    return 0;
+}
+
+// Handles received with a frame which is dropped would leak otherwise
+static void close_received_handles(struct msghdr* header)
+{
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(header); cmsg; cmsg = CMSG_NXTHDR(header, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            close(fd);
+        }
+    }
+}
+
+/*
+ * Same framing as ipc::Port::receive(): the ipc header is peeked to size the
+ * receive buffer, then the whole frame is read with its handles.
+ */
+static int receive_frame(sidl_channel_t* c, size_t* frame_size)
+{
+    uint64_t ipc_header[3];
+
+    struct iovec iov[2];
+    iov[0].iov_base = ipc_header;
+    iov[0].iov_len = sizeof(ipc_header);
+
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = iov;
+    header.msg_iovlen = 1;
+
+    ssize_t err;
+
+    while ((err = recvmsg(c->fd, &header, MSG_PEEK | MSG_WAITALL)) == -1)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+
+    if ((size_t)err < sizeof(ipc_header) || ipc_header[1] > SIDL_MAX_HANDLES)
+        return -1;
+
+    if (ipc_header[0] > c->frame_capacity)
+    {
+        size_t new_capacity = c->frame_capacity * 2;
+
+        if (new_capacity < ipc_header[0])
+            new_capacity = ipc_header[0];
+
+        void* new_frame = realloc(c->frame, new_capacity);
+
+        if (!new_frame)
+            return -1;
+
+        c->frame_capacity = new_capacity;
+        c->frame = new_frame;
+    }
+
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int) * SIDL_MAX_HANDLES)];
+        struct cmsghdr align;
+    } control;
+
+    iov[1].iov_base = c->frame;
+    iov[1].iov_len = ipc_header[0];
+    header.msg_iovlen = 2;
+    header.msg_control = control.buffer;
+    header.msg_controllen = sizeof(control.buffer);
+
+    while ((err = recvmsg(c->fd, &header, MSG_WAITALL)) == -1)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+
+    if ((size_t)err != sizeof(ipc_header) + ipc_header[0])
+    {
+        close_received_handles(&header);
+        return -1;
+    }
+
+    c->frame_handle_count = ipc_header[1];
+    c->frame_source_port = ipc_header[2];
+
+    if (c->frame_handle_count > 0)
+    {
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+
+        if (!cmsg || cmsg->cmsg_len < CMSG_LEN(sizeof(int) * c->frame_handle_count))
+        {
+            close_received_handles(&header);
+            c->frame_handle_count = 0;
+            return -1;
+        }
+
+        memcpy(c->frame_handles, CMSG_DATA(cmsg), sizeof(int) * c->frame_handle_count);
+    }
+
+    *frame_size = ipc_header[0];
+    return 0;
+}
+
+static int decode_message(const uint8_t* data, size_t size, sidl_message_t* m)
+{
+    uint64_t rpc_header[6];
+
+    if (size < sizeof(rpc_header))
+        return -1;
+
+    memcpy(rpc_header, data, sizeof(rpc_header));
+
+    if (rpc_header[5] > size - sizeof(rpc_header))
+        return -1;
+
+    m->source = rpc_header[0];
+    m->destination = rpc_header[1];
+    m->opcode = rpc_header[2];
+    m->request_id = rpc_header[3];
+    m->deadline = rpc_header[4];
+    m->payload = data + sizeof(rpc_header);
+    m->payload_size = rpc_header[5];
+
+    return 0;
+}
+
+/*
+ * Returns the next message, from the batch being unpacked or from a new
+ * frame. Batched messages take their handles from the frame one after the
+ * other.
+ */
+static int next_message(sidl_channel_t* c, sidl_message_t* m, uint64_t* source_port)
+{
+    while (c->batch_offset == c->batch_end)
+    {
+        size_t frame_size = 0;
+
+        if (receive_frame(c, &frame_size) < 0)
+            return -1;
+
+        if (decode_message(c->frame, frame_size, m) < 0)
+        {
+            close_handles(c->frame_handles, c->frame_handle_count);
+            return -1;
+        }
+
+        *source_port = c->frame_source_port;
+
+        if (m->destination != SIDL_CONTROL_OBJECT || m->opcode != SIDL_CONTROL_BATCH)
+        {
+            m->handles = c->frame_handles;
+            m->handle_count = c->frame_handle_count;
+            return 0;
+        }
+
+        c->batch_offset = SIDL_RPC_HEADER_SIZE;
+        c->batch_end = SIDL_RPC_HEADER_SIZE + m->payload_size;
+        c->batch_handle_index = 0;
+    }
+
+    const uint8_t* entry = (const uint8_t*)c->frame + c->batch_offset;
+    size_t remaining = c->batch_end - c->batch_offset;
+    uint64_t handle_count = 0;
+
+    if (remaining < sizeof(handle_count))
+        goto error;
+
+    memcpy(&handle_count, entry, sizeof(handle_count));
+
+    if (decode_message(entry + sizeof(handle_count), remaining - sizeof(handle_count), m) < 0 ||
+            handle_count > c->frame_handle_count - c->batch_handle_index)
+        goto error;
+
+    m->handles = c->frame_handles + c->batch_handle_index;
+    m->handle_count = handle_count;
+
+    c->batch_offset += sizeof(handle_count) + SIDL_RPC_HEADER_SIZE + m->payload_size;
+    c->batch_handle_index += handle_count;
+    *source_port = c->frame_source_port;
+
+    return 0;
+
+error:
+    // The rest of the batch is dropped along with its handles
+    close_handles(c->frame_handles + c->batch_handle_index, c->frame_handle_count - c->batch_handle_index);
+    c->batch_offset = c->batch_end = 0;
+    return -1;
+}
+
+static int deadline_expired(uint64_t deadline)
+{
+    struct timespec now;
+
+    if (deadline == 0 || clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+        return 0;
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec >= deadline;
+}
+
+static int dispatch_message(sidl_channel_t* c, uint64_t source_port, sidl_message_t* m)
+{
+    if (m->destination == SIDL_CONTROL_OBJECT)
+        return 0;
+
+    for (size_t i = 0; i < c->receiver_count; i++)
+    {
+        if (c->receivers[i].id != m->destination)
+            continue;
+
+        // Nobody waits for the result of an overdue request anymore.
+        if (deadline_expired(m->deadline))
+            return 0;
+
+        // The receiver table can be modified by the handler
+        sidl_receiver_t receiver = c->receivers[i];
+        receiver.dispatch(c, &receiver, source_port, m);
+
+        return 0;
+    }
+
+    return -1;
+}
+
+static int is_reply(const sidl_waiting_call_t* call, uint64_t destination, uint64_t request_id)
+{
+    return destination == call->source && request_id == call->request_id;
+}
+
+/*
+ * The received frame is overwritten by the next one, the reply of an outer
+ * call is copied until that call gets back to waiting.
+ */
+static int keep_reply(sidl_channel_t* c, const sidl_message_t* m)
+{
+    sidl_pending_reply_t* r = malloc(sizeof(*r) + sizeof(int) * m->handle_count + m->payload_size);
+
+    if (!r)
+    {
+        close_handles(m->handles, m->handle_count);
+        return -1;
+    }
+
+    r->destination = m->destination;
+    r->request_id = m->request_id;
+    r->payload_size = m->payload_size;
+    r->handle_count = m->handle_count;
+
+    if (m->handle_count > 0)
+        memcpy(pending_reply_handles(r), m->handles, sizeof(int) * m->handle_count);
+
+    if (m->payload_size > 0)
+        memcpy(pending_reply_payload(r), m->payload, m->payload_size);
+
+    r->next = c->pending_replies;
+    c->pending_replies = r;
+
+    return 0;
+}
+
+static sidl_pending_reply_t* take_reply(sidl_channel_t* c, const sidl_waiting_call_t* call)
+{
+    for (sidl_pending_reply_t** r = &c->pending_replies; *r; r = &(*r)->next)
+    {
+        sidl_pending_reply_t* pending = *r;
+
+        if (is_reply(call, pending->destination, pending->request_id))
+        {
+            *r = pending->next;
+            return pending;
+        }
+    }
+
+    return NULL;
+}
+
+static int wait_reply(sidl_channel_t* c, const sidl_waiting_call_t* call, sidl_unserializer_t* reply)
+{
+    while (1)
+    {
+        // Received by a call made by a receiver dispatched below
+        sidl_pending_reply_t* pending = take_reply(c, call);
+
+        if (pending)
+        {
+            free(c->returned_reply);
+            c->returned_reply = pending;
+
+            sidl_unserializer_init(reply, pending_reply_payload(pending), pending->payload_size,
+                    pending_reply_handles(pending), pending->handle_count);
+            return 0;
+        }
+
+        sidl_message_t m;
+        uint64_t source_port = 0;
+
+        if (next_message(c, &m, &source_port) < 0)
+            return -1;
+
+        if (is_reply(call, m.destination, m.request_id))
+        {
+            sidl_unserializer_init(reply, (void*)m.payload, m.payload_size, m.handles, m.handle_count);
+            return 0;
+        }
+
+        int outer = 0;
+
+        for (const sidl_waiting_call_t* w = call->outer; w && !outer; w = w->outer)
+            outer = is_reply(w, m.destination, m.request_id);
+
+        if (outer)
+        {
+            if (keep_reply(c, &m) < 0)
+                return -1;
+
+            continue;
+        }
+
+        // Late replies and messages to unknown objects are dropped
+        dispatch_message(c, source_port, &m);
+    }
+}
+
+int sidl_channel_call(sidl_channel_t* c, uint64_t remote_port, uint64_t source, uint64_t destination,
+        uint64_t opcode, sidl_unserializer_t* reply)
+{
+    uint64_t request_id = c->next_request_id++;
+
+    if (sidl_channel_send(c, remote_port, source, destination, opcode, request_id) < 0)
+        return -1;
+
+    sidl_waiting_call_t call;
+    call.outer = c->waiting;
+    call.source = source;
+    call.request_id = request_id;
+
+    c->waiting = &call;
+    int err = wait_reply(c, &call, reply);
+    c->waiting = call.outer;
+
+    return err;
+}
+
+int sidl_channel_reply(sidl_channel_t* c, uint64_t source_port, const sidl_message_t* request)
+{
+    return sidl_channel_send(c, source_port, request->destination, request->source,
+            request->opcode, request->request_id);
+}
+
+int sidl_channel_dispatch(sidl_channel_t* c)
+{
+    sidl_message_t m;
+    uint64_t source_port = 0;
+
+    if (next_message(c, &m, &source_port) < 0)
+        return -1;
+
+    return dispatch_message(c, source_port, &m);
+}
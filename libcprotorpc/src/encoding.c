@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cprotorpc/encoding.h"
+
+// Largest varint of a 64 bits value
+#define SIDL_MAX_VARINT_SIZE (10)
+
+// Largest varint of a value of the given size, zigzagged values and
+// differences take one more bit.
+#define SIDL_VARINT_BOUND(SIZE) (((SIZE) * 8 + 1 + 6) / 7)
+
+#define SIDL_IS_SIGNED(C_TYPE) ((C_TYPE)-1 < (C_TYPE)0)
+
+static size_t write_varint(uint8_t* out, uint64_t value)
+{
+    size_t size = 0;
+
+    while (value >= 0x80)
+    {
+        out[size++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+
+    out[size++] = (uint8_t)value;
+    return size;
+}
+
+static int read_varint(const uint8_t** in, const uint8_t* end, uint64_t* value)
+{
+    const uint8_t* p = *in;
+    uint64_t result = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end)
+            return -1;
+
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *in = p;
+            *value = result;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static inline uint64_t zigzag(uint64_t value)
+{
+    return (value << 1) ^ (0 - (value >> 63));
+}
+
+static inline uint64_t unzigzag(uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+static inline unsigned bit_width(uint64_t value)
+{
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+/*
+ * Values are processed as 64 bits integers, sign extended if their type is
+ * signed, so that differences and offsets from the minimum never overflow.
+ * The element size and signedness are constants in the callers, these are
+ * specialized once inlined.
+ */
+static inline uint64_t load(const void* values, size_t index, size_t size, int is_signed)
+{
+    switch (size)
+    {
+    case 1:
+        return is_signed ? (uint64_t)((const int8_t*)values)[index] : ((const uint8_t*)values)[index];
+    case 2:
+        return is_signed ? (uint64_t)((const int16_t*)values)[index] : ((const uint16_t*)values)[index];
+    case 4:
+        return is_signed ? (uint64_t)((const int32_t*)values)[index] : ((const uint32_t*)values)[index];
+    default:
+        return ((const uint64_t*)values)[index];
+    }
+}
+
+static inline void store(void* values, size_t index, size_t size, uint64_t value)
+{
+    switch (size)
+    {
+    case 1:
+        ((uint8_t*)values)[index] = (uint8_t)value;
+        break;
+    case 2:
+        ((uint16_t*)values)[index] = (uint16_t)value;
+        break;
+    case 4:
+        ((uint32_t*)values)[index] = (uint32_t)value;
+        break;
+    default:
+        ((uint64_t*)values)[index] = value;
+        break;
+    }
+}
+
+static inline int less(uint64_t a, uint64_t b, int is_signed)
+{
+    return is_signed ? (int64_t)a < (int64_t)b : a < b;
+}
+
+static inline int write_encoded(sidl_serializer_t* s, const void* values, size_t count, size_t size, int is_signed, sidl_encoding_t encoding)
+{
+    size_t bound = SIDL_MAX_VARINT_SIZE * 2 + 1;
+    bound += count * (encoding == SIDL_ENCODING_BITPACK ? size : SIDL_VARINT_BOUND(size));
+
+    if (sidl_serializer_reserve(s, bound) < 0)
+        return -1;
+
+    uint8_t* begin = (uint8_t*)s->data + s->data_size;
+    uint8_t* p = begin + write_varint(begin, count);
+    uint64_t mask = size == 8 ? ~(uint64_t)0 : ((uint64_t)1 << (size * 8)) - 1;
+    uint64_t previous = 0;
+
+    switch (encoding)
+    {
+    case SIDL_ENCODING_VARINT:
+        for (size_t i = 0; i < count; i++)
+            p += write_varint(p, load(values, i, size, is_signed) & mask);
+        break;
+    case SIDL_ENCODING_ZIGZAG:
+        for (size_t i = 0; i < count; i++)
+            p += write_varint(p, zigzag(load(values, i, size, is_signed)));
+        break;
+    case SIDL_ENCODING_DELTA:
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t value = load(values, i, size, is_signed);
+
+            p += write_varint(p, zigzag(value - previous));
+            previous = value;
+        }
+        break;
+    case SIDL_ENCODING_BITPACK:
+    {
+        if (count == 0)
+            break;
+
+        uint64_t min = load(values, 0, size, is_signed);
+        uint64_t max = min;
+
+        for (size_t i = 1; i < count; i++)
+        {
+            uint64_t value = load(values, i, size, is_signed);
+
+            if (less(value, min, is_signed))
+                min = value;
+
+            if (less(max, value, is_signed))
+                max = value;
+        }
+
+        // At least a bit per value, a corrupted count then cannot make the
+        // decoder allocate more than 8 values per byte.
+        unsigned bits = bit_width(max - min);
+
+        if (bits == 0)
+            bits = 1;
+
+        p += write_varint(p, zigzag(min));
+        *p++ = (uint8_t)bits;
+
+        uint64_t acc = 0;
+        unsigned filled = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t offset = load(values, i, size, is_signed) - min;
+
+            acc |= offset << filled;
+            filled += bits;
+
+            if (filled >= 64)
+            {
+                memcpy(p, &acc, sizeof(acc));
+                p += sizeof(acc);
+                filled -= 64;
+
+                // High bits of the offset which did not fit
+                acc = filled ? offset >> (bits - filled) : 0;
+            }
+        }
+
+        memcpy(p, &acc, (filled + 7) / 8);
+        p += (filled + 7) / 8;
+        break;
+    }
+    default:
+        return -1;
+    }
+
+    s->data_size += p - begin;
+    return 0;
+}
+
+static inline int read_encoded(sidl_unserializer_t* u, void** elements, size_t* count_out, size_t size, sidl_encoding_t encoding)
+{
+    const uint8_t* p = (const uint8_t*)u->data + u->data_offset;
+    const uint8_t* end = (const uint8_t*)u->data + u->data_size;
+    uint64_t count = 0;
+
+    if (read_varint(&p, end, &count) < 0)
+        return -1;
+
+    // Every value takes at least a byte, or a bit once packed.
+    size_t remaining = end - p;
+
+    if (encoding == SIDL_ENCODING_BITPACK ? count / 8 > remaining : count > remaining)
+        return -1;
+
+    void* values = sidl_unserializer_alloc(u, count * size);
+
+    if (!values)
+        return -1;
+
+    uint64_t value = 0;
+    uint64_t previous = 0;
+
+    switch (encoding)
+    {
+    case SIDL_ENCODING_VARINT:
+    case SIDL_ENCODING_ZIGZAG:
+    case SIDL_ENCODING_DELTA:
+        for (size_t i = 0; i < count; i++)
+        {
+            if (read_varint(&p, end, &value) < 0)
+                goto error;
+
+            if (encoding == SIDL_ENCODING_ZIGZAG)
+                value = unzigzag(value);
+            else if (encoding == SIDL_ENCODING_DELTA)
+                value = previous += unzigzag(value);
+
+            store(values, i, size, value);
+        }
+        break;
+    case SIDL_ENCODING_BITPACK:
+    {
+        if (count == 0)
+            break;
+
+        uint64_t min = 0;
+
+        if (read_varint(&p, end, &min) < 0 || p == end)
+            goto error;
+
+        unsigned bits = *p++;
+
+        if (bits == 0 || bits > 64 || count * bits > (uint64_t)(end - p) * 8)
+            goto error;
+
+        uint64_t mask = bits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+        const uint8_t* in = p;
+        uint64_t acc = 0;
+        unsigned available = 0;
+
+        min = unzigzag(min);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t offset;
+
+            if (available >= bits)
+            {
+                offset = acc & mask;
+                acc = bits == 64 ? 0 : acc >> bits;
+                available -= bits;
+            }
+            else
+            {
+                uint64_t word = 0;
+                size_t left = end - in;
+
+                memcpy(&word, in, left < sizeof(word) ? left : sizeof(word));
+                in += sizeof(word);
+
+                unsigned used = bits - available;
+                offset = (acc | (word << available)) & mask;
+                acc = used == 64 ? 0 : word >> used;
+                available = 64 - used;
+            }
+
+            store(values, i, size, min + offset);
+        }
+
+        p += (count * bits + 7) / 8;
+        break;
+    }
+    default:
+        goto error;
+    }
+
+    u->data_offset = p - (const uint8_t*)u->data;
+    *elements = values;
+    *count_out = count;
+
+    return 0;
+
+error:
+    sidl_unserializer_free(u, values);
+    return -1;
+}
+
+int sidl_serializer_write_varint(sidl_serializer_t* s, uint64_t value)
+{
+    if (sidl_serializer_reserve(s, SIDL_MAX_VARINT_SIZE) < 0)
+        return -1;
+
+    s->data_size += write_varint((uint8_t*)s->data + s->data_size, value);
+    return 0;
+}
+
+int sidl_unserializer_read_varint(sidl_unserializer_t* u, uint64_t* value)
+{
+    const uint8_t* p = (const uint8_t*)u->data + u->data_offset;
+
+    if (read_varint(&p, (const uint8_t*)u->data + u->data_size, value) < 0)
+        return -1;
+
+    u->data_offset = p - (const uint8_t*)u->data;
+    return 0;
+}
+
+#define SIDL_DEFINE_ENCODED(SIDL_TYPE, C_TYPE) \
+int sidl_serializer_write_encoded_##SIDL_TYPE(sidl_serializer_t* s, const C_TYPE* values, size_t count, sidl_encoding_t encoding) { \
+    return write_encoded(s, values, count, sizeof(C_TYPE), SIDL_IS_SIGNED(C_TYPE), encoding); \
+} \
+\
+int sidl_unserializer_read_encoded_##SIDL_TYPE(sidl_unserializer_t* u, SIDL_VSNAME(SIDL_TYPE)* v, sidl_encoding_t encoding) { \
+    void* elements = NULL; \
+    size_t count = 0; \
+    \
+    if (read_encoded(u, &elements, &count, sizeof(C_TYPE), encoding) < 0) \
+        return -1; \
+    \
+    v->elements = elements; \
+    v->size = count; \
+    v->capacity = count; \
+    \
+    return 0; \
+}
+
+XM_SIDL_TYPES(SIDL_DEFINE_ENCODED)
+
+#undef SIDL_DEFINE_ENCODED
@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cprotorpc/serializer.h"
@@ -33,8 +34,11 @@ void sidl_serializer_destroy(sidl_serializer_t* s)
     free(s->fds);
 }
 
-int sidl_serializer_write_raw(sidl_serializer_t* s, const void* data, size_t size)
+int sidl_serializer_reserve(sidl_serializer_t* s, size_t size)
 {
+    if (size > SIZE_MAX / 2 - s->data_size)
+        return -1;
+
     if (s->data_size + size > s->data_capacity)
     {
         size_t new_capacity = s->data_capacity;
@@ -51,6 +55,14 @@ int sidl_serializer_write_raw(sidl_serializer_t* s, const void* data, size_t siz
         s->data = new_data;
     }
 
+    return 0;
+}
+
+int sidl_serializer_write_raw(sidl_serializer_t* s, const void* data, size_t size)
+{
+    if (sidl_serializer_reserve(s, size) < 0)
+        return -1;
+
     memcpy((char*)s->data + s->data_size, data, size);
     s->data_size += size;
 
@@ -76,24 +88,36 @@ int sidl_serializer_write_fd(sidl_serializer_t* s, int fd)
     return 0;
 }
 
+// The buffer has no particular alignment, values are copied bytewise.
 #define SIDL_DEFINE_SERIALIZER(SIDL_NAME, C_TYPE) \
 int sidl_serializer_write_##SIDL_NAME(sidl_serializer_t* s, C_TYPE value) {\
-    if (s->data_size + sizeof(C_TYPE) > s->data_capacity) \
-    { \
-        size_t new_capacity = s->data_capacity * 2; \
-        void* new_data = realloc(s->data, new_capacity); \
-        \
-        if (!new_data) \
-            return -1; \
-        \
-        s->data_capacity = new_capacity; \
-        s->data = new_data; \
-    } \
+    if (sidl_serializer_reserve(s, sizeof(C_TYPE)) < 0) \
+        return -1; \
     \
-    *(C_TYPE*)((char*)s->data + s->data_size) = value; \
+    memcpy((char*)s->data + s->data_size, &value, sizeof(C_TYPE)); \
     s->data_size += sizeof(C_TYPE); \
     \
     return 0; \
+} \
+\
+int sidl_serializer_write_##SIDL_NAME##_array(sidl_serializer_t* s, const C_TYPE* values, size_t count) { \
+    if (count > SIZE_MAX / sizeof(C_TYPE)) \
+        return -1; \
+    \
+    return sidl_serializer_write_raw(s, values, count * sizeof(C_TYPE)); \
+} \
+\
+int sidl_serializer_write_##SIDL_NAME##_vector(sidl_serializer_t* s, const SIDL_VSNAME(SIDL_NAME)* v) { \
+    if (v->size > (SIZE_MAX - sizeof(size_t)) / sizeof(C_TYPE)) \
+        return -1; \
+    \
+    /* A single reservation for the size and the elements */ \
+    if (sidl_serializer_reserve(s, sizeof(size_t) + v->size * sizeof(C_TYPE)) < 0) \
+        return -1; \
+    \
+    sidl_serializer_write_usize(s, v->size); \
+    \
+    return sidl_serializer_write_raw(s, v->elements, v->size * sizeof(C_TYPE)); \
 }
 
 XM_SIDL_TYPES(SIDL_DEFINE_SERIALIZER)
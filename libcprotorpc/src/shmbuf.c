@@ -0,0 +1,176 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cprotorpc/shmbuf.h"
+
+static size_t round_to_page(size_t size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (size == 0)
+        return page_size;
+
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+int sidl_shmbuf_create(sidl_shmbuf_t* b, size_t capacity)
+{
+    b->size = 0;
+    b->capacity = 0;
+    b->mapping = NULL;
+    b->fd = memfd_create("cprotorpc-shmbuf", MFD_CLOEXEC);
+
+    if (b->fd == -1)
+        return -1;
+
+    capacity = round_to_page(capacity);
+
+    if (ftruncate(b->fd, capacity) == -1)
+    {
+        close(b->fd);
+        b->fd = -1;
+        return -1;
+    }
+
+    b->capacity = capacity;
+
+    return 0;
+}
+
+void sidl_shmbuf_destroy(sidl_shmbuf_t* b)
+{
+    if (b->mapping)
+        munmap(b->mapping, b->capacity);
+
+    if (b->fd != -1)
+        close(b->fd);
+
+    b->fd = -1;
+    b->capacity = 0;
+    b->mapping = NULL;
+}
+
+int sidl_shmbuf_resize(sidl_shmbuf_t* b, size_t size)
+{
+    if (size > b->capacity)
+        return -1;
+
+    b->size = size;
+
+    return 0;
+}
+
+void* sidl_shmbuf_data(sidl_shmbuf_t* b)
+{
+    if (!b->mapping && b->fd != -1)
+    {
+        void* mapping = mmap(NULL, b->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+
+        if (mapping == MAP_FAILED)
+            return NULL;
+
+        b->mapping = mapping;
+    }
+
+    return b->mapping;
+}
+
+int sidl_serializer_write_shmbuf(sidl_serializer_t* s, const sidl_shmbuf_t* b)
+{
+    if (sidl_serializer_write_fd(s, b->fd) != 0)
+        return -1;
+
+    return sidl_serializer_write_u64(s, b->size);
+}
+
+int sidl_unserializer_read_shmbuf(sidl_unserializer_t* u, sidl_shmbuf_t* b)
+{
+    struct stat st;
+    uint64_t size = 0;
+
+    b->fd = -1;
+    b->mapping = NULL;
+
+    if (sidl_unserializer_read_fd(u, &b->fd) != 0)
+        return -1;
+
+    // Accessing a mapping past the end of the file raises SIGBUS, the peer
+    // must not be able to trigger it.
+    if (sidl_unserializer_read_u64(u, &size) != 0
+            || fstat(b->fd, &st) == -1 || (uint64_t)st.st_size < size)
+    {
+        close(b->fd);
+        b->fd = -1;
+        return -1;
+    }
+
+    b->size = size;
+    b->capacity = st.st_size;
+
+    return 0;
+}
+
+void sidl_shmbuf_pool_init(sidl_shmbuf_pool_t* pool)
+{
+    pool->count = 0;
+}
+
+void sidl_shmbuf_pool_destroy(sidl_shmbuf_pool_t* pool)
+{
+    for (size_t i = 0; i < pool->count; i++)
+        sidl_shmbuf_destroy(&pool->buffers[i]);
+
+    pool->count = 0;
+}
+
+sidl_shmbuf_t* sidl_shmbuf_pool_acquire(sidl_shmbuf_pool_t* pool, size_t size)
+{
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        if (!pool->in_use[i] && pool->buffers[i].capacity >= size)
+        {
+            pool->in_use[i] = 1;
+            pool->buffers[i].size = size;
+            return &pool->buffers[i];
+        }
+    }
+
+    // Replace the first free region which is too small, or grow the pool.
+    size_t index = pool->count;
+
+    for (size_t i = 0; i < pool->count; i++)
+    {
+        if (!pool->in_use[i])
+        {
+            sidl_shmbuf_destroy(&pool->buffers[i]);
+            index = i;
+            break;
+        }
+    }
+
+    if (index == SIDL_SHMBUF_POOL_SIZE)
+        return NULL;
+
+    // A replaced slot which failed to be created is left empty and free.
+    if (sidl_shmbuf_create(&pool->buffers[index], size) != 0)
+        return NULL;
+
+    if (index == pool->count)
+        pool->count++;
+
+    pool->in_use[index] = 1;
+    pool->buffers[index].size = size;
+
+    return &pool->buffers[index];
+}
+
+void sidl_shmbuf_pool_release(sidl_shmbuf_pool_t* pool, sidl_shmbuf_t* b)
+{
+    size_t index = (size_t)(b - pool->buffers);
+
+    if (index < pool->count)
+        pool->in_use[index] = 0;
+}
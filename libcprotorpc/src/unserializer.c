@@ -11,11 +11,32 @@ void sidl_unserializer_init(sidl_unserializer_t* u, void* data, size_t data_size
     u->fds = fds;
     u->fd_count = fd_count;
     u->fd_index = 0;
+
+    u->arena = NULL;
+}
+
+void sidl_unserializer_set_arena(sidl_unserializer_t* u, sidl_arena_t* arena)
+{
+    u->arena = arena;
+}
+
+void* sidl_unserializer_alloc(sidl_unserializer_t* u, size_t size)
+{
+    if (u->arena)
+        return sidl_arena_alloc(u->arena, size);
+
+    return malloc(size ? size : 1);
+}
+
+void sidl_unserializer_free(sidl_unserializer_t* u, void* p)
+{
+    if (!u->arena)
+        free(p);
 }
 
 int sidl_unserializer_read_raw(sidl_unserializer_t* u, void* data, size_t size)
 {
-    if (u->data_offset + size > u->data_size)
+    if (size > u->data_size - u->data_offset)
         return -1;
 
     memcpy(data, (char*)u->data + u->data_offset, size);
@@ -34,15 +55,45 @@ int sidl_unserializer_read_fd(sidl_unserializer_t* u, int* fd)
     return 0;
 }
 
+// The input has no particular alignment, values are copied bytewise.
 #define DEFINE_UNSERIALIZER(SIDL_NAME, C_TYPE) \
 int sidl_unserializer_read_##SIDL_NAME(sidl_unserializer_t* u, C_TYPE* value) { \
-    if (u->data_offset + sizeof(C_TYPE) > u->data_size) \
+    if (sizeof(C_TYPE) > u->data_size - u->data_offset) \
         return -1; \
     \
-    *value = *(C_TYPE*)((char*)u->data + u->data_offset); \
+    memcpy(value, (char*)u->data + u->data_offset, sizeof(C_TYPE)); \
     u->data_offset += sizeof(C_TYPE); \
     \
     return 0; \
+} \
+\
+int sidl_unserializer_read_##SIDL_NAME##_array(sidl_unserializer_t* u, C_TYPE* values, size_t count) { \
+    if (count > (u->data_size - u->data_offset) / sizeof(C_TYPE)) \
+        return -1; \
+    \
+    return sidl_unserializer_read_raw(u, values, count * sizeof(C_TYPE)); \
+} \
+\
+int sidl_unserializer_read_##SIDL_NAME##_vector(sidl_unserializer_t* u, SIDL_VSNAME(SIDL_NAME)* v) { \
+    size_t count = 0; \
+    \
+    /* Checked before allocating, a corrupted count cannot make it explode */ \
+    if (sidl_unserializer_read_usize(u, &count) < 0 || \
+            count > (u->data_size - u->data_offset) / sizeof(C_TYPE)) \
+        return -1; \
+    \
+    C_TYPE* elements = sidl_unserializer_alloc(u, count * sizeof(C_TYPE)); \
+    \
+    if (!elements) \
+        return -1; \
+    \
+    sidl_unserializer_read_raw(u, elements, count * sizeof(C_TYPE)); \
+    \
+    v->size = count; \
+    v->capacity = count; \
+    v->elements = elements; \
+    \
+    return 0; \
 }
 
 DEFINE_UNSERIALIZER(u8, uint8_t)
@@ -64,11 +115,15 @@ int sidl_unserializer_read_string(sidl_unserializer_t* u, const char** str)
     if (sidl_unserializer_read_usize(u, &string_len) < 0)
         return -1;
 
-    char* string = malloc(string_len + 1);
+    // A corrupted length cannot make the allocation explode
+    if (string_len > u->data_size - u->data_offset)
+        return -1;
+
+    char* string = sidl_unserializer_alloc(u, string_len + 1);
 
-    if (sidl_unserializer_read_raw(u, string, string_len) < 0)
+    if (!string || sidl_unserializer_read_raw(u, string, string_len) < 0)
     {
-        free(string);
+        sidl_unserializer_free(u, string);
         return -1;
     }
 
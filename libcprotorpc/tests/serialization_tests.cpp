@@ -1,5 +1,13 @@
 #include "cprotorpc/serializer.h"
+#include "cprotorpc/encoding.h"
 #include "cprotorpc/unserializer.h"
+#include "cprotorpc/shmbuf.h"
+#include "cprotorpc/channel.h"
+#include "cprotorpc/arena.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <thread>
 #include "gtest/gtest.h"
 
 TEST(serializer, simple_serialization_1)
@@ -52,3 +60,400 @@ int main(int argc, char** argv)
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
+
+TEST(serializer, shmbuf_round_trip)
+{
+    sidl_shmbuf_pool_t pool;
+    sidl_shmbuf_pool_init(&pool);
+
+    sidl_shmbuf_t* buffer = sidl_shmbuf_pool_acquire(&pool, 10000);
+    ASSERT_NE(buffer, nullptr);
+    ASSERT_EQ(buffer->size, 10000);
+    memset(sidl_shmbuf_data(buffer), 0x5a, buffer->size);
+
+    sidl_serializer_t s;
+    sidl_serializer_init(&s);
+    ASSERT_EQ(sidl_serializer_write_shmbuf(&s, buffer), 0);
+    ASSERT_EQ(s.fd_count, 1);
+
+    // The receiving side owns its own descriptor.
+    int received_fd = dup(s.fds[0]);
+
+    sidl_unserializer_t u;
+    sidl_unserializer_init(&u, s.data, s.data_size, &received_fd, 1);
+
+    sidl_shmbuf_t received;
+    ASSERT_EQ(sidl_unserializer_read_shmbuf(&u, &received), 0);
+    ASSERT_EQ(received.size, 10000);
+    ASSERT_EQ(((uint8_t*)sidl_shmbuf_data(&received))[9999], 0x5a);
+
+    sidl_shmbuf_destroy(&received);
+    sidl_serializer_destroy(&s);
+
+    // Released regions are reused
+    sidl_shmbuf_pool_release(&pool, buffer);
+    ASSERT_EQ(sidl_shmbuf_pool_acquire(&pool, 16), buffer);
+    ASSERT_EQ(pool.count, 1);
+
+    sidl_shmbuf_pool_destroy(&pool);
+}
+
+TEST(serializer, encoded_vectors)
+{
+    sidl_serializer_t s;
+    sidl_serializer_init(&s);
+
+    uint64_t stamps[] = { 1000, 1001, 1003, 1010 };
+    int32_t values[1000];
+
+    for (int i = 0; i < 1000; i++)
+        values[i] = (i % 2 ? -i : i) * 1000;
+
+    ASSERT_EQ(sidl_serializer_write_encoded_u64(&s, stamps, 4, SIDL_ENCODING_DELTA), 0);
+
+    // Same bytes as rpc::Encoding::Delta in libprotorpc
+    const uint8_t delta[] = { 0x04, 0xd0, 0x0f, 0x02, 0x04, 0x0e };
+    ASSERT_EQ(s.data_size, sizeof(delta));
+    ASSERT_EQ(memcmp(s.data, delta, sizeof(delta)), 0);
+
+    ASSERT_EQ(sidl_serializer_write_encoded_u64(&s, stamps, 4, SIDL_ENCODING_BITPACK), 0);
+    ASSERT_EQ(sidl_serializer_write_encoded_i32(&s, values, 1000, SIDL_ENCODING_ZIGZAG), 0);
+    ASSERT_EQ(sidl_serializer_write_encoded_i32(&s, values, 1000, SIDL_ENCODING_BITPACK), 0);
+    ASSERT_EQ(sidl_serializer_write_encoded_i32(&s, values, 0, SIDL_ENCODING_VARINT), 0);
+
+    sidl_unserializer_t u;
+    sidl_unserializer_init(&u, s.data, s.data_size, NULL, 0);
+
+    sidl_u64_vector delta_u;
+    sidl_u64_vector packed_u;
+    sidl_i32_vector zigzag_u;
+    sidl_i32_vector packed_i32_u;
+    sidl_i32_vector empty_u;
+
+    ASSERT_EQ(sidl_unserializer_read_encoded_u64(&u, &delta_u, SIDL_ENCODING_DELTA), 0);
+    ASSERT_EQ(sidl_unserializer_read_encoded_u64(&u, &packed_u, SIDL_ENCODING_BITPACK), 0);
+    ASSERT_EQ(sidl_unserializer_read_encoded_i32(&u, &zigzag_u, SIDL_ENCODING_ZIGZAG), 0);
+    ASSERT_EQ(sidl_unserializer_read_encoded_i32(&u, &packed_i32_u, SIDL_ENCODING_BITPACK), 0);
+    ASSERT_EQ(sidl_unserializer_read_encoded_i32(&u, &empty_u, SIDL_ENCODING_VARINT), 0);
+    ASSERT_EQ(u.data_offset, u.data_size);
+
+    ASSERT_EQ(delta_u.size, 4);
+    ASSERT_EQ(packed_u.size, 4);
+    ASSERT_EQ(memcmp(delta_u.elements, stamps, sizeof(stamps)), 0);
+    ASSERT_EQ(memcmp(packed_u.elements, stamps, sizeof(stamps)), 0);
+    ASSERT_EQ(zigzag_u.size, 1000);
+    ASSERT_EQ(packed_i32_u.size, 1000);
+    ASSERT_EQ(memcmp(zigzag_u.elements, values, sizeof(values)), 0);
+    ASSERT_EQ(memcmp(packed_i32_u.elements, values, sizeof(values)), 0);
+    ASSERT_EQ(empty_u.size, 0);
+
+    sidl_u64_vector_destroy(&delta_u);
+    sidl_u64_vector_destroy(&packed_u);
+    sidl_i32_vector_destroy(&zigzag_u);
+    sidl_i32_vector_destroy(&packed_i32_u);
+    sidl_i32_vector_destroy(&empty_u);
+
+    // A truncated vector is rejected
+    sidl_unserializer_init(&u, s.data, sizeof(delta) - 1, NULL, 0);
+    ASSERT_EQ(sidl_unserializer_read_encoded_u64(&u, &delta_u, SIDL_ENCODING_DELTA), -1);
+
+    sidl_serializer_destroy(&s);
+}
+
+TEST(serializer, bulk_arrays)
+{
+    sidl_serializer_t s;
+    sidl_serializer_init(&s);
+
+    // Misaligned on purpose
+    ASSERT_EQ(sidl_serializer_write_u8(&s, 1), 0);
+
+    uint64_t values[100];
+
+    for (int i = 0; i < 100; i++)
+        values[i] = 0x0123456789abcdef * i;
+
+    sidl_u64_vector v = { 100, 100, values };
+    ASSERT_EQ(sidl_serializer_write_u64_array(&s, values, 3), 0);
+    ASSERT_EQ(sidl_serializer_write_u64_vector(&s, &v), 0);
+    ASSERT_EQ(s.data_size, 1 + 3 * sizeof(uint64_t) + sizeof(size_t) + sizeof(values));
+
+    // Same bytes as the element by element encoding
+    sidl_serializer_t reference;
+    sidl_serializer_init(&reference);
+    sidl_serializer_write_u8(&reference, 1);
+
+    for (int i = 0; i < 3; i++)
+        sidl_serializer_write_u64(&reference, values[i]);
+
+    sidl_serializer_write_usize(&reference, 100);
+
+    for (int i = 0; i < 100; i++)
+        sidl_serializer_write_u64(&reference, values[i]);
+
+    ASSERT_EQ(reference.data_size, s.data_size);
+    ASSERT_EQ(memcmp(reference.data, s.data, s.data_size), 0);
+
+    sidl_unserializer_t u;
+    sidl_unserializer_init(&u, s.data, s.data_size, NULL, 0);
+
+    uint8_t first = 0;
+    uint64_t array[3];
+    sidl_u64_vector decoded;
+
+    ASSERT_EQ(sidl_unserializer_read_u8(&u, &first), 0);
+    ASSERT_EQ(sidl_unserializer_read_u64_array(&u, array, 3), 0);
+    ASSERT_EQ(sidl_unserializer_read_u64_vector(&u, &decoded), 0);
+    ASSERT_EQ(u.data_offset, u.data_size);
+    ASSERT_EQ(memcmp(array, values, sizeof(array)), 0);
+    ASSERT_EQ(decoded.size, 100);
+    ASSERT_EQ(memcmp(decoded.elements, values, sizeof(values)), 0);
+    sidl_u64_vector_destroy(&decoded);
+
+    // Truncated inputs are rejected
+    sidl_unserializer_init(&u, (uint8_t*)s.data + 1, 2 * sizeof(uint64_t), NULL, 0);
+    ASSERT_EQ(sidl_unserializer_read_u64_array(&u, array, 3), -1);
+
+    sidl_unserializer_init(&u, (uint8_t*)s.data + 1 + sizeof(array), s.data_size - 2 - sizeof(array), NULL, 0);
+    ASSERT_EQ(sidl_unserializer_read_u64_vector(&u, &decoded), -1);
+
+    sidl_serializer_destroy(&reference);
+    sidl_serializer_destroy(&s);
+}
+
+TEST(serializer, arena_decoding)
+{
+    sidl_serializer_t s;
+    sidl_serializer_init(&s);
+
+    uint32_t values[] = { 1, 2, 3 };
+    ASSERT_EQ(sidl_serializer_write_string(&s, "hello"), 0);
+    ASSERT_EQ(sidl_serializer_write_encoded_u32(&s, values, 3, SIDL_ENCODING_VARINT), 0);
+
+    sidl_arena_t arena;
+    sidl_arena_init(&arena);
+
+    const char* str = NULL;
+    sidl_u32_vector v;
+
+    for (int i = 0; i < 2; i++)
+    {
+        sidl_unserializer_t u;
+        sidl_unserializer_init(&u, s.data, s.data_size, NULL, 0);
+        sidl_unserializer_set_arena(&u, &arena);
+
+        ASSERT_EQ(sidl_unserializer_read_string(&u, &str), 0);
+        ASSERT_EQ(sidl_unserializer_read_encoded_u32(&u, &v, SIDL_ENCODING_VARINT), 0);
+        ASSERT_STREQ(str, "hello");
+        ASSERT_EQ(memcmp(v.elements, values, sizeof(values)), 0);
+
+        // Both come from the same block
+        ASSERT_EQ((uintptr_t)str % SIDL_ARENA_ALIGNMENT, 0);
+        ASSERT_EQ((const char*)v.elements, str + SIDL_ARENA_ALIGNMENT);
+
+        sidl_arena_reset(&arena);
+    }
+
+    // A rewind releases what was allocated after the mark, the released
+    // blocks are reused.
+    sidl_arena_mark_t mark = sidl_arena_mark(&arena);
+    void* small = sidl_arena_alloc(&arena, 8);
+    sidl_arena_block_t* first = arena.block;
+    void* big = sidl_arena_alloc(&arena, 3 * SIDL_ARENA_BLOCK_SIZE);
+    ASSERT_NE(big, nullptr);
+    ASSERT_NE(arena.block, first);
+
+    sidl_arena_rewind(&arena, mark);
+    ASSERT_EQ(arena.block, nullptr);
+    ASSERT_EQ(sidl_arena_alloc(&arena, 8), small);
+    ASSERT_EQ(sidl_arena_alloc(&arena, 3 * SIDL_ARENA_BLOCK_SIZE), big);
+
+    sidl_arena_destroy(&arena);
+    sidl_serializer_destroy(&s);
+}
+
+// Replies to opcode 0 with its u32 argument plus one, counts the other messages
+static void increment_dispatch(sidl_channel_t* c, const sidl_receiver_t* receiver, uint64_t source_port,
+        sidl_message_t* message)
+{
+    int* count = (int*)receiver->object;
+    (*count)++;
+
+    if (message->opcode != 0)
+        return;
+
+    sidl_unserializer_t u;
+    sidl_unserializer_init(&u, (void*)message->payload, message->payload_size, message->handles,
+            message->handle_count);
+
+    uint32_t value = 0;
+    if (sidl_unserializer_read_u32(&u, &value) < 0)
+        return;
+
+    sidl_serializer_write_u32(sidl_channel_payload(c), value + 1);
+    sidl_channel_reply(c, source_port, message);
+}
+
+TEST(channel, call_round_trip)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    sidl_channel_t client;
+    sidl_channel_t server;
+    ASSERT_EQ(sidl_channel_init(&client, 1, fds[0]), 0);
+    ASSERT_EQ(sidl_channel_init(&server, 2, fds[1]), 0);
+
+    int count = 0;
+    ASSERT_EQ(sidl_channel_bind(&server, 5, increment_dispatch, NULL, &count), 0);
+    ASSERT_EQ(sidl_channel_bind(&server, 5, increment_dispatch, NULL, &count), -1);
+
+    // Serves until the client goes away
+    std::thread server_thread([&]() {
+        while (sidl_channel_dispatch(&server) == 0) {}
+    });
+
+    // Bigger than the initial receive buffer
+    sidl_serializer_t* payload = sidl_channel_payload(&client);
+    ASSERT_EQ(sidl_serializer_write_u32(payload, 41), 0);
+    uint8_t padding[10000] = {0};
+    ASSERT_EQ(sidl_serializer_write_raw(payload, padding, sizeof(padding)), 0);
+
+    sidl_unserializer_t reply;
+    ASSERT_EQ(sidl_channel_call(&client, 2, 7, 5, 0, &reply), 0);
+
+    uint32_t value = 0;
+    ASSERT_EQ(sidl_unserializer_read_u32(&reply, &value), 0);
+    ASSERT_EQ(value, 42);
+
+    // One-way message, then a call which is answered after it
+    sidl_channel_payload(&client);
+    ASSERT_EQ(sidl_channel_send(&client, 2, 7, 5, 1, 0), 0);
+    ASSERT_EQ(sidl_serializer_write_u32(sidl_channel_payload(&client), 1), 0);
+    ASSERT_EQ(sidl_channel_call(&client, 2, 7, 5, 0, &reply), 0);
+    ASSERT_EQ(sidl_unserializer_read_u32(&reply, &value), 0);
+    ASSERT_EQ(value, 2);
+
+    shutdown(fds[0], SHUT_RDWR);
+    server_thread.join();
+    ASSERT_EQ(count, 3);
+
+    close(fds[0]);
+    close(fds[1]);
+    sidl_channel_destroy(&client);
+    sidl_channel_destroy(&server);
+}
+
+// Makes a call while the call of the client is waiting for its reply
+static void nested_call_dispatch(sidl_channel_t* c, const sidl_receiver_t* receiver, uint64_t source_port,
+        sidl_message_t* message)
+{
+    uint32_t* value = (uint32_t*)receiver->object;
+    sidl_unserializer_t reply;
+
+    sidl_channel_payload(c);
+
+    if (sidl_channel_call(c, source_port, 8, 5, 0, &reply) == 0)
+        sidl_unserializer_read_u32(&reply, value);
+}
+
+TEST(channel, nested_call_keeps_outer_reply)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    sidl_channel_t client;
+    sidl_channel_t peer;
+    ASSERT_EQ(sidl_channel_init(&client, 2, fds[1]), 0);
+    ASSERT_EQ(sidl_channel_init(&peer, 1, fds[0]), 0);
+
+    uint32_t inner = 0;
+    ASSERT_EQ(sidl_channel_bind(&client, 9, nested_call_dispatch, NULL, &inner), 0);
+
+    int pipe_fds[2];
+    ASSERT_EQ(pipe(pipe_fds), 0);
+
+    // Sent ahead by the peer: a request to the receiver, the reply to the
+    // outer call (id 1) which arrives while the nested call (id 2) waits, then
+    // the reply to the nested call.
+    sidl_channel_payload(&peer);
+    ASSERT_EQ(sidl_channel_send(&peer, 2, 30, 9, 0, 100), 0);
+
+    ASSERT_EQ(sidl_serializer_write_u32(sidl_channel_payload(&peer), 111), 0);
+    ASSERT_EQ(sidl_serializer_write_fd(&peer.payload, pipe_fds[0]), 0);
+    ASSERT_EQ(sidl_channel_send(&peer, 2, 5, 7, 0, 1), 0);
+
+    ASSERT_EQ(sidl_serializer_write_u32(sidl_channel_payload(&peer), 222), 0);
+    ASSERT_EQ(sidl_channel_send(&peer, 2, 5, 8, 0, 2), 0);
+
+    sidl_unserializer_t reply;
+    sidl_channel_payload(&client);
+    ASSERT_EQ(sidl_channel_call(&client, 1, 7, 5, 0, &reply), 0);
+    ASSERT_EQ(inner, 222);
+
+    uint32_t value = 0;
+    int fd = -1;
+    ASSERT_EQ(sidl_unserializer_read_u32(&reply, &value), 0);
+    ASSERT_EQ(value, 111);
+    ASSERT_EQ(sidl_unserializer_read_fd(&reply, &fd), 0);
+
+    // The handle was kept along with the reply
+    ASSERT_EQ(write(pipe_fds[1], "x", 1), 1);
+    char byte = 0;
+    ASSERT_EQ(read(fd, &byte, 1), 1);
+    ASSERT_EQ(byte, 'x');
+
+    close(fd);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+    sidl_channel_destroy(&client);
+    sidl_channel_destroy(&peer);
+}
+
+TEST(channel, batched_messages)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    sidl_channel_t server;
+    ASSERT_EQ(sidl_channel_init(&server, 2, fds[1]), 0);
+
+    int count = 0;
+    ASSERT_EQ(sidl_channel_bind(&server, 5, increment_dispatch, NULL, &count), 0);
+
+    // Two messages packed by rpc::Channel::flush(): each entry is a handle
+    // count followed by an encoded message.
+    sidl_serializer_t batch;
+    sidl_serializer_init(&batch);
+
+    for (int i = 0; i < 2; i++)
+    {
+        uint64_t entry[] = { 0, 7, 5, 1, 0, 0, 0 };
+        ASSERT_EQ(sidl_serializer_write_raw(&batch, entry, sizeof(entry)), 0);
+    }
+
+    sidl_serializer_t frame;
+    sidl_serializer_init(&frame);
+    uint64_t header[] = { 6 * sizeof(uint64_t) + batch.data_size, 0, 2,
+        7, SIDL_CONTROL_OBJECT, SIDL_CONTROL_BATCH, 0, 0, batch.data_size };
+    ASSERT_EQ(sidl_serializer_write_raw(&frame, header, sizeof(header)), 0);
+    ASSERT_EQ(sidl_serializer_write_raw(&frame, batch.data, batch.data_size), 0);
+    ASSERT_EQ(write(fds[0], frame.data, frame.data_size), (ssize_t)frame.data_size);
+
+    ASSERT_EQ(sidl_channel_dispatch(&server), 0);
+    ASSERT_EQ(sidl_channel_dispatch(&server), 0);
+    ASSERT_EQ(count, 2);
+
+    // Messages to objects which are not bound are reported
+    sidl_channel_unbind(&server, 5);
+    ASSERT_EQ(write(fds[0], frame.data, frame.data_size), (ssize_t)frame.data_size);
+    ASSERT_EQ(sidl_channel_dispatch(&server), -1);
+
+    sidl_serializer_destroy(&batch);
+    sidl_serializer_destroy(&frame);
+    close(fds[0]);
+    close(fds[1]);
+    sidl_channel_destroy(&server);
+}
@@ -0,0 +1,104 @@
+#ifndef IPC_CAPTURE_HH
+#define IPC_CAPTURE_HH
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include "protoipc/message.hh"
+
+namespace ipc
+{
+    /**
+     * Message recorded by a capture. Handles are not recorded, only their
+     * number, and the payload may be truncated to keep captures small.
+     */
+    struct CapturedMessage
+    {
+        // Nanoseconds elapsed since the first message of the capture.
+        std::uint64_t timestamp = 0;
+
+        std::uint64_t source = 0;
+        std::uint64_t destination = 0;
+
+        // Size of the payload when it was captured.
+        std::uint64_t size = 0;
+        std::uint64_t handle_count = 0;
+
+        // First bytes of the payload, at most the capture limit.
+        std::vector<std::uint8_t> payload;
+    };
+
+    /**
+     * Writes messages to a capture file. Records are varint encoded, a
+     * message costs a few bytes on top of the payload bytes kept.
+     */
+    class CaptureWriter
+    {
+    public:
+        /**
+         * Keeps at most `max_payload` bytes of each payload. Zero only records
+         * the sizes.
+         */
+        CaptureWriter(std::size_t max_payload = SIZE_MAX)
+            : max_payload_(max_payload)
+        {}
+
+        bool open(const std::string& path);
+        void close();
+
+        bool is_open() const
+        {
+            return out_.is_open();
+        }
+
+        /**
+         * Records a message sent from port `source` to port `destination`,
+         * timestamped now.
+         */
+        bool write(std::uint64_t source, std::uint64_t destination, const Message& message);
+
+        /**
+         * Records a message with its own timestamp, which must not be before
+         * the one of the previous message.
+         */
+        bool write(const CapturedMessage& message);
+
+    private:
+        std::ofstream out_;
+        std::size_t max_payload_;
+        std::chrono::steady_clock::time_point start_;
+        std::uint64_t last_timestamp_ = 0;
+        std::uint64_t count_ = 0;
+        std::vector<std::uint8_t> buffer_;
+    };
+
+    /**
+     * Reads the messages of a capture file in order.
+     */
+    class CaptureReader
+    {
+    public:
+        bool open(const std::string& path);
+        void close();
+
+        /**
+         * Reads the next message. Returns false at the end of the capture or
+         * if the capture is corrupted, at_end() tells which one it was.
+         */
+        bool next(CapturedMessage* message);
+
+        bool at_end() const
+        {
+            return end_;
+        }
+
+    private:
+        std::ifstream in_;
+        std::uint64_t last_timestamp_ = 0;
+        bool end_ = false;
+    };
+}
+
+#endif
@@ -1,10 +1,13 @@
 #ifndef IPC_PORT_HH
 #define IPC_PORT_HH
 
+#include <cstddef>
 #include "protoipc/message.hh"
 
 namespace ipc
 {
+    // XXX: High enough limit for common cases (same as kMaxSendmsgHandles in mojo)
+    constexpr std::size_t IPC_MAX_HANDLES = 128;
 
     enum class PortError
     {
@@ -15,6 +18,7 @@ namespace ipc
         WriteFailed,
         BadFileDescriptor,
         PollError,
+        Timeout,
         Unknown
     };
 
@@ -30,6 +34,13 @@ namespace ipc
         PortError send(const Message& message);
         PortError receive(Message& message);
 
+        /**
+         * Waits until a message can be received. A negative timeout waits
+         * forever, a zero timeout returns immediately. Returns
+         * PortError::Timeout if no message arrived in time.
+         */
+        PortError poll(int timeout_ms);
+
         static bool create_pair(Port& a, Port& b);
 
         int handle() const
@@ -1,8 +1,10 @@
 #ifndef IPC_ROUTER_HH
 #define IPC_ROUTER_HH
 
+#include <vector>
 #include <unordered_map>
 #include "protoipc/port.hh"
+#include "protoipc/capture.hh"
 
 namespace ipc
 {
@@ -30,16 +32,83 @@ namespace ipc
          */
         bool remove_port(PortId id);
 
+        /**
+         * Creates an anycast group and returns its PortId. A message sent to
+         * the group is forwarded to the member with the fewest outstanding
+         * messages. A message forwarded to a member stays outstanding until
+         * the member sends a message back to its sender, messages to other
+         * ports (such as one-way calls or streams) do not count. Receivers see
+         * the sender as source, answers go back to it directly.
+         *
+         * Members must be interchangeable: every message may reach a
+         * different one, so messages tied to a previous one (such as stream
+         * chunks) must not be sent to a group.
+         */
+        PortId add_group();
+
+        /**
+         * Removes a group. Its members are left untouched.
+         */
+        bool remove_group(PortId group);
+
+        /**
+         * Adds a port to a group. Returns false if either is unknown.
+         */
+        bool join_group(PortId group, PortId member);
+
+        /**
+         * Removes a port from a group, which stops receiving the messages
+         * sent to the group. Messages to a group without members are dropped.
+         */
+        bool leave_group(PortId group, PortId member);
+
         /**
          * Handles requests and routes messages. Messages with unknown desintation
          * are dropped.
          */
         ipc::PortError loop();
 
+        /**
+         * Records every forwarded message in the capture, which must outlive
+         * the loop. Null stops capturing. Must not be called while the loop
+         * runs.
+         */
+        void set_capture(CaptureWriter* capture)
+        {
+            capture_ = capture;
+        }
+
     private:
+        struct Group
+        {
+            std::vector<PortId> members;
+
+            // Member checked first, rotating so that ties are spread.
+            std::size_t next = 0;
+        };
+
+        /**
+         * Resolves the destination of a message sent to a group. Returns false
+         * if the group has no member.
+         */
+        bool pick_member_(Group& group, PortId* member);
+
         // XXX: Should this be protected by a mutex ?
         std::unordered_map<PortId, Port> ports_;
+        std::unordered_map<PortId, Group> groups_;
+
+        struct MemberLoad
+        {
+            std::uint64_t total = 0;
+
+            // Messages forwarded from the group and not answered, by sender.
+            std::unordered_map<PortId, std::uint64_t> senders;
+        };
+
+        // Outstanding messages of the ports which are member of a group.
+        std::unordered_map<PortId, MemberLoad> outstanding_;
         PortId current_id_ = 0;
+        CaptureWriter* capture_ = nullptr;
 
 #ifdef __linux__
         int epoll_fd_ = -1;
@@ -0,0 +1,166 @@
+#include <cstring>
+#include <algorithm>
+#include "protoipc/capture.hh"
+
+namespace ipc
+{
+
+static const char CAPTURE_MAGIC[8] = { 'i', 'p', 'c', 'c', 'a', 'p', '0', '1' };
+
+static void write_varint(std::vector<std::uint8_t>& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<std::uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+static bool read_varint(std::istream& in, std::uint64_t* value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = in.get();
+
+        if (byte == std::char_traits<char>::eof())
+            return false;
+
+        *value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+bool CaptureWriter::open(const std::string& path)
+{
+    close();
+    out_.open(path, std::ios::binary | std::ios::trunc);
+
+    if (!out_)
+        return false;
+
+    out_.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    last_timestamp_ = 0;
+    count_ = 0;
+
+    return static_cast<bool>(out_);
+}
+
+void CaptureWriter::close()
+{
+    if (out_.is_open())
+        out_.close();
+}
+
+bool CaptureWriter::write(std::uint64_t source, std::uint64_t destination, const Message& message)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (count_ == 0)
+        start_ = now;
+
+    CapturedMessage captured;
+    captured.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_).count();
+    captured.source = source;
+    captured.destination = destination;
+    captured.size = message.payload.size();
+    captured.handle_count = message.handles.size();
+
+    std::size_t kept = std::min(message.payload.size(), max_payload_);
+    captured.payload.assign(message.payload.begin(), message.payload.begin() + kept);
+
+    return write(captured);
+}
+
+bool CaptureWriter::write(const CapturedMessage& message)
+{
+    if (!out_.is_open() || message.timestamp < last_timestamp_)
+        return false;
+
+    std::size_t kept = std::min(message.payload.size(), max_payload_);
+
+    buffer_.clear();
+    write_varint(buffer_, message.timestamp - last_timestamp_);
+    write_varint(buffer_, message.source);
+    write_varint(buffer_, message.destination);
+    write_varint(buffer_, message.size);
+    write_varint(buffer_, message.handle_count);
+    write_varint(buffer_, kept);
+    buffer_.insert(buffer_.end(), message.payload.begin(), message.payload.begin() + kept);
+
+    out_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+    last_timestamp_ = message.timestamp;
+    count_++;
+
+    return static_cast<bool>(out_);
+}
+
+bool CaptureReader::open(const std::string& path)
+{
+    close();
+    in_.open(path, std::ios::binary);
+
+    char magic[sizeof(CAPTURE_MAGIC)];
+    last_timestamp_ = 0;
+    end_ = false;
+
+    if (!in_.read(magic, sizeof(magic)) || std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if (in_.is_open())
+        in_.close();
+
+    in_.clear();
+}
+
+bool CaptureReader::next(CapturedMessage* message)
+{
+    std::uint64_t delta = 0;
+    std::uint64_t kept = 0;
+
+    if (!in_.is_open())
+        return false;
+
+    if (in_.peek() == std::char_traits<char>::eof())
+    {
+        end_ = true;
+        return false;
+    }
+
+    if (!read_varint(in_, &delta) ||
+        !read_varint(in_, &message->source) ||
+        !read_varint(in_, &message->destination) ||
+        !read_varint(in_, &message->size) ||
+        !read_varint(in_, &message->handle_count) ||
+        !read_varint(in_, &kept) ||
+        kept > message->size)
+        return false;
+
+    message->payload.resize(kept);
+
+    if (!in_.read(reinterpret_cast<char*>(message->payload.data()), kept))
+        return false;
+
+    last_timestamp_ += delta;
+    message->timestamp = last_timestamp_;
+
+    return true;
+}
+
+
+}
@@ -1,13 +1,11 @@
 #include <cstring>
 #include <cerrno>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include "protoipc/port.hh"
 
-// XXX: High enough limit for common cases (same as kMaxSendmsgHandles in mojo)
-constexpr std::size_t IPC_MAX_HANDLES = 128;
-
 namespace ipc
 {
 
@@ -150,6 +148,35 @@ PortError Port::receive(Message& message)
     return PortError::Ok;
 }
 
+PortError Port::poll(int timeout_ms)
+{
+    struct pollfd pfd = {};
+    pfd.fd = pipe_fd_;
+    pfd.events = POLLIN;
+
+    int res = 0;
+
+    while ((res = ::poll(&pfd, 1, timeout_ms)) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        else
+            return PortError::PollError;
+    }
+
+    if (res == 0)
+        return PortError::Timeout;
+
+    if (pfd.revents & POLLNVAL)
+        return PortError::BadFileDescriptor;
+
+    // Data still pending on a hung up socket must be read first.
+    if (pfd.revents & POLLIN)
+        return PortError::Ok;
+
+    return PortError::PollError;
+}
+
 bool Port::create_pair(Port& a, Port& b)
 {
     int pair[2];
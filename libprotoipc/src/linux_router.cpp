@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <stdexcept>
 #include <sys/epoll.h>
 #include <unistd.h>
@@ -46,12 +47,114 @@ bool Router::remove_port(PortId id)
     ipc::Port port_obj = it->second;
     ports_.erase(it);
 
+    // Answers to the port cannot be delivered anymore.
+    for (auto& [member, load] : outstanding_)
+    {
+        auto sender = load.senders.find(id);
+
+        if (sender != load.senders.end())
+        {
+            load.total -= sender->second;
+            load.senders.erase(sender);
+        }
+    }
+
+    for (auto& [group_id, group] : groups_)
+        leave_group(group_id, id);
+
     // XXX: Should we close the port or leave this to the caller who added it ?
     port_obj.close();
 
     return true;
 }
 
+PortId Router::add_group()
+{
+    groups_[current_id_] = Group();
+
+    return current_id_++;
+}
+
+bool Router::remove_group(PortId group)
+{
+    auto it = groups_.find(group);
+
+    if (it == groups_.end())
+        return false;
+
+    for (PortId member : std::vector<PortId>(it->second.members))
+        leave_group(group, member);
+
+    groups_.erase(group);
+    return true;
+}
+
+bool Router::join_group(PortId group, PortId member)
+{
+    auto it = groups_.find(group);
+
+    if (it == groups_.end() || ports_.count(member) == 0)
+        return false;
+
+    std::vector<PortId>& members = it->second.members;
+
+    if (std::find(members.begin(), members.end(), member) == members.end())
+        members.push_back(member);
+
+    outstanding_.emplace(member, MemberLoad());
+    return true;
+}
+
+bool Router::leave_group(PortId group, PortId member)
+{
+    auto it = groups_.find(group);
+
+    if (it == groups_.end())
+        return false;
+
+    std::vector<PortId>& members = it->second.members;
+    auto position = std::find(members.begin(), members.end(), member);
+
+    if (position == members.end())
+        return false;
+
+    members.erase(position);
+
+    // The port may still be a member of another group.
+    bool member_elsewhere = std::any_of(groups_.begin(), groups_.end(), [&](const auto& entry) {
+        const std::vector<PortId>& others = entry.second.members;
+        return std::find(others.begin(), others.end(), member) != others.end();
+    });
+
+    if (!member_elsewhere)
+        outstanding_.erase(member);
+
+    return true;
+}
+
+bool Router::pick_member_(Group& group, PortId* member)
+{
+    std::size_t count = group.members.size();
+
+    if (count == 0)
+        return false;
+
+    std::size_t best = group.next % count;
+
+    for (std::size_t i = 1; i < count; i++)
+    {
+        std::size_t candidate = (group.next + i) % count;
+
+        if (outstanding_[group.members[candidate]].total < outstanding_[group.members[best]].total)
+            best = candidate;
+    }
+
+    group.next = best + 1;
+    *member = group.members[best];
+
+    return true;
+}
+
 ipc::PortError Router::loop()
 {
     for (;;)
@@ -83,16 +186,64 @@ ipc::PortError Router::loop()
             if (err != ipc::PortError::Ok)
                 return err;
 
+            if (!outstanding_.empty())
+            {
+                // Only messages going back to the sender of a forwarded
+                // message are taken as answers.
+                auto member = outstanding_.find(source->first);
+
+                if (member != outstanding_.end())
+                {
+                    auto sender = member->second.senders.find(message.destination);
+
+                    if (sender != member->second.senders.end())
+                    {
+                        member->second.total--;
+
+                        if (--sender->second == 0)
+                            member->second.senders.erase(sender);
+                    }
+                }
+            }
+
+            if (!groups_.empty())
+            {
+                auto group = groups_.find(message.destination);
+
+                if (group != groups_.end())
+                {
+                    if (!pick_member_(group->second, &message.destination))
+                    {
+                        for (int handle : message.handles)
+                            close(handle);
+
+                        continue;
+                    }
+
+                    MemberLoad& load = outstanding_[message.destination];
+                    load.total++;
+                    load.senders[source->first]++;
+                }
+            }
+
             auto destination = ports_.find(message.destination);
 
             if (destination == ports_.end())
                 return ipc::PortError::BadFileDescriptor;
 
+            if (capture_)
+                capture_->write(source->first, message.destination, message);
+
             // We patch the message and replace the destination's process id by the
             // sender's process id. The receiver can then know to who reply.
             message.destination = source->first;
             err = destination->second.send(message);
 
+            // The destination received its own copies of the handles, ours
+            // would leak otherwise.
+            for (int handle : message.handles)
+                close(handle);
+
             if (err != ipc::PortError::Ok)
                 return err;
         }
@@ -7,6 +7,7 @@
 
 #include "protoipc/port.hh"
 #include "protoipc/router.hh"
+#include "protoipc/capture.hh"
 
 TEST(ipc_test, simple_send)
 {
@@ -108,6 +109,173 @@ TEST(ipc_test, router_simple)
     ASSERT_EQ(received.payload, payload);
 }
 
+TEST(ipc_test, router_anycast_group)
+{
+    ipc::Port client_router;
+    ipc::Port router_client;
+    ipc::Port worker_router_a;
+    ipc::Port router_worker_a;
+    ipc::Port worker_router_b;
+    ipc::Port router_worker_b;
+
+    ASSERT_TRUE(ipc::Port::create_pair(client_router, router_client));
+    ASSERT_TRUE(ipc::Port::create_pair(worker_router_a, router_worker_a));
+    ASSERT_TRUE(ipc::Port::create_pair(worker_router_b, router_worker_b));
+
+    ipc::Router router;
+    ipc::PortId client_id = router.add_port(router_client);
+    ipc::PortId worker_a_id = router.add_port(router_worker_a);
+    ipc::PortId worker_b_id = router.add_port(router_worker_b);
+    ipc::PortId group_id = router.add_group();
+
+    ASSERT_TRUE(router.join_group(group_id, worker_a_id));
+    ASSERT_TRUE(router.join_group(group_id, worker_b_id));
+    ASSERT_FALSE(router.join_group(client_id, worker_a_id));
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    auto send = [&](ipc::Port& port, ipc::PortId destination) {
+        ipc::Message message;
+        message.destination = destination;
+        message.payload = { 0x42 };
+
+        ASSERT_EQ(port.send(message), ipc::PortError::Ok);
+    };
+
+    // Returns the number of messages from the source waiting on the port.
+    auto drain = [&](ipc::Port& port, ipc::PortId source) {
+        int count = 0;
+
+        while (port.poll(100) == ipc::PortError::Ok)
+        {
+            ipc::Message received;
+
+            if (port.receive(received) != ipc::PortError::Ok)
+                break;
+
+            EXPECT_EQ(received.destination, source);
+            count++;
+        }
+
+        return count;
+    };
+
+    // Equally loaded workers take turns.
+    for (int i = 0; i < 4; i++)
+        send(client_router, group_id);
+
+    // The sender is the client, not the group.
+    ASSERT_EQ(drain(worker_router_a, client_id), 2);
+    ASSERT_EQ(drain(worker_router_b, client_id), 2);
+
+    // Worker a answers its requests, new ones go to it.
+    send(worker_router_a, client_id);
+    send(worker_router_a, client_id);
+    ASSERT_EQ(drain(client_router, worker_a_id), 2);
+
+    send(client_router, group_id);
+    send(client_router, group_id);
+
+    ASSERT_EQ(drain(worker_router_a, client_id), 2);
+    ASSERT_EQ(drain(worker_router_b, client_id), 0);
+
+    // Worker b answers its requests, then worker a sends one-way messages to
+    // it: they do not answer the requests of the client.
+    send(worker_router_b, client_id);
+    send(worker_router_b, client_id);
+    ASSERT_EQ(drain(client_router, worker_b_id), 2);
+
+    for (int i = 0; i < 3; i++)
+        send(worker_router_a, worker_b_id);
+
+    ASSERT_EQ(drain(worker_router_b, worker_a_id), 3);
+
+    send(client_router, group_id);
+    send(client_router, group_id);
+
+    ASSERT_EQ(drain(worker_router_a, client_id), 0);
+    ASSERT_EQ(drain(worker_router_b, client_id), 2);
+}
+
+TEST(ipc_test, router_capture)
+{
+    ipc::Port client_router_a, router_client_a;
+    ipc::Port client_router_b, router_client_b;
+
+    ASSERT_TRUE(ipc::Port::create_pair(client_router_a, router_client_a));
+    ASSERT_TRUE(ipc::Port::create_pair(client_router_b, router_client_b));
+
+    ipc::Router router;
+    ipc::PortId client_a_id = router.add_port(router_client_a);
+    ipc::PortId client_b_id = router.add_port(router_client_b);
+
+    char path[] = "/tmp/ipc_capture_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+
+    // Payloads are truncated to 4 bytes
+    ipc::CaptureWriter capture(4);
+    ASSERT_TRUE(capture.open(path));
+    router.set_capture(&capture);
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    router_thread.detach();
+
+    ipc::Message first;
+    first.destination = client_b_id;
+    first.payload = { 1, 2, 3, 4, 5, 6 };
+    first.handles = { open("/dev/null", O_RDONLY) };
+
+    ipc::Message second;
+    second.destination = client_a_id;
+    second.payload = { 7 };
+
+    ipc::Message received;
+
+    ASSERT_EQ(client_router_a.send(first), ipc::PortError::Ok);
+    ASSERT_EQ(client_router_b.receive(received), ipc::PortError::Ok);
+    ASSERT_EQ(client_router_b.send(second), ipc::PortError::Ok);
+    ASSERT_EQ(client_router_a.receive(received), ipc::PortError::Ok);
+
+    // The router wrote the second record before forwarding it
+    capture.close();
+
+    ipc::CaptureReader reader;
+    ASSERT_TRUE(reader.open(path));
+
+    ipc::CapturedMessage captured;
+    ASSERT_TRUE(reader.next(&captured));
+    ASSERT_EQ(captured.source, client_a_id);
+    ASSERT_EQ(captured.destination, client_b_id);
+    ASSERT_EQ(captured.size, 6);
+    ASSERT_EQ(captured.handle_count, 1);
+    ASSERT_EQ(captured.payload, std::vector<std::uint8_t>({ 1, 2, 3, 4 }));
+
+    std::uint64_t first_timestamp = captured.timestamp;
+
+    ASSERT_TRUE(reader.next(&captured));
+    ASSERT_EQ(captured.source, client_b_id);
+    ASSERT_EQ(captured.destination, client_a_id);
+    ASSERT_EQ(captured.size, 1);
+    ASSERT_EQ(captured.handle_count, 0);
+    ASSERT_EQ(captured.payload, std::vector<std::uint8_t>({ 7 }));
+    ASSERT_GE(captured.timestamp, first_timestamp);
+
+    ASSERT_FALSE(reader.next(&captured));
+    ASSERT_TRUE(reader.at_end());
+
+    unlink(path);
+}
+
 #ifdef __linux__
 
 TEST(ipc_test, fd_passing_linux)
@@ -0,0 +1,84 @@
+#ifndef RPC_BYTE_VIEW_HH
+#define RPC_BYTE_VIEW_HH
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+namespace rpc
+{
+
+    /**
+     * Non-owning view of a sequence of bytes, encoded like a
+     * std::vector<std::uint8_t>. Decoded views point into the buffer of the
+     * Unserializer and are only valid as long as this buffer is.
+     */
+    class ByteView
+    {
+    public:
+        ByteView() = default;
+
+        ByteView(const std::uint8_t* data, std::size_t size)
+            : data_(data), size_(size)
+        {}
+
+        ByteView(const std::vector<std::uint8_t>& bytes)
+            : data_(bytes.data()), size_(bytes.size())
+        {}
+
+        const std::uint8_t* data() const
+        {
+            return data_;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        bool empty() const
+        {
+            return size_ == 0;
+        }
+
+        const std::uint8_t* begin() const
+        {
+            return data_;
+        }
+
+        const std::uint8_t* end() const
+        {
+            return data_ + size_;
+        }
+
+        std::uint8_t operator[](std::size_t index) const
+        {
+            return data_[index];
+        }
+
+        /**
+         * Copies the bytes, the copy outlives the viewed buffer.
+         */
+        std::vector<std::uint8_t> to_vector() const
+        {
+            return std::vector<std::uint8_t>(begin(), end());
+        }
+
+        bool operator==(const ByteView& other) const
+        {
+            return size_ == other.size_ && (size_ == 0 || std::memcmp(data_, other.data_, size_) == 0);
+        }
+
+        bool operator!=(const ByteView& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        const std::uint8_t* data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+
+}
+
+#endif
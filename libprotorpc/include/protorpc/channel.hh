@@ -3,14 +3,33 @@
 
 #include <memory>
 #include <deque>
+#include <chrono>
+#include <map>
+#include <set>
+#include <tuple>
+#include <functional>
 #include <unordered_map>
-#include <unordered_set>
 #include "protoipc/port.hh"
 #include "protorpc/message.hh"
+#include "protorpc/serializer.hh"
 #include "protorpc/rpcobject.hh"
+#include "protorpc/object_table.hh"
 
 namespace rpc
 {
+    /**
+     * Limits applied when unidirectional messages are packed together in a
+     * single ipc frame.
+     */
+    struct BatchingPolicy
+    {
+        // Maximum time a message can stay in the batch before being sent.
+        std::chrono::microseconds max_delay{200};
+
+        // Maximum number of rpc messages packed in one ipc frame.
+        std::size_t max_batch_size = 64;
+    };
+
     class Channel
     {
     public:
@@ -21,7 +40,14 @@ namespace rpc
             rpc::Message message;
         };
 
+        /**
+         * Called with the reply of a request sent with send_request_async().
+         * The reply is empty if the error is not ChannelError::Ok.
+         */
+        using CompletionHandler = std::function<void(ChannelError error, rpc::Message& reply)>;
+
         Channel(PortId port_id, ipc::Port port);
+        ~Channel();
 
         /**
          * Binds a receiver to the current channel and return its id.
@@ -29,12 +55,42 @@ namespace rpc
         template <typename T, typename... Ts>
         ObjectId bind(Ts&&... args)
         {
-            next_id_();
             Receiver<T> object = std::make_shared<T>(std::forward<Ts>(args)...);
-            receivers_[current_id_] = object;
-            allocated_objects_.emplace(current_id_);
+            return objects_.allocate(std::move(object));
+        }
 
-            return current_id_;
+        /**
+         * Binds a receiver which is unbound once every proxy connected to it
+         * has been destroyed. The object stays bound until a first proxy is
+         * connected.
+         */
+        template <typename T, typename... Ts>
+        ObjectId bind_refcounted(Ts&&... args)
+        {
+            Receiver<T> object = std::make_shared<T>(std::forward<Ts>(args)...);
+            return objects_.allocate(std::move(object), true);
+        }
+
+        /**
+         * Removes an object from the channel. Messages still in flight for it
+         * are dropped. Returns false if the id is stale.
+         */
+        bool unbind(ObjectId id);
+
+        /**
+         * Returns true if the id refers to an object bound to this channel.
+         */
+        bool is_bound(ObjectId id) const
+        {
+            return objects_.contains(id);
+        }
+
+        /**
+         * Number of remote proxies connected to a reference counted object.
+         */
+        std::uint64_t reference_count(ObjectId id) const
+        {
+            return objects_.references(id);
         }
 
         /**
@@ -45,64 +101,494 @@ namespace rpc
         void bind_static(ObjectId id, Ts&&... args)
         {
             Receiver<T> object = std::make_shared<T>(std::forward<Ts>(args)...);
-            receivers_[id] = object;
-            allocated_objects_.emplace(id);
+            objects_.insert(id, std::move(object));
         }
 
         /**
-         * Binds a proxy to the current channel.
+         * Binds a proxy to the current channel. A proxy of a reference counted
+         * object holds a reference to it until its destruction.
          */
         template <typename T>
         Proxy<T> connect(PortId remote_port, ObjectId remote_id)
         {
-            next_id_();
-            Proxy<T> object = std::make_shared<T>(this, current_id_, remote_port, remote_id);
-            allocated_objects_.emplace(current_id_);
+            ObjectId id = objects_.allocate();
+            Proxy<T> object = std::make_shared<T>(this, id, remote_port, remote_id);
+
+            if (ObjectTable::is_refcounted(remote_id))
+                acquire_(id, remote_port, remote_id);
+
             return object;
         }
 
+        /**
+         * Binds a multi-proxy sending its calls to every target.
+         */
+        template <typename T>
+        MultiProxy<T> connect_multi(std::vector<RemoteObject> targets)
+        {
+            ObjectId id = objects_.allocate();
+
+            for (const RemoteObject& target : targets)
+            {
+                if (ObjectTable::is_refcounted(target.object))
+                    acquire_(id, target.port, target.object);
+            }
+
+            return std::make_shared<T>(this, id, std::move(targets));
+        }
+
+        /**
+         * Frees the id of a destroyed proxy. Its reference to the remote object
+         * is dropped with the next flush(): releases of several proxies are
+         * sent together, after the messages the proxies sent before.
+         */
+        void release_proxy(ObjectId proxy);
+
+        /**
+         * Serializer for the payload of the next message, returned empty.
+         * Its buffer is recycled from the messages sent by the channel, it
+         * keeps its capacity from one message to the next. Must not be held
+         * across calls to the channel.
+         */
+        Serializer& payload_serializer()
+        {
+            payload_.clear();
+            return payload_;
+        }
+
         /**
          * Handles the event loop.
          */
         void loop();
 
         /**
-         * Send an unidirectional message to a remote object.
+         * Native handle to watch for readability when the channel is driven
+         * by an external event loop.
+         */
+        int handle() const
+        {
+            return port_.handle();
+        }
+
+        /**
+         * Reads every message currently available on the port without
+         * blocking, then dispatches them. Returns the number of dispatched
+         * messages.
+         */
+        std::size_t poll_once();
+
+        /**
+         * Dispatches the messages already received to their receivers or
+         * completion handlers without reading from the port. Returns the
+         * number of dispatched messages.
+         */
+        std::size_t dispatch_pending();
+
+        /**
+         * Reads every frame currently available on the port without blocking
+         * and without dispatching. Control messages such as invalidations take
+         * effect immediately, other messages wait for dispatch_pending().
+         */
+        void receive_pending();
+
+        /**
+         * Send an unidirectional message to a remote object. The payload is
+         * consumed, its buffer goes back to payload_serializer().
          */
         bool send_message(PortId remote_port, rpc::Message& msg);
 
         /**
          * Sends a bidirectional message to a remote object. Blocks the event loop while
-         * waiting for an answer.
+         * waiting for an answer. If the message has a deadline and no answer arrived in
+         * time, the request is cancelled and last_error() is ChannelError::Timeout.
          */
         bool send_request(PortId remote_port, rpc::Message& msg, rpc::Message& result);
 
-    private:
         /**
-         * Advance to the next available id.
+         * Reserves a request id. Needed when state tied to the request (such as
+         * streams) must exist before the request is sent.
+         */
+        std::uint64_t allocate_request_id()
+        {
+            return next_request_id_++;
+        }
+
+        /**
+         * First half of send_request(): sends the request, assigning it an id
+         * if it has none, without waiting for the answer.
+         */
+        bool start_request(PortId remote_port, rpc::Message& msg);
+
+        /**
+         * Second half of send_request(): waits for the answer of a request sent
+         * with start_request().
+         */
+        bool wait_reply(PortId remote_port, rpc::Message& msg, rpc::Message& result);
+
+        /**
+         * Sends a bidirectional message without waiting for the answer. The
+         * handler is called from loop(), poll_once() or dispatch_pending()
+         * once the reply has arrived, or once the deadline of the message has
+         * passed. The request id is stored in the message.
+         */
+        bool send_request_async(PortId remote_port, rpc::Message& msg, CompletionHandler handler);
+
+        /**
+         * Called with each answer of a gathered request and the index of the
+         * target which sent it. Returns false to reject an invalid answer.
+         */
+        using GatherHandler = std::function<bool(std::size_t target, rpc::Message& reply)>;
+
+        /**
+         * Sends a copy of the request to every target in one burst, then
+         * handles the answers in their arrival order until `needed` of them
+         * were accepted, until too few targets are left for that, or until
+         * the deadline of the message. The requests still pending are
+         * cancelled. Returns the number of accepted answers.
+         */
+        std::size_t gather(const std::vector<RemoteObject>& targets, rpc::Message& msg,
+                std::size_t needed, const GatherHandler& handler);
+
+        /**
+         * Sends a copy of an unidirectional message to every target.
+         */
+        bool scatter(const std::vector<RemoteObject>& targets, rpc::Message& msg);
+
+        /**
+         * Gives up on an asynchronous request. Its handler is called with
+         * ChannelError::Cancelled and the receiver drops the request if it did
+         * not start handling it yet.
+         */
+        bool cancel(std::uint64_t request_id);
+
+        /**
+         * Earliest deadline of the pending asynchronous requests and of the
+         * current batch, zero if there is none. External event loops should
+         * call poll_once() by then.
+         */
+        std::uint64_t next_deadline() const;
+
+        /**
+         * Reason of the failure of the last request.
+         */
+        ChannelError last_error() const
+        {
+            return last_error_;
+        }
+
+        /**
+         * Holds back unidirectional messages until uncork() or flush() is
+         * called. Messages are packed in as few ipc frames as possible.
+         */
+        void cork();
+
+        /**
+         * Stops holding back messages and sends the pending ones.
+         */
+        bool uncork();
+
+        /**
+         * Sends the messages held back by cork() or by the batching mode.
+         */
+        bool flush();
+
+        /**
+         * Enables automatic batching of unidirectional messages. A message sent
+         * on an idle channel leaves immediately, messages following it closely
+         * are packed together until the policy limits are reached. Pending
+         * messages are also flushed before any blocking operation.
+         */
+        void enable_batching(BatchingPolicy policy = BatchingPolicy());
+
+        /**
+         * Disables automatic batching and sends the pending messages.
+         */
+        bool disable_batching();
+
+        /**
+         * Stream primitives used by rpc::StreamReader and rpc::StreamWriter.
+         * A stream is identified by the remote port, the id of the request
+         * which opened it and the side which allocated that id. Elements are
+         * sent in chunks, each consuming credits granted by the reader as it
+         * makes progress.
+         */
+
+        /**
+         * Starts accepting chunks of an incoming stream.
+         */
+        void open_inbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin);
+
+        /**
+         * Allows the writer of an incoming stream to send more elements.
+         */
+        bool grant_stream_credits(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+                std::uint64_t credits);
+
+        /**
+         * Waits for the next chunk of an incoming stream. Returns false once
+         * the stream has ended, success is then set to the writer status.
          */
-        void next_id_();
+        bool receive_stream_chunk(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+                std::vector<std::uint8_t>& chunk, bool* success);
+
+        /**
+         * Stops receiving an incoming stream, asking the writer to stop if it
+         * has not ended yet.
+         */
+        void close_inbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin);
+
+        /**
+         * Starts sending a stream with the given initial credits.
+         */
+        void open_outbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+                std::uint64_t credits);
+
+        /**
+         * Waits until the reader grants credits. Returns the available credits,
+         * zero if the reader gave up on the stream.
+         */
+        std::uint64_t wait_stream_credits(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin);
+
+        /**
+         * Sends a chunk of serialized elements, consuming one credit each.
+         */
+        bool send_stream_chunk(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+                std::vector<std::uint8_t>&& chunk, std::uint64_t count);
+
+        /**
+         * Ends an outgoing stream.
+         */
+        bool close_outbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+                bool success);
+
+        /**
+         * Invalidation epoch of a remote object. Proxies compare it with the
+         * epoch of their cached results.
+         */
+        std::uint64_t cache_epoch(PortId remote_port, ObjectId remote_id) const
+        {
+            auto it = cache_epochs_.find(CacheKey(remote_port, remote_id));
+            return it == cache_epochs_.end() ? 0 : it->second;
+        }
+
+        /**
+         * Records that a port may cache results of the given object. Called
+         * by the generated receivers of @cacheable methods.
+         */
+        void add_cache_subscriber(ObjectId object, PortId remote_port)
+        {
+            cache_subscribers_[object].insert(remote_port);
+        }
 
+        /**
+         * Tells every port which cached results of the object that they are
+         * stale. Must be called after the state of the object changed.
+         */
+        bool invalidate(ObjectId object);
+
+    private:
         PortId port_id_;
         ipc::Port port_;
-        ObjectId current_id_ = 0;
 
-        std::unordered_map<ObjectId, std::shared_ptr<RpcReceiver>> receivers_;
+        /**
+         * Receivers and proxies bound to this channel. Ids of released objects
+         * become stale and are rejected on dispatch.
+         */
+        ObjectTable objects_;
+
+        /**
+         * Returns the next rpc message, reading a new frame from the port if
+         * no decoded message is available. Gives up once the deadline has
+         * passed, zero waits forever. Returns false on timeout.
+         */
+        bool next_message_before_(std::uint64_t deadline, PendingRpcMessage& pending);
+
+        /**
+         * Handles a message addressed to the channel itself.
+         */
+        void handle_control_(PortId source_port, rpc::Message& msg);
+
+        /**
+         * Tells the remote channel that a proxy references one of its objects.
+         */
+        void acquire_(ObjectId proxy, PortId remote_port, ObjectId remote_id);
+
+        /**
+         * Adds the pending releases to the current batch.
+         */
+        bool batch_releases_();
+
+        /**
+         * Drops the references listed in a release message, unbinding the
+         * objects which lost their last one.
+         */
+        void handle_release_(rpc::Message& msg);
+
+        /**
+         * Asks the remote channel to drop a request, or only a stream when
+         * its id was allocated by the remote channel.
+         */
+        bool send_cancel_(PortId remote_port, std::uint64_t request_id,
+                StreamOrigin origin = StreamOrigin::Local);
 
         /**
-         * Keeps the id of all allocated objects. Needed for computing the next available
-         * id.
+         * Fails the asynchronous requests whose deadline has passed.
          */
-        std::unordered_set<ObjectId> allocated_objects_;
+        void expire_completions_();
 
         /**
-         * Extracts the payload from the ipc message and does preprocessing on the
-         * rpc message (swapping source and destination object ids).
+         * Reads an ipc frame, extracts the rpc messages it contains and does
+         * preprocessing on them (swapping source and destination object ids).
          */
-        PendingRpcMessage next_message_();
+        void receive_frame_();
+
+        /**
+         * Sends a single rpc message in its own ipc frame.
+         */
+        bool send_frame_(PortId remote_port, rpc::Message& msg);
+
+        /**
+         * Same as send_frame_(), then recycles the payload of the message.
+         */
+        bool send_unbatched_(PortId remote_port, rpc::Message& msg);
+
+        /**
+         * Adds a message to the current batch, flushing it first if the
+         * message cannot be part of it.
+         */
+        bool batch_message_(PortId remote_port, rpc::Message& msg);
+
+        /**
+         * Reads a single frame from the port and queues its messages for
+         * dispatch. Used while waiting on stream progress.
+         */
+        void pump_();
+
+        /**
+         * Returns true if the message is the reply to the given request. The
+         * reply is addressed to the proxy which sent the request.
+         */
+        static bool is_reply_(const PendingRpcMessage& pending, std::uint64_t request_id, ObjectId proxy);
+
+        /**
+         * Hands a single message to its completion handler or receiver.
+         */
+        void dispatch_(PendingRpcMessage& pending);
+
+        struct PendingCompletion
+        {
+            ObjectId proxy;
+            PortId remote_port;
+            std::uint64_t deadline;
+            CompletionHandler handler;
+        };
+
+        ChannelError last_error_ = ChannelError::Ok;
+
+        std::uint64_t next_request_id_ = 1;
+
+        using StreamKey = std::tuple<PortId, std::uint64_t, StreamOrigin>;
+
+        struct InboundStream
+        {
+            std::deque<std::vector<std::uint8_t>> chunks;
+            bool ended = false;
+            bool success = false;
+        };
+
+        struct OutboundStream
+        {
+            std::uint64_t credits = 0;
+            bool cancelled = false;
+        };
+
+        std::map<StreamKey, InboundStream> inbound_streams_;
+        std::map<StreamKey, OutboundStream> outbound_streams_;
+
+        using CacheKey = std::pair<PortId, ObjectId>;
+
+        // Invalidations received, by remote object
+        std::map<CacheKey, std::uint64_t> cache_epochs_;
+
+        // Ports which may cache results, by local object
+        std::unordered_map<ObjectId, std::set<PortId>> cache_subscribers_;
+
+        // Reference counted remote objects referenced by the live proxies, by
+        // proxy id.
+        std::unordered_map<ObjectId, std::vector<std::pair<PortId, ObjectId>>> references_;
+
+        // Remote objects whose proxies were destroyed, by port. Sent by flush().
+        std::unordered_map<PortId, std::vector<ObjectId>> pending_releases_;
+
+        // Receivers unbound while a message was being handled, destroyed once
+        // the handler returns since it may be one of them.
+        std::vector<std::shared_ptr<RpcReceiver>> unbound_;
+        std::size_t dispatch_depth_ = 0;
+
+        /**
+         * Asynchronous requests waiting for their reply, by request id.
+         */
+        std::unordered_map<std::uint64_t, PendingCompletion> completions_;
 
         std::deque<PendingRpcMessage> message_queue_;
+
+        /**
+         * Messages decoded from received frames but not yet handled.
+         */
+        std::deque<PendingRpcMessage> incoming_;
+
+        // See payload_serializer().
+        Serializer payload_;
+
+        // Encodes the frames sent one at a time, keeping its capacity.
+        Serializer frame_;
+
+        bool corked_ = false;
+        bool batching_ = false;
+        BatchingPolicy batching_policy_;
+
+        // Current batch: all messages share the same destination port.
+        Serializer batch_;
+        PortId batch_port_ = 0;
+        std::size_t batch_count_ = 0;
+        std::size_t batch_handle_count_ = 0;
+        std::chrono::steady_clock::time_point batch_start_;
+        std::chrono::steady_clock::time_point last_flush_;
     };
+
+    inline RpcProxy::~RpcProxy()
+    {
+        channel_->release_proxy(id_);
+    }
+
+    inline ChannelError RpcProxy::last_error() const
+    {
+        return channel_->last_error();
+    }
+
+    inline RpcMultiProxy::~RpcMultiProxy()
+    {
+        channel_->release_proxy(id_);
+    }
+
+    inline ChannelError RpcMultiProxy::last_error() const
+    {
+        return channel_->last_error();
+    }
+
+    template <typename F>
+    bool RpcMultiProxy::gather_(rpc::Message& msg, F&& handler)
+    {
+        std::size_t needed = policy_.needed(targets_.size());
+
+        last_reply_count_ = channel_->gather(targets_, msg, needed, std::forward<F>(handler));
+        return last_reply_count_ >= needed;
+    }
+
+    inline bool RpcMultiProxy::scatter_(rpc::Message& msg)
+    {
+        return channel_->scatter(targets_, msg);
+    }
 }
 
 #endif
@@ -0,0 +1,382 @@
+#ifndef RPC_ENCODING_HH
+#define RPC_ENCODING_HH
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+namespace rpc
+{
+
+    /**
+     * Opt-in encodings of integer vectors, selected with @encoding(...) on a
+     * SIDL declaration. The length of an encoded vector is a varint instead
+     * of a size_t. libcprotorpc implements the same formats.
+     */
+    enum class Encoding
+    {
+        // LEB128 of each value, for small unsigned values.
+        Varint,
+
+        // LEB128 of the zigzag of each value, for small signed values.
+        Zigzag,
+
+        // Zigzag LEB128 of the difference with the previous value, for
+        // sorted or slowly changing values such as timestamps.
+        Delta,
+
+        // Frame of reference: the minimum, then the offsets of every value
+        // from it packed on as few bits as the largest one needs.
+        BitPack,
+    };
+
+    template <typename T>
+    constexpr bool is_encodable_v = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+namespace encoding
+{
+
+    /**
+     * Largest varint needed by an element of type T. Zigzagged values and
+     * differences take one more bit than T.
+     */
+    template <typename T>
+    constexpr std::size_t max_varint_size_v = (sizeof(T) * 8 + 1 + 6) / 7;
+
+    constexpr std::size_t MAX_VARINT_SIZE = max_varint_size_v<std::uint64_t>;
+
+    inline std::size_t write_varint(std::uint8_t* out, std::uint64_t value)
+    {
+        std::size_t size = 0;
+
+        while (value >= 0x80)
+        {
+            out[size++] = static_cast<std::uint8_t>(value) | 0x80;
+            value >>= 7;
+        }
+
+        out[size++] = static_cast<std::uint8_t>(value);
+        return size;
+    }
+
+    /**
+     * Decodes a varint from [*in, end) and advances *in past it. Returns
+     * false if it is truncated or longer than 64 bits.
+     */
+    inline bool read_varint(const std::uint8_t** in, const std::uint8_t* end, std::uint64_t* value)
+    {
+        const std::uint8_t* p = *in;
+        std::uint64_t result = 0;
+
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            if (p == end)
+                return false;
+
+            std::uint8_t byte = *p++;
+            result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+            if (!(byte & 0x80))
+            {
+                *in = p;
+                *value = result;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline std::size_t varint_size(std::uint64_t value)
+    {
+        std::size_t size = 1;
+
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            size++;
+        }
+
+        return size;
+    }
+
+    inline std::uint64_t zigzag(std::uint64_t value)
+    {
+        return (value << 1) ^ (0 - (value >> 63));
+    }
+
+    inline std::uint64_t unzigzag(std::uint64_t value)
+    {
+        return (value >> 1) ^ (0 - (value & 1));
+    }
+
+    /**
+     * Values are processed as 64 bits integers, sign extended if T is
+     * signed, so that differences and offsets from the minimum never
+     * overflow.
+     */
+    template <typename T>
+    std::uint64_t widen(T value)
+    {
+        if constexpr (std::is_signed_v<T>)
+            return static_cast<std::uint64_t>(static_cast<std::int64_t>(value));
+        else
+            return static_cast<std::uint64_t>(value);
+    }
+
+    inline unsigned bit_width(std::uint64_t value)
+    {
+        return value == 0 ? 0 : 64 - __builtin_clzll(value);
+    }
+
+    /**
+     * Packs the low `bits` bits of every offset, little endian, into
+     * (count * bits + 7) / 8 bytes.
+     */
+    template <typename T>
+    void pack_bits(std::uint8_t* out, const T* values, std::size_t count, std::uint64_t min, unsigned bits)
+    {
+        std::uint64_t acc = 0;
+        unsigned filled = 0;
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::uint64_t offset = widen(values[i]) - min;
+
+            acc |= offset << filled;
+            filled += bits;
+
+            if (filled >= 64)
+            {
+                std::memcpy(out, &acc, sizeof(acc));
+                out += sizeof(acc);
+                filled -= 64;
+
+                // High bits of the offset which did not fit
+                acc = filled ? offset >> (bits - filled) : 0;
+            }
+        }
+
+        std::memcpy(out, &acc, (filled + 7) / 8);
+    }
+
+    template <typename T>
+    void unpack_bits(T* out, const std::uint8_t* in, const std::uint8_t* end, std::size_t count, std::uint64_t min, unsigned bits)
+    {
+        std::uint64_t mask = bits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+        std::uint64_t acc = 0;
+        unsigned available = 0;
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::uint64_t offset;
+
+            if (available >= bits)
+            {
+                offset = acc & mask;
+                acc = bits == 64 ? 0 : acc >> bits;
+                available -= bits;
+            }
+            else
+            {
+                std::uint64_t word = 0;
+                std::memcpy(&word, in, std::min<std::size_t>(sizeof(word), end - in));
+                in += sizeof(word);
+
+                unsigned used = bits - available;
+                offset = (acc | (word << available)) & mask;
+                acc = used == 64 ? 0 : word >> used;
+                available = 64 - used;
+            }
+
+            out[i] = static_cast<T>(min + offset);
+        }
+    }
+
+    /**
+     * Number of bytes written by encode().
+     */
+    template <typename T>
+    std::size_t encoded_size(const T* values, std::size_t count, Encoding encoding)
+    {
+        std::size_t size = varint_size(count);
+        std::uint64_t previous = 0;
+
+        switch (encoding)
+        {
+        case Encoding::Varint:
+            for (std::size_t i = 0; i < count; i++)
+                size += varint_size(static_cast<std::make_unsigned_t<T>>(values[i]));
+            break;
+        case Encoding::Zigzag:
+            for (std::size_t i = 0; i < count; i++)
+                size += varint_size(zigzag(widen(values[i])));
+            break;
+        case Encoding::Delta:
+            for (std::size_t i = 0; i < count; i++)
+            {
+                size += varint_size(zigzag(widen(values[i]) - previous));
+                previous = widen(values[i]);
+            }
+            break;
+        case Encoding::BitPack:
+            if (count > 0)
+            {
+                auto [min, max] = std::minmax_element(values, values + count);
+                unsigned bits = std::max(1u, bit_width(widen(*max) - widen(*min)));
+
+                size += varint_size(zigzag(widen(*min))) + 1 + (count * bits + 7) / 8;
+            }
+            break;
+        }
+
+        return size;
+    }
+
+    /**
+     * Appends the encoding of `count` values to `out`.
+     */
+    template <typename T>
+    void encode(std::vector<std::uint8_t>& out, const T* values, std::size_t count, Encoding encoding)
+    {
+        static_assert(is_encodable_v<T>, "Only integer vectors can be encoded");
+
+        std::size_t start = out.size();
+        std::size_t bound = MAX_VARINT_SIZE * 2 + 1;
+
+        if (encoding == Encoding::BitPack)
+            bound += count * sizeof(T);
+        else
+            bound += count * max_varint_size_v<T>;
+
+        out.resize(start + bound);
+
+        std::uint8_t* begin = out.data() + start;
+        std::uint8_t* p = begin + write_varint(begin, count);
+        std::uint64_t previous = 0;
+
+        switch (encoding)
+        {
+        case Encoding::Varint:
+            for (std::size_t i = 0; i < count; i++)
+                p += write_varint(p, static_cast<std::make_unsigned_t<T>>(values[i]));
+            break;
+        case Encoding::Zigzag:
+            for (std::size_t i = 0; i < count; i++)
+                p += write_varint(p, zigzag(widen(values[i])));
+            break;
+        case Encoding::Delta:
+            for (std::size_t i = 0; i < count; i++)
+            {
+                p += write_varint(p, zigzag(widen(values[i]) - previous));
+                previous = widen(values[i]);
+            }
+            break;
+        case Encoding::BitPack:
+            if (count > 0)
+            {
+                // At least a bit per value, a corrupted count then cannot make
+                // the decoder allocate more than 8 values per byte.
+                auto [min, max] = std::minmax_element(values, values + count);
+                unsigned bits = std::max(1u, bit_width(widen(*max) - widen(*min)));
+                std::size_t packed = (count * bits + 7) / 8;
+
+                p += write_varint(p, zigzag(widen(*min)));
+                *p++ = static_cast<std::uint8_t>(bits);
+
+                pack_bits(p, values, count, widen(*min), bits);
+                p += packed;
+            }
+            break;
+        }
+
+        out.resize(start + (p - begin));
+    }
+
+    /**
+     * Decodes values from [*in, end) in place of the content of `out` and
+     * advances *in past them. Returns false on malformed input.
+     */
+    template <typename T, typename A>
+    bool decode(const std::uint8_t** in, const std::uint8_t* end, std::vector<T, A>* out, Encoding encoding)
+    {
+        static_assert(is_encodable_v<T>, "Only integer vectors can be encoded");
+
+        const std::uint8_t* p = *in;
+        std::uint64_t count = 0;
+
+        if (!read_varint(&p, end, &count))
+            return false;
+
+        std::size_t remaining = end - p;
+
+        // Every value takes at least a byte, or a bit once packed.
+        if (encoding == Encoding::BitPack ? count / 8 > remaining : count > remaining)
+            return false;
+
+        out->resize(count);
+
+        T* values = out->data();
+        std::uint64_t value = 0;
+        std::uint64_t previous = 0;
+
+        switch (encoding)
+        {
+        case Encoding::Varint:
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if (!read_varint(&p, end, &value))
+                    return false;
+
+                values[i] = static_cast<T>(value);
+            }
+            break;
+        case Encoding::Zigzag:
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if (!read_varint(&p, end, &value))
+                    return false;
+
+                values[i] = static_cast<T>(unzigzag(value));
+            }
+            break;
+        case Encoding::Delta:
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if (!read_varint(&p, end, &value))
+                    return false;
+
+                previous += unzigzag(value);
+                values[i] = static_cast<T>(previous);
+            }
+            break;
+        case Encoding::BitPack:
+            if (count > 0)
+            {
+                std::uint64_t min = 0;
+
+                if (!read_varint(&p, end, &min) || p == end)
+                    return false;
+
+                unsigned bits = *p++;
+
+                if (bits == 0 || bits > 64 || count * bits > static_cast<std::uint64_t>(end - p) * 8)
+                    return false;
+
+                unpack_bits(values, p, end, count, unzigzag(min), bits);
+                p += (count * bits + 7) / 8;
+            }
+            break;
+        }
+
+        *in = p;
+        return true;
+    }
+
+}
+
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef RPC_INSTRUMENTATION_HH
+#define RPC_INSTRUMENTATION_HH
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include "protorpc/message.hh"
+
+namespace rpc
+{
+    /**
+     * Per method statistics recorded by the code generated with
+     * `sidlcc --instrument`. Code generated without the flag does not
+     * reference any of this.
+     *
+     * Each thread records into its own counters without locking, dumps
+     * aggregate the counters of every thread which ever recorded a call. The
+     * counters of a thread are folded into shared totals when it exits, its
+     * trace events are dropped.
+     */
+    class Instrumentation
+    {
+    public:
+        static constexpr std::size_t MAX_METHODS = 1024;
+        static constexpr std::size_t HISTOGRAM_BUCKETS = 64;
+
+        // Events kept per thread for the chrome trace, older ones are
+        // overwritten.
+        static constexpr std::size_t TRACE_CAPACITY = 4096;
+
+        enum class Side
+        {
+            Proxy = 0,
+            Receiver,
+        };
+
+        enum class Phase
+        {
+            Serialize = 0,
+            Transit,
+            Handler,
+            Deserialize,
+            Count
+        };
+
+        /**
+         * Returns the id of a method, registering it on first use. The name
+         * must outlive the program (generated code uses string literals).
+         */
+        static std::size_t register_method(const char* name, Side side);
+
+        /**
+         * Records a completed call. Durations are in nanoseconds, indexed by
+         * Phase. The start time is only used by the chrome trace.
+         */
+        static void record(std::size_t method, const std::uint64_t (&durations)[static_cast<int>(Phase::Count)],
+                std::size_t request_bytes, std::size_t reply_bytes, std::uint64_t start);
+
+        /**
+         * Starts or stops collecting chrome trace events. Disabled by default.
+         */
+        static void enable_trace(bool enabled);
+
+        /**
+         * Writes the aggregated statistics as JSON. Histogram bucket i counts
+         * the durations in [2^i, 2^(i+1)) nanoseconds.
+         */
+        static void dump_json(std::ostream& out);
+
+        /**
+         * Writes the recorded calls in the chrome trace event format (for
+         * chrome://tracing or Perfetto). Threads should be idle meanwhile.
+         */
+        static void dump_chrome_trace(std::ostream& out);
+
+        /**
+         * Zeroes every counter and drops the trace events.
+         */
+        static void reset();
+    };
+
+    /**
+     * Measures a single call. Each call to phase() attributes the time spent
+     * since the previous one to a phase, the remaining time is attributed to
+     * the final phase when the probe is destroyed, on any exit path.
+     */
+    class CallProbe
+    {
+    public:
+        using Phase = Instrumentation::Phase;
+
+        CallProbe(std::size_t method, Phase final_phase)
+            : method_(method), final_phase_(final_phase), start_(deadline_now()), last_(start_)
+        {}
+
+        CallProbe(const CallProbe&) = delete;
+        CallProbe& operator=(const CallProbe&) = delete;
+
+        ~CallProbe()
+        {
+            phase(final_phase_);
+            Instrumentation::record(method_, durations_, request_bytes_, reply_bytes_, start_);
+        }
+
+        void phase(Phase phase)
+        {
+            std::uint64_t now = deadline_now();
+            durations_[static_cast<int>(phase)] += now - last_;
+            last_ = now;
+        }
+
+        void request_bytes(std::size_t size)
+        {
+            request_bytes_ = size;
+        }
+
+        void reply_bytes(std::size_t size)
+        {
+            reply_bytes_ = size;
+        }
+
+    private:
+        std::size_t method_;
+        Phase final_phase_;
+        std::uint64_t start_;
+        std::uint64_t last_;
+        std::uint64_t durations_[static_cast<int>(Phase::Count)] = {};
+        std::size_t request_bytes_ = 0;
+        std::size_t reply_bytes_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef RPC_LOADTEST_HH
+#define RPC_LOADTEST_HH
+
+#include <array>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include "protoipc/port.hh"
+#include "protoipc/router.hh"
+#include "protorpc/channel.hh"
+#include "protorpc/serializer.hh"
+#include "protorpc/unserializer.hh"
+
+namespace rpc
+{
+    /**
+     * Support code of the load generators produced by `sidlcc --loadtest`.
+     */
+
+    template <typename T>
+    struct randomizable
+    {
+        randomizable() = delete;
+    };
+
+    /*
+     * template <>
+     * struct randomizable<Object> {
+     *     // Fill every field with a random value
+     *     static void generate(Object* out, RandomGenerator& r) { ... };
+     * };
+     */
+
+    template <typename T>
+    constexpr bool is_randomizable_v = std::is_constructible_v<randomizable<T>>;
+
+    /**
+     * Produces random values of the SIDL types. Strings and vectors have up to
+     * `max_size` elements.
+     */
+    class RandomGenerator
+    {
+    public:
+        RandomGenerator(std::uint64_t seed, std::size_t max_size)
+            : engine_(seed), max_size_(max_size)
+        {}
+
+        template <typename T>
+        void generate(T* output)
+        {
+            generate_into(output);
+        }
+
+    private:
+        template <typename T>
+        std::enable_if_t<std::is_integral_v<T>>
+        generate_into(T* output)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+                *output = engine_() & 1;
+            else
+                *output = static_cast<T>(engine_());
+        }
+
+        template <typename Traits, typename A>
+        void generate_into(std::basic_string<char, Traits, A>* output)
+        {
+            output->resize(size_());
+
+            for (char& c : *output)
+                c = 'a' + engine_() % 26;
+        }
+
+        template <typename T, typename A>
+        void generate_into(std::vector<T, A>* output)
+        {
+            std::size_t size = size_();
+            output->clear();
+
+            for (std::size_t i = 0; i < size; i++)
+            {
+                T element;
+                generate(&element);
+                output->push_back(std::move(element));
+            }
+        }
+
+        template <typename T, std::size_t N>
+        void generate_into(std::array<T, N>* output)
+        {
+            for (T& e : *output)
+                generate(&e);
+        }
+
+        template <typename T>
+        void generate_into(std::optional<T>* output)
+        {
+            if (engine_() & 1)
+            {
+                T element;
+                generate(&element);
+                *output = std::move(element);
+            }
+            else
+            {
+                *output = std::nullopt;
+            }
+        }
+
+        template <typename T>
+        std::enable_if_t<is_randomizable_v<T>>
+        generate_into(T* output)
+        {
+            randomizable<T>::generate(output, *this);
+        }
+
+        std::size_t size_()
+        {
+            return engine_() % (max_size_ + 1);
+        }
+
+        std::mt19937_64 engine_;
+        std::size_t max_size_;
+    };
+
+    /**
+     * Arguments of a call issued by the load generator.
+     */
+    struct RecordedCall
+    {
+        std::uint64_t opcode;
+        std::vector<std::uint8_t> arguments;
+    };
+
+    bool load_recorded_calls(const std::string& path, std::vector<RecordedCall>* calls);
+    bool save_recorded_calls(const std::string& path, const std::vector<RecordedCall>& calls);
+
+    /**
+     * Provides the arguments of the calls, either random or replayed from a
+     * recording. Generated arguments can be recorded to replay the exact same
+     * load later on.
+     */
+    class ArgumentSource
+    {
+    public:
+        ArgumentSource(std::uint64_t seed, std::size_t max_size)
+            : random_(seed, max_size)
+        {}
+
+        /**
+         * Starts the arguments of a new call, decoded from `replayed` if it is
+         * not null. `replayed` is borrowed until the next call to begin().
+         */
+        void begin(const std::vector<std::uint8_t>* replayed, bool record)
+        {
+            if (replayed)
+                replay_.emplace(*replayed);
+            else
+                replay_.reset();
+
+            record_.get_payload();
+            recording_ = record;
+        }
+
+        template <typename T>
+        bool next(T* value)
+        {
+            if (replay_)
+            {
+                if (!replay_->unserialize(value))
+                    return false;
+            }
+            else
+            {
+                random_.generate(value);
+            }
+
+            if (recording_)
+                record_.serialize(*value);
+
+            return true;
+        }
+
+        /**
+         * Arguments of the current call, encoded as the proxy sends them.
+         */
+        std::vector<std::uint8_t> recorded()
+        {
+            return record_.get_payload();
+        }
+
+    private:
+        RandomGenerator random_;
+        std::optional<Unserializer> replay_;
+        Serializer record_;
+        bool recording_ = false;
+    };
+
+    struct LoadTestOptions
+    {
+        // Interface to load, the first one of the file if empty.
+        std::string interface;
+
+        // Method to call, every supported method if empty.
+        std::string method;
+
+        std::size_t threads = 1;
+        std::chrono::milliseconds duration{5000};
+
+        // Calls per second over all the threads. Zero runs a closed loop where
+        // each thread issues its next call as soon as the previous one returns.
+        double rate = 0;
+
+        std::uint64_t seed = 1;
+        std::size_t max_size = 16;
+
+        std::string record_path;
+        std::string replay_path;
+
+        // Router traffic capture, see ipc::Router::set_capture().
+        std::string capture_path;
+
+        /**
+         * Parses the command line. Prints the usage and returns false on
+         * error.
+         */
+        bool parse(int argc, char** argv);
+    };
+
+    struct LoadTestMethod
+    {
+        const char* name;
+        std::uint64_t opcode;
+    };
+
+    /**
+     * Runs a router connecting a server channel to one client channel per
+     * thread, then drives the load and prints the throughput and the latency
+     * percentiles of every method.
+     */
+    class LoadTestDriver
+    {
+    public:
+        /**
+         * Issues a call of methods[method] from the given client thread.
+         * Returns false if the call failed.
+         */
+        using Call = std::function<bool(std::size_t thread, std::size_t method, ArgumentSource& args)>;
+
+        LoadTestDriver(const LoadTestOptions& options);
+        ~LoadTestDriver();
+
+        LoadTestDriver(const LoadTestDriver&) = delete;
+        LoadTestDriver& operator=(const LoadTestDriver&) = delete;
+
+        Channel& server()
+        {
+            return *server_;
+        }
+
+        PortId server_port() const
+        {
+            return server_port_;
+        }
+
+        Channel& client(std::size_t thread)
+        {
+            return *clients_[thread];
+        }
+
+        /**
+         * Runs the load. Returns the exit status of the load generator.
+         */
+        int run(const char* interface, const std::vector<LoadTestMethod>& methods, const Call& call);
+
+    private:
+        void stop_();
+
+        LoadTestOptions options_;
+
+        ipc::Router router_;
+        ipc::CaptureWriter capture_;
+        std::vector<ipc::Port> ports_;
+        ipc::Port control_;
+
+        PortId server_port_ = 0;
+        std::unique_ptr<Channel> server_;
+        std::vector<std::unique_ptr<Channel>> clients_;
+
+        std::thread router_thread_;
+        std::thread server_thread_;
+        std::atomic<bool> stop_server_{false};
+    };
+
+    /**
+     * Calls a method of proxy P with arguments taken from an ArgumentSource.
+     * Generated for every method the load generator supports.
+     */
+    template <typename P>
+    struct LoadTestCall
+    {
+        const char* name;
+        std::uint64_t opcode;
+        bool (*call)(P& proxy, ArgumentSource& args);
+    };
+
+    /**
+     * Loads the interface of proxy P, served by a receiver of type R.
+     */
+    template <typename P, typename R>
+    int run_load_test(const LoadTestOptions& options, const char* interface, const std::vector<LoadTestCall<P>>& calls)
+    {
+        LoadTestDriver driver(options);
+        ObjectId receiver = driver.server().bind<R>();
+
+        std::vector<Proxy<P>> proxies;
+        std::vector<LoadTestMethod> methods;
+
+        for (std::size_t i = 0; i < options.threads; i++)
+            proxies.push_back(driver.client(i).connect<P>(driver.server_port(), receiver));
+
+        for (const LoadTestCall<P>& call : calls)
+            methods.push_back(LoadTestMethod{ call.name, call.opcode });
+
+        return driver.run(interface, methods, [&](std::size_t thread, std::size_t method, ArgumentSource& args) {
+            return calls[method].call(*proxies[thread], args);
+        });
+    }
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define RPC_MESSAGE_HH
 
 #include <vector>
+#include <chrono>
 #include <cstdint>
 
 namespace rpc
@@ -18,12 +19,98 @@ namespace rpc
         // Operation on the object
         std::uint64_t opcode;
 
+        // Identifier of the request, echoed by its reply. Zero for
+        // unidirectional messages.
+        std::uint64_t request_id = 0;
+
+        // Time after which the request is not worth handling anymore, see
+        // deadline_after(). Zero when there is no deadline.
+        std::uint64_t deadline = 0;
+
         // rpc message content
         std::vector<std::uint8_t> payload;
 
         // File descriptors
         std::vector<int> handles;
     };
+
+    /**
+     * Destination object of messages handled by the channel itself instead of
+     * a bound receiver.
+     */
+    constexpr std::uint64_t CONTROL_OBJECT = UINT64_MAX;
+
+    enum class ControlOpcode : std::uint64_t
+    {
+        // Several rpc messages packed in a single ipc frame.
+        Batch = 0,
+
+        // The sender gave up on a request, payload is its request id. Also
+        // stops the streams opened by the request. Sent for a stream alone
+        // when the source is StreamOrigin::Remote.
+        Cancel = 1,
+
+        // Chunk of stream elements: element count followed by the elements.
+        StreamData = 2,
+
+        // End of a stream, payload is the success status of the writer.
+        StreamEnd = 3,
+
+        // The reader accepts more elements, payload is the element count.
+        StreamCredit = 4,
+
+        // Results cached for the source object are stale.
+        Invalidate = 5,
+
+        // A proxy was connected to a reference counted object, payload is the
+        // object id.
+        Acquire = 6,
+
+        // Proxies of reference counted objects were destroyed, payload is the
+        // list of object ids, one per proxy.
+        Release = 7,
+    };
+
+    /**
+     * Side which allocated the id of a stream. Stream ids are request ids,
+     * which are only unique on the side allocating them: both peers may use
+     * the same id for unrelated streams. Control messages about a stream
+     * carry the origin seen by their sender in their source field.
+     */
+    enum class StreamOrigin : std::uint64_t
+    {
+        Local = 0,
+        Remote = 1,
+    };
+
+    /**
+     * Origin of a stream as seen by the other end.
+     */
+    inline StreamOrigin peer_origin(StreamOrigin origin)
+    {
+        return origin == StreamOrigin::Local ? StreamOrigin::Remote : StreamOrigin::Local;
+    }
+
+    /**
+     * Deadlines are absolute times of the steady clock in nanoseconds. On
+     * linux it is CLOCK_MONOTONIC, which is shared by all processes of the
+     * host.
+     */
+    inline std::uint64_t deadline_now()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
+
+    inline std::uint64_t deadline_after(std::chrono::nanoseconds timeout)
+    {
+        return deadline_now() + timeout.count();
+    }
+
+    inline bool deadline_expired(std::uint64_t deadline)
+    {
+        return deadline != 0 && deadline_now() >= deadline;
+    }
 }
 
 #endif
@@ -0,0 +1,153 @@
+#ifndef RPC_OBJECT_TABLE_HH
+#define RPC_OBJECT_TABLE_HH
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "protorpc/rpcobject.hh"
+
+namespace rpc
+{
+    /**
+     * Dense slot map holding the objects of a channel.
+     *
+     * An ObjectId packs a slot index (low 32 bits), the generation of the
+     * slot (next 31 bits) and whether the object is reference counted (high
+     * bit). Releasing a slot bumps its generation so that ids referring to the
+     * previous occupant are detected as stale instead of silently reaching the
+     * new one. Allocation, release and lookup are O(1).
+     */
+    class ObjectTable
+    {
+    public:
+        static constexpr std::uint32_t NO_SLOT = UINT32_MAX;
+        static constexpr std::uint32_t GENERATION_MASK = 0x7fffffff;
+
+        // Set in the ids of objects freed once their last remote reference is
+        // dropped. Proxies only report their references to these objects.
+        static constexpr ObjectId REFCOUNTED_FLAG = ObjectId(1) << 63;
+
+        static ObjectId make_id(std::uint32_t index, std::uint32_t generation, bool refcounted = false)
+        {
+            ObjectId id = (static_cast<ObjectId>(generation & GENERATION_MASK) << 32) | index;
+            return refcounted ? id | REFCOUNTED_FLAG : id;
+        }
+
+        static std::uint32_t index_of(ObjectId id)
+        {
+            return static_cast<std::uint32_t>(id);
+        }
+
+        static std::uint32_t generation_of(ObjectId id)
+        {
+            return static_cast<std::uint32_t>(id >> 32) & GENERATION_MASK;
+        }
+
+        static bool is_refcounted(ObjectId id)
+        {
+            return (id & REFCOUNTED_FLAG) && index_of(id) != NO_SLOT;
+        }
+
+        /**
+         * Allocates a new slot and returns its id. The receiver can be null
+         * for objects which do not handle messages (proxies).
+         */
+        ObjectId allocate(std::shared_ptr<RpcReceiver> receiver = nullptr, bool refcounted = false);
+
+        /**
+         * Stores an object under a caller chosen id, overwriting the previous
+         * occupant of the slot if any.
+         */
+        void insert(ObjectId id, std::shared_ptr<RpcReceiver> receiver);
+
+        /**
+         * Frees the slot of the given id. Returns false if the id is stale or
+         * was never allocated. The receiver is handed over to the caller if
+         * `receiver` is not null, destroyed otherwise.
+         */
+        bool release(ObjectId id, std::shared_ptr<RpcReceiver>* receiver = nullptr);
+
+        /**
+         * Returns true if the id refers to a live object.
+         */
+        bool contains(ObjectId id) const;
+
+        /**
+         * Returns true if the id refers to an object which has been released
+         * since, as opposed to an id which was never allocated.
+         */
+        bool is_stale(ObjectId id) const;
+
+        /**
+         * Counts a new remote reference to a live object. Returns false if the
+         * id is stale.
+         */
+        bool add_reference(ObjectId id);
+
+        /**
+         * Drops a remote reference. Returns true if the object is reference
+         * counted and this was its last reference.
+         */
+        bool remove_reference(ObjectId id);
+
+        /**
+         * Number of remote references to a live object.
+         */
+        std::uint64_t references(ObjectId id) const;
+
+        /**
+         * Returns the receiver bound to the id, or null if the id is stale,
+         * unallocated or refers to an object without receiver.
+         */
+        RpcReceiver* find(ObjectId id) const
+        {
+            std::uint32_t index = index_of(id);
+
+            if (index >= slots_.size())
+                return nullptr;
+
+            const Slot& slot = slots_[index];
+
+            if (!slot.allocated || id != make_id(index, slot.generation, slot.refcounted))
+                return nullptr;
+
+            return slot.receiver.get();
+        }
+
+        /**
+         * Number of live objects.
+         */
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+    private:
+
+        struct Slot
+        {
+            std::shared_ptr<RpcReceiver> receiver;
+            std::uint32_t generation = 0;
+
+            // Remote proxies connected to the object.
+            std::uint64_t references = 0;
+            bool refcounted = false;
+
+            // Next slot of the free list when the slot is not allocated.
+            std::uint32_t next_free = NO_SLOT;
+            bool allocated = false;
+        };
+
+        /**
+         * Removes a specific slot from the free list. Only used by insert()
+         * which is not expected to be on a hot path.
+         */
+        void unlink_free_(std::uint32_t index);
+
+        std::vector<Slot> slots_;
+        std::uint32_t free_head_ = NO_SLOT;
+        std::size_t size_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef RPC_RESULT_CACHE_HH
+#define RPC_RESULT_CACHE_HH
+
+#include <list>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+namespace rpc
+{
+    /**
+     * Bounded LRU of replies kept by proxies for @cacheable methods. Entries
+     * are keyed by the opcode and the serialized arguments.
+     *
+     * Each entry remembers the invalidation epoch of the remote object at the
+     * time the request was sent. An invalidation bumps the epoch (see
+     * Channel::cache_epoch()), which makes older entries miss.
+     */
+    class ResultCache
+    {
+    public:
+        static constexpr std::size_t DEFAULT_CAPACITY = 128;
+
+        ResultCache(std::size_t capacity = DEFAULT_CAPACITY)
+            : capacity_(capacity)
+        {}
+
+        /**
+         * Changes the maximum number of entries, evicting the least recently
+         * used ones if needed. A zero capacity disables the cache.
+         */
+        void set_capacity(std::size_t capacity);
+
+        std::size_t capacity() const
+        {
+            return capacity_;
+        }
+
+        /**
+         * Returns the cached reply payload, or null if there is no valid
+         * entry for these arguments.
+         */
+        const std::vector<std::uint8_t>* find(std::uint64_t opcode,
+                const std::vector<std::uint8_t>& arguments, std::uint64_t epoch);
+
+        /**
+         * Stores a reply payload. A zero ttl keeps the entry until it is
+         * evicted or invalidated.
+         */
+        void insert(std::uint64_t opcode, const std::vector<std::uint8_t>& arguments,
+                std::vector<std::uint8_t> result, std::uint64_t epoch, std::chrono::milliseconds ttl);
+
+        void clear()
+        {
+            entries_.clear();
+            index_.clear();
+        }
+
+        std::size_t size() const
+        {
+            return entries_.size();
+        }
+
+    private:
+        struct Entry
+        {
+            std::string key;
+            std::vector<std::uint8_t> result;
+            std::uint64_t epoch;
+
+            // steady_clock time in nanoseconds, zero if the entry never expires
+            std::uint64_t expiry;
+        };
+
+        static std::string make_key_(std::uint64_t opcode, const std::vector<std::uint8_t>& arguments);
+
+        std::size_t capacity_;
+
+        // Most recently used entry first
+        std::list<Entry> entries_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    };
+}
+
+#endif
@@ -1,13 +1,27 @@
 #ifndef RPC_RPCOBJECT_HH
 #define RPC_RPCOBJECT_HH
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
+#include <vector>
+#include <algorithm>
+#include "protorpc/message.hh"
 
 namespace rpc
 {
     class Channel;
-    struct Message;
+
+    enum class ChannelError
+    {
+        Ok = 0,
+        SendFailed,
+        Timeout,
+        Cancelled,
+
+        // Too few targets of a multi-proxy answered.
+        Incomplete,
+    };
 
     class RpcObject
     {};
@@ -22,6 +36,15 @@ namespace rpc
             : channel_(chan), id_(id), remote_port_(remote_port), remote_id_(remote_id)
         {}
 
+        /**
+         * Frees the id of the proxy and drops its reference to the remote
+         * object. The channel must outlive its proxies.
+         */
+        ~RpcProxy();
+
+        RpcProxy(const RpcProxy&) = delete;
+        RpcProxy& operator=(const RpcProxy&) = delete;
+
         PortId remote_port() const
         {
             return remote_port_;
@@ -37,6 +60,32 @@ namespace rpc
             return id_;
         }
 
+        /**
+         * Bounds the duration of the requests sent by this proxy. A zero
+         * timeout waits forever.
+         */
+        void set_timeout(std::chrono::nanoseconds timeout)
+        {
+            timeout_ = timeout;
+        }
+
+        /**
+         * Deadline of a request sent now, zero if there is no timeout.
+         */
+        std::uint64_t call_deadline() const
+        {
+            if (timeout_.count() <= 0)
+                return 0;
+
+            return deadline_after(timeout_);
+        }
+
+        /**
+         * Reason of the failure of the last request sent by the channel of
+         * this proxy.
+         */
+        ChannelError last_error() const;
+
     protected:
         Channel* channel_;
 
@@ -44,6 +93,160 @@ namespace rpc
         ObjectId id_;
         PortId remote_port_;
         ObjectId remote_id_;
+        std::chrono::nanoseconds timeout_{0};
+    };
+
+    /**
+     * Object of a remote channel, target of a multi-proxy.
+     */
+    struct RemoteObject
+    {
+        PortId port;
+        ObjectId object;
+    };
+
+    /**
+     * Number of answers a multi-proxy waits for before completing a call.
+     */
+    struct GatherPolicy
+    {
+        enum class Mode
+        {
+            // Every target answered.
+            All,
+
+            // The first `count` answers arrived.
+            First,
+
+            // A strict majority of the targets answered.
+            Quorum,
+        };
+
+        Mode mode = Mode::All;
+        std::size_t count = 0;
+
+        static GatherPolicy all()
+        {
+            return GatherPolicy{ Mode::All, 0 };
+        }
+
+        static GatherPolicy first(std::size_t count)
+        {
+            return GatherPolicy{ Mode::First, count };
+        }
+
+        static GatherPolicy quorum()
+        {
+            return GatherPolicy{ Mode::Quorum, 0 };
+        }
+
+        std::size_t needed(std::size_t targets) const
+        {
+            switch (mode)
+            {
+            case Mode::First:
+                return std::min(count, targets);
+            case Mode::Quorum:
+                return targets / 2 + 1;
+            default:
+                return targets;
+            }
+        }
+    };
+
+    /**
+     * Proxy sending every call to a set of remote objects at once. Answers
+     * are gathered as they arrive, the call completes according to the
+     * GatherPolicy.
+     */
+    class RpcMultiProxy : public RpcObject
+    {
+    public:
+        RpcMultiProxy(Channel* chan, ObjectId id, std::vector<RemoteObject> targets)
+            : channel_(chan), id_(id), targets_(std::move(targets))
+        {}
+
+        /**
+         * Frees the id of the proxy and drops its references to the remote
+         * objects. The channel must outlive its proxies.
+         */
+        ~RpcMultiProxy();
+
+        RpcMultiProxy(const RpcMultiProxy&) = delete;
+        RpcMultiProxy& operator=(const RpcMultiProxy&) = delete;
+
+        ObjectId id() const
+        {
+            return id_;
+        }
+
+        const std::vector<RemoteObject>& targets() const
+        {
+            return targets_;
+        }
+
+        void set_policy(GatherPolicy policy)
+        {
+            policy_ = policy;
+        }
+
+        GatherPolicy policy() const
+        {
+            return policy_;
+        }
+
+        /**
+         * Bounds the duration of the calls. A zero timeout waits forever,
+         * which never completes if a target is gone.
+         */
+        void set_timeout(std::chrono::nanoseconds timeout)
+        {
+            timeout_ = timeout;
+        }
+
+        std::uint64_t call_deadline() const
+        {
+            if (timeout_.count() <= 0)
+                return 0;
+
+            return deadline_after(timeout_);
+        }
+
+        /**
+         * Number of answers accepted by the last call.
+         */
+        std::size_t last_reply_count() const
+        {
+            return last_reply_count_;
+        }
+
+        /**
+         * Reason of the failure of the last request sent by the channel of
+         * this proxy.
+         */
+        ChannelError last_error() const;
+
+    protected:
+        /**
+         * Sends a request to every target and waits for the answers. The
+         * handler decodes an answer, returning false if it is invalid.
+         */
+        template <typename F>
+        bool gather_(rpc::Message& msg, F&& handler);
+
+        /**
+         * Sends an unidirectional message to every target.
+         */
+        bool scatter_(rpc::Message& msg);
+
+        Channel* channel_;
+
+    private:
+        ObjectId id_;
+        std::vector<RemoteObject> targets_;
+        GatherPolicy policy_;
+        std::chrono::nanoseconds timeout_{0};
+        std::size_t last_reply_count_ = 0;
     };
 
     class RpcReceiver : public RpcObject
@@ -63,6 +266,9 @@ namespace rpc
 
     template <typename T>
     using Proxy = std::shared_ptr<std::enable_if_t<std::is_base_of_v<RpcProxy, T>, T>>;
+
+    template <typename T>
+    using MultiProxy = std::shared_ptr<std::enable_if_t<std::is_base_of_v<RpcMultiProxy, T>, T>>;
 }
 
 #endif
@@ -1,13 +1,18 @@
 #ifndef RPC_SERIALIZER_HH
 #define RPC_SERIALIZER_HH
 
+#include <array>
 #include <vector>
 #include <string>
+#include <cstring>
 #include <cstdint>
 #include <optional>
 #include <iostream>
+#include <string_view>
 #include <typeinfo>
 #include <type_traits>
+#include "protorpc/byte_view.hh"
+#include "protorpc/encoding.hh"
 
 namespace rpc
 {
@@ -22,28 +27,233 @@ namespace rpc
      * template <>
      * struct serializable<Object> {
      *     // Serialize fields to bytes
-     *     static void serialize(Object& obj, Serializer& s) { ... };
+     *     static void serialize(const Object& obj, Serializer& s) { ... };
+     *
+     *     // Optional, number of bytes written by serialize()
+     *     static std::size_t size(const Object& obj) { ... };
      * };
      */
 
     template <typename T>
     constexpr bool is_serializable_v = std::is_constructible_v<serializable<T>>;
 
+    template <typename T, typename = void>
+    struct has_serialized_size : std::false_type
+    {};
+
+    template <typename T>
+    struct has_serialized_size<T, std::void_t<decltype(serializable<T>::size(std::declval<const T&>()))>>
+        : std::true_type
+    {};
+
+    template <typename T, typename = void>
+    struct is_packed_serializable : std::false_type
+    {};
+
+    template <typename T>
+    struct is_packed_serializable<T, std::enable_if_t<serializable<T>::packed>>
+        : std::true_type
+    {};
+
+    /**
+     * Types encoded as their memory representation: arithmetic types but
+     * bool, whose vectors are packed, and structures whose serializable
+     * specialization declares a packed layout (`static constexpr bool
+     * packed = true`, fields back to back without padding).
+     */
+    template <typename T>
+    struct is_trivially_serializable
+        : std::bool_constant<(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) || is_packed_serializable<T>::value>
+    {};
+
+    // Fixed arrays of such types, as long as std::array adds no padding.
+    template <typename T, std::size_t N>
+    struct is_trivially_serializable<std::array<T, N>>
+        : std::bool_constant<is_trivially_serializable<T>::value && sizeof(std::array<T, N>) == N * sizeof(T)>
+    {};
+
+    template <typename T>
+    constexpr bool is_trivially_serializable_v = is_trivially_serializable<T>::value;
+
+    /**
+     * Encoded size of the types whose size does not depend on their value,
+     * zero for the others.
+     */
+    template <typename T>
+    struct fixed_serialized_size
+        : std::integral_constant<std::size_t, std::is_arithmetic_v<T> || is_packed_serializable<T>::value ? sizeof(T) : 0>
+    {};
+
+    template <typename T, std::size_t N>
+    struct fixed_serialized_size<std::array<T, N>>
+        : std::integral_constant<std::size_t, N * fixed_serialized_size<T>::value>
+    {};
+
+    template <typename T>
+    constexpr std::size_t fixed_serialized_size_v = fixed_serialized_size<T>::value;
+
+    template <typename T, typename A>
+    std::size_t serialized_size(const std::vector<T, A>& v);
+
+    template <typename T, std::size_t N>
+    std::size_t serialized_size(const std::array<T, N>& a);
+
+    template <typename T>
+    std::size_t serialized_size(const std::optional<T>& obj);
+
+    /**
+     * Number of bytes written when serializing a value. Structures without
+     * a size() in their serializable specialization count as zero, the
+     * result is then only a lower bound.
+     */
+    template <typename T>
+    std::size_t serialized_size(const T& value)
+    {
+        if constexpr (std::is_arithmetic_v<T>)
+            return sizeof(T);
+        else if constexpr (has_serialized_size<T>::value)
+            return serializable<T>::size(value);
+        else
+            return 0;
+    }
+
+    template <typename Traits, typename A>
+    std::size_t serialized_size(const std::basic_string<char, Traits, A>& str)
+    {
+        return sizeof(std::size_t) + str.size();
+    }
+
+    inline std::size_t serialized_size(std::string_view str)
+    {
+        return sizeof(std::size_t) + str.size();
+    }
+
+    inline std::size_t serialized_size(const ByteView& bytes)
+    {
+        return sizeof(std::size_t) + bytes.size();
+    }
+
+    template <typename T, typename A>
+    std::size_t serialized_size(const std::vector<T, A>& v)
+    {
+        if constexpr (fixed_serialized_size_v<T> != 0)
+            return sizeof(std::size_t) + v.size() * fixed_serialized_size_v<T>;
+
+        std::size_t size = sizeof(std::size_t);
+
+        for (const T& e : v)
+            size += serialized_size(e);
+
+        return size;
+    }
+
+    // Fixed arrays are encoded without their length.
+    template <typename T, std::size_t N>
+    std::size_t serialized_size(const std::array<T, N>& a)
+    {
+        if constexpr (fixed_serialized_size_v<T> != 0)
+            return N * fixed_serialized_size_v<T>;
+
+        std::size_t size = 0;
+
+        for (const T& e : a)
+            size += serialized_size(e);
+
+        return size;
+    }
+
+    template <typename T>
+    std::size_t serialized_size(const std::optional<T>& obj)
+    {
+        return 1 + (obj ? serialized_size(*obj) : 0);
+    }
+
+    template <typename T, typename A>
+    std::size_t serialized_size(const std::vector<T, A>& v, Encoding encoding)
+    {
+        return encoding::encoded_size(v.data(), v.size(), encoding);
+    }
+
     class Serializer
     {
     public:
         template <typename T>
-        void serialize(T value)
+        void serialize(const T& value)
         {
             serialize_into(value);
         }
 
-        void serialize(void* data, std::size_t size)
+        /**
+         * Serializes an integer vector with one of the opt-in encodings.
+         */
+        template <typename T, typename A>
+        void serialize(const std::vector<T, A>& values, Encoding encoding)
         {
-            std::uint8_t* data_ptr = reinterpret_cast<std::uint8_t*>(data);
+            encoding::encode(data_, values.data(), values.size(), encoding);
+        }
+
+        void serialize(const void* data, std::size_t size)
+        {
+            const std::uint8_t* data_ptr = reinterpret_cast<const std::uint8_t*>(data);
             data_.insert(data_.end(), data_ptr, data_ptr + size);
         }
 
+        /**
+         * Overwrites bytes already serialized at `position`, to fill in a
+         * header once what follows it is known.
+         */
+        void write_at(std::size_t position, const void* data, std::size_t size)
+        {
+            std::memcpy(data_.data() + position, data, size);
+        }
+
+        /**
+         * Makes room for `size` more bytes, so that serializing values whose
+         * serialized_size() adds up to it does not reallocate.
+         */
+        void reserve(std::size_t size)
+        {
+            data_.reserve(data_.size() + size);
+        }
+
+        /**
+         * Number of bytes serialized so far.
+         */
+        std::size_t size() const
+        {
+            return data_.size();
+        }
+
+        /**
+         * Drops the serialized bytes and handles, keeping the capacity.
+         */
+        void clear()
+        {
+            data_.clear();
+            handles_.clear();
+        }
+
+        /**
+         * Takes over a buffer which is not needed anymore to serialize the
+         * next values in it without allocating. Serialized bytes are dropped.
+         */
+        void recycle(std::vector<std::uint8_t>&& buffer)
+        {
+            if (buffer.capacity() > data_.capacity())
+                data_ = std::move(buffer);
+
+            clear();
+        }
+
+        /**
+         * Exchanges the serialized bytes with a buffer. Both keep their
+         * capacity.
+         */
+        void swap_payload(std::vector<std::uint8_t>& buffer)
+        {
+            data_.swap(buffer);
+        }
+
         void add_handle(int handle)
         {
             handles_.push_back(handle);
@@ -75,30 +285,62 @@ namespace rpc
         }
 
 
-        void serialize_into(std::string str)
+        // Strings, whatever their allocator, and views share the encoding of
+        // byte vectors.
+        void serialize_into(std::string_view str)
         {
             serialize<std::size_t>(str.size());
-            data_.insert(data_.end(), str.c_str(), str.c_str() + str.size());
+            serialize(str.data(), str.size());
         }
 
-        template <typename T>
-        void serialize_into(std::vector<T> v)
+        void serialize_into(const ByteView& bytes)
         {
+            serialize<std::size_t>(bytes.size());
+            serialize(bytes.data(), bytes.size());
+        }
+
+        template <typename T, typename A>
+        void serialize_into(const std::vector<T, A>& v)
+        {
+            if constexpr (fixed_serialized_size_v<T> != 0)
+                reserve(serialized_size(v));
+
             serialize<std::size_t>(v.size());
 
-            for (auto& e : v)
+            // Elements encoded as their memory representation are copied in
+            // bulk.
+            if constexpr (is_trivially_serializable_v<T>)
+            {
+                serialize(v.data(), v.size() * sizeof(T));
+                return;
+            }
+
+            for (const T& e : v)
+                serialize<T>(e);
+        }
+
+        template <typename T, std::size_t N>
+        void serialize_into(const std::array<T, N>& a)
+        {
+            if constexpr (is_trivially_serializable_v<T>)
+            {
+                serialize(a.data(), N * sizeof(T));
+                return;
+            }
+
+            for (const T& e : a)
                 serialize<T>(e);
         }
 
         template <typename T>
         std::enable_if_t<is_serializable_v<T>>
-        serialize_into(T obj)
+        serialize_into(const T& obj)
         {
             serializable<T>::serialize(obj, *this);
         }
 
         template <typename T>
-        void serialize_into(std::optional<T> obj)
+        void serialize_into(const std::optional<T>& obj)
         {
             if (obj)
             {
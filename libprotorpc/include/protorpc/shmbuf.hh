@@ -0,0 +1,168 @@
+#ifndef RPC_SHMBUF_HH
+#define RPC_SHMBUF_HH
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "protorpc/serializer.hh"
+#include "protorpc/unserializer.hh"
+
+namespace rpc
+{
+    /**
+     * Buffer living in a shared memory region (memfd). Only the file
+     * descriptor and the size go through the socket, the receiver maps the
+     * region on first access to data().
+     *
+     * Copies share the same region. The region is unmapped and closed once
+     * the last copy is destroyed.
+     */
+    class ShmBuffer
+    {
+    public:
+        ShmBuffer() = default;
+
+        /**
+         * Creates a new region able to hold at least `capacity` bytes.
+         * Throws std::runtime_error if the region cannot be created.
+         */
+        static ShmBuffer create(std::size_t capacity);
+
+        /**
+         * Takes ownership of a region received from another process. Returns
+         * an invalid buffer if the region is smaller than `size`.
+         */
+        static ShmBuffer adopt(int fd, std::size_t size);
+
+        bool valid() const
+        {
+            return region_ != nullptr;
+        }
+
+        int fd() const
+        {
+            return region_ ? region_->fd : -1;
+        }
+
+        /**
+         * Number of meaningful bytes, this is what the receiver sees.
+         */
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+        std::size_t capacity() const
+        {
+            return region_ ? region_->capacity : 0;
+        }
+
+        /**
+         * Sets the number of meaningful bytes. Returns false if it exceeds
+         * the capacity.
+         */
+        bool resize(std::size_t size);
+
+        /**
+         * Pointer to the region, mapped on first use. Returns null if the
+         * mapping failed.
+         */
+        std::uint8_t* data();
+
+    private:
+        struct Region
+        {
+            Region(int fd, std::size_t capacity)
+                : fd(fd), capacity(capacity)
+            {}
+
+            ~Region();
+
+            Region(const Region&) = delete;
+            Region& operator=(const Region&) = delete;
+
+            int fd;
+            std::size_t capacity;
+            std::uint8_t* mapping = nullptr;
+        };
+
+        ShmBuffer(std::shared_ptr<Region> region, std::size_t size)
+            : region_(std::move(region)), size_(size)
+        {}
+
+        std::shared_ptr<Region> region_;
+        std::size_t size_ = 0;
+
+        friend class ShmBufferPool;
+    };
+
+    /**
+     * Recycles the regions of a sender. A region is handed out again once no
+     * ShmBuffer refers to it anymore, the caller must then make sure the peer
+     * is done with it (e.g. the call which carried it returned).
+     */
+    class ShmBufferPool
+    {
+    public:
+        ShmBufferPool(std::size_t max_regions = 8)
+            : max_regions_(max_regions)
+        {}
+
+        /**
+         * Returns a buffer of `size` bytes, reusing a free region when one is
+         * large enough.
+         */
+        ShmBuffer acquire(std::size_t size);
+
+        /**
+         * Number of regions kept by the pool.
+         */
+        std::size_t size() const
+        {
+            return regions_.size();
+        }
+
+        void clear()
+        {
+            regions_.clear();
+        }
+
+    private:
+        std::size_t max_regions_;
+        std::vector<std::shared_ptr<ShmBuffer::Region>> regions_;
+    };
+
+    template <>
+    struct serializable<ShmBuffer>
+    {
+        // The handle stays owned by the buffer, it must outlive the send.
+        static void serialize(const ShmBuffer& buffer, Serializer& s)
+        {
+            s.add_handle(buffer.fd());
+            s.serialize<std::uint64_t>(buffer.size());
+        }
+
+        static std::size_t size(const ShmBuffer& buffer)
+        {
+            return sizeof(std::uint64_t);
+        }
+    };
+
+    template <>
+    struct unserializable<ShmBuffer>
+    {
+        static bool unserialize(ShmBuffer* out, Unserializer& u)
+        {
+            int fd = -1;
+            std::uint64_t size = 0;
+
+            if (!u.next_handle(&fd) || !u.unserialize(&size))
+                return false;
+
+            *out = ShmBuffer::adopt(fd, size);
+            return out->valid();
+        }
+    };
+}
+
+#endif
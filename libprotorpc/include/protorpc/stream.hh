@@ -0,0 +1,312 @@
+#ifndef RPC_STREAM_HH
+#define RPC_STREAM_HH
+
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include "protorpc/channel.hh"
+#include "protorpc/serializer.hh"
+#include "protorpc/unserializer.hh"
+
+namespace rpc
+{
+    /**
+     * Maximum number of elements in flight on a stream. The writer blocks once
+     * the reader has not consumed that many elements.
+     */
+    constexpr std::uint64_t STREAM_DEFAULT_WINDOW = 64;
+
+    /**
+     * Chunks are sent once they reach this size, even if more credits are
+     * available, so that the reader gets the first elements early.
+     */
+    constexpr std::size_t STREAM_CHUNK_SIZE = 16 * 1024;
+
+    /**
+     * Produces the elements of a stream sent by a proxy. Returns false once
+     * there are no more elements.
+     */
+    template <typename T>
+    using StreamProducer = std::function<bool(T* element)>;
+
+    /**
+     * Receiving end of a `stream<T>`. Elements are unserialized one at a time
+     * as they are consumed, only a window of them is buffered.
+     */
+    template <typename T>
+    class StreamReader
+    {
+    public:
+        StreamReader() = default;
+
+        StreamReader(const StreamReader&) = delete;
+        StreamReader& operator=(const StreamReader&) = delete;
+
+        ~StreamReader()
+        {
+            close();
+        }
+
+        /**
+         * Number of elements the writer can send ahead. Must be set before
+         * the stream is opened.
+         */
+        void set_window(std::uint64_t window)
+        {
+            window_ = window > 1 ? window : 1;
+        }
+
+        std::uint64_t window() const
+        {
+            return window_;
+        }
+
+        /**
+         * Attaches the reader to a stream. Called by the generated code, the
+         * origin tells whether this side allocated the stream id.
+         */
+        void open(Channel* channel, PortId remote_port, std::uint64_t stream_id, StreamOrigin origin)
+        {
+            close();
+
+            channel_ = channel;
+            remote_port_ = remote_port;
+            stream_id_ = stream_id;
+            origin_ = origin;
+            consumed_ = 0;
+            remaining_ = 0;
+            success_ = false;
+            chunk_.reset();
+
+            channel_->open_inbound_stream(remote_port_, stream_id_, origin_);
+        }
+
+        /**
+         * Grants the initial window to a writer which is waiting for it.
+         */
+        bool grant_window()
+        {
+            return channel_ && channel_->grant_stream_credits(remote_port_, stream_id_, origin_, window_);
+        }
+
+        /**
+         * Reads the next element. Returns false at the end of the stream or
+         * on error, success() then tells which one it was.
+         */
+        bool next(T* element)
+        {
+            if (!channel_)
+                return false;
+
+            while (remaining_ == 0)
+            {
+                std::vector<std::uint8_t> chunk;
+
+                if (!channel_->receive_stream_chunk(remote_port_, stream_id_, origin_, chunk, &success_))
+                {
+                    // The channel already forgot about the stream.
+                    channel_ = nullptr;
+                    return false;
+                }
+
+                chunk_data_ = std::move(chunk);
+                chunk_.emplace(chunk_data_);
+
+                if (!chunk_->unserialize(&remaining_))
+                    return fail_();
+            }
+
+            if (!chunk_->unserialize(element))
+                return fail_();
+
+            remaining_--;
+            consumed_++;
+
+            // Credits are returned by halves of the window to limit the
+            // number of control messages.
+            if (consumed_ >= (window_ + 1) / 2)
+            {
+                channel_->grant_stream_credits(remote_port_, stream_id_, origin_, consumed_);
+                consumed_ = 0;
+            }
+
+            return true;
+        }
+
+        /**
+         * Calls the callback for each remaining element. Returns true if the
+         * whole stream was read successfully.
+         */
+        template <typename F>
+        bool for_each(F&& callback)
+        {
+            T element;
+
+            while (next(&element))
+                callback(std::move(element));
+
+            return success_;
+        }
+
+        /**
+         * True if the stream ended and the writer reported success.
+         */
+        bool success() const
+        {
+            return success_;
+        }
+
+        /**
+         * Stops reading. The writer is asked to stop if it did not finish.
+         */
+        void close()
+        {
+            if (!channel_)
+                return;
+
+            channel_->close_inbound_stream(remote_port_, stream_id_, origin_);
+            channel_ = nullptr;
+        }
+
+    private:
+        bool fail_()
+        {
+            success_ = false;
+            close();
+            return false;
+        }
+
+        Channel* channel_ = nullptr;
+        PortId remote_port_ = 0;
+        std::uint64_t stream_id_ = 0;
+        StreamOrigin origin_ = StreamOrigin::Local;
+        std::uint64_t window_ = STREAM_DEFAULT_WINDOW;
+        std::uint64_t consumed_ = 0;
+        std::uint64_t remaining_ = 0;
+        bool success_ = false;
+        std::vector<std::uint8_t> chunk_data_;
+        std::optional<Unserializer> chunk_;
+    };
+
+    /**
+     * Sending end of a `stream<T>`. Elements are serialized as they are
+     * written and sent in chunks as long as the reader grants credits.
+     */
+    template <typename T>
+    class StreamWriter
+    {
+    public:
+        StreamWriter(Channel* channel, PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+                std::uint64_t credits = 0)
+            : channel_(channel), remote_port_(remote_port), stream_id_(stream_id), origin_(origin)
+        {
+            channel_->open_outbound_stream(remote_port_, stream_id_, origin_, credits);
+        }
+
+        StreamWriter(const StreamWriter&) = delete;
+        StreamWriter& operator=(const StreamWriter&) = delete;
+
+        ~StreamWriter()
+        {
+            close(false);
+        }
+
+        /**
+         * Queues an element, blocking while the reader is late. Returns false
+         * if the reader gave up on the stream.
+         */
+        bool write(const T& element)
+        {
+            if (closed_)
+                return false;
+
+            if (credits_ == 0)
+            {
+                if (!send_chunk_())
+                    return false;
+
+                credits_ = channel_->wait_stream_credits(remote_port_, stream_id_, origin_);
+
+                if (credits_ == 0)
+                    return false;
+            }
+
+            chunk_.serialize(element);
+            count_++;
+            credits_--;
+
+            if (credits_ == 0 || chunk_.size() >= STREAM_CHUNK_SIZE)
+                return send_chunk_();
+
+            return true;
+        }
+
+        /**
+         * Writes elements until the producer is exhausted.
+         */
+        bool write_all(const StreamProducer<T>& producer)
+        {
+            T element;
+
+            while (producer(&element))
+            {
+                if (!write(element))
+                    return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * Sends the queued elements without waiting for the chunk to fill.
+         */
+        bool flush()
+        {
+            return send_chunk_() && channel_->flush();
+        }
+
+        /**
+         * Ends the stream, reporting the given status to the reader.
+         */
+        bool close(bool success)
+        {
+            if (closed_)
+                return true;
+
+            bool sent = send_chunk_();
+            closed_ = true;
+
+            return channel_->close_outbound_stream(remote_port_, stream_id_, origin_, sent && success) && sent;
+        }
+
+    private:
+        bool send_chunk_()
+        {
+            if (count_ == 0)
+                return true;
+
+            Serializer s;
+            s.serialize(count_);
+
+            std::vector<std::uint8_t> elements = chunk_.get_payload();
+            s.serialize(elements.data(), elements.size());
+
+            bool sent = channel_->send_stream_chunk(remote_port_, stream_id_, origin_, s.get_payload(), count_);
+            count_ = 0;
+
+            return sent;
+        }
+
+        Channel* channel_;
+        PortId remote_port_;
+        std::uint64_t stream_id_;
+        StreamOrigin origin_;
+        std::uint64_t credits_ = 0;
+        std::uint64_t count_ = 0;
+        bool closed_ = false;
+        Serializer chunk_;
+    };
+}
+
+#endif
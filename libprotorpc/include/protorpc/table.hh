@@ -0,0 +1,137 @@
+#ifndef RPC_TABLE_HH
+#define RPC_TABLE_HH
+
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "protorpc/serializer.hh"
+#include "protorpc/unserializer.hh"
+
+namespace rpc
+{
+
+    /*
+     * Layout of the structures declared @table in SIDL:
+     *
+     *     std::size_t    size of what follows
+     *     std::uint32_t  offset of each of the N fields, from the first one
+     *     ...            fields, with their usual encoding
+     *
+     * Any field can be decoded without decoding the ones before it.
+     */
+
+    /**
+     * Writes a table with N fields. next_field() is called before
+     * serializing each field, finish() once they are all serialized.
+     */
+    template <std::size_t N>
+    class TableWriter
+    {
+    public:
+        static_assert(N > 0, "A table has at least one field");
+
+        static constexpr std::size_t header_size = sizeof(std::size_t) + N * sizeof(std::uint32_t);
+
+        TableWriter(Serializer& s)
+            : s_(s), start_(s.size()), field_(0)
+        {
+            // Filled in by finish()
+            s_.serialize<std::size_t>(0);
+            s_.serialize(offsets_, sizeof(offsets_));
+            fields_ = s_.size();
+        }
+
+        void next_field()
+        {
+            std::size_t offset = s_.size() - fields_;
+
+            if (offset > std::numeric_limits<std::uint32_t>::max())
+                throw std::runtime_error("Table fields exceed 4 GiB");
+
+            offsets_[field_++] = static_cast<std::uint32_t>(offset);
+        }
+
+        void finish()
+        {
+            std::size_t size = s_.size() - start_ - sizeof(std::size_t);
+
+            s_.write_at(start_, &size, sizeof(size));
+            s_.write_at(start_ + sizeof(size), offsets_, sizeof(offsets_));
+        }
+
+    private:
+        Serializer& s_;
+        std::size_t start_;
+        std::size_t fields_;
+        std::size_t field_;
+        std::uint32_t offsets_[N] = {};
+    };
+
+    /**
+     * Table with N fields bound to a borrowed buffer, like the views decoded
+     * by an Unserializer. An unbound table has N empty fields.
+     */
+    template <std::size_t N>
+    class Table
+    {
+    public:
+        static_assert(N > 0, "A table has at least one field");
+
+        /**
+         * Takes the table at the cursor of `u`, which moves past it. Only the
+         * offsets are read, whatever the size of the fields.
+         */
+        bool bind(Unserializer& u)
+        {
+            std::size_t size = 0;
+
+            if (!u.unserialize(&size))
+                return false;
+
+            const std::uint8_t* data = u.take(size);
+
+            if (!data || size < N * sizeof(std::uint32_t))
+                return false;
+
+            for (std::size_t i = 0; i < N; i++)
+            {
+                std::uint32_t offset;
+                std::memcpy(&offset, data + i * sizeof(offset), sizeof(offset));
+                offsets_[i] = offset;
+            }
+
+            fields_ = data + N * sizeof(std::uint32_t);
+            offsets_[N] = size - N * sizeof(std::uint32_t);
+
+            for (std::size_t i = 0; i < N; i++)
+            {
+                if (offsets_[i] > offsets_[i + 1])
+                    return false;
+            }
+
+            resource_ = u.resource();
+            return true;
+        }
+
+        /**
+         * Cursor over the encoding of the field `index`, decoded values use
+         * the memory resource of the Unserializer the table was bound from.
+         */
+        Unserializer field(std::size_t index) const
+        {
+            Unserializer u(fields_ + offsets_[index], offsets_[index + 1] - offsets_[index]);
+            u.set_resource(resource_);
+
+            return u;
+        }
+
+    private:
+        const std::uint8_t* fields_ = nullptr;
+        std::size_t offsets_[N + 1] = {};
+        std::pmr::memory_resource* resource_ = nullptr;
+    };
+
+}
+
+#endif
@@ -1,11 +1,18 @@
 #ifndef RPC_UNSERIALIZER_HH
 #define RPC_UNSERIALIZER_HH
 
+#include <array>
 #include <vector>
 #include <string>
+#include <cstring>
 #include <optional>
 #include <cstdint>
+#include <string_view>
+#include <algorithm>
 #include <type_traits>
+#include <memory_resource>
+#include "protorpc/byte_view.hh"
+#include "protorpc/encoding.hh"
 
 namespace rpc
 {
@@ -26,47 +33,183 @@ namespace rpc
     template <typename T>
     constexpr bool is_unserializable_v = std::is_constructible_v<unserializable<T>>;
 
+    template <typename T, typename = void>
+    struct is_packed_unserializable : std::false_type
+    {};
+
+    template <typename T>
+    struct is_packed_unserializable<T, std::enable_if_t<unserializable<T>::packed>>
+        : std::true_type
+    {};
+
+    /**
+     * Types decoded by copying their memory representation, see
+     * is_trivially_serializable_v.
+     */
+    template <typename T>
+    struct is_trivially_unserializable
+        : std::bool_constant<(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) || is_packed_unserializable<T>::value>
+    {};
+
+    template <typename T, std::size_t N>
+    struct is_trivially_unserializable<std::array<T, N>>
+        : std::bool_constant<is_trivially_unserializable<T>::value && sizeof(std::array<T, N>) == N * sizeof(T)>
+    {};
+
+    template <typename T>
+    constexpr bool is_trivially_unserializable_v = is_trivially_unserializable<T>::value;
+
+    /**
+     * Initial size of the arena of a decoded message: containers take about
+     * as much memory as their encoding, plus their headers.
+     */
+    inline std::size_t arena_size(std::size_t payload_size)
+    {
+        return payload_size * 2 + 256;
+    }
+
+    /**
+     * Cursor over a borrowed buffer. The buffer and the handles are not
+     * copied, they must outlive the Unserializer and the views decoded from
+     * it (std::string_view and ByteView).
+     *
+     * With a memory resource, allocator-aware values (std::pmr containers,
+     * structures generated with sidlcc --pmr) decoded into objects made by
+     * construct() take all their memory from it. A per-message
+     * std::pmr::monotonic_buffer_resource then frees a whole decoded message
+     * at once.
+     */
     class Unserializer
     {
     public:
-        Unserializer(std::vector<std::uint8_t>&& buffer)
-            : data_(std::move(buffer)), index_(0), handle_index_(0)
-        {}
-
-        Unserializer(std::vector<std::uint8_t>&& buffer, const std::vector<int>& handles)
-            : data_(std::move(buffer)), handles_(handles), index_(0), handle_index_(0)
+        Unserializer(const std::uint8_t* data, std::size_t size, const int* handles = nullptr, std::size_t handle_count = 0)
+            : data_(data), size_(size), handles_(handles), handle_count_(handle_count), index_(0), handle_index_(0),
+              resource_(nullptr)
         {}
 
         Unserializer(const std::vector<std::uint8_t>& buffer)
-            : data_(buffer), index_(0), handle_index_(0)
+            : Unserializer(buffer.data(), buffer.size())
         {}
 
         Unserializer(const std::vector<std::uint8_t>& buffer, const std::vector<int>& handles)
-            : data_(buffer), handles_(handles), index_(0), handle_index_(0)
+            : Unserializer(buffer.data(), buffer.size(), handles.data(), handles.size())
         {}
 
+        // The buffer would be destroyed before being read.
+        Unserializer(std::vector<std::uint8_t>&& buffer) = delete;
+        Unserializer(std::vector<std::uint8_t>&& buffer, const std::vector<int>& handles) = delete;
+
         template <typename T>
         bool unserialize(T* output)
         {
             return unserialize_into(output);
         }
 
+        /**
+         * Unserializes an integer vector written with the same encoding.
+         */
+        template <typename T, typename A>
+        bool unserialize(std::vector<T, A>* output, Encoding encoding)
+        {
+            const std::uint8_t* start = data_ + index_;
+
+            if (!encoding::decode(&start, data_ + size_, output, encoding))
+            {
+                index_ = size_;
+                return false;
+            }
+
+            index_ = start - data_;
+            return true;
+        }
+
+        /**
+         * Copies the next `size` bytes to `output`, the counterpart of
+         * Serializer::serialize(const void*, std::size_t).
+         */
+        bool unserialize(void* output, std::size_t size)
+        {
+            const std::uint8_t* start = take(size);
+
+            if (!start)
+                return false;
+
+            std::memcpy(output, start, size);
+            return true;
+        }
+
+        /**
+         * Takes the next `size` bytes as they are, without copying them.
+         * Returns nullptr if they are not all there.
+         */
+        const std::uint8_t* take(std::size_t size)
+        {
+            if (size > remaining())
+            {
+                index_ = size_;
+                return nullptr;
+            }
+
+            const std::uint8_t* start = data_ + index_;
+            index_ += size;
+
+            return start;
+        }
+
+        /**
+         * Memory resource of the decoded values, nullptr for the default
+         * allocators. It must outlive them.
+         */
+        void set_resource(std::pmr::memory_resource* resource)
+        {
+            resource_ = resource;
+        }
+
+        std::pmr::memory_resource* resource() const
+        {
+            return resource_;
+        }
+
+        /**
+         * Default constructs a T to unserialize into, allocator-aware types
+         * use the resource of the Unserializer when it has one.
+         */
+        template <typename T>
+        T construct() const
+        {
+            if constexpr (std::uses_allocator_v<T, std::pmr::polymorphic_allocator<std::byte>>)
+            {
+                if (resource_)
+                    return T(std::pmr::polymorphic_allocator<std::byte>(resource_));
+            }
+
+            return T();
+        }
+
         /**
          * Unserialize the next handle. Returns true on success.
          */
         bool next_handle(int* out)
         {
-            if (handle_index_ >= handles_.size())
+            if (handle_index_ >= handle_count_)
                 return false;
 
             *out = handles_[handle_index_++];
             return true;
         }
 
+        /**
+         * Number of bytes left to unserialize.
+         */
+        std::size_t remaining() const
+        {
+            return size_ - index_;
+        }
+
         std::vector<std::uint8_t> get_remaining()
         {
-            std::vector<std::uint8_t> result(data_.begin() + index_, data_.end());
-            index_ = data_.size();
+            std::vector<std::uint8_t> result(data_ + index_, data_ + size_);
+            index_ = size_;
 
             return result;
         }
@@ -77,56 +220,150 @@ namespace rpc
         std::enable_if_t<std::is_arithmetic_v<T>, bool>
         unserialize_into(T* output)
         {
-            if (index_ + sizeof(T) > data_.size())
+            if (sizeof(T) > remaining())
             {
                 // We invalidate the stream if the unserialization failed.
-                index_ = data_.size();
+                index_ = size_;
                 return false;
             }
 
-            std::uint8_t* start = data_.data() + index_;
+            const std::uint8_t* start = data_ + index_;
             std::copy(start, start + sizeof(T), reinterpret_cast<std::uint8_t*>(output));
             index_ += sizeof(T);
 
             return true;
         }
 
-        bool unserialize_into(std::string* output)
+        /**
+         * Takes the next `size` prefixed bytes, returns nullptr if they are
+         * not all there.
+         */
+        const std::uint8_t* next_bytes_(std::size_t* size)
+        {
+            if (!unserialize<std::size_t>(size))
+                return nullptr;
+
+            return take(*size);
+        }
+
+        template <typename Traits, typename A>
+        bool unserialize_into(std::basic_string<char, Traits, A>* output)
         {
             std::size_t size = 0;
+            const std::uint8_t* start = next_bytes_(&size);
 
-            if (!unserialize<std::size_t>(&size))
+            if (!start)
                 return false;
 
-            if (index_ + size > data_.size())
+            output->assign(reinterpret_cast<const char*>(start), size);
+            return true;
+        }
+
+        /**
+         * Views point into the buffer, nothing is copied.
+         */
+        bool unserialize_into(std::string_view* output)
+        {
+            std::size_t size = 0;
+            const std::uint8_t* start = next_bytes_(&size);
+
+            if (!start)
                 return false;
 
-            auto* str_start = data_.data() + index_;
-            *output = std::string(str_start, str_start + size);
-            index_ += size;
+            *output = std::string_view(reinterpret_cast<const char*>(start), size);
+            return true;
+        }
+
+        bool unserialize_into(ByteView* output)
+        {
+            std::size_t size = 0;
+            const std::uint8_t* start = next_bytes_(&size);
 
+            if (!start)
+                return false;
+
+            *output = ByteView(start, size);
             return true;
         }
 
-        template <typename T>
+        /**
+         * Vectors are decoded in place of the previous content of the output,
+         * reusing its capacity. Elements whose encoding is their memory
+         * representation are copied in bulk. Other elements are decoded in
+         * place, allocator-aware ones get the allocator of the vector.
+         */
+        template <typename T, typename A>
         std::enable_if_t<std::is_default_constructible_v<T>, bool>
-        unserialize_into(std::vector<T>* output)
+        unserialize_into(std::vector<T, A>* output)
         {
             std::size_t size;
 
             if (!unserialize<std::size_t>(&size))
                 return false;
 
+            output->clear();
+
+            if constexpr (is_trivially_unserializable_v<T>)
+            {
+                if (size > remaining() / sizeof(T))
+                {
+                    index_ = size_;
+                    return false;
+                }
+
+                output->resize(size);
+                std::memcpy(output->data(), data_ + index_, size * sizeof(T));
+                index_ += size * sizeof(T);
+
+                return true;
+            }
+
+            // Elements take at least a byte unless they only hold handles, a
+            // corrupted size cannot make the reservation explode.
+            output->reserve(std::min(size, remaining()));
+
             for (std::size_t i = 0; i < size; i++)
             {
-                // XXX: For now any contained element must be default
-                //      constructible.
-                T element;
+                // Bits of vector<bool> are not addressable
+                if constexpr (std::is_same_v<T, bool>)
+                {
+                    bool element;
+
+                    if (!unserialize(&element))
+                        return false;
+
+                    output->push_back(element);
+                }
+                else
+                {
+                    // XXX: For now any contained element must be default
+                    //      constructible.
+                    if constexpr (std::uses_allocator_v<T, A>)
+                        output->emplace_back();
+                    else
+                        output->push_back(construct<T>());
+
+                    if (!unserialize<T>(&output->back()))
+                        return false;
+                }
+            }
 
-                if (!unserialize<T>(&element))
-                    return false;
+            return true;
+        }
 
-                output->push_back(std::move(element));
+        /**
+         * Fixed arrays have no length, each element is decoded in place.
+         */
+        template <typename T, std::size_t N>
+        bool unserialize_into(std::array<T, N>* output)
+        {
+            if constexpr (is_trivially_unserializable_v<T>)
+                return unserialize(output->data(), N * sizeof(T));
+
+            for (T& e : *output)
+            {
+                if (!unserialize<T>(&e))
+                    return false;
             }
 
             return true;
@@ -149,12 +386,13 @@ namespace rpc
 
             if (has_element)
             {
-                T element;
+                T element = construct<T>();
 
                 if (!unserialize(&element))
                     return false;
 
-                *output = std::move(element);
+                // Constructed anew, the value keeps the allocator of element
+                output->emplace(std::move(element));
             }
             else
             {
@@ -165,10 +403,13 @@ namespace rpc
         }
 
     private:
-        std::vector<std::uint8_t> data_;
-        std::vector<int> handles_;
+        const std::uint8_t* data_;
+        std::size_t size_;
+        const int* handles_;
+        std::size_t handle_count_;
         std::size_t index_;
         std::size_t handle_index_;
+        std::pmr::memory_resource* resource_;
     };
 
 }
@@ -12,66 +12,383 @@ Channel::Channel(std::uint64_t port_id, ipc::Port port)
     : port_id_(port_id), port_(port)
 {}
 
-PendingRpcMessage Channel::next_message_()
+Channel::~Channel()
 {
-        ipc::Message msg;
-        ipc::PortError err = port_.receive(msg);
+    flush();
+}
 
-        if (err != ipc::PortError::Ok)
-            throw std::runtime_error("Error while reading from port");
+static std::size_t encoded_size(const rpc::Message& msg)
+{
+    return 5 * sizeof(std::uint64_t) + serialized_size(msg.payload);
+}
+
+static void encode_message(Serializer& s, const rpc::Message& msg)
+{
+    s.serialize(msg.source);
+    s.serialize(msg.destination);
+    s.serialize(msg.opcode);
+    s.serialize(msg.request_id);
+    s.serialize(msg.deadline);
+
+    // payload_size is encoded as part of the vector
+    s.serialize(msg.payload);
+}
+
+static bool decode_message(Unserializer& u, rpc::Message& msg)
+{
+    bool status = true;
+
+    status &= u.unserialize(&msg.source);
+    status &= u.unserialize(&msg.destination);
+    status &= u.unserialize(&msg.opcode);
+    status &= u.unserialize(&msg.request_id);
+    status &= u.unserialize(&msg.deadline);
+    status &= u.unserialize(&msg.payload);
+
+    return status;
+}
+
+static PendingRpcMessage make_pending(PortId source_port, rpc::Message&& msg)
+{
+    PendingRpcMessage pending;
+    pending.source_port = source_port;
+
+    // We patch the rpc::Message to indicate the source object.
+    pending.destination_object = msg.destination;
+    msg.destination = msg.source;
+    msg.source = pending.destination_object;
+
+    pending.message = std::move(msg);
+
+    return pending;
+}
+
+bool Channel::next_message_before_(std::uint64_t deadline, PendingRpcMessage& pending)
+{
+    while (incoming_.empty())
+    {
+        if (deadline != 0)
+        {
+            std::uint64_t now = deadline_now();
 
-        struct PendingRpcMessage pending;
-        pending.source_port = msg.destination;
+            if (now >= deadline)
+                return false;
 
-        // Extract the rpc payload from the message
-        rpc::Message result;
+            // Rounding up, poll() would otherwise spin on the last millisecond.
+            int timeout_ms = static_cast<int>((deadline - now + 999999) / 1000000);
+            ipc::PortError err = port_.poll(timeout_ms);
+
+            if (err == ipc::PortError::Timeout)
+                continue;
+
+            if (err != ipc::PortError::Ok)
+                throw std::runtime_error("Error while polling port");
+        }
+
+        receive_frame_();
+    }
+
+    pending = std::move(incoming_.front());
+    incoming_.pop_front();
+
+    return true;
+}
+
+void Channel::receive_frame_()
+{
+    ipc::Message msg;
+    ipc::PortError err = port_.receive(msg);
+
+    if (err != ipc::PortError::Ok)
+        throw std::runtime_error("Error while reading from port");
+
+    // Extract the rpc payload from the message
+    rpc::Message result;
+    Unserializer u(msg.payload);
+
+    if (!decode_message(u, result))
+        throw std::runtime_error("Could not decode rpc message header");
+
+    if (result.destination != CONTROL_OBJECT ||
+            result.opcode != static_cast<std::uint64_t>(ControlOpcode::Batch))
+    {
         result.handles = std::move(msg.handles);
 
-        Unserializer u(std::move(msg.payload));
+        if (result.destination != CONTROL_OBJECT || result.opcode == static_cast<std::uint64_t>(ControlOpcode::Release))
+            incoming_.push_back(make_pending(msg.destination, std::move(result)));
+        else
+            handle_control_(msg.destination, result);
 
-        bool status = true;
-        std::vector<std::uint8_t> payload;
+        return;
+    }
 
-        status &= u.unserialize(&result.source);
-        status &= u.unserialize(&result.destination);
-        status &= u.unserialize(&result.opcode);
-        status &= u.unserialize(&result.payload);
+    // Unpacking a batch: messages are queued in their sending order and take
+    // their handles from the frame one after the other.
+    Unserializer batch(result.payload);
+    std::size_t handle_index = 0;
 
-        if (!status)
-            throw std::runtime_error("Could not decode rpc message header");
+    while (batch.remaining() > 0)
+    {
+        rpc::Message entry;
+        std::uint64_t handle_count = 0;
 
-        // We patch the rpc::Message to indicate the source object.
-        pending.destination_object = result.destination;
-        result.destination = result.source;
-        result.source = pending.destination_object;
+        if (!batch.unserialize(&handle_count) || !decode_message(batch, entry))
+            throw std::runtime_error("Could not decode batched rpc message");
 
-        pending.message = std::move(result);
+        if (handle_count > msg.handles.size() - handle_index)
+            throw std::runtime_error("Batched rpc message references missing handles");
 
-        return pending;
+        entry.handles.assign(msg.handles.begin() + handle_index,
+                msg.handles.begin() + handle_index + handle_count);
+        handle_index += handle_count;
+
+        if (entry.destination != CONTROL_OBJECT || entry.opcode == static_cast<std::uint64_t>(ControlOpcode::Release))
+            incoming_.push_back(make_pending(msg.destination, std::move(entry)));
+        else
+            handle_control_(msg.destination, entry);
+    }
+}
+
+// Origin of the stream a control message is about, from this side.
+static StreamOrigin stream_origin(const rpc::Message& msg)
+{
+    if (msg.source > static_cast<std::uint64_t>(StreamOrigin::Remote))
+        throw std::runtime_error("Unknown stream origin");
+
+    return peer_origin(static_cast<StreamOrigin>(msg.source));
+}
+
+void Channel::handle_control_(PortId source_port, rpc::Message& msg)
+{
+    switch (static_cast<ControlOpcode>(msg.opcode))
+    {
+    case ControlOpcode::Cancel:
+    {
+        Unserializer u(msg.payload);
+        std::uint64_t request_id = 0;
+
+        if (!u.unserialize(&request_id))
+            throw std::runtime_error("Could not decode cancelled request id");
+
+        StreamOrigin origin = stream_origin(msg);
+        auto stream = outbound_streams_.find(StreamKey(source_port, request_id, origin));
+
+        if (stream != outbound_streams_.end())
+            stream->second.cancelled = true;
+
+        // The id is one of ours, it does not name a request of the sender.
+        if (origin == StreamOrigin::Local)
+            break;
+
+        // The request was sent before its cancellation on the same path: it is
+        // either queued or already handled.
+        auto cancelled = [&](const PendingRpcMessage& pending) {
+            return pending.source_port == source_port && pending.message.request_id == request_id;
+        };
+
+        for (auto* queue : { &incoming_, &message_queue_ })
+        {
+            for (auto it = queue->begin(); it != queue->end(); ++it)
+            {
+                if (cancelled(*it))
+                {
+                    queue->erase(it);
+                    return;
+                }
+            }
+        }
+
+        break;
+    }
+    case ControlOpcode::StreamData:
+    {
+        // Chunks of streams which are not open (anymore) are dropped.
+        auto stream = inbound_streams_.find(StreamKey(source_port, msg.request_id, stream_origin(msg)));
+
+        if (stream != inbound_streams_.end() && !stream->second.ended)
+            stream->second.chunks.push_back(std::move(msg.payload));
+
+        break;
+    }
+    case ControlOpcode::StreamEnd:
+    {
+        auto stream = inbound_streams_.find(StreamKey(source_port, msg.request_id, stream_origin(msg)));
+
+        if (stream == inbound_streams_.end())
+            break;
+
+        Unserializer u(msg.payload);
+        std::uint8_t success = 0;
+
+        stream->second.ended = true;
+        stream->second.success = u.unserialize(&success) && success;
+        break;
+    }
+    case ControlOpcode::StreamCredit:
+    {
+        auto stream = outbound_streams_.find(StreamKey(source_port, msg.request_id, stream_origin(msg)));
+
+        if (stream == outbound_streams_.end())
+            break;
+
+        Unserializer u(msg.payload);
+        std::uint64_t credits = 0;
+
+        if (!u.unserialize(&credits))
+            throw std::runtime_error("Could not decode stream credits");
+
+        stream->second.credits += credits;
+        break;
+    }
+    case ControlOpcode::Invalidate:
+        cache_epochs_[CacheKey(source_port, msg.source)]++;
+        break;
+    case ControlOpcode::Acquire:
+    {
+        Unserializer u(msg.payload);
+        ObjectId object = 0;
+
+        if (!u.unserialize(&object))
+            throw std::runtime_error("Could not decode acquired object id");
+
+        // The object may already be gone, requests of the proxy will be
+        // dropped.
+        objects_.add_reference(object);
+        break;
+    }
+    default:
+        throw std::runtime_error("Unknown control message");
+    }
 }
 
 void Channel::loop()
 {
     for (;;)
     {
-        PendingRpcMessage msg = next_message_();
-        message_queue_.push_back(std::move(msg));
+        PendingRpcMessage msg;
 
-        while (!message_queue_.empty())
-        {
-            PendingRpcMessage& pending_msg = message_queue_.front();
-            auto handler = receivers_.find(pending_msg.destination_object);
+        // Wakes up for the deadlines of the asynchronous requests and of the
+        // current batch even when no message arrives, dispatch_pending() then
+        // fails the expired requests and flushes the batch.
+        if (next_message_before_(next_deadline(), msg))
+            message_queue_.push_back(std::move(msg));
 
-            if (handler == receivers_.end())
-                throw std::runtime_error("Destination object not found");
+        dispatch_pending();
+    }
+}
 
-            handler->second->on_message(*this, pending_msg.destination_object, pending_msg.source_port, pending_msg.message);
-            message_queue_.pop_front();
+std::size_t Channel::poll_once()
+{
+    receive_pending();
+
+    return dispatch_pending();
+}
+
+void Channel::receive_pending()
+{
+    for (;;)
+    {
+        ipc::PortError err = port_.poll(0);
+
+        if (err == ipc::PortError::Timeout)
+            break;
+
+        if (err != ipc::PortError::Ok)
+            throw std::runtime_error("Error while polling port");
+
+        receive_frame_();
+    }
+}
+
+std::size_t Channel::dispatch_pending()
+{
+    std::size_t count = 0;
+
+    while (!incoming_.empty())
+    {
+        message_queue_.push_back(std::move(incoming_.front()));
+        incoming_.pop_front();
+    }
+
+    while (!message_queue_.empty())
+    {
+        // Handlers can reenter the channel, the message must leave the queue
+        // before being dispatched.
+        PendingRpcMessage pending_msg = std::move(message_queue_.front());
+        message_queue_.pop_front();
+
+        dispatch_(pending_msg);
+        count++;
+    }
+
+    // Replies dispatched above arrived in time, the remaining ones did not.
+    expire_completions_();
+
+    // Replies batched by the handlers must not wait for the next message.
+    if (!flush())
+        throw std::runtime_error("Error while flushing batched messages");
+
+    return count;
+}
+
+void Channel::dispatch_(PendingRpcMessage& pending_msg)
+{
+    // Releases are dispatched in order: the messages sent to an object before
+    // its last reference was dropped still reach it.
+    if (pending_msg.destination_object == CONTROL_OBJECT)
+    {
+        handle_release_(pending_msg.message);
+        return;
+    }
+
+    if (pending_msg.message.request_id != 0)
+    {
+        auto completion = completions_.find(pending_msg.message.request_id);
+
+        if (completion != completions_.end() &&
+                is_reply_(pending_msg, completion->first, completion->second.proxy))
+        {
+            CompletionHandler handler = std::move(completion->second.handler);
+            completions_.erase(completion);
+
+            handler(ChannelError::Ok, pending_msg.message);
+            return;
         }
     }
+
+    RpcReceiver* handler = objects_.find(pending_msg.destination_object);
+
+    if (!handler)
+    {
+        // Late reply to a request which timed out or was cancelled, or
+        // message to an object which has been unbound since.
+        if (objects_.contains(pending_msg.destination_object) || objects_.is_stale(pending_msg.destination_object))
+            return;
+
+        throw std::runtime_error("Destination object not found");
+    }
+
+    // Nobody waits for the result of an overdue request anymore.
+    if (deadline_expired(pending_msg.message.deadline))
+        return;
+
+    dispatch_depth_++;
+
+    try
+    {
+        handler->on_message(*this, pending_msg.destination_object, pending_msg.source_port, pending_msg.message);
+    }
+    catch (...)
+    {
+        dispatch_depth_--;
+        throw;
+    }
+
+    if (--dispatch_depth_ == 0)
+        unbound_.clear();
 }
 
-bool Channel::send_message(std::uint64_t remote_port, rpc::Message& msg)
+bool Channel::send_frame_(PortId remote_port, rpc::Message& msg)
 {
     ipc::Message ipc_msg;
 
@@ -79,36 +396,200 @@ bool Channel::send_message(std::uint64_t remote_port, rpc::Message& msg)
     ipc_msg.destination = remote_port;
     ipc_msg.handles = std::move(msg.handles);
 
-    // Encoding the rpc::Message data
-    rpc::Serializer s;
-    s.serialize(msg.source);
-    s.serialize(msg.destination);
-    s.serialize(msg.opcode);
-
-    // payload_size is encoded as part of the vector
-    s.serialize(msg.payload);
-
-    ipc_msg.payload = s.get_payload();
+    // Encoding the rpc::Message data in a single reservation of a buffer
+    // which is reused by the next frames.
+    frame_.clear();
+    frame_.reserve(encoded_size(msg));
+    encode_message(frame_, msg);
 
+    frame_.swap_payload(ipc_msg.payload);
     ipc::PortError error = port_.send(ipc_msg);
+    frame_.swap_payload(ipc_msg.payload);
 
     // TODO: Return a more explicit error than just "failed"
     return error == ipc::PortError::Ok;
 }
 
+bool Channel::send_unbatched_(PortId remote_port, rpc::Message& msg)
+{
+    bool sent = send_frame_(remote_port, msg);
+
+    // The payload has been copied, its buffer serves the next message.
+    payload_.recycle(std::move(msg.payload));
+
+    return sent;
+}
+
+bool Channel::send_message(std::uint64_t remote_port, rpc::Message& msg)
+{
+    if (!corked_ && !batching_)
+        return send_unbatched_(remote_port, msg);
+
+    auto now = std::chrono::steady_clock::now();
+
+    // An idle channel does not delay its messages: batching only kicks in
+    // when messages follow each other closely.
+    if (!corked_ && batch_count_ == 0 && now - last_flush_ >= batching_policy_.max_delay)
+    {
+        last_flush_ = now;
+        return send_unbatched_(remote_port, msg);
+    }
+
+    if (!batch_message_(remote_port, msg))
+        return false;
+
+    if (batch_count_ >= batching_policy_.max_batch_size)
+        return flush();
+
+    if (!corked_ && now - batch_start_ >= batching_policy_.max_delay)
+        return flush();
+
+    return true;
+}
+
+bool Channel::batch_message_(PortId remote_port, rpc::Message& msg)
+{
+    // A frame only has one destination port and a limited number of handles.
+    if (batch_count_ > 0 && (batch_port_ != remote_port ||
+                batch_handle_count_ + msg.handles.size() > ipc::IPC_MAX_HANDLES))
+    {
+        if (!flush())
+            return false;
+    }
+
+    if (batch_count_ == 0)
+    {
+        batch_port_ = remote_port;
+        batch_start_ = std::chrono::steady_clock::now();
+    }
+
+    batch_.reserve(sizeof(std::uint64_t) + encoded_size(msg));
+    batch_.serialize<std::uint64_t>(msg.handles.size());
+    encode_message(batch_, msg);
+    payload_.recycle(std::move(msg.payload));
+
+    for (int handle : msg.handles)
+        batch_.add_handle(handle);
+
+    batch_handle_count_ += msg.handles.size();
+    batch_count_++;
+
+    return true;
+}
+
+bool Channel::flush()
+{
+    bool sent = true;
+
+    if (!pending_releases_.empty())
+        sent = batch_releases_();
+
+    if (batch_count_ == 0)
+        return sent;
+
+    rpc::Message frame;
+    frame.source = 0;
+    frame.destination = CONTROL_OBJECT;
+    frame.opcode = static_cast<std::uint64_t>(ControlOpcode::Batch);
+    frame.handles = batch_.get_handles();
+    batch_.swap_payload(frame.payload);
+
+    batch_count_ = 0;
+    batch_handle_count_ = 0;
+    last_flush_ = std::chrono::steady_clock::now();
+
+    sent = send_frame_(batch_port_, frame) && sent;
+
+    // The batch keeps its buffer for the next one.
+    batch_.swap_payload(frame.payload);
+    batch_.clear();
+
+    return sent;
+}
+
+void Channel::cork()
+{
+    corked_ = true;
+}
+
+bool Channel::uncork()
+{
+    corked_ = false;
+    return flush();
+}
+
+void Channel::enable_batching(BatchingPolicy policy)
+{
+    if (policy.max_batch_size == 0)
+        throw std::invalid_argument("Batch size must be positive");
+
+    batching_policy_ = policy;
+    batching_ = true;
+}
+
+bool Channel::disable_batching()
+{
+    batching_ = false;
+    return flush();
+}
+
+bool Channel::is_reply_(const PendingRpcMessage& pending, std::uint64_t request_id, ObjectId proxy)
+{
+    // Requests are addressed to receivers, replies come back to the proxy
+    // which sent the request.
+    return pending.message.request_id == request_id && pending.destination_object == proxy;
+}
+
+bool Channel::start_request(PortId remote_port, rpc::Message& msg)
+{
+    // Messages sent before the request must reach the receiver first.
+    if (!flush())
+        return false;
+
+    if (msg.request_id == 0)
+        msg.request_id = allocate_request_id();
+
+    return send_unbatched_(remote_port, msg);
+}
+
 bool Channel::send_request(std::uint64_t remote_port, rpc::Message& msg, rpc::Message& result)
 {
-    if (!send_message(remote_port, msg))
+    if (!start_request(remote_port, msg))
+    {
+        last_error_ = ChannelError::SendFailed;
         return false;
+    }
+
+    return wait_reply(remote_port, msg, result);
+}
+
+bool Channel::wait_reply(PortId remote_port, rpc::Message& msg, rpc::Message& result)
+{
+    // The reply may already have been queued while waiting on a stream.
+    for (auto it = message_queue_.begin(); it != message_queue_.end(); ++it)
+    {
+        if (is_reply_(*it, msg.request_id, msg.source))
+        {
+            result = std::move(it->message);
+            message_queue_.erase(it);
+
+            last_error_ = ChannelError::Ok;
+            return true;
+        }
+    }
 
     for (;;)
     {
-        PendingRpcMessage pending = next_message_();
+        PendingRpcMessage pending;
+
+        if (!next_message_before_(msg.deadline, pending))
+        {
+            send_cancel_(remote_port, msg.request_id);
+            last_error_ = ChannelError::Timeout;
+            return false;
+        }
 
-        // We have to check the destination because next_message_ swaps source and destination ids
-        // on message arrival.
-        if (pending.message.destination == msg.destination && pending.message.opcode == msg.opcode &&
-                remote_port == pending.source_port)
+        if (is_reply_(pending, msg.request_id, msg.source))
         {
             result = std::move(pending.message);
             break;
@@ -117,13 +598,494 @@ bool Channel::send_request(std::uint64_t remote_port, rpc::Message& msg, rpc::Me
         message_queue_.push_back(std::move(pending));
     }
 
+    last_error_ = ChannelError::Ok;
+    return true;
+}
+
+bool Channel::send_request_async(PortId remote_port, rpc::Message& msg, CompletionHandler handler)
+{
+    if (!start_request(remote_port, msg))
+    {
+        last_error_ = ChannelError::SendFailed;
+        return false;
+    }
+
+    completions_[msg.request_id] = PendingCompletion {
+        msg.source, remote_port, msg.deadline, std::move(handler)
+    };
+
+    last_error_ = ChannelError::Ok;
     return true;
 }
 
-void Channel::next_id_()
+std::size_t Channel::gather(const std::vector<RemoteObject>& targets, rpc::Message& msg,
+        std::size_t needed, const GatherHandler& handler)
 {
-    while (allocated_objects_.find(current_id_) != allocated_objects_.end())
-        current_id_++;
+    // Messages sent before the requests must reach the receivers first.
+    if (!flush())
+    {
+        last_error_ = ChannelError::SendFailed;
+        return 0;
+    }
+
+    // Target of each request still waiting for its answer, by request id.
+    std::unordered_map<std::uint64_t, std::size_t> pending;
+    std::size_t accepted = 0;
+
+    for (std::size_t i = 0; i < targets.size(); i++)
+    {
+        rpc::Message request;
+        request.source = msg.source;
+        request.destination = targets[i].object;
+        request.opcode = msg.opcode;
+        request.request_id = allocate_request_id();
+        request.deadline = msg.deadline;
+        request.payload = msg.payload;
+        request.handles = msg.handles;
+
+        if (send_frame_(targets[i].port, request))
+            pending.emplace(request.request_id, i);
+    }
+
+    auto take = [&](PendingRpcMessage& reply) {
+        if (reply.destination_object != msg.source)
+            return false;
+
+        auto request = pending.find(reply.message.request_id);
+
+        if (request == pending.end())
+            return false;
+
+        std::size_t target = request->second;
+        pending.erase(request);
+
+        if (handler(target, reply.message))
+            accepted++;
+
+        return true;
+    };
+
+    bool timed_out = false;
+
+    while (accepted < needed && accepted + pending.size() >= needed)
+    {
+        PendingRpcMessage reply;
+
+        if (!next_message_before_(msg.deadline, reply))
+        {
+            timed_out = true;
+            break;
+        }
+
+        if (!take(reply))
+            message_queue_.push_back(std::move(reply));
+    }
+
+    // Late answers are dropped on dispatch since the proxy has no receiver.
+    for (auto& [request_id, target] : pending)
+        send_cancel_(targets[target].port, request_id);
+
+    flush();
+
+    if (accepted >= needed)
+        last_error_ = ChannelError::Ok;
+    else if (timed_out)
+        last_error_ = ChannelError::Timeout;
+    else
+        last_error_ = ChannelError::Incomplete;
+
+    return accepted;
+}
+
+bool Channel::scatter(const std::vector<RemoteObject>& targets, rpc::Message& msg)
+{
+    bool sent = true;
+
+    for (const RemoteObject& target : targets)
+    {
+        rpc::Message copy;
+        copy.source = msg.source;
+        copy.destination = target.object;
+        copy.opcode = msg.opcode;
+        copy.deadline = msg.deadline;
+        copy.payload = msg.payload;
+        copy.handles = msg.handles;
+
+        sent = send_message(target.port, copy) && sent;
+    }
+
+    return sent;
+}
+
+bool Channel::cancel(std::uint64_t request_id)
+{
+    auto completion = completions_.find(request_id);
+
+    if (completion == completions_.end())
+        return false;
+
+    PendingCompletion cancelled = std::move(completion->second);
+    completions_.erase(completion);
+
+    bool sent = send_cancel_(cancelled.remote_port, request_id);
+
+    rpc::Message empty;
+    cancelled.handler(ChannelError::Cancelled, empty);
+
+    return sent;
+}
+
+bool Channel::send_cancel_(PortId remote_port, std::uint64_t request_id, StreamOrigin origin)
+{
+    rpc::Message cancel;
+    cancel.source = static_cast<std::uint64_t>(origin);
+    cancel.destination = CONTROL_OBJECT;
+    cancel.opcode = static_cast<std::uint64_t>(ControlOpcode::Cancel);
+
+    Serializer s;
+    s.serialize(request_id);
+    cancel.payload = s.get_payload();
+
+    // Cancellations are unidirectional and can be batched.
+    return send_message(remote_port, cancel);
+}
+
+bool Channel::unbind(ObjectId id)
+{
+    cache_subscribers_.erase(id);
+
+    if (dispatch_depth_ == 0)
+        return objects_.release(id);
+
+    std::shared_ptr<RpcReceiver> receiver;
+
+    if (!objects_.release(id, &receiver))
+        return false;
+
+    unbound_.push_back(std::move(receiver));
+    return true;
+}
+
+void Channel::acquire_(ObjectId proxy, PortId remote_port, ObjectId remote_id)
+{
+    references_[proxy].emplace_back(remote_port, remote_id);
+
+    rpc::Message acquire;
+    acquire.source = 0;
+    acquire.destination = CONTROL_OBJECT;
+    acquire.opcode = static_cast<std::uint64_t>(ControlOpcode::Acquire);
+
+    Serializer s;
+    s.serialize(remote_id);
+    acquire.payload = s.get_payload();
+
+    // Sent right away so that it reaches the object before the releases of
+    // previous proxies, which wait for the next flush.
+    send_message(remote_port, acquire);
+}
+
+void Channel::release_proxy(ObjectId proxy)
+{
+    // Ids of receivers are never released through a proxy.
+    if (objects_.find(proxy) == nullptr)
+        objects_.release(proxy);
+
+    auto reference = references_.find(proxy);
+
+    if (reference == references_.end())
+        return;
+
+    bool full = false;
+
+    for (auto [remote_port, remote_id] : reference->second)
+    {
+        std::vector<ObjectId>& releases = pending_releases_[remote_port];
+        releases.push_back(remote_id);
+
+        full = full || releases.size() >= batching_policy_.max_batch_size;
+    }
+
+    references_.erase(reference);
+
+    if (full)
+        flush();
+}
+
+bool Channel::batch_releases_()
+{
+    std::unordered_map<PortId, std::vector<ObjectId>> releases;
+    releases.swap(pending_releases_);
+
+    bool sent = true;
+
+    // Appended to the batch, after the messages of the released proxies.
+    for (auto& [remote_port, ids] : releases)
+    {
+        rpc::Message release;
+        release.source = 0;
+        release.destination = CONTROL_OBJECT;
+        release.opcode = static_cast<std::uint64_t>(ControlOpcode::Release);
+
+        Serializer s;
+        s.serialize(ids);
+        release.payload = s.get_payload();
+
+        sent = batch_message_(remote_port, release) && sent;
+    }
+
+    return sent;
+}
+
+void Channel::handle_release_(rpc::Message& msg)
+{
+    Unserializer u(msg.payload);
+    std::vector<ObjectId> ids;
+
+    if (!u.unserialize(&ids))
+        throw std::runtime_error("Could not decode released object ids");
+
+    for (ObjectId id : ids)
+    {
+        if (objects_.remove_reference(id))
+            unbind(id);
+    }
+}
+
+bool Channel::invalidate(ObjectId object)
+{
+    auto subscribers = cache_subscribers_.find(object);
+
+    if (subscribers == cache_subscribers_.end())
+        return true;
+
+    bool sent = true;
+
+    // Ports subscribe again on their next cache miss.
+    for (PortId port : subscribers->second)
+    {
+        rpc::Message msg;
+        msg.source = object;
+        msg.destination = CONTROL_OBJECT;
+        msg.opcode = static_cast<std::uint64_t>(ControlOpcode::Invalidate);
+
+        sent = send_message(port, msg) && sent;
+    }
+
+    cache_subscribers_.erase(subscribers);
+
+    return flush() && sent;
+}
+
+std::uint64_t Channel::next_deadline() const
+{
+    std::uint64_t next = 0;
+
+    // A batch must leave once its oldest message has waited long enough,
+    // messages held by cork() wait for uncork() instead.
+    if (batch_count_ > 0 && !corked_)
+    {
+        auto batch_end = batch_start_ + batching_policy_.max_delay;
+        next = std::chrono::duration_cast<std::chrono::nanoseconds>(batch_end.time_since_epoch()).count();
+    }
+
+    for (auto& completion : completions_)
+    {
+        std::uint64_t deadline = completion.second.deadline;
+
+        if (deadline != 0 && (next == 0 || deadline < next))
+            next = deadline;
+    }
+
+    return next;
+}
+
+void Channel::expire_completions_()
+{
+    std::vector<std::uint64_t> expired;
+
+    for (auto& completion : completions_)
+    {
+        if (deadline_expired(completion.second.deadline))
+            expired.push_back(completion.first);
+    }
+
+    for (std::uint64_t request_id : expired)
+    {
+        auto completion = completions_.find(request_id);
+
+        // A previous handler may have cancelled it.
+        if (completion == completions_.end())
+            continue;
+
+        PendingCompletion timed_out = std::move(completion->second);
+        completions_.erase(completion);
+
+        send_cancel_(timed_out.remote_port, request_id);
+
+        rpc::Message empty;
+        timed_out.handler(ChannelError::Timeout, empty);
+    }
+}
+
+void Channel::pump_()
+{
+    receive_frame_();
+
+    while (!incoming_.empty())
+    {
+        message_queue_.push_back(std::move(incoming_.front()));
+        incoming_.pop_front();
+    }
+}
+
+static rpc::Message make_stream_message(ControlOpcode opcode, std::uint64_t stream_id, StreamOrigin origin)
+{
+    rpc::Message msg;
+    msg.source = static_cast<std::uint64_t>(origin);
+    msg.destination = CONTROL_OBJECT;
+    msg.opcode = static_cast<std::uint64_t>(opcode);
+    msg.request_id = stream_id;
+
+    return msg;
+}
+
+void Channel::open_inbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin)
+{
+    inbound_streams_[StreamKey(remote_port, stream_id, origin)] = InboundStream();
+}
+
+bool Channel::grant_stream_credits(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+        std::uint64_t credits)
+{
+    auto stream = inbound_streams_.find(StreamKey(remote_port, stream_id, origin));
+
+    // The writer does not need credits anymore.
+    if (stream == inbound_streams_.end() || stream->second.ended)
+        return true;
+
+    rpc::Message credit = make_stream_message(ControlOpcode::StreamCredit, stream_id, origin);
+
+    Serializer s;
+    s.serialize(credits);
+    credit.payload = s.get_payload();
+
+    // The writer may be blocked on these credits, they must not be delayed.
+    return send_message(remote_port, credit) && flush();
+}
+
+bool Channel::receive_stream_chunk(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+        std::vector<std::uint8_t>& chunk, bool* success)
+{
+    auto stream = inbound_streams_.find(StreamKey(remote_port, stream_id, origin));
+
+    if (stream == inbound_streams_.end())
+    {
+        *success = false;
+        return false;
+    }
+
+    // Pumping only inserts new streams, the iterator stays valid.
+    while (stream->second.chunks.empty() && !stream->second.ended)
+        pump_();
+
+    if (!stream->second.chunks.empty())
+    {
+        chunk = std::move(stream->second.chunks.front());
+        stream->second.chunks.pop_front();
+        return true;
+    }
+
+    *success = stream->second.success;
+    inbound_streams_.erase(stream);
+
+    return false;
+}
+
+void Channel::close_inbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin)
+{
+    auto stream = inbound_streams_.find(StreamKey(remote_port, stream_id, origin));
+
+    if (stream == inbound_streams_.end())
+        return;
+
+    bool ended = stream->second.ended;
+    inbound_streams_.erase(stream);
+
+    // Remaining chunks will be dropped on arrival.
+    if (!ended)
+        send_cancel_(remote_port, stream_id, origin);
+}
+
+void Channel::open_outbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+        std::uint64_t credits)
+{
+    OutboundStream stream;
+    stream.credits = credits;
+
+    outbound_streams_[StreamKey(remote_port, stream_id, origin)] = stream;
+}
+
+std::uint64_t Channel::wait_stream_credits(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin)
+{
+    auto stream = outbound_streams_.find(StreamKey(remote_port, stream_id, origin));
+
+    if (stream == outbound_streams_.end())
+        return 0;
+
+    // The reader cannot grant credits for chunks it has not received yet.
+    if (stream->second.credits == 0 && !flush())
+        return 0;
+
+    while (stream->second.credits == 0 && !stream->second.cancelled)
+        pump_();
+
+    if (stream->second.cancelled)
+        return 0;
+
+    return stream->second.credits;
+}
+
+bool Channel::send_stream_chunk(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+        std::vector<std::uint8_t>&& chunk, std::uint64_t count)
+{
+    auto stream = outbound_streams_.find(StreamKey(remote_port, stream_id, origin));
+
+    if (stream == outbound_streams_.end() || stream->second.cancelled)
+        return false;
+
+    if (count > stream->second.credits)
+        throw std::logic_error("Stream chunk exceeds the granted credits");
+
+    stream->second.credits -= count;
+
+    rpc::Message data = make_stream_message(ControlOpcode::StreamData, stream_id, origin);
+    data.payload = std::move(chunk);
+
+    return send_message(remote_port, data);
+}
+
+bool Channel::close_outbound_stream(PortId remote_port, std::uint64_t stream_id, StreamOrigin origin,
+        bool success)
+{
+    auto stream = outbound_streams_.find(StreamKey(remote_port, stream_id, origin));
+
+    if (stream == outbound_streams_.end())
+        return false;
+
+    bool cancelled = stream->second.cancelled;
+    outbound_streams_.erase(stream);
+
+    // The reader already forgot about the stream.
+    if (cancelled)
+        return true;
+
+    rpc::Message end = make_stream_message(ControlOpcode::StreamEnd, stream_id, origin);
+
+    Serializer s;
+    s.serialize<std::uint8_t>(success ? 1 : 0);
+    end.payload = s.get_payload();
+
+    return send_message(remote_port, end) && flush();
 }
 
 }
@@ -0,0 +1,407 @@
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include "protorpc/instrumentation.hh"
+
+namespace rpc
+{
+
+namespace
+{
+    constexpr int PHASE_COUNT = static_cast<int>(Instrumentation::Phase::Count);
+
+    const char* PHASE_NAMES[PHASE_COUNT] = { "serialize", "transit", "handler", "deserialize" };
+
+    struct Histogram
+    {
+        std::atomic<std::uint64_t> buckets[Instrumentation::HISTOGRAM_BUCKETS];
+        std::atomic<std::uint64_t> total_ns;
+
+        void record(std::uint64_t ns)
+        {
+            std::size_t bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+
+            buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            total_ns.fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        void merge(const Histogram& other)
+        {
+            for (std::size_t b = 0; b < Instrumentation::HISTOGRAM_BUCKETS; b++)
+                buckets[b].fetch_add(other.buckets[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            total_ns.fetch_add(other.total_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    };
+
+    struct MethodCounters
+    {
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> request_bytes;
+        std::atomic<std::uint64_t> reply_bytes;
+        Histogram phases[PHASE_COUNT];
+
+        void merge(const MethodCounters& other)
+        {
+            calls.fetch_add(other.calls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            request_bytes.fetch_add(other.request_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            reply_bytes.fetch_add(other.reply_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            for (int p = 0; p < PHASE_COUNT; p++)
+                phases[p].merge(other.phases[p]);
+        }
+    };
+
+    struct TraceEvent
+    {
+        std::size_t method;
+        std::uint64_t start;
+        std::uint64_t duration;
+    };
+
+    /**
+     * Counters of a single thread. Only the owning thread writes them, other
+     * threads read them when dumping.
+     */
+    struct ThreadRecorder
+    {
+        std::size_t index;
+        std::atomic<MethodCounters*> methods[Instrumentation::MAX_METHODS];
+
+        std::vector<TraceEvent> trace;
+        std::atomic<std::uint64_t> trace_count;
+
+        ~ThreadRecorder()
+        {
+            for (auto& method : methods)
+                delete method.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct MethodInfo
+    {
+        const char* name;
+        Instrumentation::Side side;
+    };
+
+    struct Registry
+    {
+        std::mutex lock;
+        std::vector<std::unique_ptr<ThreadRecorder>> threads;
+
+        // Counters of the threads which exited, their trace events are dropped.
+        ThreadRecorder retired{};
+
+        MethodInfo methods[Instrumentation::MAX_METHODS];
+        std::atomic<std::size_t> method_count{0};
+
+        std::atomic<bool> trace_enabled{false};
+    };
+
+    // Never destroyed: threads may still record while statics are torn down.
+    Registry& registry()
+    {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+
+    MethodCounters& counters(ThreadRecorder& thread, std::size_t method)
+    {
+        MethodCounters* c = thread.methods[method].load(std::memory_order_relaxed);
+
+        if (!c)
+        {
+            c = new MethodCounters();
+            thread.methods[method].store(c, std::memory_order_release);
+        }
+
+        return *c;
+    }
+
+    /**
+     * Recorder of the current thread. Its counters are folded into the
+     * retired ones when the thread exits, so that the registry does not grow
+     * with every short-lived thread.
+     */
+    struct RecorderOwner
+    {
+        ThreadRecorder* recorder = nullptr;
+
+        ~RecorderOwner()
+        {
+            if (!recorder)
+                return;
+
+            Registry& r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+
+            for (std::size_t method = 0; method < Instrumentation::MAX_METHODS; method++)
+            {
+                MethodCounters* c = recorder->methods[method].load(std::memory_order_relaxed);
+
+                if (c)
+                    counters(r.retired, method).merge(*c);
+            }
+
+            for (auto it = r.threads.begin(); it != r.threads.end(); ++it)
+            {
+                if (it->get() == recorder)
+                {
+                    r.threads.erase(it);
+                    break;
+                }
+            }
+        }
+    };
+
+    thread_local RecorderOwner current_recorder;
+
+    ThreadRecorder& recorder()
+    {
+        if (current_recorder.recorder)
+            return *current_recorder.recorder;
+
+        Registry& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+
+        // Value initialization zeroes the atomics. Indexes identify threads in
+        // the chrome trace, they are not reused.
+        static std::size_t next_index = 1;
+
+        r.threads.emplace_back(new ThreadRecorder());
+        current_recorder.recorder = r.threads.back().get();
+        current_recorder.recorder->index = next_index++;
+
+        return *current_recorder.recorder;
+    }
+
+    void reset_counters(ThreadRecorder& thread)
+    {
+        for (auto& method : thread.methods)
+        {
+            MethodCounters* c = method.load(std::memory_order_acquire);
+
+            if (!c)
+                continue;
+
+            c->calls.store(0, std::memory_order_relaxed);
+            c->request_bytes.store(0, std::memory_order_relaxed);
+            c->reply_bytes.store(0, std::memory_order_relaxed);
+
+            for (auto& phase : c->phases)
+            {
+                phase.total_ns.store(0, std::memory_order_relaxed);
+
+                for (auto& bucket : phase.buckets)
+                    bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        thread.trace_count.store(0, std::memory_order_release);
+    }
+
+    const char* side_name(Instrumentation::Side side)
+    {
+        return side == Instrumentation::Side::Proxy ? "proxy" : "receiver";
+    }
+
+    void write_escaped(std::ostream& out, const char* str)
+    {
+        out << '"';
+
+        for (; *str; str++)
+        {
+            if (*str == '"' || *str == '\\')
+                out << '\\';
+
+            out << *str;
+        }
+
+        out << '"';
+    }
+}
+
+std::size_t Instrumentation::register_method(const char* name, Side side)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::size_t count = r.method_count.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        if (r.methods[i].side == side && std::strcmp(r.methods[i].name, name) == 0)
+            return i;
+    }
+
+    if (count == MAX_METHODS)
+        throw std::runtime_error("Too many instrumented methods");
+
+    r.methods[count] = MethodInfo{ name, side };
+    r.method_count.store(count + 1, std::memory_order_release);
+
+    return count;
+}
+
+void Instrumentation::record(std::size_t method, const std::uint64_t (&durations)[PHASE_COUNT],
+        std::size_t request_bytes, std::size_t reply_bytes, std::uint64_t start)
+{
+    ThreadRecorder& thread = recorder();
+    MethodCounters& c = counters(thread, method);
+
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    c.request_bytes.fetch_add(request_bytes, std::memory_order_relaxed);
+    c.reply_bytes.fetch_add(reply_bytes, std::memory_order_relaxed);
+
+    std::uint64_t total = 0;
+
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        if (durations[i] > 0)
+            c.phases[i].record(durations[i]);
+
+        total += durations[i];
+    }
+
+    if (!registry().trace_enabled.load(std::memory_order_relaxed))
+        return;
+
+    if (thread.trace.empty())
+        thread.trace.resize(TRACE_CAPACITY);
+
+    std::uint64_t index = thread.trace_count.load(std::memory_order_relaxed);
+    thread.trace[index % TRACE_CAPACITY] = TraceEvent{ method, start, total };
+    thread.trace_count.store(index + 1, std::memory_order_release);
+}
+
+void Instrumentation::enable_trace(bool enabled)
+{
+    registry().trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Instrumentation::dump_json(std::ostream& out)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::size_t count = r.method_count.load(std::memory_order_acquire);
+    bool first_method = true;
+
+    out << "{\"methods\": [";
+
+    for (std::size_t method = 0; method < count; method++)
+    {
+        std::uint64_t calls = 0;
+        std::uint64_t request_bytes = 0;
+        std::uint64_t reply_bytes = 0;
+        std::uint64_t buckets[PHASE_COUNT][HISTOGRAM_BUCKETS] = {};
+        std::uint64_t total_ns[PHASE_COUNT] = {};
+
+        auto add = [&](const ThreadRecorder& thread) {
+            MethodCounters* c = thread.methods[method].load(std::memory_order_acquire);
+
+            if (!c)
+                return;
+
+            calls += c->calls.load(std::memory_order_relaxed);
+            request_bytes += c->request_bytes.load(std::memory_order_relaxed);
+            reply_bytes += c->reply_bytes.load(std::memory_order_relaxed);
+
+            for (int p = 0; p < PHASE_COUNT; p++)
+            {
+                total_ns[p] += c->phases[p].total_ns.load(std::memory_order_relaxed);
+
+                for (std::size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+                    buckets[p][b] += c->phases[p].buckets[b].load(std::memory_order_relaxed);
+            }
+        };
+
+        add(r.retired);
+
+        for (auto& thread : r.threads)
+            add(*thread);
+
+        if (calls == 0)
+            continue;
+
+        if (!first_method)
+            out << ", ";
+
+        first_method = false;
+
+        out << "{\"name\": ";
+        write_escaped(out, r.methods[method].name);
+        out << ", \"side\": \"" << side_name(r.methods[method].side) << "\"";
+        out << ", \"calls\": " << calls;
+        out << ", \"request_bytes\": " << request_bytes;
+        out << ", \"reply_bytes\": " << reply_bytes;
+
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            // Trailing empty buckets are omitted.
+            std::size_t used = HISTOGRAM_BUCKETS;
+
+            while (used > 0 && buckets[p][used - 1] == 0)
+                used--;
+
+            out << ", \"" << PHASE_NAMES[p] << "\": {\"total_ns\": " << total_ns[p] << ", \"buckets\": [";
+
+            for (std::size_t b = 0; b < used; b++)
+                out << (b > 0 ? ", " : "") << buckets[p][b];
+
+            out << "]}";
+        }
+
+        out << "}";
+    }
+
+    out << "]}\n";
+}
+
+void Instrumentation::dump_chrome_trace(std::ostream& out)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    bool first_event = true;
+
+    out << "{\"traceEvents\": [";
+
+    for (auto& thread : r.threads)
+    {
+        std::uint64_t count = thread->trace_count.load(std::memory_order_acquire);
+        std::uint64_t first = count > TRACE_CAPACITY ? count - TRACE_CAPACITY : 0;
+
+        for (std::uint64_t i = first; i < count; i++)
+        {
+            const TraceEvent& event = thread->trace[i % TRACE_CAPACITY];
+            const MethodInfo& info = r.methods[event.method];
+
+            if (!first_event)
+                out << ",\n";
+
+            first_event = false;
+
+            out << "{\"name\": ";
+            write_escaped(out, info.name);
+            out << ", \"cat\": \"" << side_name(info.side) << "\", \"ph\": \"X\"";
+            out << ", \"ts\": " << event.start / 1000.0 << ", \"dur\": " << event.duration / 1000.0;
+            out << ", \"pid\": " << getpid() << ", \"tid\": " << thread->index << "}";
+        }
+    }
+
+    out << "]}\n";
+}
+
+void Instrumentation::reset()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+
+    reset_counters(r.retired);
+
+    for (auto& thread : r.threads)
+        reset_counters(*thread);
+}
+
+}
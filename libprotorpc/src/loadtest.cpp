@@ -0,0 +1,435 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <poll.h>
+#include "protorpc/loadtest.hh"
+
+namespace rpc
+{
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct MethodStats
+    {
+        std::uint64_t calls = 0;
+        std::uint64_t errors = 0;
+        std::vector<std::uint64_t> latencies;
+    };
+
+    struct ThreadResult
+    {
+        std::vector<MethodStats> methods;
+        std::vector<RecordedCall> recorded;
+    };
+
+    void usage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --interface NAME   interface to load (default: first of the file)\n"
+                  << "  --method NAME      only call this method (default: every method)\n"
+                  << "  --threads N        client channels, each in its own thread (default: 1)\n"
+                  << "  --duration SECONDS duration of the load (default: 5)\n"
+                  << "  --rate CALLS       target calls per second, closed loop if 0 (default: 0)\n"
+                  << "  --seed N           seed of the random arguments (default: 1)\n"
+                  << "  --max-size N       maximum size of random strings and vectors (default: 16)\n"
+                  << "  --record FILE      record the arguments of the calls\n"
+                  << "  --replay FILE      replay recorded arguments instead of random ones\n"
+                  << "  --capture FILE     capture the traffic of the router\n";
+    }
+
+    double percentile(const std::vector<std::uint64_t>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+
+        std::size_t index = std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()));
+        return sorted[index] / 1000.0;
+    }
+
+    void print_row(const std::string& name, const MethodStats& stats, double seconds)
+    {
+        std::cout << std::left << std::setw(24) << name << std::right
+                  << std::setw(12) << stats.calls
+                  << std::setw(10) << stats.errors
+                  << std::setw(14) << std::fixed << std::setprecision(1) << stats.calls / seconds
+                  << std::setw(12) << std::setprecision(2) << percentile(stats.latencies, 0.5)
+                  << std::setw(12) << percentile(stats.latencies, 0.99)
+                  << std::setw(12) << percentile(stats.latencies, 0.999)
+                  << "\n";
+    }
+}
+
+bool load_recorded_calls(const std::string& path, std::vector<RecordedCall>* calls)
+{
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in)
+        return false;
+
+    std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    Unserializer u(data);
+
+    calls->clear();
+
+    while (u.remaining() > 0)
+    {
+        RecordedCall call;
+
+        if (!u.unserialize(&call.opcode) || !u.unserialize(&call.arguments))
+            return false;
+
+        calls->push_back(std::move(call));
+    }
+
+    return true;
+}
+
+bool save_recorded_calls(const std::string& path, const std::vector<RecordedCall>& calls)
+{
+    Serializer s;
+
+    for (const RecordedCall& call : calls)
+    {
+        s.serialize(call.opcode);
+        s.serialize(call.arguments);
+    }
+
+    std::vector<std::uint8_t> data = s.get_payload();
+    std::ofstream out(path, std::ios::binary);
+
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(out);
+}
+
+bool LoadTestOptions::parse(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (!value)
+        {
+            usage(argv[0]);
+            return false;
+        }
+
+        if (std::strcmp(arg, "--interface") == 0)
+            interface = value;
+        else if (std::strcmp(arg, "--method") == 0)
+            method = value;
+        else if (std::strcmp(arg, "--threads") == 0)
+            threads = std::max(1l, std::strtol(value, nullptr, 10));
+        else if (std::strcmp(arg, "--duration") == 0)
+            duration = std::chrono::milliseconds(static_cast<long>(std::strtod(value, nullptr) * 1000));
+        else if (std::strcmp(arg, "--rate") == 0)
+            rate = std::strtod(value, nullptr);
+        else if (std::strcmp(arg, "--seed") == 0)
+            seed = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--max-size") == 0)
+            max_size = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--record") == 0)
+            record_path = value;
+        else if (std::strcmp(arg, "--replay") == 0)
+            replay_path = value;
+        else if (std::strcmp(arg, "--capture") == 0)
+            capture_path = value;
+        else
+        {
+            usage(argv[0]);
+            return false;
+        }
+
+        i++;
+    }
+
+    return true;
+}
+
+LoadTestDriver::LoadTestDriver(const LoadTestOptions& options)
+    : options_(options)
+{
+    auto add_client = [this]() {
+        ipc::Port router_side;
+        ipc::Port client_side;
+
+        if (!ipc::Port::create_pair(router_side, client_side))
+            throw std::runtime_error("Could not create a port pair");
+
+        ports_.push_back(router_side);
+        ports_.push_back(client_side);
+
+        return std::make_pair(router_.add_port(router_side), client_side);
+    };
+
+    auto [server_id, server_port] = add_client();
+    server_port_ = server_id;
+    server_ = std::make_unique<Channel>(server_id, server_port);
+
+    for (std::size_t i = 0; i < options_.threads; i++)
+    {
+        auto [client_id, client_port] = add_client();
+        clients_.push_back(std::make_unique<Channel>(client_id, client_port));
+    }
+
+    control_ = add_client().second;
+}
+
+LoadTestDriver::~LoadTestDriver()
+{
+    stop_();
+
+    clients_.clear();
+    server_.reset();
+
+    for (ipc::Port& port : ports_)
+        port.close();
+}
+
+void LoadTestDriver::stop_()
+{
+    if (server_thread_.joinable())
+    {
+        stop_server_.store(true, std::memory_order_relaxed);
+        server_thread_.join();
+    }
+
+    if (router_thread_.joinable())
+    {
+        // The router stops on messages to unknown ports.
+        ipc::Message stop;
+        stop.destination = UINT64_MAX;
+        control_.send(stop);
+
+        router_thread_.join();
+    }
+}
+
+int LoadTestDriver::run(const char* interface, const std::vector<LoadTestMethod>& all_methods, const Call& call)
+{
+    // Indices of the methods to call in all_methods
+    std::vector<std::size_t> methods;
+
+    for (std::size_t i = 0; i < all_methods.size(); i++)
+    {
+        if (options_.method.empty() || options_.method == all_methods[i].name)
+            methods.push_back(i);
+    }
+
+    if (methods.empty())
+    {
+        std::cerr << "No method of " << interface << " to call";
+
+        if (!options_.method.empty())
+            std::cerr << " named " << options_.method;
+
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::vector<RecordedCall> replayed;
+    std::vector<std::size_t> replayed_methods;
+
+    if (!options_.replay_path.empty())
+    {
+        std::vector<RecordedCall> recorded;
+
+        if (!load_recorded_calls(options_.replay_path, &recorded))
+        {
+            std::cerr << "Could not read recorded calls from " << options_.replay_path << std::endl;
+            return 1;
+        }
+
+        // Calls to the methods filtered out are dropped
+        for (RecordedCall& rec : recorded)
+        {
+            for (std::size_t i = 0; i < methods.size(); i++)
+            {
+                if (all_methods[methods[i]].opcode == rec.opcode)
+                {
+                    replayed.push_back(std::move(rec));
+                    replayed_methods.push_back(i);
+                    break;
+                }
+            }
+        }
+
+        if (replayed.empty())
+        {
+            std::cerr << "No recorded call to replay" << std::endl;
+            return 1;
+        }
+    }
+
+    if (!options_.capture_path.empty())
+    {
+        if (!capture_.open(options_.capture_path))
+        {
+            std::cerr << "Could not write the capture to " << options_.capture_path << std::endl;
+            return 1;
+        }
+
+        router_.set_capture(&capture_);
+    }
+
+    router_thread_ = std::thread([this]() {
+        router_.loop();
+    });
+
+    server_thread_ = std::thread([this]() {
+        pollfd fd = { server_->handle(), POLLIN, 0 };
+
+        while (!stop_server_.load(std::memory_order_relaxed))
+        {
+            if (::poll(&fd, 1, 10) > 0)
+                server_->poll_once();
+        }
+    });
+
+    std::size_t thread_count = options_.threads;
+    bool record = !options_.record_path.empty();
+    std::vector<ThreadResult> results(thread_count);
+    std::vector<std::thread> threads;
+
+    // Delay between two calls of a thread with a target rate
+    Clock::duration interval = Clock::duration::zero();
+
+    if (options_.rate > 0)
+        interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(thread_count / options_.rate));
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + options_.duration;
+
+    for (std::size_t t = 0; t < thread_count; t++)
+    {
+        threads.emplace_back([&, t]() {
+            ThreadResult& result = results[t];
+            ArgumentSource args(options_.seed + t, options_.max_size);
+            std::mt19937_64 engine(options_.seed + t);
+
+            result.methods.resize(methods.size());
+
+            for (std::uint64_t n = 0;; n++)
+            {
+                Clock::time_point begin = Clock::now();
+
+                // Latencies are measured from the scheduled time, a call
+                // delayed by a slow predecessor counts the delay.
+                if (interval != Clock::duration::zero())
+                {
+                    begin = start + interval * n;
+
+                    if (begin >= end)
+                        break;
+
+                    std::this_thread::sleep_until(begin);
+                }
+                else if (begin >= end)
+                {
+                    break;
+                }
+
+                std::size_t method;
+
+                if (replayed.empty())
+                {
+                    method = engine() % methods.size();
+                    args.begin(nullptr, record);
+                }
+                else
+                {
+                    std::size_t index = (t + n * thread_count) % replayed.size();
+
+                    method = replayed_methods[index];
+                    args.begin(&replayed[index].arguments, record);
+                }
+
+                bool ok = call(t, methods[method], args);
+                std::uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+
+                MethodStats& stats = result.methods[method];
+                stats.calls++;
+                stats.latencies.push_back(latency);
+
+                if (!ok)
+                    stats.errors++;
+
+                if (record)
+                    result.recorded.push_back(RecordedCall{ all_methods[methods[method]].opcode, args.recorded() });
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stop_();
+    capture_.close();
+
+    std::cout << interface << ": " << thread_count << " threads, ";
+
+    if (options_.rate > 0)
+        std::cout << "target rate " << options_.rate << " calls/s, ";
+    else
+        std::cout << "closed loop, ";
+
+    std::cout << std::fixed << std::setprecision(2) << seconds << " s\n\n";
+
+    std::cout << std::left << std::setw(24) << "method" << std::right
+              << std::setw(12) << "calls" << std::setw(10) << "errors" << std::setw(14) << "calls/s"
+              << std::setw(12) << "p50 (us)" << std::setw(12) << "p99 (us)" << std::setw(12) << "p999 (us)"
+              << "\n";
+
+    MethodStats total;
+
+    for (std::size_t i = 0; i < methods.size(); i++)
+    {
+        MethodStats merged;
+
+        for (ThreadResult& result : results)
+        {
+            MethodStats& stats = result.methods[i];
+
+            merged.calls += stats.calls;
+            merged.errors += stats.errors;
+            merged.latencies.insert(merged.latencies.end(), stats.latencies.begin(), stats.latencies.end());
+        }
+
+        if (merged.calls == 0)
+            continue;
+
+        total.calls += merged.calls;
+        total.errors += merged.errors;
+        total.latencies.insert(total.latencies.end(), merged.latencies.begin(), merged.latencies.end());
+
+        std::sort(merged.latencies.begin(), merged.latencies.end());
+        print_row(all_methods[methods[i]].name, merged, seconds);
+    }
+
+    std::sort(total.latencies.begin(), total.latencies.end());
+    print_row("total", total, seconds);
+
+    if (record)
+    {
+        std::vector<RecordedCall> recorded;
+
+        for (ThreadResult& result : results)
+            std::move(result.recorded.begin(), result.recorded.end(), std::back_inserter(recorded));
+
+        if (!save_recorded_calls(options_.record_path, recorded))
+        {
+            std::cerr << "Could not write recorded calls to " << options_.record_path << std::endl;
+            return 1;
+        }
+    }
+
+    return total.errors > 0 ? 1 : 0;
+}
+
+}
@@ -0,0 +1,162 @@
+#include <stdexcept>
+#include "protorpc/object_table.hh"
+
+namespace rpc
+{
+
+ObjectId ObjectTable::allocate(std::shared_ptr<RpcReceiver> receiver, bool refcounted)
+{
+    std::uint32_t index = free_head_;
+
+    if (index == NO_SLOT)
+    {
+        if (slots_.size() >= NO_SLOT)
+            throw std::runtime_error("Object table is full");
+
+        index = static_cast<std::uint32_t>(slots_.size());
+        slots_.emplace_back();
+    }
+    else
+    {
+        free_head_ = slots_[index].next_free;
+    }
+
+    Slot& slot = slots_[index];
+    slot.receiver = std::move(receiver);
+    slot.next_free = NO_SLOT;
+    slot.allocated = true;
+    slot.references = 0;
+    slot.refcounted = refcounted;
+    size_++;
+
+    return make_id(index, slot.generation, refcounted);
+}
+
+void ObjectTable::insert(ObjectId id, std::shared_ptr<RpcReceiver> receiver)
+{
+    std::uint32_t index = index_of(id);
+
+    if (index == NO_SLOT)
+        throw std::runtime_error("Invalid object id");
+
+    // Slots created in between are made available to allocate().
+    while (slots_.size() <= index)
+    {
+        slots_.emplace_back();
+        slots_.back().next_free = free_head_;
+        free_head_ = static_cast<std::uint32_t>(slots_.size() - 1);
+    }
+
+    Slot& slot = slots_[index];
+
+    if (!slot.allocated)
+    {
+        unlink_free_(index);
+        slot.allocated = true;
+        size_++;
+    }
+
+    // Keep the previous occupant alive until the slot is consistent, its
+    // destructor may call back into the table.
+    std::shared_ptr<RpcReceiver> previous = std::move(slot.receiver);
+    slot.receiver = std::move(receiver);
+    slot.generation = generation_of(id);
+    slot.references = 0;
+    slot.refcounted = is_refcounted(id);
+}
+
+bool ObjectTable::release(ObjectId id, std::shared_ptr<RpcReceiver>* receiver)
+{
+    if (!contains(id))
+        return false;
+
+    std::uint32_t index = index_of(id);
+    Slot& slot = slots_[index];
+
+    std::shared_ptr<RpcReceiver> previous = std::move(slot.receiver);
+    slot.receiver = nullptr;
+    slot.allocated = false;
+    slot.generation = (slot.generation + 1) & GENERATION_MASK;
+    slot.references = 0;
+    slot.refcounted = false;
+    slot.next_free = free_head_;
+    free_head_ = index;
+    size_--;
+
+    if (receiver)
+        *receiver = std::move(previous);
+
+    return true;
+}
+
+bool ObjectTable::contains(ObjectId id) const
+{
+    std::uint32_t index = index_of(id);
+
+    if (index >= slots_.size())
+        return false;
+
+    const Slot& slot = slots_[index];
+
+    return slot.allocated && id == make_id(index, slot.generation, slot.refcounted);
+}
+
+bool ObjectTable::is_stale(ObjectId id) const
+{
+    std::uint32_t index = index_of(id);
+
+    if (index >= slots_.size())
+        return false;
+
+    const Slot& slot = slots_[index];
+
+    // Generations wrap around, anything but the current one is stale.
+    return !contains(id) && (slot.allocated || generation_of(id) != slot.generation);
+}
+
+bool ObjectTable::add_reference(ObjectId id)
+{
+    if (!contains(id))
+        return false;
+
+    slots_[index_of(id)].references++;
+    return true;
+}
+
+bool ObjectTable::remove_reference(ObjectId id)
+{
+    if (!contains(id))
+        return false;
+
+    Slot& slot = slots_[index_of(id)];
+
+    // Releases without a matching acquire are ignored.
+    if (slot.references == 0)
+        return false;
+
+    return --slot.references == 0 && slot.refcounted;
+}
+
+std::uint64_t ObjectTable::references(ObjectId id) const
+{
+    return contains(id) ? slots_[index_of(id)].references : 0;
+}
+
+void ObjectTable::unlink_free_(std::uint32_t index)
+{
+    std::uint32_t* link = &free_head_;
+
+    while (*link != NO_SLOT)
+    {
+        if (*link == index)
+        {
+            *link = slots_[index].next_free;
+            slots_[index].next_free = NO_SLOT;
+            return;
+        }
+
+        link = &slots_[*link].next_free;
+    }
+}
+
+}
@@ -0,0 +1,83 @@
+#include <cstring>
+#include "protorpc/message.hh"
+#include "protorpc/result_cache.hh"
+
+namespace rpc
+{
+
+std::string ResultCache::make_key_(std::uint64_t opcode, const std::vector<std::uint8_t>& arguments)
+{
+    std::string key(sizeof(opcode) + arguments.size(), '\0');
+    std::memcpy(key.data(), &opcode, sizeof(opcode));
+    std::memcpy(key.data() + sizeof(opcode), arguments.data(), arguments.size());
+
+    return key;
+}
+
+void ResultCache::set_capacity(std::size_t capacity)
+{
+    capacity_ = capacity;
+
+    while (entries_.size() > capacity_)
+    {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+const std::vector<std::uint8_t>* ResultCache::find(std::uint64_t opcode,
+        const std::vector<std::uint8_t>& arguments, std::uint64_t epoch)
+{
+    if (entries_.empty())
+        return nullptr;
+
+    auto it = index_.find(make_key_(opcode, arguments));
+
+    if (it == index_.end())
+        return nullptr;
+
+    auto entry = it->second;
+
+    if (entry->epoch != epoch || deadline_expired(entry->expiry))
+    {
+        index_.erase(it);
+        entries_.erase(entry);
+        return nullptr;
+    }
+
+    entries_.splice(entries_.begin(), entries_, entry);
+
+    return &entry->result;
+}
+
+void ResultCache::insert(std::uint64_t opcode, const std::vector<std::uint8_t>& arguments,
+        std::vector<std::uint8_t> result, std::uint64_t epoch, std::chrono::milliseconds ttl)
+{
+    if (capacity_ == 0)
+        return;
+
+    std::string key = make_key_(opcode, arguments);
+    std::uint64_t expiry = ttl.count() > 0 ? deadline_after(ttl) : 0;
+    auto it = index_.find(key);
+
+    if (it != index_.end())
+    {
+        auto entry = it->second;
+        entry->result = std::move(result);
+        entry->epoch = epoch;
+        entry->expiry = expiry;
+        entries_.splice(entries_.begin(), entries_, entry);
+        return;
+    }
+
+    if (entries_.size() >= capacity_)
+    {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+
+    entries_.push_front(Entry{ key, std::move(result), epoch, expiry });
+    index_.emplace(std::move(key), entries_.begin());
+}
+
+}
@@ -0,0 +1,106 @@
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "protorpc/shmbuf.hh"
+
+namespace rpc
+{
+
+static std::size_t round_to_page(std::size_t size)
+{
+    static const std::size_t page_size = sysconf(_SC_PAGESIZE);
+
+    if (size == 0)
+        return page_size;
+
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+ShmBuffer::Region::~Region()
+{
+    if (mapping)
+        munmap(mapping, capacity);
+
+    ::close(fd);
+}
+
+ShmBuffer ShmBuffer::create(std::size_t capacity)
+{
+    capacity = round_to_page(capacity);
+
+    int fd = memfd_create("protorpc-shmbuf", MFD_CLOEXEC);
+
+    if (fd == -1)
+        throw std::runtime_error("Could not create shared memory region");
+
+    if (ftruncate(fd, capacity) == -1)
+    {
+        ::close(fd);
+        throw std::runtime_error("Could not resize shared memory region");
+    }
+
+    return ShmBuffer(std::make_shared<Region>(fd, capacity), 0);
+}
+
+ShmBuffer ShmBuffer::adopt(int fd, std::size_t size)
+{
+    struct stat st;
+
+    // Accessing a mapping past the end of the file raises SIGBUS, the peer
+    // must not be able to trigger it.
+    if (fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < size)
+    {
+        ::close(fd);
+        return ShmBuffer();
+    }
+
+    return ShmBuffer(std::make_shared<Region>(fd, st.st_size), size);
+}
+
+bool ShmBuffer::resize(std::size_t size)
+{
+    if (size > capacity())
+        return false;
+
+    size_ = size;
+    return true;
+}
+
+std::uint8_t* ShmBuffer::data()
+{
+    if (!region_)
+        return nullptr;
+
+    if (!region_->mapping && region_->capacity > 0)
+    {
+        void* mapping = mmap(nullptr, region_->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, region_->fd, 0);
+
+        if (mapping == MAP_FAILED)
+            return nullptr;
+
+        region_->mapping = static_cast<std::uint8_t*>(mapping);
+    }
+
+    return region_->mapping;
+}
+
+ShmBuffer ShmBufferPool::acquire(std::size_t size)
+{
+    for (auto& region : regions_)
+    {
+        // Only the pool refers to the region, nobody uses it anymore.
+        if (region.use_count() == 1 && region->capacity >= size)
+            return ShmBuffer(region, size);
+    }
+
+    ShmBuffer buffer = ShmBuffer::create(size);
+    buffer.resize(size);
+
+    if (regions_.size() < max_regions_)
+        regions_.push_back(buffer.region_);
+
+    return buffer;
+}
+
+}
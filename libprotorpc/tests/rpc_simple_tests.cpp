@@ -1,4 +1,12 @@
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory_resource>
 #include <thread>
+#include <sstream>
+#include <poll.h>
 #include <sys/socket.h>
 #include "gtest/gtest.h"
 #include "fmt/core.h"
@@ -6,10 +14,18 @@
 #include "protoipc/port.hh"
 #include "protoipc/router.hh"
 #include "protorpc/channel.hh"
+#include "protorpc/instrumentation.hh"
+#include "protorpc/object_table.hh"
+#include "protorpc/result_cache.hh"
 #include "protorpc/serializer.hh"
+#include "protorpc/shmbuf.hh"
+#include "protorpc/stream.hh"
+#include "protorpc/table.hh"
 #include "protorpc/unserializer.hh"
 
 constexpr std::uint64_t PING_COMMAND = 42;
+constexpr std::uint64_t APPEND_COMMAND = 43;
+constexpr std::uint64_t DUMP_COMMAND = 44;
 
 class SimpleSendProxy : public rpc::RpcProxy
 {
@@ -38,7 +54,7 @@ public:
             return false;
         }
 
-        rpc::Unserializer u(std::move(result.payload));
+        rpc::Unserializer u(result.payload);
 
         if (!u.unserialize(output))
             throw std::runtime_error("There was an error parsing the ping reply");
@@ -56,7 +72,7 @@ public:
         {
             fmt::print("Received PING from {},{}\n", source_port, message.destination);
 
-            rpc::Unserializer u(std::move(message.payload));
+            rpc::Unserializer u(message.payload);
             std::string ping_str;
 
             if (!u.unserialize(&ping_str))
@@ -71,6 +87,82 @@ public:
     }
 };
 
+class RecordingReceiver : public rpc::RpcReceiver
+{
+public:
+    RecordingReceiver(int* dump_count = nullptr)
+        : dump_count_(dump_count)
+    {}
+
+    void on_message(rpc::Channel& chan, rpc::ObjectId object, rpc::PortId source_port, rpc::Message& message) override
+    {
+        if (message.opcode == APPEND_COMMAND)
+        {
+            rpc::Unserializer u(message.payload);
+            std::uint64_t value = 0;
+
+            if (!u.unserialize(&value))
+                throw std::runtime_error("Could not unserialize appended value");
+
+            values_.push_back(value);
+        }
+        else if (message.opcode == DUMP_COMMAND)
+        {
+            if (dump_count_)
+                (*dump_count_)++;
+
+            rpc::Serializer s;
+            s.serialize(values_);
+
+            message.payload = s.get_payload();
+            chan.send_message(source_port, message);
+        }
+    }
+
+private:
+    std::vector<std::uint64_t> values_;
+    int* dump_count_;
+};
+
+class RecordingProxy : public rpc::RpcProxy
+{
+public:
+    RecordingProxy(rpc::Channel* chan, rpc::ObjectId object_id, rpc::PortId remote_port, rpc::ObjectId remote_id)
+        : rpc::RpcProxy(chan, object_id, remote_port, remote_id)
+    {}
+
+    bool append(std::uint64_t value)
+    {
+        rpc::Message message;
+        message.source = id();
+        message.destination = remote_id();
+        message.opcode = APPEND_COMMAND;
+
+        rpc::Serializer s;
+        s.serialize(value);
+        message.payload = s.get_payload();
+
+        return channel_->send_message(remote_port(), message);
+    }
+
+    bool dump(std::vector<std::uint64_t>* values)
+    {
+        rpc::Message message;
+        message.source = id();
+        message.destination = remote_id();
+        message.opcode = DUMP_COMMAND;
+        message.deadline = call_deadline();
+
+        rpc::Message result;
+
+        if (!channel_->send_request(remote_port(), message, result))
+            return false;
+
+        rpc::Unserializer u(result.payload);
+        return u.unserialize(values);
+    }
+};
+
 TEST(rpc_test, simple_send)
 {
     int client_a_socks[2];
@@ -179,6 +271,1262 @@ TEST(rpc_test, simple_multi_proxy)
     ASSERT_EQ(pong_string, ping_string);
 }
 
+TEST(rpc_test, corked_messages_keep_order)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    auto receiver_id = second_channel.bind<RecordingReceiver>();
+    auto proxy = first_channel.connect<RecordingProxy>(client_b_id, receiver_id);
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    std::thread receiver_thread([&]() {
+        second_channel.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+    receiver_thread.detach();
+
+    std::vector<std::uint64_t> expected;
+
+    // Explicit corking, spanning several frames.
+    first_channel.cork();
+
+    for (std::uint64_t i = 0; i < 100; i++)
+    {
+        ASSERT_TRUE(proxy->append(i));
+        expected.push_back(i);
+    }
+
+    ASSERT_TRUE(first_channel.uncork());
+
+    // Automatic batching, the request flushes the pending messages.
+    rpc::BatchingPolicy policy;
+    policy.max_delay = std::chrono::seconds(10);
+    policy.max_batch_size = 7;
+    first_channel.enable_batching(policy);
+
+    for (std::uint64_t i = 100; i < 150; i++)
+    {
+        ASSERT_TRUE(proxy->append(i));
+        expected.push_back(i);
+    }
+
+    std::vector<std::uint64_t> values;
+
+    ASSERT_TRUE(proxy->dump(&values));
+    ASSERT_EQ(values, expected);
+}
+
+TEST(rpc_test, batch_sent_after_max_delay)
+{
+    int socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, socks), 0);
+
+    // Both ends are leaked along with the thread looping on the channel.
+    auto* channel = new rpc::Channel(1, ipc::Port(socks[0]));
+    auto* peer = new ipc::Port(socks[1]);
+
+    rpc::BatchingPolicy policy;
+    policy.max_delay = std::chrono::milliseconds(20);
+    channel->enable_batching(policy);
+
+    // The first message leaves an idle channel right away, the second one
+    // opens a batch and nothing is sent after it.
+    for (std::uint64_t i = 0; i < 2; i++)
+    {
+        rpc::Message message;
+        message.source = 1;
+        message.destination = 1;
+        message.opcode = APPEND_COMMAND;
+
+        ASSERT_TRUE(channel->send_message(2, message));
+    }
+
+    ipc::Message frame;
+
+    ASSERT_EQ(peer->receive(frame), ipc::PortError::Ok);
+    ASSERT_EQ(peer->poll(0), ipc::PortError::Timeout);
+    ASSERT_NE(channel->next_deadline(), 0);
+
+    std::thread loop_thread([channel]() {
+        channel->loop();
+    });
+
+    loop_thread.detach();
+
+    ASSERT_EQ(peer->poll(5000), ipc::PortError::Ok);
+    ASSERT_EQ(peer->receive(frame), ipc::PortError::Ok);
+}
+
+TEST(rpc_test, external_event_loop)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    auto receiver_id = second_channel.bind<SimpleSendReceiver>();
+    auto proxy = first_channel.connect<SimpleSendProxy>(client_b_id, receiver_id);
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    std::vector<std::string> replies;
+
+    for (std::string ping : { "first", "second", "third" })
+    {
+        rpc::Message message;
+        message.source = proxy->id();
+        message.destination = proxy->remote_id();
+        message.opcode = PING_COMMAND;
+
+        rpc::Serializer s;
+        s.serialize(ping);
+        message.payload = s.get_payload();
+
+        bool sent = first_channel.send_request_async(client_b_id, message, [&](rpc::ChannelError error, rpc::Message& reply) {
+            ASSERT_EQ(error, rpc::ChannelError::Ok);
+
+            rpc::Unserializer u(reply.payload);
+            std::string pong;
+
+            ASSERT_TRUE(u.unserialize(&pong));
+            replies.push_back(pong);
+        });
+
+        ASSERT_TRUE(sent);
+    }
+
+    // Both channels are driven from this thread.
+    struct pollfd fds[2] = {};
+    fds[0].fd = first_channel.handle();
+    fds[0].events = POLLIN;
+    fds[1].fd = second_channel.handle();
+    fds[1].events = POLLIN;
+
+    while (replies.size() < 3)
+    {
+        ASSERT_GT(poll(fds, 2, 5000), 0);
+
+        second_channel.poll_once();
+        first_channel.poll_once();
+    }
+
+    std::vector<std::string> expected = { "first", "second", "third" };
+    ASSERT_EQ(replies, expected);
+    ASSERT_EQ(first_channel.poll_once(), 0);
+}
+
+TEST(rpc_test, request_timeout_and_cancel)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    int dump_count = 0;
+    auto receiver_id = second_channel.bind<RecordingReceiver>(&dump_count);
+    auto proxy = first_channel.connect<RecordingProxy>(client_b_id, receiver_id);
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    // Nobody serves the receiver yet, the request must time out.
+    std::vector<std::uint64_t> values;
+    proxy->set_timeout(std::chrono::milliseconds(20));
+
+    ASSERT_FALSE(proxy->dump(&values));
+    ASSERT_EQ(proxy->last_error(), rpc::ChannelError::Timeout);
+
+    // Both the request and its cancellation reach the receiver, which must
+    // not handle the request.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    second_channel.poll_once();
+
+    ASSERT_EQ(dump_count, 0);
+
+    std::thread receiver_thread([&]() {
+        second_channel.loop();
+    });
+
+    receiver_thread.detach();
+
+    proxy->set_timeout(std::chrono::seconds(0));
+
+    ASSERT_TRUE(proxy->append(1));
+    ASSERT_TRUE(proxy->dump(&values));
+    ASSERT_EQ(values, std::vector<std::uint64_t>({ 1 }));
+    ASSERT_EQ(dump_count, 1);
+}
+
+TEST(rpc_test, async_request_timeout_in_loop)
+{
+    int socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, socks), 0);
+
+    // Nobody reads the other end, the request is never answered. Both are
+    // leaked along with the thread looping on the channel.
+    auto* channel = new rpc::Channel(1, ipc::Port(socks[0]));
+    auto timed_out = std::make_shared<std::promise<rpc::ChannelError>>();
+
+    rpc::Message message;
+    message.source = 1;
+    message.destination = 1;
+    message.opcode = DUMP_COMMAND;
+    message.deadline = rpc::deadline_after(std::chrono::milliseconds(20));
+
+    bool sent = channel->send_request_async(2, message, [timed_out](rpc::ChannelError error, rpc::Message& reply) {
+        timed_out->set_value(error);
+    });
+
+    ASSERT_TRUE(sent);
+    ASSERT_NE(channel->next_deadline(), 0);
+
+    std::thread loop_thread([channel]() {
+        channel->loop();
+    });
+
+    loop_thread.detach();
+
+    // No other traffic wakes the loop up, only the deadline does.
+    auto result = timed_out->get_future();
+
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    ASSERT_EQ(result.get(), rpc::ChannelError::Timeout);
+}
+
+TEST(rpc_test, stream_flow_control)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    constexpr std::uint64_t WINDOW = 4;
+    constexpr std::uint64_t COUNT = 100;
+
+    std::uint64_t stream_id = first_channel.allocate_request_id();
+
+    rpc::StreamReader<std::uint64_t> reader;
+    reader.set_window(WINDOW);
+    reader.open(&first_channel, client_b_id, stream_id, rpc::StreamOrigin::Local);
+    ASSERT_TRUE(reader.grant_window());
+
+    std::atomic<std::uint64_t> produced = 0;
+    std::atomic<bool> writer_done = false;
+
+    std::thread writer_thread([&]() {
+        rpc::StreamWriter<std::uint64_t> writer(&second_channel, client_a_id, stream_id, rpc::StreamOrigin::Remote);
+
+        std::uint64_t next = 0;
+        bool written = writer.write_all([&](std::uint64_t* element) {
+            if (next == COUNT)
+                return false;
+
+            *element = next++;
+            produced++;
+            return true;
+        });
+
+        writer.close(written);
+        writer_done = true;
+    });
+
+    // The writer must stall once the window is used up.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_LE(produced.load(), WINDOW + 1);
+    ASSERT_FALSE(writer_done.load());
+
+    std::vector<std::uint64_t> values;
+
+    ASSERT_TRUE(reader.for_each([&](std::uint64_t value) {
+        values.push_back(value);
+    }));
+
+    writer_thread.join();
+
+    ASSERT_EQ(values.size(), COUNT);
+
+    for (std::uint64_t i = 0; i < COUNT; i++)
+        ASSERT_EQ(values[i], i);
+}
+
+TEST(rpc_test, stream_ids_of_both_sides)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    // Both channels allocate the same id for unrelated streams, which are
+    // both read by the first channel.
+    std::uint64_t stream_id = first_channel.allocate_request_id();
+    ASSERT_EQ(second_channel.allocate_request_id(), stream_id);
+
+    rpc::StreamReader<std::uint64_t> local_reader;
+    local_reader.open(&first_channel, client_b_id, stream_id, rpc::StreamOrigin::Local);
+
+    rpc::StreamReader<std::uint64_t> remote_reader;
+    remote_reader.open(&first_channel, client_b_id, stream_id, rpc::StreamOrigin::Remote);
+
+    {
+        rpc::StreamWriter<std::uint64_t> local_writer(&second_channel, client_a_id, stream_id, rpc::StreamOrigin::Remote, 1);
+        rpc::StreamWriter<std::uint64_t> remote_writer(&second_channel, client_a_id, stream_id, rpc::StreamOrigin::Local, 1);
+
+        ASSERT_TRUE(local_writer.write(10));
+        ASSERT_TRUE(remote_writer.write(20));
+        ASSERT_TRUE(local_writer.close(true));
+        ASSERT_TRUE(remote_writer.close(true));
+    }
+
+    std::uint64_t value = 0;
+
+    ASSERT_TRUE(local_reader.next(&value));
+    ASSERT_EQ(value, 10);
+    ASSERT_FALSE(local_reader.next(&value));
+    ASSERT_TRUE(local_reader.success());
+
+    ASSERT_TRUE(remote_reader.next(&value));
+    ASSERT_EQ(value, 20);
+    ASSERT_FALSE(remote_reader.next(&value));
+    ASSERT_TRUE(remote_reader.success());
+}
+
+TEST(rpc_test, shmbuf_transfer)
+{
+    ipc::Port source;
+    ipc::Port destination;
+
+    ASSERT_TRUE(ipc::Port::create_pair(source, destination));
+
+    constexpr std::size_t BUFFER_SIZE = 1024 * 1024;
+
+    rpc::ShmBufferPool pool;
+    ipc::Message received;
+
+    {
+        rpc::ShmBuffer buffer = pool.acquire(BUFFER_SIZE);
+        ASSERT_EQ(buffer.size(), BUFFER_SIZE);
+        std::memset(buffer.data(), 0xab, buffer.size());
+
+        rpc::Serializer s;
+        s.serialize(buffer);
+
+        ipc::Message sent;
+        sent.payload = s.get_payload();
+        sent.handles = s.get_handles();
+
+        ASSERT_EQ(source.send(sent), ipc::PortError::Ok);
+        ASSERT_EQ(destination.receive(received), ipc::PortError::Ok);
+    }
+
+    // Only the descriptor and the size went through the socket.
+    ASSERT_EQ(received.handles.size(), 1);
+    ASSERT_EQ(received.payload.size(), sizeof(std::uint64_t));
+
+    rpc::Unserializer u(received.payload, received.handles);
+    rpc::ShmBuffer mapped;
+
+    ASSERT_TRUE(u.unserialize(&mapped));
+    ASSERT_EQ(mapped.size(), BUFFER_SIZE);
+    ASSERT_EQ(mapped.data()[0], 0xab);
+    ASSERT_EQ(mapped.data()[BUFFER_SIZE - 1], 0xab);
+
+    // The region is free again and gets reused.
+    rpc::ShmBuffer reused = pool.acquire(16);
+    ASSERT_EQ(pool.size(), 1);
+    ASSERT_EQ(reused.capacity(), mapped.capacity());
+}
+
+TEST(rpc_test, result_cache_lru)
+{
+    rpc::ResultCache cache(2);
+
+    std::vector<std::uint8_t> a = { 1 };
+    std::vector<std::uint8_t> b = { 2 };
+    std::vector<std::uint8_t> c = { 3 };
+
+    cache.insert(0, a, { 10 }, 0, std::chrono::milliseconds(0));
+    cache.insert(0, b, { 20 }, 0, std::chrono::milliseconds(0));
+
+    // Same arguments of another method are another entry.
+    ASSERT_EQ(cache.find(1, a, 0), nullptr);
+    ASSERT_EQ(*cache.find(0, a, 0), std::vector<std::uint8_t>({ 10 }));
+
+    // b is the least recently used entry.
+    cache.insert(0, c, { 30 }, 0, std::chrono::milliseconds(0));
+    ASSERT_EQ(cache.size(), 2);
+    ASSERT_EQ(cache.find(0, b, 0), nullptr);
+    ASSERT_NE(cache.find(0, c, 0), nullptr);
+
+    // Entries from a previous epoch are stale.
+    ASSERT_EQ(cache.find(0, a, 1), nullptr);
+    ASSERT_EQ(cache.size(), 1);
+
+    cache.insert(0, a, { 10 }, 0, std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(cache.find(0, a, 0), nullptr);
+}
+
+TEST(rpc_test, result_cache_invalidation)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    auto receiver_id = second_channel.bind<RecordingReceiver>();
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    // Nobody cached anything yet.
+    ASSERT_TRUE(second_channel.invalidate(receiver_id));
+
+    second_channel.add_cache_subscriber(receiver_id, client_a_id);
+    ASSERT_TRUE(second_channel.invalidate(receiver_id));
+
+    // The subscription is consumed by the invalidation.
+    ASSERT_TRUE(second_channel.invalidate(receiver_id));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQ(first_channel.cache_epoch(client_b_id, receiver_id), 0);
+
+    first_channel.receive_pending();
+    ASSERT_EQ(first_channel.cache_epoch(client_b_id, receiver_id), 1);
+    ASSERT_EQ(first_channel.cache_epoch(client_b_id, receiver_id + 1), 0);
+}
+
+TEST(rpc_test, instrumentation_dump)
+{
+    using Phase = rpc::CallProbe::Phase;
+
+    rpc::Instrumentation::reset();
+    rpc::Instrumentation::enable_trace(true);
+
+    std::size_t method = rpc::Instrumentation::register_method("test::Recording.dump", rpc::Instrumentation::Side::Proxy);
+    ASSERT_EQ(rpc::Instrumentation::register_method("test::Recording.dump", rpc::Instrumentation::Side::Proxy), method);
+
+    std::thread other_thread([&]() {
+        rpc::CallProbe probe(method, Phase::Deserialize);
+        probe.request_bytes(100);
+    });
+
+    other_thread.join();
+
+    {
+        rpc::CallProbe probe(method, Phase::Deserialize);
+        probe.request_bytes(20);
+        probe.phase(Phase::Serialize);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        probe.phase(Phase::Transit);
+        probe.reply_bytes(8);
+    }
+
+    rpc::Instrumentation::enable_trace(false);
+
+    std::ostringstream json;
+    rpc::Instrumentation::dump_json(json);
+
+    // Both threads are aggregated.
+    ASSERT_NE(json.str().find("\"name\": \"test::Recording.dump\", \"side\": \"proxy\", \"calls\": 2, "
+                "\"request_bytes\": 120, \"reply_bytes\": 8"), std::string::npos);
+
+    std::ostringstream trace;
+    rpc::Instrumentation::dump_chrome_trace(trace);
+
+    ASSERT_NE(trace.str().find("\"ph\": \"X\""), std::string::npos);
+}
+
+TEST(rpc_test, instrumentation_exited_threads)
+{
+    using Phase = rpc::CallProbe::Phase;
+
+    rpc::Instrumentation::reset();
+
+    std::size_t method = rpc::Instrumentation::register_method("test::Recording.append", rpc::Instrumentation::Side::Receiver);
+
+    // Each thread gets its own recorder, retired when it exits.
+    for (int round = 0; round < 2; round++)
+    {
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < 8; i++)
+        {
+            threads.emplace_back([&]() {
+                for (int call = 0; call < 10; call++)
+                {
+                    rpc::CallProbe probe(method, Phase::Handler);
+                    probe.request_bytes(3);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        std::ostringstream json;
+        rpc::Instrumentation::dump_json(json);
+
+        std::string expected = fmt::format("\"name\": \"test::Recording.append\", \"side\": \"receiver\", \"calls\": {}, "
+                "\"request_bytes\": {}, \"reply_bytes\": 0", (round + 1) * 80, (round + 1) * 240);
+
+        ASSERT_NE(json.str().find(expected), std::string::npos) << json.str();
+    }
+
+    // Retired counters are reset along with the live ones.
+    rpc::Instrumentation::reset();
+
+    std::ostringstream json;
+    rpc::Instrumentation::dump_json(json);
+
+    ASSERT_EQ(json.str().find("test::Recording.append"), std::string::npos);
+}
+
+TEST(rpc_test, serialized_size_matches_encoding)
+{
+    std::vector<std::optional<std::string>> strings = { "a", std::nullopt, "bcd" };
+    std::vector<std::vector<std::uint32_t>> nested = { { 1, 2 }, {}, { 3 } };
+    std::optional<std::uint16_t> number = 7;
+
+    rpc::Serializer s;
+    s.serialize(strings);
+    s.serialize(nested);
+    s.serialize(number);
+    s.serialize(std::string("xyz"));
+
+    std::size_t expected = rpc::serialized_size(strings) + rpc::serialized_size(nested)
+        + rpc::serialized_size(number) + rpc::serialized_size(std::string("xyz"));
+
+    ASSERT_EQ(s.size(), expected);
+
+    // A recycled buffer keeps its capacity for the next payload.
+    std::vector<std::uint8_t> payload = s.get_payload();
+    const std::uint8_t* buffer = payload.data();
+
+    s.recycle(std::move(payload));
+    s.reserve(expected);
+    s.serialize(strings);
+
+    ASSERT_EQ(s.get_payload().data(), buffer);
+}
+
+TEST(rpc_test, bulk_vector_round_trip)
+{
+    std::vector<std::uint8_t> bytes(1 << 20);
+    std::vector<std::int32_t> numbers = { -1, 2, -3, 4 };
+    std::vector<bool> flags = { true, false, true };
+
+    for (std::size_t i = 0; i < bytes.size(); i++)
+        bytes[i] = static_cast<std::uint8_t>(i * 7);
+
+    rpc::Serializer s;
+    s.serialize(bytes);
+    s.serialize(numbers);
+    s.serialize(flags);
+
+    ASSERT_EQ(s.size(), rpc::serialized_size(bytes) + rpc::serialized_size(numbers) + rpc::serialized_size(flags));
+
+    // Outputs are overwritten, not appended to.
+    std::vector<std::uint8_t> bytes_out = { 1, 2, 3 };
+    std::vector<std::int32_t> numbers_out(100);
+    std::vector<bool> flags_out;
+
+    std::vector<std::uint8_t> payload = s.get_payload();
+    rpc::Unserializer u(payload);
+
+    ASSERT_TRUE(u.unserialize(&bytes_out));
+    ASSERT_TRUE(u.unserialize(&numbers_out));
+    ASSERT_TRUE(u.unserialize(&flags_out));
+    ASSERT_EQ(bytes_out, bytes);
+    ASSERT_EQ(numbers_out, numbers);
+    ASSERT_EQ(flags_out, flags);
+
+    // A length larger than the payload is rejected before reserving.
+    rpc::Serializer corrupted;
+    corrupted.serialize<std::size_t>(SIZE_MAX / 2);
+    corrupted.serialize<std::uint32_t>(1);
+
+    std::vector<std::uint8_t> corrupted_payload = corrupted.get_payload();
+    rpc::Unserializer bad(corrupted_payload);
+    ASSERT_FALSE(bad.unserialize(&numbers_out));
+}
+
+TEST(rpc_test, views_point_into_the_buffer)
+{
+    std::vector<std::uint8_t> bytes = { 0, 1, 2, 254, 255 };
+
+    rpc::Serializer s;
+    s.serialize(std::string("key"));
+    s.serialize(bytes);
+    s.serialize(std::string_view("value"));
+    s.serialize(rpc::ByteView(bytes));
+
+    std::vector<std::uint8_t> payload = s.get_payload();
+    rpc::Unserializer u(payload);
+
+    std::string_view key;
+    rpc::ByteView bytes_view;
+    std::string value;
+    std::vector<std::uint8_t> bytes_copy;
+
+    // Views and owning types share their encoding.
+    ASSERT_TRUE(u.unserialize(&key));
+    ASSERT_TRUE(u.unserialize(&bytes_view));
+    ASSERT_TRUE(u.unserialize(&value));
+    ASSERT_TRUE(u.unserialize(&bytes_copy));
+    ASSERT_EQ(u.remaining(), 0);
+
+    ASSERT_EQ(key, "key");
+    ASSERT_EQ(value, "value");
+    ASSERT_EQ(bytes_view.to_vector(), bytes);
+    ASSERT_EQ(bytes_copy, bytes);
+
+    auto inside = [&](const void* p) {
+        auto* byte = static_cast<const std::uint8_t*>(p);
+        return byte >= payload.data() && byte < payload.data() + payload.size();
+    };
+
+    ASSERT_TRUE(inside(key.data()));
+    ASSERT_TRUE(inside(bytes_view.data()));
+
+    // A view longer than the remaining bytes is rejected.
+    rpc::Unserializer truncated(payload.data(), sizeof(std::size_t) + 2);
+    ASSERT_FALSE(truncated.unserialize(&key));
+}
+
+TEST(rpc_test, encoded_vectors)
+{
+    std::vector<std::uint64_t> stamps = { 1000, 1001, 1003, 1010 };
+    std::vector<std::int32_t> values;
+    std::vector<std::uint8_t> bytes;
+
+    for (int i = 0; i < 1000; i++)
+    {
+        values.push_back((i % 2 ? -i : i) * 1000);
+        bytes.push_back(static_cast<std::uint8_t>(i * 37));
+    }
+
+    rpc::Serializer s;
+    s.serialize(stamps, rpc::Encoding::Delta);
+
+    // Same bytes as SIDL_ENCODING_DELTA in libcprotorpc
+    std::vector<std::uint8_t> delta = { 0x04, 0xd0, 0x0f, 0x02, 0x04, 0x0e };
+    std::vector<std::uint8_t> payload = s.get_payload();
+    ASSERT_EQ(payload, delta);
+
+    for (rpc::Encoding encoding : { rpc::Encoding::Varint, rpc::Encoding::Zigzag, rpc::Encoding::Delta, rpc::Encoding::BitPack })
+    {
+        s.serialize(stamps, encoding);
+        s.serialize(values, encoding);
+        s.serialize(bytes, encoding);
+        s.serialize(std::vector<std::int64_t>{ INT64_MIN, INT64_MAX, 0 }, encoding);
+
+        ASSERT_EQ(s.size(), rpc::serialized_size(stamps, encoding) + rpc::serialized_size(values, encoding) +
+                rpc::serialized_size(bytes, encoding) + rpc::serialized_size(std::vector<std::int64_t>{ INT64_MIN, INT64_MAX, 0 }, encoding));
+
+        payload = s.get_payload();
+        rpc::Unserializer u(payload);
+
+        std::vector<std::uint64_t> stamps_out;
+        std::vector<std::int32_t> values_out = { 1, 2, 3 };
+        std::vector<std::uint8_t> bytes_out;
+        std::vector<std::int64_t> extremes_out;
+
+        ASSERT_TRUE(u.unserialize(&stamps_out, encoding));
+        ASSERT_TRUE(u.unserialize(&values_out, encoding));
+        ASSERT_TRUE(u.unserialize(&bytes_out, encoding));
+        ASSERT_TRUE(u.unserialize(&extremes_out, encoding));
+        ASSERT_EQ(u.remaining(), 0);
+
+        ASSERT_EQ(stamps_out, stamps);
+        ASSERT_EQ(values_out, values);
+        ASSERT_EQ(bytes_out, bytes);
+        ASSERT_EQ(extremes_out, (std::vector<std::int64_t>{ INT64_MIN, INT64_MAX, 0 }));
+
+        // Truncated payloads are rejected
+        rpc::Unserializer truncated(payload.data(), payload.size() / 2);
+        ASSERT_TRUE(truncated.unserialize(&stamps_out, encoding));
+        ASSERT_FALSE(truncated.unserialize(&values_out, encoding));
+    }
+
+    // Packed timestamps take a few bits each instead of 8 bytes
+    std::vector<std::uint64_t> clock;
+
+    for (std::uint64_t i = 0; i < 1000; i++)
+        clock.push_back(1700000000000000000 + i * 1000 + i % 7);
+
+    ASSERT_LT(rpc::serialized_size(clock, rpc::Encoding::Delta), rpc::serialized_size(clock) / 3);
+    ASSERT_LT(rpc::serialized_size(clock, rpc::Encoding::BitPack), rpc::serialized_size(clock) / 3);
+}
+
+TEST(rpc_test, arena_decoding)
+{
+    std::vector<std::string> lines = { "a string too long for the small string optimization", "", "x" };
+    std::optional<std::string> label = std::string(100, 'l');
+    std::vector<std::uint32_t> numbers = { 1, 2, 3 };
+
+    rpc::Serializer s;
+    s.serialize(lines);
+    s.serialize(label);
+    s.serialize(numbers);
+
+    std::vector<std::uint8_t> payload = s.get_payload();
+    std::pmr::monotonic_buffer_resource arena(rpc::arena_size(payload.size()));
+    rpc::Unserializer u(payload);
+    u.set_resource(&arena);
+
+    // Anything not allocated from the arena would throw
+    std::pmr::memory_resource* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+
+    auto lines_out = u.construct<std::pmr::vector<std::pmr::string>>();
+    auto label_out = u.construct<std::optional<std::pmr::string>>();
+    auto numbers_out = u.construct<std::pmr::vector<std::uint32_t>>();
+
+    bool decoded = u.unserialize(&lines_out) && u.unserialize(&label_out) && u.unserialize(&numbers_out);
+
+    std::pmr::set_default_resource(previous);
+    ASSERT_TRUE(decoded);
+    ASSERT_EQ(u.remaining(), 0);
+
+    ASSERT_EQ(lines_out.size(), lines.size());
+    ASSERT_EQ(std::string_view(lines_out[0]), lines[0]);
+    ASSERT_EQ(lines_out[0].get_allocator().resource(), &arena);
+    ASSERT_EQ(std::string_view(*label_out), *label);
+    ASSERT_EQ(label_out->get_allocator().resource(), &arena);
+    ASSERT_EQ(numbers_out, (std::pmr::vector<std::uint32_t>{ 1, 2, 3 }));
+
+    // Same encoding whatever the allocator
+    s.serialize(lines_out);
+    s.serialize(label_out);
+    s.serialize(numbers_out);
+    ASSERT_EQ(s.size(), rpc::serialized_size(lines_out) + rpc::serialized_size(label_out) + rpc::serialized_size(numbers_out));
+    ASSERT_EQ(s.get_payload(), payload);
+}
+
+struct PackedSample
+{
+    std::uint64_t stamp;
+    std::int32_t value;
+    std::uint16_t flags;
+    std::uint8_t kind;
+    std::uint8_t unit;
+};
+
+namespace rpc
+{
+    template <>
+    struct serializable<PackedSample>
+    {
+        static constexpr bool packed = true;
+
+        static void serialize(const PackedSample& obj, Serializer& s)
+        {
+            s.serialize(&obj, sizeof(obj));
+        }
+    };
+
+    template <>
+    struct unserializable<PackedSample>
+    {
+        static constexpr bool packed = true;
+
+        static bool unserialize(PackedSample* obj, Unserializer& u)
+        {
+            return u.unserialize(obj, sizeof(*obj));
+        }
+    };
+}
+
+TEST(rpc_test, packed_structures)
+{
+    static_assert(rpc::is_trivially_serializable_v<PackedSample> && rpc::is_trivially_unserializable_v<PackedSample>);
+    static_assert(rpc::fixed_serialized_size_v<PackedSample> == 16);
+
+    std::vector<PackedSample> samples;
+
+    for (std::uint32_t i = 0; i < 100; i++)
+        samples.push_back({ 1000 + i, -static_cast<std::int32_t>(i), 3, 4, static_cast<std::uint8_t>(i) });
+
+    rpc::Serializer s;
+    s.serialize(samples);
+    ASSERT_EQ(s.size(), rpc::serialized_size(samples));
+
+    // Same bytes as the fields serialized one by one
+    rpc::Serializer fields;
+    fields.serialize<std::size_t>(samples.size());
+
+    for (const PackedSample& sample : samples)
+    {
+        fields.serialize(sample.stamp);
+        fields.serialize(sample.value);
+        fields.serialize(sample.flags);
+        fields.serialize(sample.kind);
+        fields.serialize(sample.unit);
+    }
+
+    std::vector<std::uint8_t> payload = s.get_payload();
+    ASSERT_EQ(payload, fields.get_payload());
+
+    std::vector<PackedSample> samples_out;
+    rpc::Unserializer u(payload);
+    ASSERT_TRUE(u.unserialize(&samples_out));
+    ASSERT_EQ(u.remaining(), 0);
+    ASSERT_EQ(samples_out.size(), samples.size());
+    ASSERT_EQ(samples_out[42].stamp, 1042);
+    ASSERT_EQ(samples_out[42].value, -42);
+    ASSERT_EQ(samples_out[42].unit, 42);
+
+    // A truncated vector is rejected
+    rpc::Unserializer truncated(payload.data(), payload.size() - 1);
+    ASSERT_FALSE(truncated.unserialize(&samples_out));
+}
+
+TEST(rpc_test, fixed_arrays)
+{
+    static_assert(rpc::is_trivially_serializable_v<std::array<std::uint32_t, 4>>);
+    static_assert(rpc::fixed_serialized_size_v<std::array<std::array<std::uint16_t, 3>, 2>> == 12);
+    static_assert(rpc::fixed_serialized_size_v<std::array<PackedSample, 2>> == 32);
+    static_assert(!rpc::is_trivially_serializable_v<std::array<bool, 4>>);
+
+    std::array<std::uint32_t, 4> hash = { 1, 2, 3, 0xdeadbeef };
+    std::array<std::string, 2> names = { "left", "right" };
+    std::array<bool, 3> flags = { true, false, true };
+
+    // Encoded without length
+    rpc::Serializer s;
+    s.serialize(hash);
+    ASSERT_EQ(s.size(), 16);
+    s.serialize(names);
+    s.serialize(flags);
+    ASSERT_EQ(s.size(), rpc::serialized_size(hash) + rpc::serialized_size(names) + rpc::serialized_size(flags));
+
+    std::array<std::uint32_t, 4> hash_out = {};
+    std::array<std::string, 2> names_out;
+    std::array<bool, 3> flags_out = {};
+
+    std::vector<std::uint8_t> payload = s.get_payload();
+    rpc::Unserializer u(payload);
+    ASSERT_TRUE(u.unserialize(&hash_out));
+    ASSERT_TRUE(u.unserialize(&names_out));
+    ASSERT_TRUE(u.unserialize(&flags_out));
+    ASSERT_EQ(u.remaining(), 0);
+    ASSERT_EQ(hash_out, hash);
+    ASSERT_EQ(names_out, names);
+    ASSERT_EQ(flags_out, flags);
+
+    // Vectors of arrays of scalars are copied in bulk as well
+    std::vector<std::array<std::uint8_t, 16>> ids(10);
+    ids[7][15] = 0x42;
+
+    rpc::Serializer v;
+    v.serialize(ids);
+    ASSERT_EQ(v.size(), sizeof(std::size_t) + 160);
+
+    std::vector<std::array<std::uint8_t, 16>> ids_out;
+    std::vector<std::uint8_t> ids_payload = v.get_payload();
+    rpc::Unserializer vu(ids_payload);
+    ASSERT_TRUE(vu.unserialize(&ids_out));
+    ASSERT_EQ(ids_out, ids);
+
+    // A truncated array is rejected
+    rpc::Unserializer truncated(payload.data(), 15);
+    ASSERT_FALSE(truncated.unserialize(&hash_out));
+}
+
+TEST(rpc_test, tables)
+{
+    std::string key = "routing key";
+    std::vector<std::uint8_t> body(1 << 20, 0x5a);
+    std::uint64_t stamp = 1234;
+
+    rpc::Serializer s;
+    rpc::TableWriter<3> writer(s);
+    writer.next_field();
+    s.serialize(key);
+    writer.next_field();
+    s.serialize(body);
+    writer.next_field();
+    s.serialize(stamp);
+    writer.finish();
+    s.serialize<std::uint32_t>(42);
+
+    ASSERT_EQ(s.size(), rpc::TableWriter<3>::header_size + rpc::serialized_size(key) + rpc::serialized_size(body) + 4 + 8);
+
+    std::vector<std::uint8_t> payload = s.get_payload();
+    rpc::Unserializer u(payload);
+    rpc::Table<3> table;
+
+    // Binding skips the whole table
+    ASSERT_TRUE(table.bind(u));
+    std::uint32_t next = 0;
+    ASSERT_TRUE(u.unserialize(&next));
+    ASSERT_EQ(next, 42);
+
+    // Fields in any order, without decoding the others
+    std::uint64_t stamp_out = 0;
+    std::string_view key_out;
+    ASSERT_TRUE(table.field(2).unserialize(&stamp_out));
+    ASSERT_TRUE(table.field(0).unserialize(&key_out));
+    ASSERT_EQ(stamp_out, stamp);
+    ASSERT_EQ(key_out, key);
+
+    std::vector<std::uint8_t> body_out;
+    ASSERT_TRUE(table.field(1).unserialize(&body_out));
+    ASSERT_EQ(body_out, body);
+
+    // A field cannot be read past its end, the stamp is not a string size
+    std::string wrong;
+    ASSERT_FALSE(table.field(2).unserialize(&wrong));
+
+    // Offsets out of order are rejected
+    std::vector<std::uint8_t> corrupted = payload;
+    corrupted[sizeof(std::size_t) + 7] = 0xff;
+    rpc::Unserializer c(corrupted);
+    ASSERT_FALSE(table.bind(c));
+
+    // As are truncated tables
+    rpc::Unserializer truncated(payload.data(), payload.size() - 8);
+    ASSERT_FALSE(table.bind(truncated));
+
+    rpc::Table<3> unbound;
+    ASSERT_FALSE(unbound.field(0).unserialize(&key_out));
+}
+
+TEST(rpc_test, object_table_stale_ids)
+{
+    rpc::ObjectTable table;
+
+    rpc::ObjectId first = table.allocate(std::make_shared<SimpleSendReceiver>());
+    rpc::ObjectId second = table.allocate();
+
+    ASSERT_NE(first, second);
+    ASSERT_NE(table.find(first), nullptr);
+    ASSERT_EQ(table.find(second), nullptr);
+    ASSERT_TRUE(table.contains(second));
+    ASSERT_EQ(table.size(), 2);
+
+    ASSERT_TRUE(table.release(first));
+    ASSERT_FALSE(table.release(first));
+    ASSERT_FALSE(table.contains(first));
+
+    // The slot is reused with a new generation, the old id must not resolve.
+    rpc::ObjectId third = table.allocate(std::make_shared<SimpleSendReceiver>());
+
+    ASSERT_EQ(rpc::ObjectTable::index_of(third), rpc::ObjectTable::index_of(first));
+    ASSERT_NE(third, first);
+    ASSERT_EQ(table.find(first), nullptr);
+    ASSERT_NE(table.find(third), nullptr);
+}
+
+TEST(rpc_test, object_table_static_ids)
+{
+    rpc::ObjectTable table;
+
+    table.insert(3, std::make_shared<SimpleSendReceiver>());
+
+    ASSERT_TRUE(table.contains(3));
+    ASSERT_EQ(table.size(), 1);
+
+    // Slots skipped by the static id are still handed out.
+    std::vector<rpc::ObjectId> ids;
+
+    for (int i = 0; i < 4; i++)
+        ids.push_back(table.allocate());
+
+    for (rpc::ObjectId id : ids)
+        ASSERT_NE(id, 3);
+
+    ASSERT_EQ(table.size(), 5);
+}
+
+class LifetimeReceiver : public rpc::RpcReceiver
+{
+public:
+    LifetimeReceiver(bool* alive)
+        : alive_(alive)
+    {
+        *alive_ = true;
+    }
+
+    ~LifetimeReceiver()
+    {
+        *alive_ = false;
+    }
+
+    void on_message(rpc::Channel& chan, rpc::ObjectId object, rpc::PortId source_port, rpc::Message& message) override
+    {}
+
+private:
+    bool* alive_;
+};
+
+TEST(rpc_test, refcounted_object_lifetime)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+
+    auto pump = [&](auto done) {
+        for (int i = 0; i < 500 && !done(); i++)
+        {
+            pollfd fd = { second_channel.handle(), POLLIN, 0 };
+
+            if (::poll(&fd, 1, 10) > 0)
+                second_channel.poll_once();
+        }
+    };
+
+    bool alive = false;
+    rpc::ObjectId receiver_id = second_channel.bind_refcounted<LifetimeReceiver>(&alive);
+
+    ASSERT_TRUE(rpc::ObjectTable::is_refcounted(receiver_id));
+
+    auto first_proxy = first_channel.connect<SimpleSendProxy>(client_b_id, receiver_id);
+    auto second_proxy = first_channel.connect<SimpleSendProxy>(client_b_id, receiver_id);
+
+    pump([&]() { return second_channel.reference_count(receiver_id) == 2; });
+    ASSERT_EQ(second_channel.reference_count(receiver_id), 2);
+
+    first_proxy.reset();
+    ASSERT_TRUE(first_channel.flush());
+
+    pump([&]() { return second_channel.reference_count(receiver_id) == 1; });
+    ASSERT_EQ(second_channel.reference_count(receiver_id), 1);
+    ASSERT_TRUE(alive);
+
+    // The last release frees the receiver.
+    second_proxy.reset();
+    ASSERT_TRUE(first_channel.flush());
+
+    pump([&]() { return !second_channel.is_bound(receiver_id); });
+    ASSERT_FALSE(second_channel.is_bound(receiver_id));
+    ASSERT_FALSE(alive);
+
+    // Objects bound with bind() are only removed explicitly.
+    bool static_alive = false;
+    rpc::ObjectId static_id = second_channel.bind<LifetimeReceiver>(&static_alive);
+
+    ASSERT_FALSE(rpc::ObjectTable::is_refcounted(static_id));
+    ASSERT_TRUE(second_channel.unbind(static_id));
+    ASSERT_FALSE(second_channel.unbind(static_id));
+    ASSERT_FALSE(static_alive);
+}
+
+class PingMultiProxy : public rpc::RpcMultiProxy
+{
+public:
+    PingMultiProxy(rpc::Channel* chan, rpc::ObjectId object_id, std::vector<rpc::RemoteObject> targets)
+        : rpc::RpcMultiProxy(chan, object_id, std::move(targets))
+    {}
+
+    bool ping(std::string ping_str, std::vector<std::size_t>* answered)
+    {
+        rpc::Message message;
+        message.source = id();
+        message.destination = 0;
+        message.opcode = PING_COMMAND;
+        message.deadline = call_deadline();
+
+        rpc::Serializer s;
+        s.serialize(ping_str);
+        message.payload = s.get_payload();
+
+        answered->clear();
+
+        return gather_(message, [&](std::size_t target, rpc::Message& reply) {
+            rpc::Unserializer u(reply.payload);
+            std::string output;
+
+            if (!u.unserialize(&output) || output != ping_str)
+                return false;
+
+            answered->push_back(target);
+            return true;
+        });
+    }
+};
+
+TEST(rpc_test, multi_proxy_gather_modes)
+{
+    int client_a_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_a_socks), 0);
+
+    int client_b_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_b_socks), 0);
+
+    int client_c_socks[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, client_c_socks), 0);
+
+    ipc::Router router;
+
+    rpc::PortId client_a_id = router.add_port(ipc::Port(client_a_socks[0]));
+    rpc::PortId client_b_id = router.add_port(ipc::Port(client_b_socks[0]));
+    rpc::PortId client_c_id = router.add_port(ipc::Port(client_c_socks[0]));
+
+    rpc::Channel first_channel(client_a_id, ipc::Port(client_a_socks[1]));
+    rpc::Channel second_channel(client_b_id, ipc::Port(client_b_socks[1]));
+    rpc::Channel third_channel(client_c_id, ipc::Port(client_c_socks[1]));
+
+    std::vector<rpc::RemoteObject> targets = {
+        { client_b_id, second_channel.bind<SimpleSendReceiver>() },
+        { client_c_id, third_channel.bind<SimpleSendReceiver>() },
+        { client_b_id, second_channel.bind<SimpleSendReceiver>() },
+    };
+
+    // A target which never answers, its receiver is gone.
+    rpc::ObjectId gone = third_channel.bind<SimpleSendReceiver>();
+    ASSERT_TRUE(third_channel.unbind(gone));
+
+    std::thread router_thread([&]() {
+        router.loop();
+    });
+
+    std::thread second_thread([&]() {
+        second_channel.loop();
+    });
+
+    std::thread third_thread([&]() {
+        third_channel.loop();
+    });
+
+    // Leaking threads
+    router_thread.detach();
+    second_thread.detach();
+    third_thread.detach();
+
+    auto proxy = first_channel.connect_multi<PingMultiProxy>(targets);
+    std::vector<std::size_t> answered;
+
+    ASSERT_TRUE(proxy->ping("all", &answered));
+    std::sort(answered.begin(), answered.end());
+    ASSERT_EQ(answered, std::vector<std::size_t>({ 0, 1, 2 }));
+
+    proxy->set_policy(rpc::GatherPolicy::first(1));
+    ASSERT_TRUE(proxy->ping("first", &answered));
+    ASSERT_EQ(answered.size(), 1);
+
+    // Answers of the cancelled requests must not disturb the next call.
+    auto quorum = first_channel.connect_multi<PingMultiProxy>(std::vector<rpc::RemoteObject>{
+        targets[0], targets[1], { client_c_id, gone },
+    });
+
+    quorum->set_policy(rpc::GatherPolicy::quorum());
+    quorum->set_timeout(std::chrono::seconds(5));
+    ASSERT_TRUE(quorum->ping("quorum", &answered));
+    ASSERT_EQ(answered.size(), 2);
+
+    quorum->set_policy(rpc::GatherPolicy::all());
+    quorum->set_timeout(std::chrono::milliseconds(50));
+    ASSERT_FALSE(quorum->ping("all", &answered));
+    ASSERT_EQ(quorum->last_error(), rpc::ChannelError::Timeout);
+    ASSERT_EQ(quorum->last_reply_count(), 2);
+}
+
 int main(int argc, char** argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -1,4 +1,4 @@
-from typing import List, Optional, Tuple
+from typing import Dict, List, Optional, Tuple
 
 
 class AstNode:
@@ -21,9 +21,13 @@ class Type(AstNode):
     value: str
     generics: List['Type']
 
-    def __init__(self, value: str, generics: Optional[List['Type']] = None) -> None:
+    # Number of elements of array<T, N>
+    size: Optional[int]
+
+    def __init__(self, value: str, generics: Optional[List['Type']] = None, size: Optional[int] = None) -> None:
         super().__init__()
         self.value = value
+        self.size = size
 
         if generics is not None:
             self.generics = generics
@@ -46,10 +50,14 @@ class VariableDeclaration(AstNode):
     type: Type
     name: Symbol
 
+    # Annotations placed before the type (@encoding(delta) vec<u64> values)
+    annotations: Dict[str, Optional[str]]
+
     def __init__(self, type: Type, name: Symbol) -> None:
         super().__init__()
         self.type = type
         self.name = name
+        self.annotations = {}
 
 
 class Method(AstNode):
@@ -57,11 +65,15 @@ class Method(AstNode):
     arguments: List[VariableDeclaration]
     return_values: Optional[List[VariableDeclaration]]
 
+    # Annotations placed before the method (@name or @name(value))
+    annotations: Dict[str, Optional[str]]
+
     def __init__(self, name: Symbol) -> None:
         super().__init__()
         self.name = name
         self.arguments = []
         self.return_values = None
+        self.annotations = {}
 
     def add_argument(self, argument: VariableDeclaration) -> None:
         self.arguments.append(argument)
@@ -77,10 +89,14 @@ class Struct(AstNode):
     name: Symbol
     fields: List[VariableDeclaration]
 
+    # Annotations placed before the structure (@table struct A { ... })
+    annotations: Dict[str, Optional[str]]
+
     def __init__(self, name: Symbol) -> None:
         super().__init__()
         self.name = name
         self.fields = []
+        self.annotations = {}
 
     def add_variable(self, var_type: Type, var_name: Symbol) -> None:
         self.fields.append(VariableDeclaration(var_type, var_name))
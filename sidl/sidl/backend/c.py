@@ -1,19 +1,32 @@
-from typing import Dict, Set, List
+from typing import Dict, List, Optional, Tuple
 from sidl.utils import IndentedWriter
-from sidl.ast import Visitor, Type, Symbol, VariableDeclaration, Namespace, AstNode, Struct, VariableDeclaration, Interface
+from sidl.ast import Visitor, Type, Symbol, VariableDeclaration, Namespace, AstNode, Struct, Interface, Method
 
 
-def fixup_struct_types(root: AstNode) -> Dict[str, str]:
+ENCODINGS = {
+    "varint": "SIDL_ENCODING_VARINT",
+    "zigzag": "SIDL_ENCODING_ZIGZAG",
+    "delta": "SIDL_ENCODING_DELTA",
+    "bitpack": "SIDL_ENCODING_BITPACK",
+}
+
+
+def fixup_struct_types(root: AstNode) -> Tuple[Dict[str, str], Dict[str, Struct]]:
     """
     Struct names are left as is after the type resolving. We need to prefix
-    them with the namespace information.
+    them with the namespace information. The definitions are returned along
+    with the prefixed names.
     """
 
     class StructCollector(Visitor):
         namespace: List[str]
+        names: Dict[str, str]
+        structs: Dict[str, Struct]
 
         def __init__(self):
             self.namespace = []
+            self.names = {}
+            self.structs = {}
 
         def visit_Namespace(self, node: Namespace) -> None:
             self.namespace.append(node.name.value)
@@ -23,6 +36,19 @@ def fixup_struct_types(root: AstNode) -> Dict[str, str]:
 
             self.namespace.pop()
 
+        def visit_Struct(self, node: Struct) -> None:
+            self.names[node.name.value] = "_".join(self.namespace + [node.name.value])
+            self.structs[node.name.value] = node
+
+        def visit_Interface(self, node: Interface) -> None:
+            pass
+
+    collector = StructCollector()
+    root.accept(collector)
+
+    return collector.names, collector.structs
+
+
 class BaseCCompiler(Visitor):
     """
     Common code shared between the C visitors.
@@ -30,34 +56,349 @@ class BaseCCompiler(Visitor):
 
     writer: IndentedWriter
     _types: Dict[str, str]
-    _core_types: Set[str]
+    _struct_names: Dict[str, str]
+    _structs: Dict[str, Struct]
     _namespace_parts: List[str]
 
+    SCALAR_TYPES = ("bool", "u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64", "usize")
+
     def __init__(self, types: Dict[str, str], indent: int = 4) -> None:
         self._types = types
-        self._core_types = set(["bool", "u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64", "usize"])
+        self._struct_names = {}
+        self._structs = {}
         self._namespace_parts = []
         self.writer = IndentedWriter(indent)
 
+    def element_name(self, node: Type) -> str:
+        """
+        Name of a type in the libcprotorpc functions and containers, bools
+        are encoded as u8.
+        """
+        if node.value == "bool":
+            return "u8"
+
+        return self._struct_names.get(node.value, node.value)
+
     def cify_type(self, node: Type) -> str:
         if node.value == "vec":
-            return "sidl_" + self.cify_type(node.generics[0]) + "_vector"
+            return "sidl_" + self.element_name(node.generics[0]) + "_vector"
         elif node.value == "optional":
-            return "sidl_" + self.cify_type(node.generics[0]) + "_optional"
+            return "sidl_" + self.element_name(node.generics[0]) + "_optional"
+        elif node.value == "array":
+            return self.cify_type(node.generics[0])
+        elif node.value in self._struct_names:
+            return self._struct_names[node.value]
+        else:
+            return self._types.get(node.value, node.value)
+
+    def array_dimensions(self, node: Type) -> str:
+        """
+        Fixed arrays are C arrays, their dimensions follow the declared name.
+        """
+        if node.value != "array":
+            return ""
+
+        return f"[{node.size}]" + self.array_dimensions(node.generics[0])
+
+    def declaration(self, node: Type, name: str) -> str:
+        return f"{self.cify_type(node)} {name}{self.array_dimensions(node)}"
+
+    def param_declaration(self, node: Type, name: str) -> str:
+        """
+        Arguments are borrowed: scalars and handles are passed by value,
+        strings as const char*, the other types by const pointer.
+        """
+        if node.value in self.SCALAR_TYPES or node.value == "handle":
+            return self.declaration(node, name)
+
+        if node.value == "string":
+            return f"const char* {name}"
+
+        if node.value == "array":
+            const = "const " if self.is_bulk_array(node) else ""
+            return const + self.declaration(node, name)
+
+        return f"const {self.cify_type(node)}* {name}"
+
+    def is_passed_by_pointer(self, node: Type) -> bool:
+        return node.value not in self.SCALAR_TYPES and node.value not in ("handle", "string", "array")
+
+    def out_declaration(self, node: Type, name: str) -> str:
+        """
+        Return values are written to storage provided by the caller.
+        """
+        if node.value == "array":
+            return self.declaration(node, name)
+
+        return f"{self.cify_type(node)}* {name}"
+
+    def param_expression(self, node: Type, name: str) -> str:
+        """
+        Value of an argument declared with param_declaration().
+        """
+        if self.is_passed_by_pointer(node):
+            return f"(*{name})"
+
+        return name
+
+    def out_expression(self, node: Type, name: str) -> str:
+        if node.value == "array":
+            return name
+
+        return f"(*{name})"
+
+    def address_of(self, node: Type, expr: str) -> str:
+        if node.value == "array":
+            return expr
+
+        # &(*name) is name
+        if expr.startswith("(*") and expr.endswith(")") and expr[2:-1].isidentifier():
+            return expr[2:-1]
+
+        return f"&{expr}"
+
+    def is_bulk_array(self, node: Type) -> bool:
+        """
+        Arrays of scalars are encoded as their memory representation.
+        """
+        while node.value == "array":
+            node = node.generics[0]
+
+        return node.value in self.SCALAR_TYPES
+
+    def needs_destroy(self, node: Type) -> bool:
+        if node.value in self.SCALAR_TYPES or node.value == "handle":
+            return False
+
+        if node.value == "array":
+            return self.needs_destroy(node.generics[0])
+
+        return True
+
+    def _loop_variable(self, depth: int) -> str:
+        return f"__sidl_i{depth}"
+
+    def _write_loop(self, count: str, depth: int) -> str:
+        i = self._loop_variable(depth)
+        self.writer.write_line(f"for (size_t {i} = 0; {i} < {count}; {i}++)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        return i
+
+    def _end_loop(self) -> None:
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+    def compile_init(self, node: Type, expr: str) -> None:
+        """
+        Initializes a value so that destroying it is valid.
+        """
+        if node.value in self._struct_names:
+            self.writer.write_line(f"{self._struct_names[node.value]}_init({self.address_of(node, expr)});")
+        elif node.value == "array":
+            self.writer.write_line(f"memset({expr}, 0, sizeof({expr}[0]) * {node.size});")
+        elif node.value == "shmbuf":
+            self.writer.write_line(f"memset({self.address_of(node, expr)}, 0, sizeof({expr}));")
+            self.writer.write_line(f"{expr}.fd = -1;")
         else:
-            return node.value
+            self.writer.write_line(f"memset({self.address_of(node, expr)}, 0, sizeof({expr}));")
+
+    def compile_write(self, node: Type, expr: str, fail: str, encoding: Optional[str] = None, depth: int = 0) -> None:
+        ty = node.value
+        s = "__sidl_s"
+
+        def check(call: str) -> None:
+            self.writer.write_line(f"if ({call} < 0)")
+            self.writer.indent()
+            self.writer.write_line(fail)
+            self.writer.deindent()
+
+        if ty in self.SCALAR_TYPES:
+            check(f"sidl_serializer_write_{self.element_name(node)}({s}, {expr})")
+        elif ty == "string":
+            check(f"sidl_serializer_write_string({s}, {expr} ? {expr} : \"\")")
+        elif ty == "handle":
+            check(f"sidl_serializer_write_fd({s}, {expr})")
+        elif ty == "shmbuf":
+            check(f"sidl_serializer_write_shmbuf({s}, {self.address_of(node, expr)})")
+        elif ty in self._struct_names:
+            check(f"{self._struct_names[ty]}_write({s}, {self.address_of(node, expr)})")
+        elif ty == "vec" and encoding is not None:
+            check(f"sidl_serializer_write_encoded_{self.element_name(node.generics[0])}({s}, {expr}.elements, {expr}.size, {ENCODINGS[encoding]})")
+        elif ty == "vec" and node.generics[0].value in self.SCALAR_TYPES:
+            check(f"sidl_serializer_write_{self.element_name(node.generics[0])}_vector({s}, {self.address_of(node, expr)})")
+        elif ty == "vec":
+            check(f"sidl_serializer_write_usize({s}, {expr}.size)")
+            i = self._write_loop(f"{expr}.size", depth)
+            self.compile_write(node.generics[0], f"{expr}.elements[{i}]", fail, depth=depth + 1)
+            self._end_loop()
+        elif ty == "optional":
+            check(f"sidl_serializer_write_u8({s}, {expr}.present ? 1 : 0)")
+            self.writer.write_line(f"if ({expr}.present)")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.compile_write(node.generics[0], f"{expr}.element", fail, depth=depth)
+            self.writer.deindent()
+            self.writer.write_line("}")
+        elif ty == "array":
+            if node.generics[0].value in self.SCALAR_TYPES:
+                check(f"sidl_serializer_write_{self.element_name(node.generics[0])}_array({s}, {expr}, {node.size})")
+            elif self.is_bulk_array(node):
+                check(f"sidl_serializer_write_raw({s}, {expr}, sizeof({expr}[0]) * {node.size})")
+            else:
+                i = self._write_loop(str(node.size), depth)
+                self.compile_write(node.generics[0], f"{expr}[{i}]", fail, depth=depth + 1)
+                self._end_loop()
+
+    def compile_read(self, node: Type, expr: str, fail: str, encoding: Optional[str] = None, depth: int = 0) -> None:
+        """
+        Reads into an initialized value, which is left destroyable on failure.
+        """
+        ty = node.value
+        u = "__sidl_u"
+
+        def check(call: str) -> None:
+            self.writer.write_line(f"if ({call} < 0)")
+            self.writer.indent()
+            self.writer.write_line(fail)
+            self.writer.deindent()
+
+        if ty in self.SCALAR_TYPES:
+            check(f"sidl_unserializer_read_{self.element_name(node)}({u}, {self.address_of(node, expr)})")
+        elif ty == "string":
+            check(f"sidl_unserializer_read_string({u}, (const char**){self.address_of(node, expr)})")
+        elif ty == "handle":
+            check(f"sidl_unserializer_read_fd({u}, {self.address_of(node, expr)})")
+        elif ty == "shmbuf":
+            check(f"sidl_unserializer_read_shmbuf({u}, {self.address_of(node, expr)})")
+        elif ty in self._struct_names:
+            check(f"{self._struct_names[ty]}_read({u}, {self.address_of(node, expr)})")
+        elif ty == "vec" and encoding is not None:
+            check(f"sidl_unserializer_read_encoded_{self.element_name(node.generics[0])}({u}, {self.address_of(node, expr)}, {ENCODINGS[encoding]})")
+        elif ty == "vec" and node.generics[0].value in self.SCALAR_TYPES:
+            check(f"sidl_unserializer_read_{self.element_name(node.generics[0])}_vector({u}, {self.address_of(node, expr)})")
+        elif ty == "vec":
+            element = node.generics[0]
+            count = f"__sidl_count{depth}"
+
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.writer.write_line(f"size_t {count} = 0;")
+            check(f"sidl_unserializer_read_usize({u}, &{count})")
+
+            # Elements take at least a byte, a corrupted count cannot make the
+            # allocation explode.
+            self.writer.write_line(f"if ({count} > {u}->data_size - {u}->data_offset)")
+            self.writer.indent()
+            self.writer.write_line(fail)
+            self.writer.deindent()
+
+            self.writer.write_line(f"{expr}.elements = sidl_unserializer_alloc({u}, {count} * sizeof(*{expr}.elements));")
+            self.writer.write_line(f"if (!{expr}.elements)")
+            self.writer.indent()
+            self.writer.write_line(fail)
+            self.writer.deindent()
+            self.writer.write_line(f"{expr}.capacity = {count};")
+
+            # Zeroed elements can be destroyed if decoding them fails
+            self.writer.write_line(f"memset({expr}.elements, 0, {count} * sizeof(*{expr}.elements));")
+            self.writer.write_line(f"{expr}.size = {count};")
+
+            i = self._write_loop(count, depth)
+            self.compile_read(element, f"{expr}.elements[{i}]", fail, depth=depth + 1)
+            self._end_loop()
+
+            self.writer.deindent()
+            self.writer.write_line("}")
+        elif ty == "optional":
+            check(f"sidl_unserializer_read_u8({u}, &{expr}.present)")
+            self.writer.write_line(f"if ({expr}.present)")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.compile_read(node.generics[0], f"{expr}.element", fail, depth=depth)
+            self.writer.deindent()
+            self.writer.write_line("}")
+        elif ty == "array":
+            if node.generics[0].value in self.SCALAR_TYPES:
+                check(f"sidl_unserializer_read_{self.element_name(node.generics[0])}_array({u}, {expr}, {node.size})")
+            elif self.is_bulk_array(node):
+                check(f"sidl_unserializer_read_raw({u}, {expr}, sizeof({expr}[0]) * {node.size})")
+            else:
+                i = self._write_loop(str(node.size), depth)
+                self.compile_read(node.generics[0], f"{expr}[{i}]", fail, depth=depth + 1)
+                self._end_loop()
+
+    def compile_destroy(self, node: Type, expr: str, depth: int = 0) -> None:
+        ty = node.value
+
+        if not self.needs_destroy(node):
+            return
+
+        if ty == "string":
+            self.writer.write_line(f"free({expr});")
+        elif ty == "shmbuf":
+            self.writer.write_line(f"sidl_shmbuf_destroy({self.address_of(node, expr)});")
+        elif ty in self._struct_names:
+            self.writer.write_line(f"{self._struct_names[ty]}_destroy({self.address_of(node, expr)});")
+        elif ty in ("vec", "optional"):
+            self.writer.write_line(f"{self.cify_type(node)}_destroy({self.address_of(node, expr)});")
+        elif ty == "array":
+            i = self._write_loop(str(node.size), depth)
+            self.compile_destroy(node.generics[0], f"{expr}[{i}]", depth + 1)
+            self._end_loop()
+
+    def holds_shmbuf(self, node: Type) -> bool:
+        if node.value == "shmbuf":
+            return True
+
+        if node.value in self._structs:
+            return any(self.holds_shmbuf(field.type) for field in self._structs[node.value].fields)
+
+        return any(self.holds_shmbuf(generic) for generic in node.generics)
+
+    def compile_release(self, node: Type, expr: str, depth: int = 0) -> None:
+        """
+        Releases a value decoded in an arena: its memory goes away with the
+        arena, only the shared memory buffers it holds are destroyed.
+        """
+        ty = node.value
+
+        if not self.holds_shmbuf(node):
+            return
+
+        if ty == "shmbuf":
+            self.writer.write_line(f"sidl_shmbuf_destroy({self.address_of(node, expr)});")
+        elif ty in self._structs:
+            for field in self._structs[ty].fields:
+                self.compile_release(field.type, f"{expr}.{field.name.value}", depth)
+        elif ty == "vec":
+            i = self._write_loop(f"{expr}.size", depth)
+            self.compile_release(node.generics[0], f"{expr}.elements[{i}]", depth + 1)
+            self._end_loop()
+        elif ty == "optional":
+            self.writer.write_line(f"if ({expr}.present)")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.compile_release(node.generics[0], f"{expr}.element", depth)
+            self.writer.deindent()
+            self.writer.write_line("}")
+        elif ty == "array":
+            i = self._write_loop(str(node.size), depth)
+            self.compile_release(node.generics[0], f"{expr}[{i}]", depth + 1)
+            self._end_loop()
+
+    def encoding_of(self, decl: VariableDeclaration) -> Optional[str]:
+        return decl.annotations.get("encoding")
 
     def visit_Type(self, node: Type) -> None:
-        c_type = self._types.get(node.value, node.value)
         self.writer.write(self.cify_type(node))
 
     def visit_Symbol(self, node: Symbol) -> None:
         self.writer.write(node.value)
 
     def visit_VariableDeclaration(self, decl: VariableDeclaration) -> None:
-        decl.type.accept(self)
-        self.writer.write(" ")
-        decl.name.accept(self)
+        self.writer.write(self.declaration(decl.type, decl.name.value))
 
     def visit_Namespace(self, node: Namespace) -> None:
         self._namespace_parts.append(node.name.value)
@@ -73,6 +414,28 @@ class BaseCCompiler(Visitor):
 
         return "_".join(self._namespace_parts) + "_"
 
+    def proxy_signature(self, interface_name: str, node: Method) -> str:
+        params = ["sidl_proxy_t* __sidl_proxy"]
+        params += [self.param_declaration(e.type, e.name.value) for e in node.arguments]
+        params += [self.out_declaration(e.type, e.name.value) for e in node.return_values or []]
+
+        return f"int {interface_name}_{node.name.value}(" + ", ".join(params) + ")"
+
+    def vtable_entry(self, node: Method) -> str:
+        params = ["void* object"]
+        params += [self.param_declaration(e.type, e.name.value) for e in node.arguments]
+        params += [self.out_declaration(e.type, e.name.value) for e in node.return_values or []]
+
+        return f"void (*{node.name.value})(" + ", ".join(params) + ");"
+
+    def dispatch_signature(self, interface_name: str) -> str:
+        return (f"void {interface_name}_dispatch(sidl_channel_t* __sidl_channel, const sidl_receiver_t* __sidl_receiver, "
+                "uint64_t __sidl_source_port, sidl_message_t* __sidl_message)")
+
+    def visit(self, root: AstNode) -> None:
+        self._struct_names, self._structs = fixup_struct_types(root)
+        root.accept(self)
+
     @property
     def data(self) -> str:
         return self.writer.data()
@@ -89,12 +452,33 @@ class HeaderCompiler(BaseCCompiler):
         self._types = types
 
     def visit_Interface(self, node: Interface) -> None:
-        pass
+        interface_name = self.namespace_prefix() + node.name.value
+
+        # Receivers implement the entries of the vtable. Arguments are
+        # decoded in the arena of the channel and released once the entry
+        # returns, except handles which it owns. Return values are zeroed
+        # beforehand and destroyed once sent.
+        self.writer.write_line(f"typedef struct {interface_name}_vtable")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        for method in node.methods:
+            self.writer.write_line(self.vtable_entry(method))
+
+        self.writer.deindent()
+        self.writer.write_line(f"}} {interface_name}_vtable;")
+        self.writer.write_line("")
+
+        self.writer.write_line(self.dispatch_signature(interface_name) + ";")
+        self.writer.write_line(f"int {interface_name}_bind(sidl_channel_t* c, uint64_t id, const {interface_name}_vtable* vtable, void* object);")
+        self.writer.write_line("")
 
-    def visit_VariableDeclaration(self, node: VariableDeclaration) -> None:
-        node.type.accept(self)
-        self.writer.write(" ")
-        node.name.accept(self)
+        # Proxies return -1 on failure, the return values are then left
+        # destroyed. Otherwise the caller destroys them.
+        for method in node.methods:
+            self.writer.write_line(self.proxy_signature(interface_name, method) + ";")
+
+        self.writer.write_line("")
 
     def visit_Struct(self, node: Struct) -> None:
         struct_name = self.namespace_prefix() + node.name.value
@@ -111,9 +495,18 @@ class HeaderCompiler(BaseCCompiler):
         self.writer.write_line(f"}} {struct_name};")
 
         self.writer.write_line("")
+        self.writer.write_line(f"SIDL_DECLARE_VECTOR_PROTO({struct_name}, {struct_name})")
+        self.writer.write_line(f"SIDL_DECLARE_OPTIONAL_PROTO({struct_name}, {struct_name})")
+        self.writer.write_line("")
+
+        # _read initializes the object first, it must be destroyed whether
+        # it succeeds or not. When the unserializer has an arena, its strings
+        # and vectors are released with the arena instead.
+        self.writer.write_line(f"void {struct_name}_init({struct_name}* obj);")
         self.writer.write_line(f"void {struct_name}_destroy({struct_name}* obj);")
         self.writer.write_line(f"int {struct_name}_read(sidl_unserializer_t* u, {struct_name}* obj);")
-        self.writer.write_line(f"int {struct_name}_write(sidl_serializer_t* s, {struct_name}* obj);")
+        self.writer.write_line(f"int {struct_name}_write(sidl_serializer_t* s, const {struct_name}* obj);")
+        self.writer.write_line("")
 
     def visit(self, root: AstNode) -> None:
         header_name = self._filename.replace(".", "_").upper() + "_H"
@@ -122,10 +515,20 @@ class HeaderCompiler(BaseCCompiler):
         self.writer.write_line(f"#include \"cprotorpc/structures.h\"")
         self.writer.write_line(f"#include \"cprotorpc/unserializer.h\"")
         self.writer.write_line(f"#include \"cprotorpc/serializer.h\"")
+        self.writer.write_line(f"#include \"cprotorpc/shmbuf.h\"")
+        self.writer.write_line(f"#include \"cprotorpc/encoding.h\"")
+        self.writer.write_line(f"#include \"cprotorpc/channel.h\"")
+        self.writer.write_line("")
+        self.writer.write_line("#ifdef __cplusplus")
+        self.writer.write_line("extern \"C\" {")
+        self.writer.write_line("#endif")
         self.writer.write_line("")
 
-        root.accept(self)
+        super().visit(root)
 
+        self.writer.write_line("#ifdef __cplusplus")
+        self.writer.write_line("}")
+        self.writer.write_line("#endif")
         self.writer.write_line("")
         self.writer.write_line("#endif")
 
@@ -140,24 +543,286 @@ class SourceCompiler(BaseCCompiler):
         self._filename = filename
         self._types = types
 
-    def visit_Interface(self, node: Interface) -> None:
-        pass
-
-    def _compile_type_destroy(self, ty: Type) -> None:
-        pass
+    def _compile_init_function(self, node: Struct, struct_name: str) -> None:
+        self.writer.write_line(f"void {struct_name}_init({struct_name}* obj)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("memset(obj, 0, sizeof(*obj));")
 
-    def _compile_field_destructor(self, node: VariableDeclaration) -> None:
-        pass
+        for field in node.fields:
+            if field.type.value in self._struct_names or field.type.value == "shmbuf":
+                self.compile_init(field.type, f"obj->{field.name.value}")
 
-    def _compile_destroy_function(self, node: Struct) -> None:
-        struct_name = self.namespace_prefix() + node.name.value
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
 
+    def _compile_destroy_function(self, node: Struct, struct_name: str) -> None:
         self.writer.write_line(f"void {struct_name}_destroy({struct_name}* obj)")
         self.writer.write_line("{")
         self.writer.indent()
 
+        if not any(self.needs_destroy(field.type) for field in node.fields):
+            self.writer.write_line("(void)obj;")
+
+        for field in node.fields:
+            self.compile_destroy(field.type, f"obj->{field.name.value}")
+
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def _compile_read_function(self, node: Struct, struct_name: str) -> None:
+        self.writer.write_line(f"int {struct_name}_read(sidl_unserializer_t* __sidl_u, {struct_name}* obj)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line(f"{struct_name}_init(obj);")
+
+        for field in node.fields:
+            self.compile_read(field.type, f"obj->{field.name.value}", "return -1;", self.encoding_of(field))
+
+        self.writer.write_line("return 0;")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def _compile_write_function(self, node: Struct, struct_name: str) -> None:
+        self.writer.write_line(f"int {struct_name}_write(sidl_serializer_t* __sidl_s, const {struct_name}* obj)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        for field in node.fields:
+            self.compile_write(field.type, f"obj->{field.name.value}", "return -1;", self.encoding_of(field))
+
+        self.writer.write_line("return 0;")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def _compile_containers(self, struct_name: str) -> None:
+        self.writer.write_line(f"SIDL_DECLARE_VECTOR_IMPL({struct_name}, {struct_name})")
+        self.writer.write_line("")
+        self.writer.write_line(f"void sidl_{struct_name}_vector_destroy(SIDL_VSNAME({struct_name})* v)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("for (size_t i = 0; i < v->size; i++)")
+        self.writer.indent()
+        self.writer.write_line(f"{struct_name}_destroy(&v->elements[i]);")
+        self.writer.deindent()
+        self.writer.write_line("")
+        self.writer.write_line("free(v->elements);")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+        self.writer.write_line(f"void sidl_{struct_name}_optional_destroy(SIDL_OSNAME({struct_name})* opt)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("if (opt->present)")
+        self.writer.indent()
+        self.writer.write_line(f"{struct_name}_destroy(&opt->element);")
+        self.writer.deindent()
         self.writer.deindent()
         self.writer.write_line("}")
+        self.writer.write_line("")
 
     def visit_Struct(self, node: Struct) -> None:
-        self._compile_destroy_function(node)
+        struct_name = self.namespace_prefix() + node.name.value
+
+        self._compile_init_function(node, struct_name)
+        self._compile_destroy_function(node, struct_name)
+        self._compile_read_function(node, struct_name)
+        self._compile_write_function(node, struct_name)
+        self._compile_containers(struct_name)
+
+    def _compile_proxy_method(self, interface_name: str, node: Method, opcode: int) -> None:
+        self.writer.write_line(self.proxy_signature(interface_name, node))
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        self.writer.write_line(f"// Opcode '{node.name.value}' = {opcode}")
+
+        if node.arguments:
+            self.writer.write_line("sidl_serializer_t* __sidl_s = sidl_channel_payload(__sidl_proxy->channel);")
+        else:
+            self.writer.write_line("sidl_channel_payload(__sidl_proxy->channel);")
+
+        for e in node.arguments:
+            self.compile_write(e.type, self.param_expression(e.type, e.name.value), "return -1;", self.encoding_of(e))
+
+        if node.return_values is None:
+            self.writer.write_line("return sidl_channel_send(__sidl_proxy->channel, __sidl_proxy->remote_port, "
+                                   f"__sidl_proxy->id, __sidl_proxy->remote_id, {opcode}, 0);")
+            self.writer.deindent()
+            self.writer.write_line("}")
+            self.writer.write_line("")
+            return
+
+        self.writer.write_line("sidl_unserializer_t __sidl_reply;")
+        self.writer.write_line("sidl_unserializer_t* __sidl_u = &__sidl_reply;")
+        self.writer.write_line("if (sidl_channel_call(__sidl_proxy->channel, __sidl_proxy->remote_port, "
+                               f"__sidl_proxy->id, __sidl_proxy->remote_id, {opcode}, __sidl_u) < 0)")
+        self.writer.indent()
+        self.writer.write_line("return -1;")
+        self.writer.deindent()
+
+        for e in node.return_values:
+            self.compile_init(e.type, self.out_expression(e.type, e.name.value))
+
+        for e in node.return_values:
+            self.compile_read(e.type, self.out_expression(e.type, e.name.value), "goto __sidl_error;", self.encoding_of(e))
+
+        self.writer.write_line("return 0;")
+
+        if node.return_values:
+            self.writer.write_line("")
+            self.writer.deindent()
+            self.writer.write_line("__sidl_error:")
+            self.writer.indent()
+
+            for e in node.return_values:
+                self.compile_destroy(e.type, self.out_expression(e.type, e.name.value))
+
+            self.writer.write_line("return -1;")
+
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def _compile_receive_method(self, interface_name: str, node: Method) -> None:
+        """
+        Decodes the arguments of a request, calls the vtable entry and sends
+        back the return values.
+        """
+        self.writer.write_line(f"static void {interface_name}_receive_{node.name.value}(sidl_channel_t* __sidl_channel, "
+                               "const sidl_receiver_t* __sidl_receiver, uint64_t __sidl_source_port, "
+                               "sidl_message_t* __sidl_message, sidl_unserializer_t* __sidl_u)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line(f"const {interface_name}_vtable* __sidl_vtable = __sidl_receiver->vtable;")
+        decls = node.arguments + (node.return_values or [])
+
+        if node.return_values is not None:
+            self.writer.write_line("sidl_serializer_t* __sidl_s;")
+
+        for e in decls:
+            self.writer.write_line(self.declaration(e.type, e.name.value) + ";")
+
+        if node.return_values is None:
+            self.writer.write_line("(void)__sidl_channel;")
+            self.writer.write_line("(void)__sidl_source_port;")
+            self.writer.write_line("(void)__sidl_message;")
+
+        if not node.arguments:
+            self.writer.write_line("(void)__sidl_u;")
+
+        if decls:
+            self.writer.write_line("")
+
+        for e in decls:
+            self.compile_init(e.type, e.name.value)
+
+        for e in node.arguments:
+            self.compile_read(e.type, e.name.value, "goto __sidl_done;", self.encoding_of(e))
+
+        args = ["__sidl_receiver->object"]
+        args += [f"&{e.name.value}" if self.is_passed_by_pointer(e.type) else e.name.value
+                 for e in node.arguments]
+        args += [self.address_of(e.type, e.name.value) for e in node.return_values or []]
+
+        self.writer.write_line(f"__sidl_vtable->{node.name.value}(" + ", ".join(args) + ");")
+
+        if node.return_values is not None:
+            self.writer.write_line("__sidl_s = sidl_channel_payload(__sidl_channel);")
+
+            for e in node.return_values:
+                self.compile_write(e.type, e.name.value, "goto __sidl_done;", self.encoding_of(e))
+
+            self.writer.write_line("sidl_channel_reply(__sidl_channel, __sidl_source_port, __sidl_message);")
+
+        # Every argument and return value is read or written with a check
+        # jumping to the cleanup.
+        if decls:
+            self.writer.write_line("")
+            self.writer.deindent()
+            self.writer.write_line("__sidl_done:")
+            self.writer.indent()
+
+            # The arguments live in the arena of the channel, which the
+            # dispatch function rewinds. Return values come from the receiver.
+            released = [e for e in node.arguments if self.holds_shmbuf(e.type)]
+            destroyed = [e for e in node.return_values or [] if self.needs_destroy(e.type)]
+
+            for e in released:
+                self.compile_release(e.type, e.name.value)
+
+            for e in destroyed:
+                self.compile_destroy(e.type, e.name.value)
+
+            if not released and not destroyed:
+                self.writer.write_line("return;")
+
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def _compile_dispatch(self, interface_name: str, node: Interface) -> None:
+        self.writer.write_line(self.dispatch_signature(interface_name))
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("sidl_unserializer_t __sidl_u;")
+        self.writer.write_line("sidl_unserializer_init(&__sidl_u, (void*)__sidl_message->payload, __sidl_message->payload_size, "
+                               "__sidl_message->handles, __sidl_message->handle_count);")
+        self.writer.write_line("")
+        self.writer.write_line("// Receivers can dispatch other messages while they run, each one")
+        self.writer.write_line("// rewinds the arena to where it started.")
+        self.writer.write_line("sidl_arena_mark_t __sidl_mark = sidl_arena_mark(&__sidl_channel->arena);")
+        self.writer.write_line("sidl_unserializer_set_arena(&__sidl_u, &__sidl_channel->arena);")
+        self.writer.write_line("")
+        self.writer.write_line("switch (__sidl_message->opcode)")
+        self.writer.write_line("{")
+
+        for opcode, method in enumerate(node.methods):
+            self.writer.write_line(f"case {opcode}: // Opcode '{method.name.value}' = {opcode}")
+            self.writer.indent()
+            self.writer.write_line(f"{interface_name}_receive_{method.name.value}(__sidl_channel, __sidl_receiver, "
+                                   "__sidl_source_port, __sidl_message, &__sidl_u);")
+            self.writer.write_line("break;")
+            self.writer.deindent()
+
+        self.writer.write_line("default:")
+        self.writer.indent()
+        self.writer.write_line("break;")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+        self.writer.write_line("sidl_arena_rewind(&__sidl_channel->arena, __sidl_mark);")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+        self.writer.write_line(f"int {interface_name}_bind(sidl_channel_t* c, uint64_t id, const {interface_name}_vtable* vtable, void* object)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line(f"return sidl_channel_bind(c, id, {interface_name}_dispatch, vtable, object);")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def visit_Interface(self, node: Interface) -> None:
+        interface_name = self.namespace_prefix() + node.name.value
+
+        for opcode, method in enumerate(node.methods):
+            self._compile_proxy_method(interface_name, method, opcode)
+
+        for method in node.methods:
+            self._compile_receive_method(interface_name, method)
+
+        self._compile_dispatch(interface_name, node)
+
+    def visit(self, root: AstNode) -> None:
+        self.writer.write_line("#include <stdlib.h>")
+        self.writer.write_line("#include <string.h>")
+        self.writer.write_line(f"#include \"{self._filename}.h\"")
+        self.writer.write_line("")
+
+        super().visit(root)
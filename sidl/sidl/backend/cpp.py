@@ -1,5 +1,6 @@
-from typing import Dict, List
+from typing import Dict, List, Optional, Set, Tuple
 from sidl.utils import IndentedWriter
+from sidl.type_resolver import VIEW_TYPES, ENCODINGS
 from sidl.ast import Visitor, Symbol, Method, Type, Interface, Namespace, VariableDeclaration, Struct, AstNode
 
 
@@ -10,30 +11,160 @@ class BaseCppCompiler(Visitor):
 
     writer: IndentedWriter
     _types: Dict[str, str]
+    _pmr: bool
+    _allocator_aware_structs: Set[str]
+    _table_structs: Set[str]
 
-    def __init__(self, types: Dict[str, str], indent: int = 4) -> None:
+    def __init__(self, types: Dict[str, str], indent: int = 4, pmr: bool = False) -> None:
         self._types = types
+        self._pmr = pmr
+        self._allocator_aware_structs = set()
+        self._table_structs = set()
         self.writer = IndentedWriter(indent)
 
-    def visit_Type(self, node: Type) -> None:
+    def type_name(self, node: Type) -> str:
         """
         Converts a type to its C++ representation. We assume that the ast passed
         the type checker checks and that everything is valid. If in any case a
         type doesn't exist in the provided type checker mapping we let it as is.
         """
         cpp_type = self._types.get(node.value, node.value)
-        self.writer.write(cpp_type)
+        arguments = [self.type_name(e) for e in node.generics]
 
-        if len(node.generics) > 0:
-            self.writer.write("<")
+        if node.size is not None:
+            arguments.append(str(node.size))
 
-            for i, e in enumerate(node.generics):
-                e.accept(self)
+        if len(arguments) > 0:
+            cpp_type += "<" + ", ".join(arguments) + ">"
 
-                if i != len(node.generics) - 1:
-                    self.writer.write(", ")
+        return cpp_type
+
+    def visit_Type(self, node: Type) -> None:
+        self.writer.write(self.type_name(node))
+
+    SCALAR_TYPES = ("bool", "u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64", "usize", "handle")
+
+    def param_type(self, node: Type) -> str:
+        """
+        Type of a proxy method argument: only serialized, it is taken by
+        reference unless it is a scalar or a view.
+        """
+        if node.value in self.SCALAR_TYPES or node.value in VIEW_TYPES:
+            return self.type_name(node)
+
+        return f"const {self.type_name(node)}&"
+
+    def reserve_payload(self, decls: List[VariableDeclaration], prefix: str, extra: Optional[str] = None) -> None:
+        """
+        Reserves the size of the serialized values in __sidl_s at once, the
+        payload is then encoded without reallocation.
+        """
+        # Encoded vectors reserve their own worst case
+        sizes = [f"rpc::serialized_size({prefix}{e.name.value})"
+                 for e in decls if e.type.value not in ("handle", "stream") and not e.annotations]
+
+        if extra is not None:
+            sizes.append(extra)
+
+        if sizes:
+            self.writer.write_line(f"__sidl_s.reserve({' + '.join(sizes)});")
+
+    def encoding(self, decl: VariableDeclaration) -> str:
+        """
+        Extra argument of serialize() and unserialize() selecting the
+        encoding of the declaration, empty for the default one.
+        """
+        encoding = decl.annotations.get("encoding")
+
+        if encoding is None:
+            return ""
+
+        return f", rpc::Encoding::{ENCODINGS[encoding]}"
+
+    def is_allocator_aware(self, node: Type) -> bool:
+        """
+        With --pmr, strings, vectors and the structures holding them take a
+        polymorphic allocator.
+        """
+        if not self._pmr:
+            return False
+
+        return node.value in ("string", "vec") or node.value in self._allocator_aware_structs
+
+    def register_struct(self, node: Struct) -> None:
+        """
+        Structures holding allocator-aware fields are allocator-aware.
+        """
+        if any(self.is_allocator_aware(field.type) for field in node.fields):
+            self._allocator_aware_structs.add(node.name.value)
+
+        if "table" in node.annotations:
+            self._table_structs.add(node.name.value)
+
+    def view_type_name(self, node: Type) -> str:
+        """
+        Type read from a view: strings are not copied and tables are viewed
+        in turn.
+        """
+        if node.value == "string":
+            return "std::string_view"
+
+        return self.receiver_type_name(node)
+
+    def receiver_type_name(self, node: Type) -> str:
+        """
+        Type of a receiver argument, tables are passed as views.
+        """
+        if node.value in self._table_structs:
+            return self.type_name(node) + "View"
+
+        return self.type_name(node)
+
+    def uses_arena(self, node: Type) -> bool:
+        """
+        Whether decoding the type allocates from the arena of the message.
+        """
+        return self.is_allocator_aware(node) or any(self.uses_arena(ty) for ty in node.generics)
+
+    def stream_of(self, decls: Optional[List[VariableDeclaration]]) -> Optional[VariableDeclaration]:
+        """
+        Returns the stream<T> among the declarations, the type resolver ensures
+        there is at most one.
+        """
+        for e in decls or []:
+            if e.type.value == "stream":
+                return e
+
+        return None
 
-            self.writer.write(">")
+    def has_stream(self, node: Method) -> bool:
+        return self.stream_of(node.arguments) is not None or self.stream_of(node.return_values) is not None
+
+    def is_cacheable(self, node: Method) -> bool:
+        return "cacheable" in node.annotations
+
+    def stream_type(self, decl: VariableDeclaration, wrapper: str) -> str:
+        return f"rpc::{wrapper}<{self.type_name(decl.type.generics[0])}>"
+
+    def async_callback_type(self, node: Method) -> str:
+        """
+        Completion callback of the asynchronous proxy method: a success flag
+        followed by the return values.
+        """
+        assert node.return_values is not None
+        params = ["bool"] + [self.type_name(e.type) for e in node.return_values]
+
+        return "std::function<void(" + ", ".join(params) + ")>"
+
+    def gather_callback_type(self, node: Method) -> str:
+        """
+        Callback of the multi-proxy method: index of the answering target
+        followed by the return values.
+        """
+        assert node.return_values is not None
+        params = ["std::size_t"] + [self.type_name(e.type) for e in node.return_values]
+
+        return "std::function<void(" + ", ".join(params) + ")>"
 
     def visit_Symbol(self, node: Symbol) -> None:
         self.writer.write(node.value)
@@ -61,22 +192,81 @@ class SourceCompiler(BaseCppCompiler):
     _current_opcode: int
     _types: Dict[str, str]
     _filename: str
+    _instrument: bool
+    _namespace_parts: List[str]
 
-    def __init__(self, filename: str, types: Dict[str, str], indent: int = 4) -> None:
-        super().__init__(types, indent)
+    def __init__(self, filename: str, types: Dict[str, str], indent: int = 4, instrument: bool = False, pmr: bool = False) -> None:
+        super().__init__(types, indent, pmr)
         self._current_opcode = 0
         self._types = types
         self._filename = filename
+        self._instrument = instrument
+        self._namespace_parts = []
+
+    def visit_Namespace(self, node: Namespace) -> None:
+        self._namespace_parts.append(node.name.value)
+        super().visit_Namespace(node)
+        self._namespace_parts.pop()
+
+    def _compile_probe(self, node: Method, side: str, final_phase: str) -> None:
+        """
+        Declares the probe measuring the current call, only with --instrument.
+        """
+        name = "::".join(self._namespace_parts + [self._current_interface]) + "." + node.name.value
+
+        self.writer.write_line(f"static const std::size_t __sidl_method = rpc::Instrumentation::register_method(\"{name}\", rpc::Instrumentation::Side::{side});")
+        self.writer.write_line(f"rpc::CallProbe __sidl_probe(__sidl_method, rpc::CallProbe::Phase::{final_phase});")
 
     def visit_Struct(self, node: Struct) -> None:
-        pass
+        self.register_struct(node)
+
+    def _compile_proxy_request(self, node: Method, destination: str = "remote_id()") -> None:
+        # Code generation for sending
+        self.writer.write_line(f"// Opcode '{node.name.value}' = {self._current_opcode};")
+        self.writer.write_line("rpc::Message __sidl_message;")
+        self.writer.write_line("__sidl_message.source = id();")
+        self.writer.write_line(f"__sidl_message.destination = {destination};")
+        self.writer.write_line(f"__sidl_message.opcode = {self._current_opcode};")
+        self.writer.write_line("__sidl_message.deadline = call_deadline();")
+        self.writer.write_line("rpc::Serializer& __sidl_s = channel_->payload_serializer();")
+
+        ret_stream = self.stream_of(node.return_values)
+        self.reserve_payload(node.arguments, "__sidl_argument_", "sizeof(std::uint64_t)" if ret_stream else None)
+
+        # Streams are tied to the request id, it must be known beforehand
+        if self.has_stream(node):
+            self.writer.write_line("__sidl_message.request_id = channel_->allocate_request_id();")
+
+        # Serializing the arguments
+        for e in node.arguments:
+            if e.type.value == "stream":
+                continue
+            elif e.type.value == "handle":
+                self.writer.write("__sidl_s.add_handle(__sidl_argument_")
+                e.name.accept(self)
+                self.writer.write_line(");")
+            else:
+                self.writer.write_line(f"__sidl_s.serialize(__sidl_argument_{e.name.value}{self.encoding(e)});")
+
+        # The reader tells the writer how many elements it can buffer
+        if ret_stream is not None:
+            name = ret_stream.name.value
+            self.writer.write_line(f"__sidl_retval_{name}->open(channel_, remote_port(), __sidl_message.request_id, rpc::StreamOrigin::Local);")
+            self.writer.write_line(f"__sidl_s.serialize(__sidl_retval_{name}->window());")
+
+        self.writer.write_line("__sidl_message.payload = __sidl_s.get_payload();")
+        self.writer.write_line("__sidl_message.handles = __sidl_s.get_handles();")
 
     def _compile_proxy_method(self, node: Method) -> None:
         # prototype generation
         self.writer.write(f"bool {self._current_interface}Proxy::{node.name.value}(")
 
         for i, e in enumerate(node.arguments):
-            e.type.accept(self)
+            if e.type.value == "stream":
+                self.writer.write(self.stream_type(e, "StreamProducer"))
+            else:
+                self.writer.write(self.param_type(e.type))
+
             self.writer.write(" ")
             self.writer.write("__sidl_argument_")
             e.name.accept(self)
@@ -89,7 +279,11 @@ class SourceCompiler(BaseCppCompiler):
                 if len(node.arguments) > 0 or i > 0:
                     self.writer.write(", ")
 
-                e.type.accept(self)
+                if e.type.value == "stream":
+                    self.writer.write(self.stream_type(e, "StreamReader"))
+                else:
+                    e.type.accept(self)
+
                 self.writer.write("* ")
                 self.writer.write("__sidl_retval_")
                 e.name.accept(self)
@@ -98,30 +292,28 @@ class SourceCompiler(BaseCppCompiler):
         self.writer.write_line("{")
         self.writer.indent()
 
-        # Code generation for sending
-        self.writer.write_line(f"// Opcode '{node.name.value}' = {self._current_opcode};")
-        self.writer.write_line("rpc::Message __sidl_message;")
-        self.writer.write_line("__sidl_message.source = id();")
-        self.writer.write_line("__sidl_message.destination = remote_id();")
-        self.writer.write_line(f"__sidl_message.opcode = {self._current_opcode};")
-        self.writer.write_line("rpc::Serializer __sidl_s;")
+        # Streamed calls have no well defined phases, they are not measured
+        instrument = self._instrument and not self.has_stream(node)
 
-        # Serializing the arguments
-        for e in node.arguments:
-            if e.type.value == "handle":
-                self.writer.write("__sidl_s.add_handle(__sidl_argument_")
-                e.name.accept(self)
-                self.writer.write_line(");")
-            else:
-                self.writer.write("__sidl_s.serialize(__sidl_argument_")
-                e.name.accept(self)
-                self.writer.write_line(");")
+        if instrument:
+            self._compile_probe(node, "Proxy", "Deserialize")
 
-        self.writer.write_line("__sidl_message.payload = __sidl_s.get_payload();")
-        self.writer.write_line("__sidl_message.handles = __sidl_s.get_handles();")
+        self._compile_proxy_request(node)
 
-        if node.return_values is None:
+        if instrument:
+            self.writer.write_line("__sidl_probe.request_bytes(__sidl_message.payload.size());")
+            self.writer.write_line("__sidl_probe.phase(rpc::CallProbe::Phase::Serialize);")
+
+        if self.has_stream(node):
+            self._compile_proxy_stream_call(node)
+        elif node.return_values is None and instrument:
+            self.writer.write_line("bool __sidl_sent = channel_->send_message(remote_port(), __sidl_message);")
+            self.writer.write_line("__sidl_probe.phase(rpc::CallProbe::Phase::Transit);")
+            self.writer.write_line("return __sidl_sent;")
+        elif node.return_values is None:
             self.writer.write_line("return channel_->send_message(remote_port(), __sidl_message);")
+        elif self.is_cacheable(node):
+            self._compile_proxy_cached_call(node)
         else:
             # Handling the return values
             self.writer.write_line("rpc::Message __sidl_result;")
@@ -130,49 +322,270 @@ class SourceCompiler(BaseCppCompiler):
             self.writer.write_line("return false;")
             self.writer.deindent()
 
-            self.writer.write_line("rpc::Unserializer __sidl_u(std::move(__sidl_result.payload), __sidl_result.handles);")
+            if instrument:
+                self._compile_probe_reply()
 
-            for e in node.return_values:
-                if e.type.value == "handle":
-                    self.writer.write("if (!__sidl_u.next_handle(__sidl_retval_")
-                    e.name.accept(self)
-                    self.writer.write_line(")")
+            self.writer.write_line("rpc::Unserializer __sidl_u(__sidl_result.payload, __sidl_result.handles);")
+            self._compile_proxy_return_values(node)
 
-                    self.writer.indent()
-                    self.writer.write_line("return false;")
-                    self.writer.deindent()
-                else:
-                    self.writer.write("if (!__sidl_u.unserialize(__sidl_retval_")
-                    e.name.accept(self)
-                    self.writer.write_line("))")
+        self.writer.deindent()
+        self.writer.write_line("}")
 
-                    self.writer.indent()
-                    self.writer.write_line("return false;")
-                    self.writer.deindent()
+    def _compile_probe_reply(self) -> None:
+        self.writer.write_line("__sidl_probe.phase(rpc::CallProbe::Phase::Transit);")
+        self.writer.write_line("__sidl_probe.reply_bytes(__sidl_result.payload.size());")
+
+    def _compile_proxy_return_values(self, node: Method) -> None:
+        assert node.return_values is not None
 
+        for e in node.return_values:
+            if e.type.value == "handle":
+                self.writer.write("if (!__sidl_u.next_handle(__sidl_retval_")
+                e.name.accept(self)
+                self.writer.write_line(")")
+
+                self.writer.indent()
+                self.writer.write_line("return false;")
+                self.writer.deindent()
+            else:
+                self.writer.write_line(f"if (!__sidl_u.unserialize(__sidl_retval_{e.name.value}{self.encoding(e)}))")
+
+                self.writer.indent()
+                self.writer.write_line("return false;")
+                self.writer.deindent()
+
+        self.writer.write_line("return true;")
+
+    def _compile_proxy_cached_call(self, node: Method) -> None:
+        ttl = node.annotations["cacheable"] or "0"
+        opcode = self._current_opcode
+
+        # Pending invalidations must be seen before answering from the cache
+        self.writer.write_line("channel_->receive_pending();")
+        self.writer.write_line("std::uint64_t __sidl_epoch = channel_->cache_epoch(remote_port(), remote_id());")
+        self.writer.write_line(f"if (const std::vector<std::uint8_t>* __sidl_cached = cache_.find({opcode}, __sidl_message.payload, __sidl_epoch))")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("rpc::Unserializer __sidl_u(*__sidl_cached);")
+        self._compile_proxy_return_values(node)
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+        self.writer.write_line("std::vector<std::uint8_t> __sidl_arguments = __sidl_message.payload;")
+        self.writer.write_line("rpc::Message __sidl_result;")
+        self.writer.write_line("if (!channel_->send_request(remote_port(), __sidl_message, __sidl_result))")
+        self.writer.indent()
+        self.writer.write_line("return false;")
+        self.writer.deindent()
+
+        # The epoch read before sending makes a reply racing with an
+        # invalidation stale right away.
+        if self._instrument:
+            self._compile_probe_reply()
+
+        self.writer.write_line(f"cache_.insert({opcode}, __sidl_arguments, __sidl_result.payload, __sidl_epoch, std::chrono::milliseconds({ttl}));")
+        self.writer.write_line("rpc::Unserializer __sidl_u(__sidl_result.payload, __sidl_result.handles);")
+        self._compile_proxy_return_values(node)
+
+    def _compile_proxy_stream_call(self, node: Method) -> None:
+        self.writer.write_line("if (!channel_->start_request(remote_port(), __sidl_message))")
+        self.writer.indent()
+        self.writer.write_line("return false;")
+        self.writer.deindent()
+
+        arg_stream = self.stream_of(node.arguments)
+
+        # Elements are written once the request is sent and as the receiver
+        # grants credits.
+        if arg_stream is not None:
+            name = arg_stream.name.value
+            self.writer.write_line(f"{self.stream_type(arg_stream, 'StreamWriter')} __sidl_stream(channel_, remote_port(), __sidl_message.request_id, rpc::StreamOrigin::Local);")
+            self.writer.write_line(f"if (!__sidl_stream.write_all(__sidl_argument_{name}))")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.writer.write_line("__sidl_stream.close(false);")
+            self.writer.write_line("return false;")
+            self.writer.deindent()
+            self.writer.write_line("}")
+            self.writer.write_line("if (!__sidl_stream.close(true))")
+            self.writer.indent()
+            self.writer.write_line("return false;")
+            self.writer.deindent()
+
+        # A returned stream is read by the caller through the reader
+        if node.return_values is None or self.stream_of(node.return_values) is not None:
             self.writer.write_line("return true;")
+            return
+
+        self.writer.write_line("rpc::Message __sidl_result;")
+        self.writer.write_line("if (!channel_->wait_reply(remote_port(), __sidl_message, __sidl_result))")
+        self.writer.indent()
+        self.writer.write_line("return false;")
+        self.writer.deindent()
+
+        self.writer.write_line("rpc::Unserializer __sidl_u(__sidl_result.payload, __sidl_result.handles);")
+
+        for e in node.return_values:
+            if e.type.value == "handle":
+                self.writer.write_line(f"if (!__sidl_u.next_handle(__sidl_retval_{e.name.value}))")
+            else:
+                self.writer.write_line(f"if (!__sidl_u.unserialize(__sidl_retval_{e.name.value}{self.encoding(e)}))")
+
+            self.writer.indent()
+            self.writer.write_line("return false;")
+            self.writer.deindent()
+
+        self.writer.write_line("return true;")
+
+    def _compile_proxy_async_method(self, node: Method) -> None:
+        assert node.return_values is not None
+
+        # prototype generation
+        self.writer.write(f"bool {self._current_interface}Proxy::{node.name.value}_async(")
+
+        for e in node.arguments:
+            self.writer.write(self.param_type(e.type))
+            self.writer.write(" ")
+            self.writer.write("__sidl_argument_")
+            e.name.accept(self)
+            self.writer.write(", ")
+
+        self.writer.write(self.async_callback_type(node))
+        self.writer.write_line(" __sidl_callback)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        self._compile_proxy_request(node)
+
+        self.writer.write_line("auto __sidl_completion = [__sidl_callback = std::move(__sidl_callback)](rpc::ChannelError __sidl_error, rpc::Message& __sidl_result) {")
+        self.writer.indent()
+        self.writer.write_line("rpc::Unserializer __sidl_u(__sidl_result.payload, __sidl_result.handles);")
+        self.writer.write_line("bool __sidl_ok = __sidl_error == rpc::ChannelError::Ok;")
+
+        for e in node.return_values:
+            e.type.accept(self)
+            self.writer.write_line(f" __sidl_retval_{e.name.value} {{}};")
+
+        for e in node.return_values:
+            if e.type.value == "handle":
+                self.writer.write_line(f"__sidl_ok = __sidl_ok && __sidl_u.next_handle(&__sidl_retval_{e.name.value});")
+            else:
+                self.writer.write_line(f"__sidl_ok = __sidl_ok && __sidl_u.unserialize(&__sidl_retval_{e.name.value}{self.encoding(e)});")
+
+        retvals = "".join(f", std::move(__sidl_retval_{e.name.value})" for e in node.return_values)
+        self.writer.write_line(f"__sidl_callback(__sidl_ok{retvals});")
+        self.writer.deindent()
+        self.writer.write_line("};")
+
+        self.writer.write_line("return channel_->send_request_async(remote_port(), __sidl_message, std::move(__sidl_completion));")
 
         self.writer.deindent()
         self.writer.write_line("}")
 
+    def _compile_multi_proxy_method(self, node: Method) -> None:
+        # prototype generation
+        self.writer.write(f"bool {self._current_interface}MultiProxy::{node.name.value}(")
+
+        params = [f"{self.param_type(e.type)} __sidl_argument_{e.name.value}" for e in node.arguments]
+
+        if node.return_values is not None:
+            params.append(f"{self.gather_callback_type(node)} __sidl_on_reply")
+
+        self.writer.write(", ".join(params))
+        self.writer.write_line(")")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        # The channel addresses a copy of the message to every target
+        self._compile_proxy_request(node, "0")
+
+        if node.return_values is None:
+            self.writer.write_line("return scatter_(__sidl_message);")
+            self.writer.deindent()
+            self.writer.write_line("}")
+            return
+
+        self.writer.write_line("return gather_(__sidl_message, [&](std::size_t __sidl_target, rpc::Message& __sidl_result) {")
+        self.writer.indent()
+        self.writer.write_line("rpc::Unserializer __sidl_u(__sidl_result.payload, __sidl_result.handles);")
+
+        for e in node.return_values:
+            self.writer.write_line(f"{self.type_name(e.type)} __sidl_retval_{e.name.value} {{}};")
+
+        for e in node.return_values:
+            if e.type.value == "handle":
+                self.writer.write_line(f"if (!__sidl_u.next_handle(&__sidl_retval_{e.name.value}))")
+            else:
+                self.writer.write_line(f"if (!__sidl_u.unserialize(&__sidl_retval_{e.name.value}{self.encoding(e)}))")
+
+            self.writer.indent()
+            self.writer.write_line("return false;")
+            self.writer.deindent()
+
+        retvals = "".join(f", std::move(__sidl_retval_{e.name.value})" for e in node.return_values)
+        self.writer.write_line(f"__sidl_on_reply(__sidl_target{retvals});")
+        self.writer.write_line("return true;")
+        self.writer.deindent()
+        self.writer.write_line("});")
+
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+    def decoded_decl(self, decl: VariableDeclaration, prefix: str, argument: bool) -> str:
+        """
+        Declaration of a receiver local, allocator-aware ones are constructed
+        in the arena. Views of table arguments allocate nothing.
+        """
+        if argument and decl.type.value in self._table_structs:
+            return f"{self.receiver_type_name(decl.type)} {prefix}{decl.name.value}"
+
+        type_name = self.type_name(decl.type)
+        local = f"{type_name} {prefix}{decl.name.value}"
+
+        if self.is_allocator_aware(decl.type):
+            local += f" = __sidl_u.construct<{type_name}>()"
+
+        return local
+
     def _compile_receiver_method(self, node: Method) -> None:
+        if self._instrument:
+            self._compile_probe(node, "Receiver", "Serialize")
+            self.writer.write_line("__sidl_probe.request_bytes(__sidl_message.payload.size());")
+
         # Step 1: Deserialize arguments
-        self.writer.write_line("rpc::Unserializer __sidl_u(std::move(__sidl_message.payload), __sidl_message.handles);")
+        self.writer.write_line("rpc::Unserializer __sidl_u(__sidl_message.payload, __sidl_message.handles);")
         call_stmt = f"{node.name.value}("
 
-        for i, e in enumerate(node.arguments):
-            e.type.accept(self)
-            self.writer.write(" __sidl_argument_")
-            e.name.accept(self)
-            self.writer.write_line(";")
+        # Arguments and return values are allocated from one arena, released
+        # at once when the call is over.
+        decls = [e for e in node.arguments if e.type.value not in self._table_structs] + (node.return_values or [])
+        arena = any(self.uses_arena(e.type) for e in decls if e.type.value != "stream")
 
+        if arena:
+            self.writer.write_line("std::pmr::monotonic_buffer_resource __sidl_arena(rpc::arena_size(__sidl_message.payload.size()));")
+            self.writer.write_line("__sidl_u.set_resource(&__sidl_arena);")
+
+        for i, e in enumerate(node.arguments):
             arg_type = e.type.value
             arg_name = e.name.value
 
             if i > 0:
                 call_stmt += ", "
 
-            call_stmt += f"__sidl_argument_{arg_name}"
+            # Stream arguments are opened once the other arguments are decoded
+            if arg_type == "stream":
+                self.writer.write_line(f"{self.stream_type(e, 'StreamReader')} __sidl_argument_{arg_name};")
+                call_stmt += f"&__sidl_argument_{arg_name}"
+                continue
+
+            self.writer.write_line(f"{self.decoded_decl(e, '__sidl_argument_', True)};")
+
+            # Handlers take their arguments by value, decoded containers are
+            # moved into them.
+            if arg_type in self.SCALAR_TYPES or arg_type in VIEW_TYPES or arg_type in self._table_structs:
+                call_stmt += f"__sidl_argument_{arg_name}"
+            else:
+                call_stmt += f"std::move(__sidl_argument_{arg_name})"
 
             if arg_type == "handle":
                 self.writer.write_line(f"if (!__sidl_u.next_handle(&__sidl_argument_{arg_name}))")
@@ -180,17 +593,33 @@ class SourceCompiler(BaseCppCompiler):
                 self.writer.write_line("return; // TODO: Maybe return an error code ?")
                 self.writer.deindent()
             else:
-                self.writer.write_line(f"if (!__sidl_u.unserialize(&__sidl_argument_{arg_name}))")
+                self.writer.write_line(f"if (!__sidl_u.unserialize(&__sidl_argument_{arg_name}{self.encoding(e)}))")
                 self.writer.indent()
                 self.writer.write_line("return; // TODO: Maybe return an error code ?")
                 self.writer.deindent()
 
+        arg_stream = self.stream_of(node.arguments)
+
+        if arg_stream is not None:
+            name = arg_stream.name.value
+            self.writer.write_line(f"__sidl_argument_{name}.open(&__sidl_channel, __sidl_source_port, __sidl_message.request_id, rpc::StreamOrigin::Remote);")
+            self.writer.write_line(f"__sidl_argument_{name}.grant_window();")
+
+        ret_stream = self.stream_of(node.return_values)
+
         if node.return_values:
             for i, e in enumerate(node.return_values):
-                e.type.accept(self)
-                self.writer.write(" __sidl_retval_")
-                e.name.accept(self)
-                self.writer.write_line(";")
+                if e.type.value == "stream":
+                    self.writer.write_line("std::uint64_t __sidl_stream_window = 0;")
+                    self.writer.write_line("if (!__sidl_u.unserialize(&__sidl_stream_window))")
+                    self.writer.indent()
+                    self.writer.write_line("return; // TODO: Maybe return an error code ?")
+                    self.writer.deindent()
+
+                    self.writer.write(self.stream_type(e, "StreamWriter"))
+                    self.writer.write_line(f" __sidl_retval_{e.name.value}(&__sidl_channel, __sidl_source_port, __sidl_message.request_id, rpc::StreamOrigin::Remote, __sidl_stream_window);")
+                else:
+                    self.writer.write_line(f"{self.decoded_decl(e, '__sidl_retval_', False)};")
 
                 if len(node.arguments) > 0 or i > 0:
                     call_stmt += ", "
@@ -199,9 +628,21 @@ class SourceCompiler(BaseCppCompiler):
 
         call_stmt += ");"
 
+        if self._instrument:
+            self.writer.write_line("__sidl_probe.phase(rpc::CallProbe::Phase::Deserialize);")
+
         # Step 2: Call handler function
+        if ret_stream is not None:
+            # A returned stream is the only return value, its end is the answer
+            self.writer.write_line(f"bool __sidl_status = {call_stmt}")
+            self.writer.write_line(f"__sidl_retval_{ret_stream.name.value}.close(__sidl_status);")
+            return
+
         self.writer.write_line(call_stmt)
 
+        if self._instrument:
+            self.writer.write_line("__sidl_probe.phase(rpc::CallProbe::Phase::Handler);")
+
         # Step 3: Send back answer if needed
         if node.return_values is None:
             return
@@ -210,7 +651,9 @@ class SourceCompiler(BaseCppCompiler):
         self.writer.write_line("__sidl_reply.source = __sidl_id;")
         self.writer.write_line("__sidl_reply.destination = __sidl_message.destination;")
         self.writer.write_line("__sidl_reply.opcode = __sidl_message.opcode;")
-        self.writer.write_line("rpc::Serializer __sidl_s;")
+        self.writer.write_line("__sidl_reply.request_id = __sidl_message.request_id;")
+        self.writer.write_line("rpc::Serializer& __sidl_s = __sidl_channel.payload_serializer();")
+        self.reserve_payload(node.return_values, "__sidl_retval_")
 
         for e in node.return_values:
             ret_type = e.type.value
@@ -219,10 +662,18 @@ class SourceCompiler(BaseCppCompiler):
             if ret_type == "handle":
                 self.writer.write_line(f"__sidl_s.add_handle(__sidl_retval_{ret_name});")
             else:
-                self.writer.write_line(f"__sidl_s.serialize(__sidl_retval_{ret_name});")
+                self.writer.write_line(f"__sidl_s.serialize(__sidl_retval_{ret_name}{self.encoding(e)});")
 
         self.writer.write_line("__sidl_reply.payload = __sidl_s.get_payload();")
         self.writer.write_line("__sidl_reply.handles = __sidl_s.get_handles();")
+
+        if self._instrument:
+            self.writer.write_line("__sidl_probe.reply_bytes(__sidl_reply.payload.size());")
+
+        # The caller may keep the result, it must hear about invalidations
+        if self.is_cacheable(node):
+            self.writer.write_line("__sidl_channel.add_cache_subscriber(__sidl_id, __sidl_source_port);")
+
         self.writer.write_line("__sidl_channel.send_message(__sidl_source_port, __sidl_reply);")
 
     def _compile_proxy_interface(self, node: Interface) -> None:
@@ -231,6 +682,21 @@ class SourceCompiler(BaseCppCompiler):
 
         for method in node.methods:
             self._compile_proxy_method(method)
+
+            if method.return_values is not None and not self.has_stream(method):
+                self._compile_proxy_async_method(method)
+
+            self._current_opcode += 1
+
+    def _compile_multi_proxy_interface(self, node: Interface) -> None:
+        self._current_interface = node.name.value
+        self._current_opcode = 0
+
+        # Streams are tied to a single request, they cannot be fanned out
+        for method in node.methods:
+            if not self.has_stream(method):
+                self._compile_multi_proxy_method(method)
+
             self._current_opcode += 1
 
     def _compile_receiver_interface(self, node: Interface) -> None:
@@ -268,10 +734,15 @@ class SourceCompiler(BaseCppCompiler):
 
     def visit_Interface(self, node: Interface) -> None:
         self._compile_proxy_interface(node)
+        self._compile_multi_proxy_interface(node)
         self._compile_receiver_interface(node)
 
     def visit(self, node: AstNode) -> None:
         self.writer.write_line(f"#include \"{self._filename}.hh\"")
+
+        if self._instrument:
+            self.writer.write_line("#include \"protorpc/instrumentation.hh\"")
+
         self.writer.write_line("")
 
         node.accept(self)
@@ -294,12 +765,21 @@ class HeaderCompiler(BaseCppCompiler):
     _structs: List[PendingStruct]
     _namespace: List[str]
     _filename: str
+    _packed_layouts: Dict[str, Tuple[int, int]]
+
+    # Size and alignment of the scalars of fixed size. usize depends on the
+    # platform and handles travel out of band.
+    FIXED_SCALAR_SIZES = {
+        "bool": 1, "u8": 1, "i8": 1, "u16": 2, "i16": 2,
+        "u32": 4, "i32": 4, "u64": 8, "i64": 8,
+    }
 
-    def __init__(self, filename: str, types: Dict[str, str], indent: int = 4) -> None:
-        super().__init__(types, indent)
+    def __init__(self, filename: str, types: Dict[str, str], indent: int = 4, pmr: bool = False) -> None:
+        super().__init__(types, indent, pmr)
         self._structs = []
         self._namespace = []
         self._filename = filename
+        self._packed_layouts = {}
 
     def _compile_proxy_method(self, node: Method) -> None:
         name = node.name.value
@@ -307,7 +787,10 @@ class HeaderCompiler(BaseCppCompiler):
         self.writer.write(f"bool {name}(")
 
         for i, e in enumerate(node.arguments):
-            e.accept(self)
+            if e.type.value == "stream":
+                self.writer.write(f"{self.stream_type(e, 'StreamProducer')} {e.name.value}")
+            else:
+                self.writer.write(f"{self.param_type(e.type)} {e.name.value}")
 
             if i != len(node.arguments) - 1:
                 self.writer.write(", ")
@@ -317,18 +800,42 @@ class HeaderCompiler(BaseCppCompiler):
                 if len(node.arguments) > 0 or i > 0:
                     self.writer.write(", ")
 
-                e.type.accept(self)
+                if e.type.value == "stream":
+                    self.writer.write(self.stream_type(e, "StreamReader"))
+                else:
+                    e.type.accept(self)
+
                 self.writer.write(f"* {e.name.value}")
 
         self.writer.write_line(");")
 
+    def _compile_proxy_async_method(self, node: Method) -> None:
+        self.writer.write(f"bool {node.name.value}_async(")
+
+        for e in node.arguments:
+            self.writer.write(f"{self.param_type(e.type)} {e.name.value}")
+            self.writer.write(", ")
+
+        self.writer.write_line(f"{self.async_callback_type(node)} callback);")
+
+    def _compile_multi_proxy_method(self, node: Method) -> None:
+        params = [f"{self.param_type(e.type)} {e.name.value}" for e in node.arguments]
+
+        if node.return_values is not None:
+            params.append(f"{self.gather_callback_type(node)} on_reply")
+
+        self.writer.write_line(f"bool {node.name.value}({', '.join(params)});")
+
     def _compile_receiver_method(self, node: Method) -> None:
         name = node.name.value
 
         self.writer.write(f"virtual bool {name}(")
 
         for i, e in enumerate(node.arguments):
-            e.accept(self)
+            if e.type.value == "stream":
+                self.writer.write(f"{self.stream_type(e, 'StreamReader')}* {e.name.value}")
+            else:
+                self.writer.write(f"{self.receiver_type_name(e.type)} {e.name.value}")
 
             if i != len(node.arguments) - 1:
                 self.writer.write(", ")
@@ -338,7 +845,11 @@ class HeaderCompiler(BaseCppCompiler):
                 if len(node.arguments) > 0 or i > 0:
                     self.writer.write(", ")
 
-                e.type.accept(self)
+                if e.type.value == "stream":
+                    self.writer.write(self.stream_type(e, "StreamWriter"))
+                else:
+                    e.type.accept(self)
+
                 self.writer.write(f"* {e.name.value}")
 
         # XXX: Hack
@@ -365,6 +876,40 @@ class HeaderCompiler(BaseCppCompiler):
         for method in node.methods:
             self._compile_proxy_method(method)
 
+            # Asynchronous variant completing from the channel event loop
+            if method.return_values is not None and not self.has_stream(method):
+                self._compile_proxy_async_method(method)
+
+        # Results of @cacheable methods
+        if any(self.is_cacheable(method) for method in node.methods):
+            self.writer.write_line("rpc::ResultCache& result_cache() { return cache_; }")
+            self.writer.deindent()
+            self.writer.write_line("private:")
+            self.writer.indent()
+            self.writer.write_line("rpc::ResultCache cache_;")
+
+        self.writer.deindent()
+        self.writer.write_line("};")
+
+    def _compile_multi_proxy_interface(self, node: Interface) -> None:
+        interface_name = node.name.value
+        self.writer.write_line(f"class {interface_name}MultiProxy: public rpc::RpcMultiProxy")
+        self.writer.write_line("{")
+        self.writer.write_line("public:")
+        self.writer.indent()
+
+        # Constructor
+        self.writer.write_line(f"{interface_name}MultiProxy(rpc::Channel* chan, std::uint64_t object_id, std::vector<rpc::RemoteObject> targets)")
+        self.writer.indent()
+        self.writer.write_line(": rpc::RpcMultiProxy(chan, object_id, std::move(targets))")
+        self.writer.deindent()
+        self.writer.write_line("{}")
+
+        # Methods returning values call on_reply once per accepted answer
+        for method in node.methods:
+            if not self.has_stream(method):
+                self._compile_multi_proxy_method(method)
+
         self.writer.deindent()
         self.writer.write_line("};")
 
@@ -389,6 +934,7 @@ class HeaderCompiler(BaseCppCompiler):
 
     def visit_Interface(self, node: Interface) -> None:
         self._compile_proxy_interface(node)
+        self._compile_multi_proxy_interface(node)
         self._compile_receiver_interface(node)
 
     def _compile_struct_decl(self, node: Struct) -> None:
@@ -398,51 +944,254 @@ class HeaderCompiler(BaseCppCompiler):
         self.writer.write_line("{")
         self.writer.indent()
 
+        aware = struct_name in self._allocator_aware_structs
+
+        if aware:
+            self.writer.write_line("using allocator_type = std::pmr::polymorphic_allocator<std::byte>;")
+            self.writer.write_line("")
+
         for field in node.fields:
             field.accept(self)
             self.writer.write_line(";")
 
+        if aware:
+            self._compile_struct_allocator_constructors(node)
+
         self.writer.deindent()
         self.writer.write_line("};")
 
-    def _compile_struct_serialize(self, p: PendingStruct) -> None:
-        struct_type = p.struct.name.value
+        # Defined with the serialization code, it decodes other structures
+        if struct_name in self._table_structs:
+            self.writer.write_line(f"class {struct_name}View;")
 
-        if len(p.namespace) > 0:
-            struct_type = "::".join(p.namespace) + "::" + struct_type
+    def _compile_table_view(self, p: PendingStruct) -> None:
+        """
+        Read-only view of a @table structure with an accessor per field,
+        which decodes only this field.
+        """
+        name = p.struct.name.value
+        fields = p.struct.fields
 
-        self.writer.write_line("namespace rpc")
+        for part in p.namespace:
+            self.writer.write_line(f"namespace {part}")
+            self.writer.write_line("{")
+            self.writer.indent()
+
+        self.writer.write_line(f"// View of an encoded {name}, fields are decoded on demand. It points into")
+        self.writer.write_line("// the decoded buffer.")
+        self.writer.write_line(f"class {name}View")
         self.writer.write_line("{")
+        self.writer.write_line("public:")
         self.writer.indent()
 
-        self.writer.write_line("template <>")
-        self.writer.write_line(f"struct serializable<{struct_type}>")
+        self.writer.write_line("bool bind(rpc::Unserializer& u)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("return table_.bind(u);")
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+        for i, field in enumerate(fields):
+            self.writer.write_line("")
+            self.writer.write_line(f"bool {field.name.value}({self.view_type_name(field.type)}* out) const")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.writer.write_line(f"return table_.field({i}).unserialize(out{self.encoding(field)});")
+            self.writer.deindent()
+            self.writer.write_line("}")
+
+        decoders = [f"table_.field({i}).unserialize(&out->{field.name.value}{self.encoding(field)})"
+                    for i, field in enumerate(fields)]
+
+        self.writer.write_line("")
+        self.writer.write_line(f"bool decode({name}* out) const")
+        self.writer.write_line("{")
+        self.writer.indent()
+        lines = [f"return {decoders[0]}"] + [f"    && {decoder}" for decoder in decoders[1:]]
+        lines[-1] += ";"
+
+        for line in lines:
+            self.writer.write_line(line)
+
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+        self.writer.deindent()
+        self.writer.write_line("")
+        self.writer.write_line("private:")
+        self.writer.indent()
+        self.writer.write_line(f"rpc::Table<{len(fields)}> table_;")
+        self.writer.deindent()
+        self.writer.write_line("};")
+
+        for _ in p.namespace:
+            self.writer.deindent()
+            self.writer.write_line("}")
+
+    def _compile_struct_allocator_constructors(self, node: Struct) -> None:
+        """
+        Makes the structure allocator-aware: containers constructed with an
+        allocator pass it to their elements, so do the structures to their
+        fields.
+        """
+        name = node.name.value
+
+        def initializers(value: Optional[str]) -> str:
+            inits = []
+
+            for field in node.fields:
+                field_name = field.name.value
+                aware = self.is_allocator_aware(field.type)
+
+                if value is None:
+                    if aware:
+                        inits.append(f"{field_name}(alloc)")
+                elif aware:
+                    inits.append(f"{field_name}({value.format(field_name)}, alloc)")
+                else:
+                    inits.append(f"{field_name}({value.format(field_name)})")
+
+            return ", ".join(inits)
+
+        self.writer.write_line("")
+        self.writer.write_line(f"{name}() = default;")
+        self.writer.write_line(f"{name}(const {name}&) = default;")
+        self.writer.write_line(f"{name}({name}&&) = default;")
+        self.writer.write_line(f"{name}& operator=(const {name}&) = default;")
+        self.writer.write_line(f"{name}& operator=({name}&&) = default;")
+
+        constructors = [
+            (f"explicit {name}(const allocator_type& alloc)", initializers(None)),
+            (f"{name}(const {name}& other, const allocator_type& alloc)", initializers("other.{}")),
+            (f"{name}({name}&& other, const allocator_type& alloc)", initializers("std::move(other.{})")),
+        ]
+
+        for signature, inits in constructors:
+            self.writer.write_line("")
+            self.writer.write_line(signature)
+
+            if inits:
+                self.writer.indent()
+                self.writer.write_line(f": {inits}")
+                self.writer.deindent()
+
+            self.writer.write_line("{}")
+
+    def _packed_layout(self, node: Struct) -> Optional[Tuple[int, int]]:
+        """
+        Size and alignment of the structure if its fields are scalars of fixed
+        size, or such structures, laid out back to back without padding. Its
+        memory representation is then its encoding.
+        """
+        offset = 0
+        alignment = 1
+
+        if node.name.value in self._table_structs:
+            return None
+
+        for field in node.fields:
+            layout = self._fixed_layout(field.type)
+
+            if layout is None:
+                return None
+
+            size, align = layout
+
+            if offset % align != 0:
+                return None
+
+            offset += size
+            alignment = max(alignment, align)
+
+        if offset == 0 or offset % alignment != 0:
+            return None
+
+        return offset, alignment
+
+    def _fixed_layout(self, node: Type) -> Optional[Tuple[int, int]]:
+        """
+        Size and alignment of a field of a packed structure: a fixed size
+        scalar, a packed structure or a fixed array of them.
+        """
+        if node.value in self.FIXED_SCALAR_SIZES:
+            return self.FIXED_SCALAR_SIZES[node.value], self.FIXED_SCALAR_SIZES[node.value]
+
+        if node.value in self._packed_layouts:
+            return self._packed_layouts[node.value]
+
+        if node.value == "array":
+            layout = self._fixed_layout(node.generics[0])
+
+            if layout is not None:
+                return layout[0] * node.size, layout[1]
+
+        return None
+
+    def _compile_packed_serialize(self, struct_type: str, size: int) -> None:
+        # Encoded with a single copy, the layout computed here must be the one
+        # of the compiler.
+        self.writer.write_line(f"static_assert(std::is_trivially_copyable_v<{struct_type}> && std::is_standard_layout_v<{struct_type}>")
+        self.writer.write_line(f"        && sizeof({struct_type}) == {size}, \"{struct_type} is expected to have a packed layout\");")
+        self.writer.write_line("")
+        self.writer.write_line("static constexpr bool packed = true;")
+        self.writer.write_line("")
+        self.writer.write_line(f"static void serialize(const {struct_type}& __sidl_obj, Serializer& __sidl_s)")
         self.writer.write_line("{")
         self.writer.indent()
+        self.writer.write_line(f"__sidl_s.serialize(&__sidl_obj, sizeof({struct_type}));")
+        self.writer.deindent()
+        self.writer.write_line("}")
 
-        self.writer.write_line(f"static void serialize({struct_type}& __sidl_obj, Serializer& __sidl_s)")
+        self.writer.write_line(f"static std::size_t size(const {struct_type}&)")
         self.writer.write_line("{")
         self.writer.indent()
+        self.writer.write_line(f"return sizeof({struct_type});")
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+    def _compile_fields_serialize(self, node: Struct, struct_type: str) -> None:
+        table = node.name.value in self._table_structs
+        table_writer = f"TableWriter<{len(node.fields)}>"
+
+        self.writer.write_line(f"static void serialize(const {struct_type}& __sidl_obj, Serializer& __sidl_s)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        if table:
+            self.writer.write_line(f"{table_writer} __sidl_t(__sidl_s);")
 
-        for field in p.struct.fields:
+        for field in node.fields:
             ty_name = field.type.value
             field_name = field.name.value
 
+            if table:
+                self.writer.write_line("__sidl_t.next_field();")
+
             if ty_name == "handle":
                 self.writer.write_line(f"__sidl_s.add_handle(__sidl_obj.{field_name});")
             else:
-                self.writer.write_line(f"__sidl_s.serialize(__sidl_obj.{field_name});")
+                self.writer.write_line(f"__sidl_s.serialize(__sidl_obj.{field_name}{self.encoding(field)});")
+
+        if table:
+            self.writer.write_line("__sidl_t.finish();")
 
         self.writer.deindent()
         self.writer.write_line("}")
 
-        self.writer.deindent()
-        self.writer.write_line("};")
+        # Handles travel out of band, they take no room in the payload
+        sizes = [f"serialized_size(__sidl_obj.{f.name.value}{self.encoding(f)})" for f in node.fields if f.type.value != "handle"]
+
+        if table:
+            sizes.insert(0, f"{table_writer}::header_size")
 
+        self.writer.write_line(f"static std::size_t size(const {struct_type}& __sidl_obj)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line(f"return {' + '.join(sizes) if sizes else '0'};")
         self.writer.deindent()
         self.writer.write_line("}")
 
-    def _compile_struct_unserialize(self, p: PendingStruct) -> None:
+    def _compile_struct_serialize(self, p: PendingStruct) -> None:
         struct_type = p.struct.name.value
 
         if len(p.namespace) > 0:
@@ -453,22 +1202,32 @@ class HeaderCompiler(BaseCppCompiler):
         self.writer.indent()
 
         self.writer.write_line("template <>")
-        self.writer.write_line(f"struct unserializable<{struct_type}>")
+        self.writer.write_line(f"struct serializable<{struct_type}>")
         self.writer.write_line("{")
         self.writer.indent()
 
-        self.writer.write_line(f"static bool unserialize({struct_type}* __sidl_obj, Unserializer& __sidl_u)")
-        self.writer.write_line("{")
-        self.writer.indent()
+        layout = self._packed_layouts.get(p.struct.name.value)
+
+        if layout is not None:
+            self._compile_packed_serialize(struct_type, layout[0])
+        else:
+            self._compile_fields_serialize(p.struct, struct_type)
+
+        self.writer.deindent()
+        self.writer.write_line("};")
 
-        for field in p.struct.fields:
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+    def _compile_struct_fields_unserialize(self, node: Struct) -> None:
+        for field in node.fields:
             ty_name = field.type.value
             field_name = field.name.value
 
             if ty_name == "handle":
                 self.writer.write_line(f"if (!__sidl_u.next_handle(&__sidl_obj->{field_name}))")
             else:
-                self.writer.write_line(f"if (!__sidl_u.unserialize(&__sidl_obj->{field_name}))")
+                self.writer.write_line(f"if (!__sidl_u.unserialize(&__sidl_obj->{field_name}{self.encoding(field)}))")
 
             self.writer.indent()
             self.writer.write_line("return false;")
@@ -476,16 +1235,73 @@ class HeaderCompiler(BaseCppCompiler):
 
         self.writer.write_line("return true;")
 
+    def _compile_struct_unserialize(self, p: PendingStruct) -> None:
+        struct_type = p.struct.name.value
+
+        if len(p.namespace) > 0:
+            struct_type = "::".join(p.namespace) + "::" + struct_type
+
+        self.writer.write_line("namespace rpc")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        self.writer.write_line("template <>")
+        self.writer.write_line(f"struct unserializable<{struct_type}>")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        packed = p.struct.name.value in self._packed_layouts
+
+        if packed:
+            self.writer.write_line("static constexpr bool packed = true;")
+            self.writer.write_line("")
+
+        self.writer.write_line(f"static bool unserialize({struct_type}* __sidl_obj, Unserializer& __sidl_u)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        table = p.struct.name.value in self._table_structs
+
+        if packed:
+            self.writer.write_line(f"return __sidl_u.unserialize(__sidl_obj, sizeof({struct_type}));")
+        elif table:
+            self.writer.write_line(f"{struct_type}View __sidl_view;")
+            self.writer.write_line("return __sidl_view.bind(__sidl_u) && __sidl_view.decode(__sidl_obj);")
+        else:
+            self._compile_struct_fields_unserialize(p.struct)
+
         self.writer.deindent()
         self.writer.write_line("}")
 
         self.writer.deindent()
         self.writer.write_line("};")
 
+        # Receivers decode the view of a table taken as argument
+        if table:
+            self.writer.write_line("")
+            self.writer.write_line("template <>")
+            self.writer.write_line(f"struct unserializable<{struct_type}View>")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.writer.write_line(f"static bool unserialize({struct_type}View* __sidl_obj, Unserializer& __sidl_u)")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.writer.write_line("return __sidl_obj->bind(__sidl_u);")
+            self.writer.deindent()
+            self.writer.write_line("}")
+            self.writer.deindent()
+            self.writer.write_line("};")
+
         self.writer.deindent()
         self.writer.write_line("}")
 
     def visit_Struct(self, node: Struct) -> None:
+        self.register_struct(node)
+        layout = self._packed_layout(node)
+
+        if layout is not None:
+            self._packed_layouts[node.name.value] = layout
+
         p = PendingStruct([s for s in self._namespace], node)
         self._structs.append(p)
         self._compile_struct_decl(node)
@@ -511,11 +1327,20 @@ class HeaderCompiler(BaseCppCompiler):
         header_name = self._filename.replace(".", "_").upper() + "_HH"
         self.writer.write_line(f"#ifndef {header_name}")
         self.writer.write_line(f"#define {header_name}")
+        self.writer.write_line("#include <functional>")
+
+        if self._pmr:
+            self.writer.write_line("#include <memory_resource>")
+
         self.writer.write_line("#include \"protorpc/serializer.hh\"")
         self.writer.write_line("#include \"protorpc/unserializer.hh\"")
         self.writer.write_line("#include \"protorpc/rpcobject.hh\"")
         self.writer.write_line("#include \"protorpc/message.hh\"")
         self.writer.write_line("#include \"protorpc/channel.hh\"")
+        self.writer.write_line("#include \"protorpc/result_cache.hh\"")
+        self.writer.write_line("#include \"protorpc/shmbuf.hh\"")
+        self.writer.write_line("#include \"protorpc/stream.hh\"")
+        self.writer.write_line("#include \"protorpc/table.hh\"")
         self.writer.write_line("")
 
         # Generate code from namespace
@@ -523,6 +1348,9 @@ class HeaderCompiler(BaseCppCompiler):
 
         # Generate out of namespace template specialization code
         for p in self._structs:
+            if p.struct.name.value in self._table_structs:
+                self._compile_table_view(p)
+
             self._compile_struct_unserialize(p)
             self._compile_struct_serialize(p)
 
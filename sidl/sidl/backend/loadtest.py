@@ -0,0 +1,255 @@
+from typing import List, Optional, Set, Tuple
+from sidl.ast import Method, Interface, Namespace, Struct, AstNode, VariableDeclaration
+from sidl.backend.cpp import BaseCppCompiler
+from sidl.type_resolver import VIEW_TYPES, contains_view
+
+
+class LoadTestCompiler(BaseCppCompiler):
+    """
+    Generates a standalone load generator for the interfaces of an idl file,
+    built on top of the code generated by the cpp backend. Calls are issued
+    with random or recorded arguments, answered by a stub receiver unless the
+    SIDL_LOADTEST_RECEIVER_<interface> macro names another one.
+    """
+
+    _filename: str
+    _namespace: List[str]
+    _interfaces: List[str]
+    _handle_tainted: Set[str]
+
+    # Methods which are not called, with their position and the reason
+    warnings: List[Tuple[Tuple[int, int], str]]
+
+    def __init__(self, filename: str, types, indent: int = 4) -> None:
+        super().__init__(types, indent)
+        self._filename = filename
+        self._namespace = []
+        self._interfaces = []
+        self._handle_tainted = set()
+        self.warnings = []
+
+    def _qualified(self, name: str) -> str:
+        return "::".join(self._namespace + [name])
+
+    def unsupported_reason(self, node: Method) -> Optional[str]:
+        """
+        Handles, shared memory buffers and streams cannot be made up, methods
+        using them are not called. Views are made up as the owning types they
+        point into, unless they are nested in another type.
+        """
+        for decl in node.arguments + (node.return_values or []):
+            ty = decl.type.value
+
+            if ty in ("handle", "shmbuf", "stream") or ty in self._handle_tainted:
+                return f"{decl.name.value} has type {ty}, which cannot be made up"
+
+            if ty not in VIEW_TYPES and contains_view(decl.type):
+                return f"{decl.name.value} nests views in type {ty}"
+
+        return None
+
+    def owning_type_name(self, node) -> str:
+        if node.value == "strview":
+            return "std::string"
+
+        if node.value == "bytes":
+            return "std::vector<std::uint8_t>"
+
+        return self.type_name(node)
+
+    def _receiver_parameter(self, decl: VariableDeclaration, output: bool) -> str:
+        if decl.type.value == "stream":
+            return self.stream_type(decl, "StreamWriter" if output else "StreamReader") + "* " + decl.name.value
+
+        if output:
+            return self.type_name(decl.type) + "* " + decl.name.value
+
+        return self.receiver_type_name(decl.type) + " " + decl.name.value
+
+    def _compile_randomizable(self, namespace: List[str], node: Struct) -> None:
+        struct_type = "::".join(namespace + [node.name.value])
+
+        self.writer.write_line("template <>")
+        self.writer.write_line(f"struct randomizable<{struct_type}>")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line(f"static void generate({struct_type}* __sidl_obj, RandomGenerator& __sidl_r)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        for field in node.fields:
+            self.writer.write_line(f"__sidl_r.generate(&__sidl_obj->{field.name.value});")
+
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.deindent()
+        self.writer.write_line("};")
+
+    def _collect_structs(self, node: AstNode, namespace: List[str], structs: List[Tuple[List[str], Struct]]) -> None:
+        """
+        Lists the structures which can be made up, the others contain handles.
+        """
+        if isinstance(node, Namespace):
+            for elem in node.elements:
+                self._collect_structs(elem, namespace + [node.name.value], structs)
+        elif isinstance(node, Struct):
+            name = node.name.value
+            self.register_struct(node)
+
+            if any(f.type.value in ("handle", "shmbuf") or f.type.value in self._handle_tainted for f in node.fields):
+                self._handle_tainted.add(name)
+            else:
+                structs.append((namespace, node))
+
+    def visit_Struct(self, node: Struct) -> None:
+        pass
+
+    def _compile_stub(self, node: Interface) -> None:
+        name = node.name.value
+        macro = "SIDL_LOADTEST_RECEIVER_" + "_".join(self._namespace + [name])
+
+        self.writer.write_line("// Receiver answering every call with default values")
+        self.writer.write_line(f"class {name}LoadTestStub : public {name}Receiver")
+        self.writer.write_line("{")
+        self.writer.write_line("public:")
+        self.writer.indent()
+
+        for method in node.methods:
+            params = [self._receiver_parameter(e, False) for e in method.arguments]
+            params += [self._receiver_parameter(e, True) for e in method.return_values or []]
+
+            self.writer.write_line(f"bool {method.name.value}({', '.join(params)}) override")
+            self.writer.write_line("{")
+            self.writer.indent()
+            self.writer.write_line("return true;")
+            self.writer.deindent()
+            self.writer.write_line("}")
+
+        self.writer.deindent()
+        self.writer.write_line("};")
+        self.writer.write_line("")
+
+        self.writer.write_line(f"#ifdef {macro}")
+        self.writer.write_line(f"using {name}LoadTestReceiver = {macro};")
+        self.writer.write_line("#else")
+        self.writer.write_line(f"using {name}LoadTestReceiver = {name}LoadTestStub;")
+        self.writer.write_line("#endif")
+        self.writer.write_line("")
+
+    def _compile_call(self, node: Method, interface: str) -> None:
+        call_args = []
+
+        self.writer.write_line(f"bool {interface}_{node.name.value}({interface}Proxy& __sidl_proxy, rpc::ArgumentSource& __sidl_args)")
+        self.writer.write_line("{")
+        self.writer.indent()
+
+        # Views are passed pointing into the storage of their owning type
+        for e in node.arguments:
+            self.writer.write_line(f"{self.owning_type_name(e.type)} {e.name.value} {{}};")
+            self.writer.write_line(f"if (!__sidl_args.next(&{e.name.value}))")
+            self.writer.indent()
+            self.writer.write_line("return false;")
+            self.writer.deindent()
+
+            call_args.append(e.name.value)
+
+        for e in node.return_values or []:
+            self.writer.write_line(f"{self.type_name(e.type)} {e.name.value} {{}};")
+            call_args.append("&" + e.name.value)
+
+        self.writer.write_line(f"return __sidl_proxy.{node.name.value}({', '.join(call_args)});")
+        self.writer.deindent()
+        self.writer.write_line("}")
+        self.writer.write_line("")
+
+    def visit_Interface(self, node: Interface) -> None:
+        name = node.name.value
+
+        self._interfaces.append(self._qualified(name))
+        self._compile_stub(node)
+
+        # Opcodes are the indices of the methods, unsupported ones included
+        supported = []
+
+        for opcode, method in enumerate(node.methods):
+            reason = self.unsupported_reason(method)
+
+            if reason is None:
+                supported.append((opcode, method))
+            else:
+                self.warnings.append((method.position, f"{name}.{method.name.value} is not called: {reason}"))
+
+        for _, method in supported:
+            self._compile_call(method, name)
+
+        self.writer.write_line(f"const std::vector<rpc::LoadTestCall<{name}Proxy>> {name}_calls = {{")
+        self.writer.indent()
+
+        for opcode, method in supported:
+            self.writer.write_line(f"{{ \"{method.name.value}\", {opcode}, {name}_{method.name.value} }},")
+
+        self.writer.deindent()
+        self.writer.write_line("};")
+        self.writer.write_line("")
+
+    def visit_Namespace(self, node: Namespace) -> None:
+        self._namespace.append(node.name.value)
+        super().visit_Namespace(node)
+        self._namespace.pop()
+
+    def _compile_main(self) -> None:
+        self.writer.write_line("int main(int argc, char** argv)")
+        self.writer.write_line("{")
+        self.writer.indent()
+        self.writer.write_line("rpc::LoadTestOptions options;")
+        self.writer.write_line("if (!options.parse(argc, argv))")
+        self.writer.indent()
+        self.writer.write_line("return 1;")
+        self.writer.deindent()
+
+        for i, name in enumerate(self._interfaces):
+            # The first interface is loaded by default
+            condition = f"options.interface == \"{name}\""
+
+            if i == 0:
+                condition = "options.interface.empty() || " + condition
+
+            self.writer.write_line(f"if ({condition})")
+            self.writer.indent()
+            self.writer.write_line(f"return rpc::run_load_test<{name}Proxy, {name}LoadTestReceiver>(options, \"{name}\", {name}_calls);")
+            self.writer.deindent()
+
+        self.writer.write_line("std::cerr << \"Unknown interface: \" << options.interface << std::endl;")
+        self.writer.write_line("return 1;")
+        self.writer.deindent()
+        self.writer.write_line("}")
+
+    def visit(self, node: AstNode) -> None:
+        self.writer.write_line("#include <iostream>")
+        self.writer.write_line(f"#include \"{self._filename}.hh\"")
+        self.writer.write_line("#include \"protorpc/loadtest.hh\"")
+        self.writer.write_line("")
+
+        structs: List[Tuple[List[str], Struct]] = []
+        self._collect_structs(node, [], structs)
+
+        if structs:
+            self.writer.write_line("namespace rpc")
+            self.writer.write_line("{")
+            self.writer.indent()
+
+            for namespace, struct in structs:
+                self._compile_randomizable(namespace, struct)
+
+            self.writer.deindent()
+            self.writer.write_line("}")
+            self.writer.write_line("")
+
+        node.accept(self)
+        self.writer.write_line("")
+
+        self._compile_main()
+
+    @property
+    def data(self) -> str:
+        return "\n".join(line.rstrip() for line in self.writer.data().split("\n"))
@@ -2,3 +2,4 @@ from sidl.backend.cpp import SourceCompiler as CppSourceCompiler
 from sidl.backend.cpp import HeaderCompiler as CppHeaderCompiler
 from sidl.backend.c import SourceCompiler as CSourceCompiler
 from sidl.backend.c import HeaderCompiler as CHeaderCompiler
+from sidl.backend.loadtest import LoadTestCompiler
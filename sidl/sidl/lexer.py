@@ -17,6 +17,7 @@ class TokenType(Enum):
     Comma = 11
     Semicolon = 12
     Symbol = 13
+    At = 14
 
 
 class Position:
@@ -131,6 +132,7 @@ class Lexer:
             ">": TokenType.RGeneric,
             ",": TokenType.Comma,
             ";": TokenType.Semicolon,
+            "@": TokenType.At,
         }
 
         cur_line = self._line
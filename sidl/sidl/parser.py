@@ -1,4 +1,4 @@
-from typing import List
+from typing import Dict, List, Optional
 from sidl.lexer import TokenType, Token, Lexer
 from sidl.ast import AstNode, Namespace, Interface, Symbol, Type, VariableDeclaration, Method, Struct
 from sidl.utils import SidlException
@@ -30,6 +30,7 @@ class Parser:
         return token
 
     def _parse_var_decl(self) -> VariableDeclaration:
+        annotations = self._parse_annotations()
         var_type = self.parse_type()
         var_name = self._eof_next()
 
@@ -42,6 +43,7 @@ class Parser:
 
         vardecl = VariableDeclaration(var_type, arg_name)
         vardecl.position = var_type.position
+        vardecl.annotations = annotations
 
         return vardecl
 
@@ -79,6 +81,7 @@ class Parser:
         """
         Simple type      : T or T<>
         Generic container: T<T1, T2, ...>
+        Fixed array      : array<T, N>
         """
         ty_name = self._eof_next()
 
@@ -104,7 +107,11 @@ class Parser:
                 self._lexer.next()
                 break
 
-            ty.add_generic(self.parse_type())
+            # The element type of an array is followed by its size
+            if ty.value == "array" and len(ty.generics) == 1 and ty.size is None:
+                ty.size = self._parse_array_size()
+            else:
+                ty.add_generic(self.parse_type())
 
             n = self._eof_peek()
 
@@ -125,11 +132,62 @@ class Parser:
 
         return ty
 
+    def _parse_array_size(self) -> int:
+        size = self._eof_next()
+
+        if size.type != TokenType.Symbol or not size.value.isdigit():
+            raise SidlException(f"Expected an array size but got '{size.value}'",
+                    size.position.line, size.position.col)
+
+        return int(size.value)
+
+    def _parse_annotations(self) -> Dict[str, Optional[str]]:
+        """
+        Parses @name or @name(value), repeated
+        """
+        annotations: Dict[str, Optional[str]] = {}
+
+        while self._eof_peek().type == TokenType.At:
+            self._lexer.next()
+            name_tok = self._eof_next()
+
+            if name_tok.type != TokenType.Symbol:
+                raise SidlException(f"Expected annotation name but got '{name_tok.value}'",
+                        name_tok.position.line, name_tok.position.col)
+
+            if name_tok.value in annotations:
+                raise SidlException(f"Duplicate annotation: {name_tok.value}",
+                        name_tok.position.line, name_tok.position.col)
+
+            value: Optional[str] = None
+
+            if self._eof_peek().type == TokenType.LParen:
+                self._lexer.next()
+                value_tok = self._eof_next()
+
+                if value_tok.type != TokenType.Symbol:
+                    raise SidlException(f"Expected annotation value but got '{value_tok.value}'",
+                            value_tok.position.line, value_tok.position.col)
+
+                rparen_tok = self._eof_next()
+
+                if rparen_tok.type != TokenType.RParen:
+                    raise SidlException(f"Expected ')' but got '{rparen_tok.value}'",
+                            rparen_tok.position.line, rparen_tok.position.col)
+
+                value = value_tok.value
+
+            annotations[name_tok.value] = value
+
+        return annotations
+
     def parse_method(self) -> Method:
         """
         unidirectional message: fn(args...);
         bidirectional request : fn(args...) -> (return values...);
+        annotated method      : @annotation(value) fn(args...) -> (...);
         """
+        annotations = self._parse_annotations()
         name_tok = self._eof_next()
 
         if name_tok.type != TokenType.Symbol:
@@ -138,6 +196,7 @@ class Parser:
 
         m = Method(Symbol(name_tok.value))
         m.position = (name_tok.position.line, name_tok.position.col)
+        m.annotations = annotations
         m.arguments = self._parse_variable_pack()
 
         arrow_tok = self._lexer.peek()
@@ -155,11 +214,16 @@ class Parser:
         return m
 
     def parse_struct(self) -> Struct:
+        """
+        structure          : struct Name { fields... }
+        annotated structure: @annotation struct Name { fields... }
+        """
+        annotations = self._parse_annotations()
         struct_tok = self._eof_next()
 
         if struct_tok.type != TokenType.Struct:
             raise SidlException(f"Expected 'struct' but got '{struct_tok.value}'",
-                    struct_tok.position.line, name_tok.position.col)
+                    struct_tok.position.line, struct_tok.position.col)
 
         name_tok = self._eof_next()
 
@@ -175,6 +239,7 @@ class Parser:
 
         structure = Struct(Symbol(name_tok.value))
         structure.position = (struct_tok.position.line, struct_tok.position.col)
+        structure.annotations = annotations
 
         while True:
             field_tok = self._eof_peek()
@@ -273,7 +338,7 @@ class Parser:
 
             if field_tok.type == TokenType.Namespace:
                 ns.add_element(self.parse_namespace())
-            elif field_tok.type == TokenType.Struct:
+            elif field_tok.type in (TokenType.Struct, TokenType.At):
                 ns.add_element(self.parse_struct())
             elif field_tok.type == TokenType.Interface:
                 ns.add_element(self.parse_interface())
@@ -1,7 +1,31 @@
 from typing import Dict, Set
-from sidl.ast import Visitor, Interface, Struct, Type, Method
+from sidl.ast import Visitor, Interface, Struct, Type, Method, VariableDeclaration
 from sidl.utils import SidlException
 
+# Types decoded as views into the received message, only valid during the call
+# of the receiver method.
+VIEW_TYPES = ("bytes", "strview")
+
+
+# Opt-in encodings of integer vectors (@encoding(name)), named after the
+# rpc::Encoding values.
+ENCODINGS = {
+    "varint": "Varint",
+    "zigzag": "Zigzag",
+    "delta": "Delta",
+    "bitpack": "BitPack",
+}
+
+# Members of the views generated for @table structures, besides the field
+# accessors.
+TABLE_MEMBERS = ("bind", "decode")
+
+INTEGER_TYPES = ("u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64", "usize")
+
+
+def contains_view(node: Type) -> bool:
+    return node.value in VIEW_TYPES or any(contains_view(ty) for ty in node.generics)
+
 
 class TypeResolver(Visitor):
     """
@@ -31,7 +55,9 @@ class TypeResolver(Visitor):
         # Container types and their number of arguments
         container_types = {
             "vec": 1,
-            "optional": 1
+            "optional": 1,
+            "stream": 1,
+            "array": 1
         }
 
         if node.value not in self._defined_types:
@@ -40,9 +66,19 @@ class TypeResolver(Visitor):
         if len(node.generics) and node.value not in container_types:
             raise SidlException(f"Type {node.value} is not a generic container", *node.position)
 
-        # Handle is a special type and cannot be contained
-        if node.value == "handle" and self._type_depth > 0:
-            raise SidlException("Handle type cannot be contained", *node.position)
+        # Handle is a special type and cannot be contained, neither can a
+        # shared memory buffer which is carried by a handle.
+        if node.value in ("handle", "shmbuf") and self._type_depth > 0:
+            raise SidlException(f"{node.value.capitalize()} type cannot be contained", *node.position)
+
+        # Streams are only valid as method arguments or return values
+        if node.value == "stream" and self._type_depth > 0:
+            raise SidlException("Stream type cannot be contained", *node.position)
+
+        # Stream elements are decoded from chunks which are dropped as the
+        # stream is consumed.
+        if node.value == "stream" and any(contains_view(ty) for ty in node.generics):
+            raise SidlException("Stream elements cannot be views", *node.position)
 
         if node.value in self._handle_tainted and self._type_depth > 0:
             raise SidlException("Struct cannot be contained because it contains handles",
@@ -56,6 +92,9 @@ class TypeResolver(Visitor):
                 raise SidlException(f"Expected {expected} generic type arguments but {len(node.generics)} where provided",
                         *node.position)
 
+        if node.value == "array" and not node.size:
+            raise SidlException("Array size must be a positive integer", *node.position)
+
         self._type_depth += 1
 
         for ty in node.generics:
@@ -69,6 +108,10 @@ class TypeResolver(Visitor):
         if struct_name in self._defined_types:
             raise SidlException(f"Redefinition of type: {struct_name}", *node.position)
 
+        for name in node.annotations:
+            if name != "table":
+                raise SidlException(f"Unknown annotation: @{name}", *node.position)
+
         defined_fields: Set[str] = set()
 
         for field in node.fields:
@@ -79,14 +122,45 @@ class TypeResolver(Visitor):
                 raise SidlException(f"Redefinition of struct field: {field_name}",
                         *field.name.position)
 
-            if field_type == "handle" or field_type in self._handle_tainted:
+            if field_type == "stream":
+                raise SidlException(f"Struct field cannot be a stream: {field_name}",
+                        *field.name.position)
+
+            if contains_view(field.type):
+                raise SidlException(f"Struct field cannot be a view: {field_name}",
+                        *field.name.position)
+
+            if field_type in ("handle", "shmbuf") or field_type in self._handle_tainted:
                 self._handle_tainted.add(struct_name)
 
             defined_fields.add(field_name)
             field.accept(self)
+            self._check_declaration_annotations(field)
+
+        if "table" in node.annotations:
+            self._check_table(node)
 
         self._defined_types[struct_name] = struct_name
 
+    def _check_table(self, node: Struct) -> None:
+        """
+        Fields of a @table structure are decoded on demand, in any order.
+        Handles are taken in order from the message, they cannot be.
+        """
+        if node.annotations["table"] is not None:
+            raise SidlException("@table takes no value", *node.position)
+
+        if not node.fields:
+            raise SidlException("Table must have fields", *node.position)
+
+        if node.name.value in self._handle_tainted:
+            raise SidlException("Table cannot contain handles", *node.position)
+
+        for field in node.fields:
+            if field.name.value in TABLE_MEMBERS:
+                raise SidlException(f"Table field name is reserved: {field.name.value}",
+                        *field.name.position)
+
     def visit_Interface(self, node: Interface) -> None:
         intf_name = node.name.value
 
@@ -127,13 +201,80 @@ class TypeResolver(Visitor):
 
                 defined_names.add(ret_name)
 
+                # The reply would outlive the buffer the view points into.
+                if contains_view(ret.type):
+                    raise SidlException(f"Return value cannot be a view: {ret_name}",
+                            *ret.name.position)
+
+        # A method carries at most one stream in each direction and a returned
+        # stream replaces the reply.
+        arg_streams = [arg for arg in node.arguments if arg.type.value == "stream"]
+        ret_streams = [ret for ret in node.return_values or [] if ret.type.value == "stream"]
+
+        for decl in node.arguments + (node.return_values or []):
+            decl.type.accept(self)
+            self._check_declaration_annotations(decl)
+
+        if len(arg_streams) > 1:
+            raise SidlException("Method cannot take more than one stream", *arg_streams[1].position)
+
+        if len(ret_streams) > 1:
+            raise SidlException("Method cannot return more than one stream", *ret_streams[1].position)
+
+        if ret_streams and len(node.return_values or []) > 1:
+            raise SidlException("A returned stream must be the only return value",
+                    *ret_streams[0].position)
+
+        self._check_annotations(node)
+
+    def _check_declaration_annotations(self, node: VariableDeclaration) -> None:
+        for name, value in node.annotations.items():
+            if name != "encoding":
+                raise SidlException(f"Unknown annotation: @{name}", *node.position)
+
+            if value not in ENCODINGS:
+                raise SidlException(f"Unknown encoding: {value}", *node.position)
+
+            ty = node.type
+
+            if ty.value != "vec" or ty.generics[0].value not in INTEGER_TYPES:
+                raise SidlException("Only integer vectors can be encoded", *node.position)
+
+    def _check_annotations(self, node: Method) -> None:
+        for name, value in node.annotations.items():
+            if name != "cacheable":
+                raise SidlException(f"Unknown annotation: @{name}", *node.position)
+
+        if "cacheable" not in node.annotations:
+            return
+
+        # @cacheable or @cacheable(ttl in milliseconds)
+        ttl = node.annotations["cacheable"]
+
+        if ttl is not None and not ttl.isdigit():
+            raise SidlException(f"Invalid cacheable ttl: {ttl}", *node.position)
+
+        if not node.return_values:
+            raise SidlException("Cacheable method must return values", *node.position)
+
+        # Results are replayed from bytes, they cannot carry handles.
+        for decl in node.arguments + node.return_values:
+            ty = decl.type.value
+
+            if ty in ("handle", "shmbuf", "stream") or ty in self._handle_tainted:
+                raise SidlException(f"Cacheable method cannot use type {ty}", *decl.position)
+
     @property
     def types(self) -> Dict[str, str]:
         return self._defined_types
 
 
 class CppTypeResolver(TypeResolver):
-    def __init__(self) -> None:
+    def __init__(self, pmr: bool = False) -> None:
+        """
+        With pmr, strings and vectors are std::pmr containers which can be
+        decoded into a per-message arena.
+        """
         defined_types = {
             "bool": "bool",
             "u8": "std::uint8_t",
@@ -146,17 +287,26 @@ class CppTypeResolver(TypeResolver):
             "i64": "std::int64_t",
             "usize": "std::size_t",
             "string": "std::string",
+            "strview": "std::string_view",
+            "bytes": "rpc::ByteView",
             "handle": "int",
+            "shmbuf": "rpc::ShmBuffer",
             "optional": "std::optional",
             "vec": "std::vector",
+            "array": "std::array",
+            "stream": "stream",
         }
 
+        if pmr:
+            defined_types["string"] = "std::pmr::string"
+            defined_types["vec"] = "std::pmr::vector"
+
         super().__init__(defined_types)
 
 class CTypeResolver(TypeResolver):
     def __init__(self) -> None:
         defined_types = {
-            "bool": "u8",
+            "bool": "uint8_t",
             "u8": "uint8_t",
             "u16": "uint16_t",
             "u32": "uint32_t",
@@ -168,8 +318,25 @@ class CTypeResolver(TypeResolver):
             "usize": "size_t",
             "string": "char*",
             "handle": "int",
+            "shmbuf": "sidl_shmbuf_t",
             "optional": "sidl_optional_t",
             "vec": "sidl_generic_vector_t",
+            "array": "array",
         }
 
         super().__init__(defined_types)
+
+    def visit_Type(self, node: Type) -> None:
+        super().visit_Type(node)
+
+        # libcprotorpc only has vectors and optionals of scalars, strings and
+        # structures.
+        if node.value in ("vec", "optional") and node.generics[0].value in ("vec", "optional", "array"):
+            raise SidlException(f"Type {node.value}<{node.generics[0].value}> is not supported by the C backend",
+                    *node.position)
+
+    def visit_Struct(self, node: Struct) -> None:
+        if "table" in node.annotations:
+            raise SidlException("@table structures are not supported by the C backend", *node.position)
+
+        super().visit_Struct(node)
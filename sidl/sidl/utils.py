@@ -55,7 +55,10 @@ class IndentedWriter:
         self._stream.write(data)
 
     def write_line(self, data: str) -> None:
-        self._write_indent()
+        # Blank lines are not indented
+        if data:
+            self._write_indent()
+
         self._stream.write(data)
         self._newline()
 
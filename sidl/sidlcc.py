@@ -5,7 +5,7 @@ import os
 from sidl.lexer import Lexer
 from sidl.parser import Parser
 from sidl.utils import PrettyPrinter, SidlException
-from sidl.compiler import CppSourceCompiler, CppHeaderCompiler, CSourceCompiler, CHeaderCompiler
+from sidl.compiler import CppSourceCompiler, CppHeaderCompiler, CSourceCompiler, CHeaderCompiler, LoadTestCompiler
 from sidl.type_resolver import CppTypeResolver, CTypeResolver
 
 
@@ -23,6 +23,15 @@ def main():
     parser.add_argument(
         "-b", "--backend", help="Compilation backend (c, cpp)", default="cpp"
     )
+    parser.add_argument(
+        "--instrument", help="Record per method statistics (cpp backend)", action="store_true"
+    )
+    parser.add_argument(
+        "--loadtest", help="Only generate a load generator for the interfaces (cpp backend)", action="store_true"
+    )
+    parser.add_argument(
+        "--pmr", help="Use std::pmr containers decoded into a per-message arena (cpp backend)", action="store_true"
+    )
     parser.add_argument("idl_file", help="input idl file")
 
     args = parser.parse_args()
@@ -52,21 +61,34 @@ def main():
     try:
         root = p.parse()
 
-        if args.backend == "cpp":
+        if args.backend == "cpp" and args.loadtest:
+            loadtest_path = "./" + args.outdir + "/" + idl_filename + ".loadtest.cpp"
+
+            tr = CppTypeResolver(pmr=args.pmr)
+            tr.visit(root)
+
+            loadtest_compiler = LoadTestCompiler(idl_filename, tr.types)
+            loadtest_compiler.visit(root)
+
+            for (line, col), message in loadtest_compiler.warnings:
+                print(f"WARNING: {args.idl_file}:{line}:{col}: {message}")
+
+            open(loadtest_path, "w").write(loadtest_compiler.data)
+        elif args.backend == "cpp":
             impl_path = "./" + args.outdir + "/" + idl_filename + ".cpp"
             header_path = "./" + args.outdir + "/" + idl_filename + ".hh"
 
-            tr = CppTypeResolver()
+            tr = CppTypeResolver(pmr=args.pmr)
             tr.visit(root)
 
             if compile_impl:
-                source_compiler = CppSourceCompiler(idl_filename, tr.types)
+                source_compiler = CppSourceCompiler(idl_filename, tr.types, instrument=args.instrument, pmr=args.pmr)
                 source_compiler.visit(root)
 
                 open(impl_path, "w").write(source_compiler.data)
 
             if compile_header:
-                header_compiler = CppHeaderCompiler(idl_filename, tr.types)
+                header_compiler = CppHeaderCompiler(idl_filename, tr.types, pmr=args.pmr)
                 header_compiler.visit(root)
 
                 open(header_path, "w").write(header_compiler.data)
@@ -74,7 +96,6 @@ def main():
             impl_path = "./" + args.outdir + "/" + idl_filename + ".c"
             header_path = "./" + args.outdir + "/" + idl_filename + ".h"
 
-            print("WARNING: C backend is experimental and incomplete")
             tr = CTypeResolver()
             tr.visit(root)
 
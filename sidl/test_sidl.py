@@ -2,7 +2,8 @@ import pytest
 from sidl.lexer import TokenType, Token, Lexer
 from sidl.parser import Parser, SidlException
 from sidl.utils import PrettyPrinter
-from sidl.type_resolver import TypeResolver
+from sidl.type_resolver import TypeResolver, CppTypeResolver, CTypeResolver
+from sidl.compiler import CppHeaderCompiler, CppSourceCompiler, CHeaderCompiler, CSourceCompiler, LoadTestCompiler
 
 
 def test_parse_simple_1():
@@ -292,3 +293,504 @@ def test_check_handle_contained_3():
 
     with pytest.raises(SidlException):
         tc.visit(ast)
+
+
+def test_check_stream_1():
+    idl_example = """
+    namespace test {
+        interface A {
+            upload(stream<u32> values) -> (u64 count);
+            download(u64 count) -> (stream<string> values);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { struct A { stream<u32> a; } }",
+    "namespace test { interface A { f(vec<stream<u32>> a); } }",
+    "namespace test { interface A { f(stream<u32> a, stream<u32> b); } }",
+    "namespace test { interface A { f() -> (stream<u32> a, u32 b); } }",
+])
+def test_check_stream_invalid(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)
+
+
+def test_parse_annotations_1():
+    idl_example = """
+    namespace test {
+        interface A {
+            @cacheable get(string key) -> (string value);
+            @cacheable(500) version() -> (u32 version);
+            set(string key, string value);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    CppTypeResolver().visit(ast)
+
+    methods = ast.elements[0].methods
+    assert methods[0].annotations == {"cacheable": None}
+    assert methods[1].annotations == {"cacheable": "500"}
+    assert methods[2].annotations == {}
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { interface A { @cacheable set(u32 a); } }",
+    "namespace test { interface A { @cacheable(soon) get() -> (u32 a); } }",
+    "namespace test { interface A { @cacheable get() -> (handle a); } }",
+    "namespace test { interface A { @unknown get() -> (u32 a); } }",
+])
+def test_check_annotations_invalid(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)
+
+
+def test_loadtest_skips_unsupported_methods():
+    idl_example = """
+    namespace test {
+        struct S { handle h; }
+        interface A {
+            get(string key) -> (string value);
+            send(handle h);
+            wrapped(S s);
+            values() -> (stream<u32> values);
+            set(string key, string value);
+            put(strview key, bytes value);
+            put_all(vec<strview> keys);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    compiler = LoadTestCompiler("test.sidl", tc.types)
+    compiler.visit(ast)
+
+    # Opcodes still count the methods which are not called
+    assert '{ "get", 0, A_get },' in compiler.data
+    assert '{ "set", 4, A_set },' in compiler.data
+    assert "A_send" not in compiler.data
+    assert "A_wrapped" not in compiler.data
+    assert "A_values" not in compiler.data
+
+    # Views point into storage owned by the call
+    assert '{ "put", 5, A_put },' in compiler.data
+    assert "std::string key {};" in compiler.data
+    assert "std::vector<std::uint8_t> value {};" in compiler.data
+    assert "A_put_all" not in compiler.data
+
+    skipped = [message.split(" ")[0] for _, message in compiler.warnings]
+    assert skipped == ["A.send", "A.wrapped", "A.values", "A.put_all"]
+
+
+def test_multi_proxy_skips_streams():
+    idl_example = """
+    namespace test {
+        interface A {
+            get(string key) -> (string value, u32 version);
+            set(string key, string value);
+            values() -> (stream<u32> values);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    compiler = CppHeaderCompiler("test.sidl", tc.types)
+    compiler.visit(ast)
+
+    assert "class AMultiProxy: public rpc::RpcMultiProxy" in compiler.data
+    assert "bool get(const std::string& key, std::function<void(std::size_t, std::string, std::uint32_t)> on_reply);" in compiler.data
+    assert "bool set(const std::string& key, const std::string& value);" in compiler.data
+    # Declared by the proxy and the receiver only
+    assert compiler.data.count("bool values(") == 2
+
+
+def test_views_are_passed_by_value():
+    idl_example = """
+    namespace test {
+        interface A {
+            get(strview key, vec<bytes> parts) -> (string value);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    compiler = CppHeaderCompiler("test.sidl", tc.types)
+    compiler.visit(ast)
+
+    assert "bool get(std::string_view key, const std::vector<rpc::ByteView>& parts, std::string* value);" in compiler.data
+    assert "virtual bool get(std::string_view key, std::vector<rpc::ByteView> parts, std::string* value) = 0;" in compiler.data
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { struct A { strview a; } }",
+    "namespace test { interface A { f() -> (bytes a); } }",
+    "namespace test { interface A { f() -> (optional<strview> a); } }",
+    "namespace test { interface A { f(stream<bytes> a); } }",
+])
+def test_check_view_invalid(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)
+
+
+def test_encoded_vectors():
+    idl_example = """
+    namespace test {
+        struct Samples { @encoding(delta) vec<u64> stamps; vec<u32> raw; }
+        interface A {
+            push(@encoding(bitpack) vec<i32> values, Samples samples);
+            since(u64 stamp) -> (@encoding(delta) vec<u64> stamps);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    assert ast.elements[0].fields[0].annotations == {"encoding": "delta"}
+    assert ast.elements[0].fields[1].annotations == {}
+
+    compiler = CppHeaderCompiler("test.sidl", tc.types)
+    compiler.visit(ast)
+
+    assert "__sidl_s.serialize(__sidl_obj.stamps, rpc::Encoding::Delta);" in compiler.data
+    assert "__sidl_u.unserialize(&__sidl_obj->raw)" in compiler.data
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { interface A { f(@encoding(delta) vec<string> a); } }",
+    "namespace test { interface A { f(@encoding(delta) u64 a); } }",
+    "namespace test { interface A { f(@encoding(huffman) vec<u64> a); } }",
+    "namespace test { interface A { f(@packed vec<u64> a); } }",
+])
+def test_check_encoding_invalid(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)
+
+
+def test_pmr_arena():
+    idl_example = """
+    namespace test {
+        struct Point {
+            i32 x;
+            i32 y;
+        }
+
+        struct Shape {
+            string name;
+            vec<Point> points;
+        }
+
+        interface A {
+            f(Shape shape, u32 n) -> (vec<string> names);
+            g(u32 n) -> (u32 m);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver(pmr=True)
+    tc.visit(ast)
+
+    header = CppHeaderCompiler("test.sidl", tc.types, pmr=True)
+    header.visit(ast)
+
+    # Only structures holding containers take an allocator
+    assert header.data.count("using allocator_type = std::pmr::polymorphic_allocator<std::byte>;") == 1
+    assert "explicit Shape(const allocator_type& alloc)" in header.data
+    assert ": name(alloc), points(alloc)" in header.data
+    assert "virtual bool f(Shape shape, std::uint32_t n, std::pmr::vector<std::pmr::string>* names) = 0;" in header.data
+
+    source = CppSourceCompiler("test.sidl", tc.types, pmr=True)
+    source.visit(ast)
+
+    assert source.data.count("__sidl_u.set_resource(&__sidl_arena);") == 1
+    assert "Shape __sidl_argument_shape = __sidl_u.construct<Shape>();" in source.data
+    assert "f(std::move(__sidl_argument_shape), __sidl_argument_n, &__sidl_retval_names);" in source.data
+
+
+def test_packed_structures():
+    idl_example = """
+    namespace test {
+        struct Point {
+            i32 x;
+            i32 y;
+        }
+
+        struct Sample {
+            u64 stamp;
+            Point at;
+            u16 flags;
+            u8 kind;
+            bool valid;
+            u32 value;
+        }
+
+        struct Padded {
+            u8 tag;
+            u32 value;
+        }
+
+        struct Wide {
+            usize size;
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    compiler = CppHeaderCompiler("test.sidl", tc.types)
+    compiler.visit(ast)
+
+    assert "sizeof(test::Point) == 8, " in compiler.data
+    assert "sizeof(test::Sample) == 24, " in compiler.data
+    assert "__sidl_s.serialize(&__sidl_obj, sizeof(test::Sample));" in compiler.data
+    assert "return __sidl_u.unserialize(__sidl_obj, sizeof(test::Sample));" in compiler.data
+
+    # Padding or a platform dependent size keep the encoding field by field
+    assert "sizeof(test::Padded) ==" not in compiler.data
+    assert "sizeof(test::Wide) ==" not in compiler.data
+    assert "__sidl_s.serialize(__sidl_obj.tag);" in compiler.data
+
+
+def test_tables():
+    idl_example = """
+    namespace test {
+        @table struct Header {
+            string route;
+            u32 priority;
+        }
+
+        @table struct Request {
+            Header header;
+            @encoding(delta) vec<u64> stamps;
+        }
+
+        interface A {
+            put(Request request, Header header) -> (Request echo);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    assert ast.elements[0].annotations == {"table": None}
+
+    header = CppHeaderCompiler("test.sidl", tc.types)
+    header.visit(ast)
+
+    assert "class RequestView" in header.data
+    assert "bool route(std::string_view* out) const" in header.data
+    assert "bool header(HeaderView* out) const" in header.data
+    assert "return table_.field(1).unserialize(out, rpc::Encoding::Delta);" in header.data
+    assert "TableWriter<2> __sidl_t(__sidl_s);" in header.data
+    assert "virtual bool put(RequestView request, HeaderView header, Request* echo) = 0;" in header.data
+
+    source = CppSourceCompiler("test.sidl", tc.types)
+    source.visit(ast)
+
+    assert "RequestView __sidl_argument_request;" in source.data
+    assert "Request __sidl_retval_echo;" in source.data
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { @table struct A { handle a; } }",
+    "namespace test { @table(1) struct A { u32 a; } }",
+    "namespace test { @table struct A { } }",
+    "namespace test { @table struct A { u32 decode; } }",
+    "namespace test { @packed struct A { u32 a; } }",
+])
+def test_check_table_invalid(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)
+
+
+def test_fixed_arrays():
+    idl_example = """
+    namespace test {
+        struct Pixel {
+            array<u8, 3> rgb;
+            u8 alpha;
+        }
+
+        struct Frame {
+            array<array<i32, 3>, 3> matrix;
+            array<Pixel, 2> corners;
+        }
+
+        interface Hasher {
+            hash(vec<u8> data) -> (array<u8, 32> digest);
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+    tc.visit(ast)
+
+    rgb = ast.elements[0].fields[0].type
+    assert rgb.value == "array"
+    assert rgb.size == 3
+    assert rgb.generics[0].value == "u8"
+
+    compiler = CppHeaderCompiler("test.sidl", tc.types)
+    compiler.visit(ast)
+
+    assert "std::array<std::uint8_t, 3> rgb;" in compiler.data
+    assert "std::array<std::array<std::int32_t, 3>, 3> matrix;" in compiler.data
+    assert "std::array<std::uint8_t, 32>* digest" in compiler.data
+
+    # Arrays of fixed size elements are part of packed layouts
+    assert "sizeof(test::Pixel) == 4, " in compiler.data
+    assert "sizeof(test::Frame) == 44, " in compiler.data
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { struct A { array<u8> a; } }",
+    "namespace test { struct A { array<u8, 0> a; } }",
+    "namespace test { struct A { array<u8, 2, 3> a; } }",
+    "namespace test { struct A { array<handle, 2> a; } }",
+    "namespace test { struct A { vec<u8, 2> a; } }",
+])
+def test_check_array_invalid(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CppTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)
+
+
+def test_parse_array_invalid_size():
+    lex = Lexer("struct A { array<u8, N> a; }")
+    p = Parser(lex)
+
+    with pytest.raises(SidlException):
+        p.parse_struct()
+
+
+def test_c_backend():
+    idl_example = """
+    namespace test {
+        struct Point {
+            i32 x;
+            string label;
+            vec<u32> ids;
+        }
+
+        interface Plotter {
+            draw(Point p, vec<string> tags) -> (u32 id);
+            clear();
+        }
+    }
+    """
+
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CTypeResolver()
+    tc.visit(ast)
+
+    header = CHeaderCompiler("test.sidl", tc.types)
+    header.visit(ast)
+
+    assert "int test_Point_read(sidl_unserializer_t* u, test_Point* obj);" in header.data
+    assert "void (*draw)(void* object, const test_Point* p, const sidl_string_vector* tags, uint32_t* id);" in header.data
+    assert "int test_Plotter_draw(sidl_proxy_t* __sidl_proxy, const test_Point* p, const sidl_string_vector* tags, uint32_t* id);" in header.data
+    assert "int test_Plotter_bind(sidl_channel_t* c, uint64_t id, const test_Plotter_vtable* vtable, void* object);" in header.data
+
+    source = CSourceCompiler("test.sidl", tc.types)
+    source.visit(ast)
+
+    assert "if (test_Point_write(__sidl_s, p) < 0)" in source.data
+    assert "if (sidl_unserializer_read_u32_vector(__sidl_u, &obj->ids) < 0)" in source.data
+    assert "sidl_channel_call(__sidl_proxy->channel, __sidl_proxy->remote_port, __sidl_proxy->id, __sidl_proxy->remote_id, 0, __sidl_u)" in source.data
+    assert "return sidl_channel_send(__sidl_proxy->channel, __sidl_proxy->remote_port, __sidl_proxy->id, __sidl_proxy->remote_id, 1, 0);" in source.data
+    assert "__sidl_vtable->draw(__sidl_receiver->object, &p, &tags, &id);" in source.data
+
+    # Arguments are decoded in the arena of the channel
+    assert "tags.elements = sidl_unserializer_alloc(__sidl_u, __sidl_count0 * sizeof(*tags.elements));" in source.data
+    assert "sidl_arena_rewind(&__sidl_channel->arena, __sidl_mark);" in source.data
+    assert "test_Point_destroy(&p);" not in source.data
+    assert "case 1: // Opcode 'clear' = 1" in source.data
+
+
+@pytest.mark.parametrize("idl_example", [
+    "namespace test { struct A { vec<vec<u8>> a; } }",
+    "namespace test { struct A { optional<vec<u8>> a; } }",
+    "namespace test { @table struct A { u32 a; } }",
+])
+def test_check_c_unsupported(idl_example):
+    lex = Lexer(idl_example)
+    p = Parser(lex)
+    ast = p.parse()
+    tc = CTypeResolver()
+
+    with pytest.raises(SidlException):
+        tc.visit(ast)